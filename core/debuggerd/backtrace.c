@@ -117,6 +117,7 @@ void dump_backtrace(int fd, pid_t pid, pid_t tid, bool* detach_failed,
     log_t log;
     log.tfd = fd;
     log.quiet = true;
+    log.buffer = NULL;
 
     ptrace_context_t* context = load_ptrace_context(tid);
     dump_process_header(&log, pid);
@@ -36,7 +36,11 @@
 
 #define R(x) ((unsigned int)(x))
 
-static void dump_memory(log_t* log, pid_t tid, uintptr_t addr, bool at_fault) {
+static void dump_memory(const ptrace_context_t* context, log_t* log, pid_t tid, uintptr_t addr,
+        bool at_fault) {
+    memory_t memory;
+    init_memory_ptrace_context(&memory, tid, context);
+
     char code_buffer[64];       /* actual 8+1+((8+1)*4) + 1 == 45 */
     char ascii_buffer[32];      /* actual 16 + 1 == 17 */
     uintptr_t p, end;
@@ -65,15 +69,15 @@ static void dump_memory(log_t* log, pid_t tid, uintptr_t addr, bool at_fault) {
         int i;
         for (i = 0; i < 4; i++) {
             /*
-             * If we see (data == -1 && errno != 0), we know that the ptrace
-             * call failed, probably because we're dumping memory in an
-             * unmapped or inaccessible page.  I don't know if there's
-             * value in making that explicit in the output -- it likely
-             * just complicates parsing and clarifies nothing for the
-             * enlightened reader.
+             * If the read fails, data is 0xffffffff, probably because
+             * we're dumping memory in an unmapped or inaccessible page.
+             * I don't know if there's value in making that explicit in
+             * the output -- it likely just complicates parsing and
+             * clarifies nothing for the enlightened reader.
              */
-            long data = ptrace(PTRACE_PEEKTEXT, tid, (void*)p, NULL);
-            sprintf(code_buffer + strlen(code_buffer), "%08lx ", data);
+            uint32_t data;
+            try_get_word(&memory, p, &data);
+            sprintf(code_buffer + strlen(code_buffer), "%08x ", data);
 
             int j;
             for (j = 0; j < 4; j++) {
@@ -100,7 +104,7 @@ static void dump_memory(log_t* log, pid_t tid, uintptr_t addr, bool at_fault) {
  * If configured to do so, dump memory around *all* registers
  * for the crashing thread.
  */
-void dump_memory_and_code(const ptrace_context_t* context __attribute((unused)),
+void dump_memory_and_code(const ptrace_context_t* context,
         log_t* log, pid_t tid, bool at_fault) {
     pt_regs_mips_t r;
     if(ptrace(PTRACE_GETREGS, tid, 0, &r)) {
@@ -130,7 +134,7 @@ void dump_memory_and_code(const ptrace_context_t* context __attribute((unused)),
             }
 
             _LOG(log, false, "\nmemory near %.2s:\n", &REG_NAMES[reg * 2]);
-            dump_memory(log, tid, addr, at_fault);
+            dump_memory(context, log, tid, addr, at_fault);
         }
     }
 
@@ -138,11 +142,11 @@ void dump_memory_and_code(const ptrace_context_t* context __attribute((unused)),
     unsigned int ra = R(r.regs[31]);
 
     _LOG(log, !at_fault, "\ncode around pc:\n");
-    dump_memory(log, tid, (uintptr_t)pc, at_fault);
+    dump_memory(context, log, tid, (uintptr_t)pc, at_fault);
 
     if (pc != ra) {
         _LOG(log, !at_fault, "\ncode around ra:\n");
-        dump_memory(log, tid, (uintptr_t)ra, at_fault);
+        dump_memory(context, log, tid, (uintptr_t)ra, at_fault);
     }
 }
 
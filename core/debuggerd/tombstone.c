@@ -217,13 +217,11 @@ static void dump_backtrace(const ptrace_context_t* context __attribute((unused))
     free_backtrace_symbols(backtrace_symbols, frames);
 }
 
-static void dump_stack_segment(const ptrace_context_t* context, log_t* log, pid_t tid,
-        bool only_in_tombstone, uintptr_t* sp, size_t words, int label) {
+static void dump_stack_segment(const ptrace_context_t* context, log_t* log,
+        bool only_in_tombstone, uintptr_t* sp, const uint32_t* stack, size_t words,
+        int label) {
     for (size_t i = 0; i < words; i++) {
-        uint32_t stack_content;
-        if (!try_get_word_ptrace(tid, *sp, &stack_content)) {
-            break;
-        }
+        uint32_t stack_content = stack[i];
 
         const map_info_t* mi;
         const symbol_t* symbol;
@@ -265,8 +263,34 @@ static void dump_stack_segment(const ptrace_context_t* context, log_t* log, pid_
     }
 }
 
-static void dump_stack(const ptrace_context_t* context, log_t* log, pid_t tid, bool at_fault,
-        const backtrace_frame_t* backtrace, size_t frames) {
+/*
+ * Reads the stack words that dump_stack() shows: a few words below the first
+ * frame into stack[0], and up to STACK_WORDS words of frame i into stack[i + 1].
+ * The number of words read into each is stored in stack_words.
+ */
+static void capture_stack(const ptrace_context_t* context,
+        const backtrace_frame_t* backtrace, size_t frames,
+        uint32_t stack[][STACK_WORDS], size_t* stack_words) {
+    bool have_first = false;
+    memset(stack_words, 0, (frames + 1) * sizeof(size_t));
+    for (size_t i = 0; i < frames; i++) {
+        uintptr_t sp = backtrace[i].stack_top;
+        if (!sp) {
+            continue;
+        }
+        if (!have_first) {
+            have_first = true;
+            stack_words[0] = read_memory_ptrace(context, sp - STACK_WORDS * sizeof(uint32_t),
+                    stack[0], STACK_WORDS * sizeof(uint32_t)) / sizeof(uint32_t);
+        }
+        stack_words[i + 1] = read_memory_ptrace(context, sp, stack[i + 1],
+                STACK_WORDS * sizeof(uint32_t)) / sizeof(uint32_t);
+    }
+}
+
+static void dump_stack(const ptrace_context_t* context, log_t* log, bool at_fault,
+        const backtrace_frame_t* backtrace, size_t frames,
+        uint32_t stack[][STACK_WORDS], const size_t* stack_words) {
     bool have_first = false;
     size_t first, last;
     for (size_t i = 0; i < frames; i++) {
@@ -287,7 +311,7 @@ static void dump_stack(const ptrace_context_t* context, log_t* log, pid_t tid, b
     // Dump a few words before the first frame.
     bool only_in_tombstone = !at_fault;
     uintptr_t sp = backtrace[first].stack_top - STACK_WORDS * sizeof(uint32_t);
-    dump_stack_segment(context, log, tid, only_in_tombstone, &sp, STACK_WORDS, -1);
+    dump_stack_segment(context, log, only_in_tombstone, &sp, stack[0], stack_words[0], -1);
 
     // Dump a few words from all successive frames.
     // Only log the first 3 frames, put the rest in the tombstone.
@@ -300,19 +324,21 @@ static void dump_stack(const ptrace_context_t* context, log_t* log, pid_t tid, b
         if (i - first == 3) {
             only_in_tombstone = true;
         }
+        size_t words = stack_words[i + 1];
         if (i == last) {
-            dump_stack_segment(context, log, tid, only_in_tombstone, &sp, STACK_WORDS, i);
+            dump_stack_segment(context, log, only_in_tombstone, &sp, stack[i + 1], words, i);
             if (sp < frame->stack_top + frame->stack_size) {
                 _LOG(log, only_in_tombstone, "         ........  ........\n");
             }
         } else {
-            size_t words = frame->stack_size / sizeof(uint32_t);
-            if (words == 0) {
-                words = 1;
-            } else if (words > STACK_WORDS) {
-                words = STACK_WORDS;
+            size_t frame_words = frame->stack_size / sizeof(uint32_t);
+            if (frame_words == 0) {
+                frame_words = 1;
+            }
+            if (words > frame_words) {
+                words = frame_words;
             }
-            dump_stack_segment(context, log, tid, only_in_tombstone, &sp, words, i);
+            dump_stack_segment(context, log, only_in_tombstone, &sp, stack[i + 1], words, i);
         }
     }
 }
@@ -322,8 +348,11 @@ static void dump_backtrace_and_stack(const ptrace_context_t* context, log_t* log
     backtrace_frame_t backtrace[STACK_DEPTH];
     ssize_t frames = unwind_backtrace_ptrace(tid, context, backtrace, 0, STACK_DEPTH);
     if (frames > 0) {
+        uint32_t stack[STACK_DEPTH + 1][STACK_WORDS];
+        size_t stack_words[STACK_DEPTH + 1];
+        capture_stack(context, backtrace, frames, stack, stack_words);
         dump_backtrace(context, log, tid, at_fault, backtrace, frames);
-        dump_stack(context, log, tid, at_fault, backtrace, frames);
+        dump_stack(context, log, at_fault, backtrace, frames, stack, stack_words);
     }
 }
 
@@ -402,52 +431,135 @@ static void dump_thread(const ptrace_context_t* context, log_t* log, pid_t tid,
     }
 }
 
-/* Return true if some thread is not detached cleanly */
-static bool dump_sibling_thread_report(const ptrace_context_t* context,
-        log_t* log, pid_t pid, pid_t tid, int* total_sleep_time_usec) {
+/*
+ * What the report of a sibling thread needs, captured while the thread is
+ * stopped so that symbolizing and formatting can wait until it is released.
+ */
+typedef struct {
+    pid_t tid;
+    bool attached;
+    log_buffer_t header;        /* thread info and registers, already formatted */
+    backtrace_frame_t backtrace[STACK_DEPTH];
+    ssize_t frames;
+    uint32_t stack[STACK_DEPTH + 1][STACK_WORDS];
+    size_t stack_words[STACK_DEPTH + 1];
+} thread_capture_t;
+
+static int64_t now_usec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/*
+ * Stops all the other threads of the process at once, snapshots their
+ * registers and stacks, and releases them again. Returns the snapshots in
+ * *captures (to be freed with free_thread_captures()) and their count.
+ * Sets *detach_failed if some thread is not detached cleanly.
+ */
+static size_t capture_sibling_threads(const ptrace_context_t* context, pid_t pid, pid_t tid,
+        thread_capture_t** captures, bool* detach_failed, int* total_sleep_time_usec) {
+    *captures = NULL;
+
     char task_path[64];
     snprintf(task_path, sizeof(task_path), "/proc/%d/task", pid);
-
     DIR* d = opendir(task_path);
     /* Bail early if cannot open the task directory */
     if (d == NULL) {
         XLOG("Cannot open /proc/%d/task\n", pid);
-        return false;
+        return 0;
     }
 
-    bool detach_failed = false;
+    size_t count = 0, capacity = 0;
     struct dirent debuf;
     struct dirent *de;
     while (!readdir_r(d, &debuf, &de) && de) {
-        /* Ignore "." and ".." */
-        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
-            continue;
-        }
-
         /* The main thread at fault has been handled individually */
         char* end;
         pid_t new_tid = strtoul(de->d_name, &end, 10);
-        if (*end || new_tid == tid) {
+        if (*end || !new_tid || new_tid == tid) {
             continue;
         }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 32;
+            thread_capture_t* grown = realloc(*captures, capacity * sizeof(thread_capture_t));
+            if (!grown) {
+                break;
+            }
+            *captures = grown;
+        }
+        memset(&(*captures)[count], 0, sizeof(thread_capture_t));
+        (*captures)[count++].tid = new_tid;
+    }
+    closedir(d);
 
+    /* Attach to every thread before capturing any, so the snapshot is consistent. */
+    int64_t start = now_usec();
+    size_t attached = 0;
+    for (size_t i = 0; i < count; i++) {
         /* Skip this thread if cannot ptrace it */
-        if (ptrace(PTRACE_ATTACH, new_tid, 0, 0) < 0) {
+        (*captures)[i].attached = !ptrace(PTRACE_ATTACH, (*captures)[i].tid, 0, 0);
+        attached += (*captures)[i].attached;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        thread_capture_t* capture = &(*captures)[i];
+        if (!capture->attached) {
             continue;
         }
+        log_t log;
+        log.tfd = -1;
+        log.quiet = true;
+        log.buffer = &capture->header;
+        dump_thread_info(&log, pid, capture->tid, false);
+        wait_for_stop(capture->tid, total_sleep_time_usec);
+        dump_registers(context, &log, capture->tid, false);
+
+        capture->frames = unwind_backtrace_ptrace(capture->tid, context,
+                capture->backtrace, 0, STACK_DEPTH);
+        if (capture->frames > 0) {
+            capture_stack(context, capture->backtrace, capture->frames,
+                    capture->stack, capture->stack_words);
+        }
+    }
 
-        _LOG(log, true, "--- --- --- --- --- --- --- --- --- --- --- --- --- --- --- ---\n");
-        dump_thread_info(log, pid, new_tid, false);
-        dump_thread(context, log, new_tid, false, total_sleep_time_usec);
-
-        if (ptrace(PTRACE_DETACH, new_tid, 0, 0) != 0) {
-            LOG("ptrace detach from %d failed: %s\n", new_tid, strerror(errno));
-            detach_failed = true;
+    for (size_t i = 0; i < count; i++) {
+        if ((*captures)[i].attached && ptrace(PTRACE_DETACH, (*captures)[i].tid, 0, 0) != 0) {
+            LOG("ptrace detach from %d failed: %s\n", (*captures)[i].tid, strerror(errno));
+            *detach_failed = true;
         }
     }
+    LOG("stopped %d threads of pid %d for %lld ms\n", (int) attached, pid,
+            (now_usec() - start) / 1000);
+    return count;
+}
 
-    closedir(d);
-    return detach_failed;
+static void free_thread_captures(thread_capture_t* captures, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(captures[i].header.data);
+    }
+    free(captures);
+}
+
+static void dump_sibling_thread_report(const ptrace_context_t* context, log_t* log,
+        thread_capture_t* captures, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        thread_capture_t* capture = &captures[i];
+        if (!capture->attached) {
+            continue;
+        }
+
+        _LOG(log, true, "--- --- --- --- --- --- --- --- --- --- --- --- --- --- --- ---\n");
+        if (capture->header.length) {
+            write(log->tfd, capture->header.data, capture->header.length);
+        }
+        if (capture->frames > 0) {
+            dump_backtrace(context, log, capture->tid, false, capture->backtrace,
+                    capture->frames);
+            dump_stack(context, log, false, capture->backtrace, capture->frames,
+                    capture->stack, capture->stack_words);
+        }
+    }
 }
 
 /*
@@ -615,16 +727,28 @@ static bool dump_crash(log_t* log, pid_t pid, pid_t tid, int signal,
     }
 
     ptrace_context_t* context = load_ptrace_context(tid);
+
+    /*
+     * Snapshot the other threads first, so they are stopped as close to the
+     * crash and for as short a time as possible. Their reports are written
+     * after they have been released.
+     */
+    bool detach_failed = false;
+    thread_capture_t* siblings = NULL;
+    size_t sibling_count = 0;
+    if (dump_sibling_threads) {
+        sibling_count = capture_sibling_threads(context, pid, tid, &siblings,
+                &detach_failed, total_sleep_time_usec);
+    }
+
     dump_thread(context, log, tid, true, total_sleep_time_usec);
 
     if (want_logs) {
         dump_logs(log, pid, true);
     }
 
-    bool detach_failed = false;
-    if (dump_sibling_threads) {
-        detach_failed = dump_sibling_thread_report(context, log, pid, tid, total_sleep_time_usec);
-    }
+    dump_sibling_thread_report(context, log, siblings, sibling_count);
+    free_thread_captures(siblings, sibling_count);
 
     free_ptrace_context(context);
 
@@ -713,6 +837,7 @@ char* engrave_tombstone(pid_t pid, pid_t tid, int signal,
     log_t log;
     log.tfd = fd;
     log.quiet = quiet;
+    log.buffer = NULL;
     *detach_failed = dump_crash(&log, pid, tid, signal, dump_sibling_threads,
             total_sleep_time_usec);
 
@@ -18,6 +18,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
@@ -37,7 +38,23 @@ void _LOG(log_t* log, bool in_tombstone_only, const char *fmt, ...) {
     va_list ap;
     va_start(ap, fmt);
 
-    if (log && log->tfd >= 0) {
+    if (log && log->buffer) {
+        log_buffer_t* buffer = log->buffer;
+        vsnprintf(buf, sizeof(buf), fmt, ap);
+        size_t len = strlen(buf);
+        if (buffer->length + len > buffer->capacity) {
+            size_t capacity = (buffer->length + len) * 2;
+            char* data = realloc(buffer->data, capacity);
+            if (data) {
+                buffer->data = data;
+                buffer->capacity = capacity;
+            }
+        }
+        if (buffer->length + len <= buffer->capacity) {
+            memcpy(buffer->data + buffer->length, buf, len);
+            buffer->length += len;
+        }
+    } else if (log && log->tfd >= 0) {
         int len;
         vsnprintf(buf, sizeof(buf), fmt, ap);
         len = strlen(buf);
@@ -21,11 +21,19 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} log_buffer_t;
+
 typedef struct {
     /* tombstone file descriptor */
     int tfd;
     /* if true, does not log anything to the Android logcat */
     bool quiet;
+    /* if not NULL, tombstone output is collected here instead of written to tfd */
+    log_buffer_t* buffer;
 } log_t;
 
 /* Log information onto the tombstone. */
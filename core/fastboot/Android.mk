@@ -18,11 +18,12 @@ include $(CLEAR_VARS)
 
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/../mkbootimg \
   $(LOCAL_PATH)/../../extras/ext4_utils
-LOCAL_SRC_FILES := protocol.c engine.c bootimg.c fastboot.c wmtupdater.c
+LOCAL_SRC_FILES := protocol.c engine.c bootimg.c fastboot.c stream.c wmtupdater.c
 LOCAL_MODULE := libfastboot
 
 ifeq ($(HOST_OS),linux)
   LOCAL_SRC_FILES += usb_linux.c util_linux.c
+  LOCAL_LDLIBS += -lpthread
 endif
 
 ifeq ($(HOST_OS),darwin)
@@ -91,6 +92,14 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES := usbtest.c usb_linux.c
 LOCAL_MODULE := usbtest
 include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := stream_test.c stream.c protocol.c
+LOCAL_MODULE := fastboot_stream_test
+LOCAL_MODULE_TAGS := optional
+LOCAL_STATIC_LIBRARIES := libzipfile libunz libsparse_host libz
+LOCAL_LDLIBS += -lpthread
+include $(BUILD_HOST_EXECUTABLE)
 endif
 
 ifeq ($(HOST_OS),windows)
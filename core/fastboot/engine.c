@@ -91,6 +91,7 @@ char *mkmsg(const char *fmt, ...)
 #define OP_NOTICE     4
 #define OP_FORMAT     5
 #define OP_DOWNLOAD_SPARSE 6
+#define OP_FLASH_IMAGE 7
 
 typedef struct Action Action;
 
@@ -459,6 +460,29 @@ void fb_queue_flash_sparse(fb_action_list *list, const char *ptn, struct sparse_
     a->msg = mkmsg("writing '%s'", ptn);
 }
 
+/* Sends the image from its file and flashes it, in as many pieces as the
+ * target's download limit makes it. */
+void fb_queue_flash_image(fb_action_list *list, const char *ptn, struct fb_image *img)
+{
+    Action *a;
+
+    a = queue_action(list, OP_FLASH_IMAGE, "%s", ptn);
+    a->data = img;
+    a->msg = mkmsg("flashing '%s'", ptn);
+}
+
+/* Starts preparing the first image to be flashed after a, if any, so that
+ * it is ready by the time a is done. */
+static void prepare_next_image(Action *a)
+{
+    for (; a; a = a->next) {
+        if (a->op == OP_FLASH_IMAGE) {
+            fb_image_prepare_async(a->data);
+            return;
+        }
+    }
+}
+
 static int match(char *str, const char **value, unsigned count)
 {
     const char *val;
@@ -661,6 +685,9 @@ void fb_free_list(fb_action_list *list){
         //Action::msg is Engine.c allocated
         //let user handle Action::data
 		free(a->msg);
+        if (a->op == OP_FLASH_IMAGE) {
+            fb_image_close(a->data);
+        }
 	}
 
     a = list->action_list;
@@ -689,6 +716,7 @@ int fb_execute_queue(usb_handle *usb, fb_action_list *list)
 
 
     double start = -1;
+    prepare_next_image(list->action_list);
     for (a = list->action_list; a; a = a->next) {
         a->start = now();
 		if (start < 0) start = a->start;
@@ -721,6 +749,11 @@ int fb_execute_queue(usb_handle *usb, fb_action_list *list)
             status = fb_download_data_sparse(usb, a->data, errBuf, sizeof(errBuf));
             status = a->func(a, status, status ? errBuf : "");
             if (status) break;
+        } else if (a->op == OP_FLASH_IMAGE) {
+            prepare_next_image(a->next);
+            status = fb_flash_image(usb, a->cmd, a->data, errBuf, sizeof(errBuf));
+            status = a->func(a, status, status ? errBuf : "");
+            if (status) break;
         } else {
             die("bogus action");
         }
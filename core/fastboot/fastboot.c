@@ -585,26 +585,12 @@ static int needs_erase(usb_handle *usb, const char *part)
 void do_flash(usb_handle *usb,fb_action_list *actionList, const char *pname, const char *fname)
 {
     int64_t sz64;
-    void *data;
     int64_t limit;
 
     sz64 = file_size(fname);
+    if (sz64 < 0) die("cannot load '%s': %s\n", fname, strerror(errno));
     limit = get_sparse_limit(usb, sz64);
-    if (limit) {
-        struct sparse_file **s = load_sparse_files(fname, limit);
-        if (s == NULL) {
-            die("cannot sparse load '%s'\n", fname);
-        }
-        while (*s) {
-            sz64 = sparse_file_len(*s, true, false);
-            fb_queue_flash_sparse(actionList, pname, *s++, sz64);
-        }
-    } else {
-        unsigned int sz;
-        data = load_file(fname, &sz);
-        if (data == 0) die("cannot load '%s': %s\n", fname, strerror(errno));
-        fb_queue_flash(actionList, pname, data, sz);
-    }
+    fb_queue_flash_image(actionList, pname, fb_image_open_file(fname, limit));
 }
 
 void do_update_signature(fb_action_list *list, zipfile_t zip, char *fn)
@@ -617,6 +603,14 @@ void do_update_signature(fb_action_list *list, zipfile_t zip, char *fn)
     fb_queue_command(list, "signature", "installing signature");
 }
 
+/* The entry is extracted when the flash is about to happen, not now. */
+static void queue_flash_zipentry(usb_handle *usb, fb_action_list *list, const char *pname,
+                                 zipentry_t entry)
+{
+    int64_t limit = get_sparse_limit(usb, get_zipentry_size(entry));
+    fb_queue_flash_image(list, pname, fb_image_open_zip(entry, limit));
+}
+
 void do_update(usb_handle *usb, fb_action_list *list, char *fn, int erase_first)
 {
     void *zdata;
@@ -624,6 +618,7 @@ void do_update(usb_handle *usb, fb_action_list *list, char *fn, int erase_first)
     void *data;
     unsigned sz;
     zipfile_t zip;
+    zipentry_t entry;
 
     queue_info_dump(list);
 
@@ -652,30 +647,30 @@ void do_update(usb_handle *usb, fb_action_list *list, char *fn, int erase_first)
 
     setup_requirements(list, data, sz);
 
-    data = unzip_file(zip, "boot.img", &sz);
-    if (data == 0) die("update package missing boot.img");
+    entry = lookup_zipentry(zip, "boot.img");
+    if (entry == 0) die("update package missing boot.img");
     do_update_signature(list, zip, "boot.sig");
     if (erase_first && needs_erase(usb, "boot")) {
         fb_queue_erase(list, "boot");
     }
-    fb_queue_flash(list, "boot", data, sz);
+    queue_flash_zipentry(usb, list, "boot", entry);
 
-    data = unzip_file(zip, "recovery.img", &sz);
-    if (data != 0) {
+    entry = lookup_zipentry(zip, "recovery.img");
+    if (entry != 0) {
         do_update_signature(list, zip, "recovery.sig");
         if (erase_first && needs_erase(usb, "recovery")) {
             fb_queue_erase(list, "recovery");
         }
-        fb_queue_flash(list, "recovery", data, sz);
+        queue_flash_zipentry(usb, list, "recovery", entry);
     }
 
-    data = unzip_file(zip, "system.img", &sz);
-    if (data == 0) die("update package missing system.img");
+    entry = lookup_zipentry(zip, "system.img");
+    if (entry == 0) die("update package missing system.img");
     do_update_signature(list, zip, "system.sig");
     if (erase_first && needs_erase(usb, "system")) {
         fb_queue_erase(list, "system");
     }
-    fb_queue_flash(list, "system", data, sz);
+    queue_flash_zipentry(usb, list, "system", entry);
 }
 
 void do_send_signature(fb_action_list *list, char *fn)
@@ -713,32 +708,29 @@ void do_flashall(usb_handle *usb, fb_action_list *list, int erase_first)
     setup_requirements(list, data, sz);
 
     fname = find_item("boot", product);
-    data = load_file(fname, &sz);
-    if (data == 0) die("could not load boot.img: %s", strerror(errno));
+    if (fname == 0 || file_size(fname) < 0) die("could not load boot.img: %s", strerror(errno));
     do_send_signature(list, fname);
     if (erase_first && needs_erase(usb, "boot")) {
         fb_queue_erase(list, "boot");
     }
-    fb_queue_flash(list, "boot", data, sz);
+    do_flash(usb, list, "boot", fname);
 
     fname = find_item("recovery", product);
-    data = load_file(fname, &sz);
-    if (data != 0) {
+    if (fname != 0 && file_size(fname) >= 0) {
         do_send_signature(list, fname);
         if (erase_first && needs_erase(usb, "recovery")) {
             fb_queue_erase(list, "recovery");
         }
-        fb_queue_flash(list, "recovery", data, sz);
+        do_flash(usb, list, "recovery", fname);
     }
 
     fname = find_item("system", product);
-    data = load_file(fname, &sz);
-    if (data == 0) die("could not load system.img: %s", strerror(errno));
+    if (fname == 0 || file_size(fname) < 0) die("could not load system.img: %s", strerror(errno));
     do_send_signature(list, fname);
     if (erase_first && needs_erase(usb, "system")) {
         fb_queue_erase(list, "system");
     }
-    fb_queue_flash(list, "system", data, sz);
+    do_flash(usb, list, "system", fname);
 }
 
 #define skip(n) do { argc -= (n); argv += (n); } while (0)
@@ -28,6 +28,7 @@
 
 #ifndef _FASTBOOT_H_
 #define _FASTBOOT_H_
+#include <stdint.h>
 #include "usb.h"
 
 #ifdef __cplusplus
@@ -42,17 +43,33 @@ int fb_command(usb_handle *usb, const char *cmd, char *errBuf, int errBufLen);
 int fb_command_response(usb_handle *usb, const char *cmd, char *response, char *errBuf, int errBufLen);
 int fb_download_data(usb_handle *usb, const void *data, unsigned size, char *errBuf, int errBufLen);
 int fb_download_data_sparse(usb_handle *usb, struct sparse_file *s, char *errBuf, int errBufLen);
+typedef int (*fb_write_func)(void *priv, const void *data, int len);
+typedef int (*fb_produce_func)(void *priv, fb_write_func write, void *write_priv);
+/* Downloads size bytes that produce() passes to write(), read ahead on another thread. */
+int fb_download_data_stream(usb_handle *usb, unsigned size, fb_produce_func produce, void *priv,
+                            char *errBuf, int errBufLen);
 //char *fb_get_error(void);
 
 #define FB_COMMAND_SZ 64
 #define FB_RESPONSE_SZ 64
 
+/* stream.c - images sent straight from their file or zip entry */
+struct fb_image;
+/* limit is the largest download the target takes, or 0 to send the image whole. */
+struct fb_image *fb_image_open_file(const char *fname, int64_t limit);
+struct fb_image *fb_image_open_zip(void *zipentry, int64_t limit);
+void fb_image_prepare_async(struct fb_image *img);
+int fb_image_wait(struct fb_image *img, char *errBuf, int errBufLen);
+int fb_flash_image(usb_handle *usb, const char *ptn, struct fb_image *img, char *errBuf, int errBufLen);
+void fb_image_close(struct fb_image *img);
+
 /* engine.c - high level command queue engine */
 int fb_getvar(struct usb_handle *usb, char *response, char *errBuf, int errBufLen, const char *fmt, ...);
 int fb_format_supported(usb_handle *usb, const char *partition, char *errBuf, int errBufLen);
 void fb_queue_oemsave(fb_action_list *list,const char*cmd, char *dest, unsigned dest_size);
 void fb_queue_flash(fb_action_list *list, const char *ptn, void *data, unsigned sz);
 void fb_queue_flash_sparse(fb_action_list *list,const char *ptn, struct sparse_file *s, unsigned sz);
+void fb_queue_flash_image(fb_action_list *list, const char *ptn, struct fb_image *img);
 void fb_queue_erase(fb_action_list *list,const char *ptn);
 void fb_queue_format(fb_action_list *list,const char *ptn, int skip_if_not_supported);
 void fb_queue_require(fb_action_list *list,const char *prod, const char *var, int invert,
@@ -36,6 +36,10 @@
 #include <string.h>
 #include <errno.h>
 
+#ifndef USE_MINGW
+#include <pthread.h>
+#endif
+
 #include <sparse/sparse.h>
 
 #include "fastboot.h"
@@ -333,3 +337,227 @@ int fb_download_data_sparse(usb_handle *usb, struct sparse_file *s, char *errBuf
 
     return _command_end(usb, errBuf, errBufLen);
 }
+
+/* Streaming downloads: the producer runs on its own thread and fills a few
+ * large buffers while this one sends the ones already full, so that reading
+ * and resparsing the image overlaps the transfer. Without threads (mingw)
+ * each buffer is sent as soon as it is full. */
+#define STREAM_BUF_SIZE (1024 * 1024)
+#define STREAM_BUFS 4
+
+typedef struct {
+    usb_handle *usb;
+    char *errBuf;
+    int errBufLen;
+
+    char *buf[STREAM_BUFS];
+    int len[STREAM_BUFS];
+    unsigned head;              /* buffers filled so far */
+    unsigned tail;              /* buffers sent so far */
+    unsigned sent;              /* bytes sent so far */
+    int done;                   /* the producer has returned */
+    int cancelled;              /* sending failed; the producer should stop */
+    int result;                 /* what the producer returned */
+
+    fb_produce_func produce;
+    void *priv;
+#ifndef USE_MINGW
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+} stream_context;
+
+/* Hands the buffer being filled over to the sender. Returns -1 if sending
+ * has failed. */
+static int stream_publish(stream_context *sc)
+{
+#ifdef USE_MINGW
+    int len = sc->len[0];
+    if (sc->cancelled) {
+        return -1;
+    }
+    if (_command_data(sc->usb, sc->buf[0], len, sc->errBuf, sc->errBufLen) != len) {
+        sc->cancelled = 1;
+        return -1;
+    }
+    sc->sent += len;
+    sc->len[0] = 0;
+    return 0;
+#else
+    int ret = 0;
+    pthread_mutex_lock(&sc->lock);
+    sc->head++;
+    pthread_cond_broadcast(&sc->cond);
+    while (sc->head - sc->tail == STREAM_BUFS && !sc->cancelled) {
+        pthread_cond_wait(&sc->cond, &sc->lock);
+    }
+    if (sc->cancelled) {
+        ret = -1;
+    } else {
+        sc->len[sc->head % STREAM_BUFS] = 0;
+    }
+    pthread_mutex_unlock(&sc->lock);
+    return ret;
+#endif
+}
+
+static int stream_write(void *priv, const void *data, int len)
+{
+    stream_context *sc = priv;
+    const char *ptr = data;
+
+    while (len > 0) {
+#ifdef USE_MINGW
+        unsigned i = 0;
+#else
+        unsigned i = sc->head % STREAM_BUFS;
+#endif
+        int to_copy = min(STREAM_BUF_SIZE - sc->len[i], len);
+
+        memcpy(sc->buf[i] + sc->len[i], ptr, to_copy);
+        sc->len[i] += to_copy;
+        ptr += to_copy;
+        len -= to_copy;
+
+        if (sc->len[i] == STREAM_BUF_SIZE && stream_publish(sc)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void *stream_produce(void *priv)
+{
+    stream_context *sc = priv;
+    int r;
+#ifdef USE_MINGW
+    unsigned i = 0;
+#else
+    unsigned i;
+#endif
+
+    r = sc->produce(sc->priv, stream_write, sc);
+#ifndef USE_MINGW
+    i = sc->head % STREAM_BUFS;
+#endif
+    if (r >= 0 && sc->len[i] > 0 && stream_publish(sc)) {
+        r = -1;
+    }
+
+#ifndef USE_MINGW
+    pthread_mutex_lock(&sc->lock);
+    sc->done = 1;
+    sc->result = r;
+    pthread_cond_broadcast(&sc->cond);
+    pthread_mutex_unlock(&sc->lock);
+#else
+    sc->done = 1;
+    sc->result = r;
+#endif
+    return NULL;
+}
+
+#ifndef USE_MINGW
+static void stream_send(stream_context *sc)
+{
+    pthread_mutex_lock(&sc->lock);
+    for (;;) {
+        unsigned i;
+        int len, r;
+
+        while (sc->tail == sc->head && !sc->done) {
+            pthread_cond_wait(&sc->cond, &sc->lock);
+        }
+        if (sc->tail == sc->head) {
+            break;
+        }
+        i = sc->tail % STREAM_BUFS;
+        len = sc->len[i];
+        pthread_mutex_unlock(&sc->lock);
+
+        r = _command_data(sc->usb, sc->buf[i], len, sc->errBuf, sc->errBufLen);
+
+        pthread_mutex_lock(&sc->lock);
+        if (r != len) {
+            sc->cancelled = 1;
+            pthread_cond_broadcast(&sc->cond);
+            break;
+        }
+        sc->sent += len;
+        sc->tail++;
+        pthread_cond_broadcast(&sc->cond);
+    }
+    pthread_mutex_unlock(&sc->lock);
+}
+#endif
+
+int fb_download_data_stream(usb_handle *usb, unsigned size, fb_produce_func produce, void *priv,
+                            char *errBuf, int errBufLen)
+{
+    char cmd[FB_COMMAND_SZ];
+    stream_context sc;
+    int nbufs = STREAM_BUFS;
+    int r = -1;
+    int i;
+
+    memset(&sc, 0, sizeof(sc));
+    sc.usb = usb;
+    sc.errBuf = errBuf;
+    sc.errBufLen = errBufLen;
+    sc.produce = produce;
+    sc.priv = priv;
+#ifdef USE_MINGW
+    nbufs = 1;
+#endif
+    for (i = 0; i < nbufs; i++) {
+        sc.buf[i] = malloc(STREAM_BUF_SIZE);
+        if (sc.buf[i] == NULL) {
+            snprintf(errBuf, errBufLen, "out of memory");
+            goto out;
+        }
+    }
+
+    sprintf(cmd, "download:%08x", size);
+    if (_command_start(usb, cmd, size, 0, errBuf, errBufLen) < 0) {
+        goto out;
+    }
+
+#ifdef USE_MINGW
+    stream_produce(&sc);
+#else
+    {
+        pthread_t thread;
+        pthread_mutex_init(&sc.lock, NULL);
+        pthread_cond_init(&sc.cond, NULL);
+        if (pthread_create(&thread, NULL, stream_produce, &sc)) {
+            snprintf(errBuf, errBufLen, "cannot start reader thread");
+            pthread_cond_destroy(&sc.cond);
+            pthread_mutex_destroy(&sc.lock);
+            goto out;
+        }
+        stream_send(&sc);
+        pthread_join(thread, NULL);
+        pthread_cond_destroy(&sc.cond);
+        pthread_mutex_destroy(&sc.lock);
+    }
+#endif
+
+    if (sc.cancelled) {
+        goto out;
+    }
+    if (sc.result < 0) {
+        snprintf(errBuf, errBufLen, "cannot read image");
+        goto out;
+    }
+    if (sc.sent != size) {
+        snprintf(errBuf, errBufLen, "image size changed (%u != %u)", sc.sent, size);
+        goto out;
+    }
+    r = _command_end(usb, errBuf, errBufLen);
+
+out:
+    for (i = 0; i < nbufs; i++) {
+        free(sc.buf[i]);
+    }
+    return r;
+}
@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* Images flashed straight from their file (or zip entry) instead of being
+ * loaded into memory first. Preparing an image -- opening it, extracting it
+ * from the zip, and splitting it into sparse pieces no larger than the
+ * target's download limit -- can run on another thread while the previous
+ * partition is being sent. */
+
+#define _LARGEFILE64_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef USE_MINGW
+#include <pthread.h>
+#endif
+
+#include <sparse/sparse.h>
+#include <zipfile/zipfile.h>
+
+#include "fastboot.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#if defined(__APPLE__) && defined(__MACH__)
+#define lseek64 lseek
+#endif
+
+#define READ_BUF_SIZE (256 * 1024)
+
+struct fb_image {
+    char *fname;                /* the image file, or */
+    zipentry_t entry;           /* the zip entry holding it */
+    int64_t limit;              /* largest download, or 0 to send it whole */
+
+    int fd;
+    int64_t size;
+    struct sparse_file *sparse;
+    struct sparse_file **pieces;
+    int npieces;
+
+    int prepared;               /* 1 when ready, -1 if that failed */
+    char error[256];
+#ifndef USE_MINGW
+    pthread_t thread;
+    int thread_started;
+#endif
+};
+
+static struct fb_image *image_new(int64_t limit)
+{
+    struct fb_image *img = calloc(1, sizeof(*img));
+    if (img == 0) die("out of memory");
+    img->fd = -1;
+    img->limit = limit;
+    return img;
+}
+
+struct fb_image *fb_image_open_file(const char *fname, int64_t limit)
+{
+    struct fb_image *img = image_new(limit);
+    img->fname = strdup(fname);
+    if (img->fname == 0) die("out of memory");
+    return img;
+}
+
+struct fb_image *fb_image_open_zip(zipentry_t entry, int64_t limit)
+{
+    struct fb_image *img = image_new(limit);
+    img->entry = entry;
+    return img;
+}
+
+static int temp_fd(void)
+{
+#ifdef USE_MINGW
+    /* See generate_ext4_image() about tmpfile() on Windows. */
+    char *filename = tempnam(getenv("TEMP"), "fastboot-image");
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    unlink(filename);
+    return fd;
+#else
+    FILE *f = tmpfile();
+    int fd;
+    if (f == NULL) {
+        return -1;
+    }
+    fd = dup(fileno(f));
+    fclose(f);
+    return fd;
+#endif
+}
+
+static int prepare(struct fb_image *img)
+{
+    int files;
+
+    if (img->fname) {
+        img->fd = open(img->fname, O_RDONLY | O_BINARY);
+        if (img->fd < 0) {
+            snprintf(img->error, sizeof(img->error), "cannot open '%s': %s",
+                     img->fname, strerror(errno));
+            return -1;
+        }
+    } else {
+        img->fd = temp_fd();
+        if (img->fd < 0 || decompress_zipentry_to_fd(img->entry, img->fd)) {
+            snprintf(img->error, sizeof(img->error), "cannot extract image from archive");
+            return -1;
+        }
+    }
+
+    img->size = lseek64(img->fd, 0, SEEK_END);
+    lseek64(img->fd, 0, SEEK_SET);
+    if (img->size < 0) {
+        snprintf(img->error, sizeof(img->error), "cannot size image");
+        return -1;
+    }
+
+    if (!img->limit || img->size <= img->limit) {
+        if (img->size > 0xffffffffLL) {
+            snprintf(img->error, sizeof(img->error), "image too large to send whole");
+            return -1;
+        }
+        return 0;
+    }
+
+    /* This reads the whole image looking for blocks that need not be sent,
+     * which is what is worth doing ahead of time. */
+    img->sparse = sparse_file_import_auto(img->fd, false);
+    if (!img->sparse) {
+        snprintf(img->error, sizeof(img->error), "cannot sparse read image");
+        return -1;
+    }
+    files = sparse_file_resparse(img->sparse, img->limit, NULL, 0);
+    if (files < 0) {
+        snprintf(img->error, sizeof(img->error), "cannot resparse image");
+        return -1;
+    }
+    img->pieces = calloc(files + 1, sizeof(struct sparse_file *));
+    if (!img->pieces) {
+        snprintf(img->error, sizeof(img->error), "out of memory");
+        return -1;
+    }
+    img->npieces = sparse_file_resparse(img->sparse, img->limit, img->pieces, files);
+    if (img->npieces < 0) {
+        snprintf(img->error, sizeof(img->error), "cannot resparse image");
+        return -1;
+    }
+    return 0;
+}
+
+static void *prepare_thread(void *arg)
+{
+    struct fb_image *img = arg;
+    img->prepared = prepare(img) ? -1 : 1;
+    return NULL;
+}
+
+void fb_image_prepare_async(struct fb_image *img)
+{
+#ifndef USE_MINGW
+    if (img->prepared || img->thread_started) {
+        return;
+    }
+    if (pthread_create(&img->thread, NULL, prepare_thread, img) == 0) {
+        img->thread_started = 1;
+    }
+#endif
+}
+
+int fb_image_wait(struct fb_image *img, char *errBuf, int errBufLen)
+{
+#ifndef USE_MINGW
+    if (img->thread_started) {
+        pthread_join(img->thread, NULL);
+        img->thread_started = 0;
+    }
+#endif
+    if (!img->prepared) {
+        prepare_thread(img);
+    }
+    if (img->prepared < 0) {
+        snprintf(errBuf, errBufLen, "%s", img->error);
+        return -1;
+    }
+    return 0;
+}
+
+static int produce_fd(void *priv, fb_write_func write_func, void *write_priv)
+{
+    struct fb_image *img = priv;
+    char *buf = malloc(READ_BUF_SIZE);
+    int64_t remain = img->size;
+    int r = 0;
+
+    if (buf == NULL) {
+        return -1;
+    }
+    lseek64(img->fd, 0, SEEK_SET);
+    while (remain > 0) {
+        int to_read = remain < READ_BUF_SIZE ? remain : READ_BUF_SIZE;
+        int n = read(img->fd, buf, to_read);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0 || write_func(write_priv, buf, n)) {
+            r = -1;
+            break;
+        }
+        remain -= n;
+    }
+    free(buf);
+    return r;
+}
+
+static int produce_sparse(void *priv, fb_write_func write_func, void *write_priv)
+{
+    return sparse_file_callback(priv, true, false, write_func, write_priv);
+}
+
+int fb_flash_image(usb_handle *usb, const char *ptn, struct fb_image *img,
+                   char *errBuf, int errBufLen)
+{
+    char cmd[FB_COMMAND_SZ];
+    int i;
+
+    if (fb_image_wait(img, errBuf, errBufLen)) {
+        return -1;
+    }
+    snprintf(cmd, sizeof(cmd), "flash:%s", ptn);
+
+    if (!img->pieces) {
+        fprintf(stderr, "sending '%s' (%lld KB)...\n", ptn, (long long)(img->size / 1024));
+        if (fb_download_data_stream(usb, img->size, produce_fd, img, errBuf, errBufLen)) {
+            return -1;
+        }
+        fprintf(stderr, "writing '%s'...\n", ptn);
+        return fb_command(usb, cmd, errBuf, errBufLen);
+    }
+
+    for (i = 0; i < img->npieces; i++) {
+        int64_t len = sparse_file_len(img->pieces[i], true, false);
+        fprintf(stderr, "sending sparse '%s' %d/%d (%lld KB)...\n",
+                ptn, i + 1, img->npieces, (long long)(len / 1024));
+        if (len <= 0 || fb_download_data_stream(usb, len, produce_sparse, img->pieces[i],
+                                                errBuf, errBufLen)) {
+            return -1;
+        }
+        fprintf(stderr, "writing '%s' %d/%d...\n", ptn, i + 1, img->npieces);
+        if (fb_command(usb, cmd, errBuf, errBufLen)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void fb_image_close(struct fb_image *img)
+{
+    int i;
+
+    /* Wait out a preparation still running before taking it apart. */
+#ifndef USE_MINGW
+    if (img->thread_started) {
+        char errBuf[256];
+        fb_image_wait(img, errBuf, sizeof(errBuf));
+    }
+#endif
+    for (i = 0; i < img->npieces; i++) {
+        sparse_file_destroy(img->pieces[i]);
+    }
+    free(img->pieces);
+    if (img->sparse) {
+        sparse_file_destroy(img->sparse);
+    }
+    if (img->fd >= 0) {
+        close(img->fd);
+    }
+    free(img->fname);
+    free(img);
+}
@@ -0,0 +1,408 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* Flashes images through stream.c to a pretend device at the other end of
+ * a socket pair, and checks that what the device wrote to its partition is
+ * the image: sent whole, sent as sparse pieces below a download limit, and
+ * extracted from a zip entry. Prints how long each took.
+ *
+ *   stream_test [-s megabytes] [-l limit megabytes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <zipfile/zipfile.h>
+#include <zlib.h>
+
+#include "fastboot.h"
+
+#define PACKET_SIZE (16 * 1024)
+
+struct usb_handle {
+    int fd;
+};
+
+/* The socket keeps packets apart, as USB does; long writes are split. */
+int usb_write(usb_handle *h, const void *_data, int len)
+{
+    const char *data = _data;
+    int done = 0;
+
+    while (done < len) {
+        int n = len - done < PACKET_SIZE ? len - done : PACKET_SIZE;
+        n = write(h->fd, data + done, n);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        done += n;
+    }
+    return done;
+}
+
+int usb_read(usb_handle *h, void *_data, int len)
+{
+    int n;
+    do {
+        n = read(h->fd, _data, len);
+    } while (n < 0 && errno == EINTR);
+    return n;
+}
+
+void die(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "error: ");
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, "\n");
+    va_end(ap);
+    exit(1);
+}
+
+/* The device: one partition, big enough for anything sent. */
+static struct {
+    usb_handle usb;
+    char *download;
+    unsigned download_size;
+    unsigned char *partition;
+    size_t partition_size;
+    int downloads;
+} device;
+
+static unsigned get32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned) p[3] << 24);
+}
+
+static int reply(const char *msg)
+{
+    return usb_write(&device.usb, msg, strlen(msg)) < 0 ? -1 : 0;
+}
+
+/* Writes a sparse image into the partition as a bootloader would. */
+static const char *write_sparse(const unsigned char *data, unsigned size)
+{
+    const unsigned char *end = data + size;
+    unsigned hdr_sz, chunk_hdr_sz, blk_sz, chunks, i;
+    size_t offset = 0;
+
+    hdr_sz = get32(data + 8) & 0xffff;
+    chunk_hdr_sz = get32(data + 8) >> 16;
+    blk_sz = get32(data + 12);
+    chunks = get32(data + 20);
+    data += hdr_sz;
+
+    for (i = 0; i < chunks; i++) {
+        unsigned type, blocks, total;
+        size_t len;
+
+        if (data + chunk_hdr_sz > end) {
+            return "truncated sparse image";
+        }
+        type = get32(data) & 0xffff;
+        blocks = get32(data + 4);
+        total = get32(data + 8);
+        len = (size_t) blocks * blk_sz;
+        if (offset + len > device.partition_size) {
+            return "sparse image larger than partition";
+        }
+        data += chunk_hdr_sz;
+        switch (type) {
+        case 0xCAC1: /* raw */
+            if (total - chunk_hdr_sz != len) {
+                return "bad raw chunk";
+            }
+            memcpy(device.partition + offset, data, len);
+            break;
+        case 0xCAC2: { /* fill */
+            size_t j;
+            for (j = 0; j < len; j += 4) {
+                memcpy(device.partition + offset + j, data, 4);
+            }
+            break;
+        }
+        case 0xCAC3: /* don't care */
+        case 0xCAC4: /* crc */
+            break;
+        default:
+            return "bad chunk type";
+        }
+        data += total - chunk_hdr_sz;
+        offset += len;
+    }
+    return NULL;
+}
+
+static const char *flash(void)
+{
+    if (device.download_size >= 28 && get32((unsigned char *) device.download) == 0xed26ff3a) {
+        return write_sparse((unsigned char *) device.download, device.download_size);
+    }
+    if (device.download_size > device.partition_size) {
+        return "image larger than partition";
+    }
+    memcpy(device.partition, device.download, device.download_size);
+    return NULL;
+}
+
+static void *device_thread(void *arg __attribute__((unused)))
+{
+    char cmd[FB_COMMAND_SZ + 1];
+    char response[FB_RESPONSE_SZ + 1];
+    int n;
+
+    while ((n = usb_read(&device.usb, cmd, FB_COMMAND_SZ)) > 0) {
+        cmd[n] = 0;
+        if (!strncmp(cmd, "download:", 9)) {
+            unsigned size = strtoul(cmd + 9, NULL, 16), got = 0;
+            free(device.download);
+            device.download = malloc(size ? size : 1);
+            snprintf(response, sizeof(response), "DATA%08x", size);
+            if (reply(response)) {
+                break;
+            }
+            while (got < size && (n = usb_read(&device.usb, device.download + got,
+                                               size - got)) > 0) {
+                got += n;
+            }
+            device.download_size = got;
+            device.downloads++;
+            if (reply(got == size ? "OKAY" : "FAILshort download")) {
+                break;
+            }
+        } else if (!strncmp(cmd, "flash:", 6)) {
+            const char *error = flash();
+            snprintf(response, sizeof(response), "%s%s", error ? "FAIL" : "OKAY",
+                     error ? error : "");
+            if (reply(response)) {
+                break;
+            }
+        } else if (reply("FAILunknown command")) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static long long now_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+/* Two blocks in five are zeros or one repeated word, so that the sparse
+ * pieces have fill and raw chunks both. */
+static unsigned char *make_image(size_t size)
+{
+    unsigned char *image = malloc(size);
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        size_t block = i / 4096;
+        if (block % 5 == 1) {
+            image[i] = 0;
+        } else if (block % 5 == 3) {
+            image[i] = "\x12\x34\x56\x78"[i & 3];
+        } else {
+            image[i] = (i * 2654435761u) >> 13;
+        }
+    }
+    return image;
+}
+
+static void put16(FILE *f, unsigned v)
+{
+    fputc(v, f);
+    fputc(v >> 8, f);
+}
+
+static void put32(FILE *f, unsigned v)
+{
+    put16(f, v);
+    put16(f, v >> 16);
+}
+
+/* A zip holding the image stored, as one entry named "system.img". */
+static void *make_zip(const unsigned char *image, size_t size, size_t *zip_size)
+{
+    static const char name[] = "system.img";
+    FILE *f = tmpfile();
+    unsigned crc = crc32(0, image, size);
+    void *data;
+    long cd;
+
+    put32(f, 0x04034b50);
+    put16(f, 10); put16(f, 0); put16(f, 0); put32(f, 0);
+    put32(f, crc); put32(f, size); put32(f, size);
+    put16(f, strlen(name)); put16(f, 0);
+    fwrite(name, strlen(name), 1, f);
+    fwrite(image, size, 1, f);
+
+    cd = ftell(f);
+    put32(f, 0x02014b50);
+    put16(f, 10); put16(f, 10); put16(f, 0); put16(f, 0); put32(f, 0);
+    put32(f, crc); put32(f, size); put32(f, size);
+    put16(f, strlen(name)); put16(f, 0); put16(f, 0); put16(f, 0); put16(f, 0);
+    put32(f, 0); put32(f, 0);
+    fwrite(name, strlen(name), 1, f);
+
+    put32(f, 0x06054b50);
+    put16(f, 0); put16(f, 0); put16(f, 1); put16(f, 1);
+    put32(f, ftell(f) - cd - 12); put32(f, cd); put16(f, 0);
+
+    *zip_size = ftell(f);
+    data = malloc(*zip_size);
+    rewind(f);
+    if (fread(data, *zip_size, 1, f) != 1) {
+        die("cannot read back zip");
+    }
+    fclose(f);
+    return data;
+}
+
+static int run(const char *what, usb_handle *usb, struct fb_image *img,
+               const unsigned char *image, size_t size, int min_downloads)
+{
+    char errBuf[256];
+    long long t0;
+    int r;
+
+    memset(device.partition, 0xa5, device.partition_size);
+    device.downloads = 0;
+
+    t0 = now_us();
+    r = fb_flash_image(usb, "system", img, errBuf, sizeof(errBuf));
+    t0 = now_us() - t0;
+    fb_image_close(img);
+
+    if (r) {
+        fprintf(stderr, "%s: flash failed: %s\n", what, errBuf);
+        return 1;
+    }
+    if (memcmp(device.partition, image, size)) {
+        fprintf(stderr, "%s: partition differs from image\n", what);
+        return 1;
+    }
+    if (device.downloads < min_downloads) {
+        fprintf(stderr, "%s: %d downloads, expected %d or more\n", what,
+                device.downloads, min_downloads);
+        return 1;
+    }
+    printf("%-8s %zu KB in %d downloads, %.1f ms\n", what, size / 1024,
+           device.downloads, t0 / 1000.0);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = 24 * 1024 * 1024 + 4096 * 3;
+    int64_t limit = 4 * 1024 * 1024;
+    char fname[] = "/tmp/stream_test.XXXXXX";
+    char errBuf[256];
+    unsigned char *image;
+    void *zip_data;
+    size_t zip_size;
+    zipfile_t zip;
+    usb_handle usb;
+    pthread_t thread;
+    int sv[2], fd, i, errors = 0;
+    struct fb_image *img;
+
+    for (i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-s")) {
+            size = atoi(argv[i + 1]) * 1024 * 1024 + 4096 * 3;
+        } else if (!strcmp(argv[i], "-l")) {
+            limit = atoi(argv[i + 1]) * 1024 * 1024;
+        }
+    }
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv)) {
+        die("socketpair: %s", strerror(errno));
+    }
+    usb.fd = sv[0];
+    device.usb.fd = sv[1];
+    device.partition_size = size + 1024 * 1024;
+    device.partition = malloc(device.partition_size);
+    pthread_create(&thread, NULL, device_thread, NULL);
+
+    image = make_image(size);
+    fd = mkstemp(fname);
+    if (fd < 0 || write(fd, image, size) != (ssize_t) size) {
+        die("cannot write %s: %s", fname, strerror(errno));
+    }
+    close(fd);
+
+    errors += run("raw", &usb, fb_image_open_file(fname, 0), image, size, 1);
+    errors += run("sparse", &usb, fb_image_open_file(fname, limit), image, size, 2);
+
+    /* Preparing ahead and then flashing gives the same thing. */
+    img = fb_image_open_file(fname, limit);
+    fb_image_prepare_async(img);
+    errors += run("prepared", &usb, img, image, size, 2);
+
+    zip_data = make_zip(image, size, &zip_size);
+    zip = init_zipfile(zip_data, zip_size);
+    if (zip == NULL) {
+        die("cannot open zip");
+    }
+    errors += run("zip", &usb, fb_image_open_zip(lookup_zipentry(zip, "system.img"), 0),
+                  image, size, 1);
+    release_zipfile(zip);
+    free(zip_data);
+
+    unlink(fname);
+    img = fb_image_open_file(fname, 0);
+    if (fb_flash_image(&usb, "system", img, errBuf, sizeof(errBuf)) == 0) {
+        fprintf(stderr, "missing file: flash succeeded\n");
+        errors++;
+    }
+    fb_image_close(img);
+
+    close(usb.fd);
+    pthread_join(thread, NULL);
+    free(image);
+    free(device.partition);
+    free(device.download);
+    if (errors) {
+        printf("%d errors\n", errors);
+    }
+    return errors ? 1 : 0;
+}
@@ -23,6 +23,7 @@
 extern "C" {
 #endif
 
+#include <signal.h>
 #include <sys/types.h>
 #include <corkscrew/ptrace.h>
 #include <corkscrew/map_info.h>
@@ -67,6 +68,18 @@ ssize_t unwind_backtrace(backtrace_frame_t* backtrace, size_t ignore_depth, size
 ssize_t unwind_backtrace_thread(pid_t tid, backtrace_frame_t* backtrace,
         size_t ignore_depth, size_t max_depth);
 
+/*
+ * Unwinds the call stack of the thread that was interrupted by a signal, from
+ * within its SA_SIGINFO handler. Safe to call from a signal handler: it does
+ * not allocate or take locks, so the map info list must be acquired ahead of
+ * time (see acquire_my_map_info_list()).
+ * Populates the backtrace array with the program counters from the call stack.
+ * Returns the number of frames collected, or -1 if an error occurred.
+ */
+ssize_t unwind_backtrace_signal(siginfo_t* siginfo, void* sigcontext,
+        const map_info_t* map_info_list,
+        backtrace_frame_t* backtrace, size_t ignore_depth, size_t max_depth);
+
 /*
  * Unwinds the call stack of a task within a remote process using ptrace().
  * Populates the backtrace array with the program counters from the call stack.
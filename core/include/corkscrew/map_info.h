@@ -32,18 +32,22 @@ typedef struct map_info {
     uintptr_t start;
     uintptr_t end;
     bool is_readable;
+    bool is_writable;
     bool is_executable;
     void* data; // arbitrary data associated with the map by the user, initially NULL
+    struct map_info_index* index; // lookup table, only set on the head of a loaded list
     char name[];
 } map_info_t;
 
-/* Loads memory map from /proc/<tid>/maps. */
+/* Loads memory map from /proc/<tid>/maps.
+ * The list is in descending address order and must not be modified. */
 map_info_t* load_map_info_list(pid_t tid);
 
 /* Frees memory map. */
 void free_map_info_list(map_info_t* milist);
 
-/* Finds the memory map that contains the specified address. */
+/* Finds the memory map that contains the specified address.
+ * Uses a binary search when milist is the head of a loaded list. */
 const map_info_t* find_map_info(const map_info_t* milist, uintptr_t addr);
 
 /* Returns true if the addr is in an readable map. */
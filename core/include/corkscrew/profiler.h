@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A sampling CPU profiler built on the signal unwinder. */
+
+#ifndef _CORKSCREW_PROFILER_H
+#define _CORKSCREW_PROFILER_H
+
+#include <signal.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Real-time signal used by corkprof to control a process that called
+ * profiler_install(). The signal is queued with a value: the sampling rate
+ * in Hz to start profiling, or 0 to stop.
+ */
+#define PROFILER_CONTROL_SIGNAL (SIGRTMIN + 10)
+
+/* Where a controlled process writes its profile; formatted with its pid.
+ * corkprof creates it, readable and writable only by the process's owner. */
+#define PROFILER_DATA_PATH_FORMAT "/data/local/tmp/corkprof-%d.data"
+
+/*
+ * The profile is a sequence of 32-bit words in host byte order: the magic and
+ * the version, then records that each start with their type.
+ */
+enum {
+    PROFILER_MAGIC = 0x46525043,    /* "CPRF" */
+    PROFILER_VERSION = 1,
+
+    /* tid, frame count, then one pc per frame, innermost first */
+    PROFILER_RECORD_SAMPLE = 1,
+    /* start, end, name length, then the name padded to a whole word */
+    PROFILER_RECORD_MAP = 2,
+    /* rate in Hz, samples, dropped samples, wall time in ms,
+     * process cpu time in us, time spent in the sampler in us */
+    PROFILER_RECORD_STATS = 3,
+    /* followed by the magic; the last record of a complete profile */
+    PROFILER_RECORD_END = 4,
+};
+
+/*
+ * Starts sampling every thread of this process at the given rate, measured in
+ * cpu time (ITIMER_PROF). Samples go into a per-thread ring from the SIGPROF
+ * handler and are written to path by a background thread.
+ * Returns 0 on success, or -1 if the profiler is already running or could not
+ * be started.
+ */
+int profiler_start(int hz, const char* path);
+
+/*
+ * Stops sampling and completes the profile with the memory map of the process
+ * and the overhead statistics. Returns 0 on success, or -1 if not running.
+ */
+int profiler_stop();
+
+/*
+ * Lets corkprof start and stop the profiler in this process by sending it
+ * PROFILER_CONTROL_SIGNAL. Does nothing unless ro.debuggable is set.
+ */
+void profiler_install();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _CORKSCREW_PROFILER_H
@@ -30,16 +30,21 @@
 extern "C" {
 #endif
 
+/* Page cache for reading the memory of another process. */
+typedef struct remote_memory remote_memory_t;
+
 /* Stores information about a process that is used for several different
  * ptrace() based operations. */
 typedef struct {
     map_info_t* map_info_list;
+    remote_memory_t* remote_memory;
 } ptrace_context_t;
 
 /* Describes how to access memory from a process. */
 typedef struct {
     pid_t tid;
     const map_info_t* map_info_list;
+    remote_memory_t* remote_memory;
 } memory_t;
 
 #if __i386__
@@ -89,6 +94,13 @@ void init_memory(memory_t* memory, const map_info_t* map_info_list);
  */
 void init_memory_ptrace(memory_t* memory, pid_t tid);
 
+/*
+ * Initializes a memory structure for accessing memory from another process
+ * through the page cache of a ptrace context, which reads whole pages at a
+ * time instead of a word per ptrace() call.
+ */
+void init_memory_ptrace_context(memory_t* memory, pid_t tid, const ptrace_context_t* context);
+
 /*
  * Reads a word of memory safely.
  * If the memory is local, ensures that the address is readable before dereferencing it.
@@ -102,6 +114,20 @@ bool try_get_word(const memory_t* memory, uintptr_t ptr, uint32_t* out_value);
  */
 bool try_get_word_ptrace(pid_t tid, uintptr_t ptr, uint32_t* out_value);
 
+/*
+ * Reads up to len bytes of memory from a process through the page cache of a
+ * ptrace context. Returns the number of bytes read, which is less than len if
+ * an unreadable address was reached.
+ */
+size_t read_memory_ptrace(const ptrace_context_t* context, uintptr_t ptr, void* buf, size_t len);
+
+/*
+ * Forgets cached contents of writable memory, which may have changed if any
+ * thread of the process has run since it was read. Read-only mappings stay
+ * cached. unwind_backtrace_ptrace() calls this before unwinding.
+ */
+void flush_ptrace_context_memory(const ptrace_context_t* context);
+
 /*
  * Loads information needed for examining a remote process using ptrace().
  * The caller must already have successfully attached to the process
@@ -46,6 +46,19 @@ symbol_table_t* load_symbol_table(const char* filename);
  */
 void free_symbol_table(symbol_table_t* table);
 
+/*
+ * Returns the symbol table for a given file from a process-wide cache,
+ * loading it if the file is not cached or has changed since (by inode and
+ * modification time). The table is shared and must not be modified.
+ * Returns NULL on error. Release the table with release_symbol_table().
+ */
+symbol_table_t* acquire_symbol_table(const char* filename);
+
+/*
+ * Releases a symbol table acquired with acquire_symbol_table().
+ */
+void release_symbol_table(symbol_table_t* table);
+
 /*
  * Finds a symbol associated with an address in the symbol table.
  * Returns NULL if not found.
@@ -54,6 +54,11 @@ const uint8_t* SHA_final(SHA_CTX* ctx);
 /* Convenience method. Returns digest parameter value. */
 const uint8_t* SHA(const void* data, int len, uint8_t* digest);
 
+/* Hashes count separate messages, several at once where the cpu has the
+ * vector unit for it. The digest of data[i] goes to digests + i *
+ * SHA_DIGEST_SIZE. */
+void SHA_multi(const void* const* data, const int* len, int count, uint8_t* digests);
+
 #define SHA_DIGEST_SIZE 20
 
 #ifdef __cplusplus
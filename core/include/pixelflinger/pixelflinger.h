@@ -315,6 +315,10 @@ extern "C" {
 ssize_t gglInit(GGLContext** context);
 ssize_t gglUninit(GGLContext* context);
 
+// split large rects and triangles between 'count' threads, the caller
+// being one of them, each drawing its own bands of rows. 1 turns it off.
+ssize_t gglSetThreads(GGLContext* context, int count);
+
 GGLint gglBitBlit(
         GGLContext* c,
         int tmu,
@@ -272,6 +272,7 @@ int needs_t::match(const needs_filter_t& filter) {
 // ----------------------------------------------------------------------------
 
 struct context_t;
+struct tiler_t;
 class Assembly;
 
 struct blend_state_t {
@@ -546,6 +547,7 @@ struct context_t {
     void*               base;
     Assembly*           scanline_as;
     GGLenum             error;
+    tiler_t*            tiler;
 };
 
 // ----------------------------------------------------------------------------
@@ -25,6 +25,7 @@ extern "C" {
 
 typedef void* zipfile_t;
 typedef void* zipentry_t;
+typedef void* zipstream_t;
 
 // Provide a buffer.  Returns NULL on failure.
 zipfile_t init_zipfile(const void* data, size_t size);
@@ -47,6 +48,20 @@ char* get_zipentry_name(zipentry_t entry);
 // by get_zipentry_size.  Returns nonzero on failure.
 int decompress_zipentry(zipentry_t entry, void* buf, int bufsize);
 
+// Start decompressing an entry a piece at a time, so that the whole of it
+// never needs to be in memory.  Returns NULL on failure.
+zipstream_t open_zipentry_stream(zipentry_t entry);
+
+// Decompress up to bufsize more bytes of the entry into buf.  Returns the
+// number of bytes, 0 once the whole entry has been read, or -1 on failure,
+// which includes the entry not matching its size or crc at the end.
+int read_zipentry_stream(zipstream_t stream, void* buf, int bufsize);
+
+void close_zipentry_stream(zipstream_t stream);
+
+// Decompress the entry and write it to fd.  Returns nonzero on failure.
+int decompress_zipentry_to_fd(zipentry_t entry, int fd);
+
 // iterate through the entries in the zip file.  pass a pointer to
 // a void* initialized to NULL to start.  Returns NULL when done
 zipentry_t iterate_zipfile(zipfile_t file, void** cookie);
@@ -7,6 +7,8 @@ LOCAL_SRC_FILES:= \
 	builtins.c \
 	init.c \
 	devices.c \
+	coldboot.c \
+	perms.c \
 	property_service.c \
 	util.c \
 	parser.c \
@@ -19,7 +21,7 @@ LOCAL_SRC_FILES:= \
 	watchdogd.c
 
 ifeq ($(strip $(INIT_BOOTCHART)),true)
-LOCAL_SRC_FILES += bootchart.c
+LOCAL_SRC_FILES += bootchart.c boottrace.c
 LOCAL_CFLAGS    += -DBOOTCHART=1
 endif
 
@@ -63,3 +65,24 @@ ALL_DEFAULT_INSTALLED_MODULES += $(SYMLINKS)
 # local module name
 ALL_MODULES.$(LOCAL_MODULE).INSTALLED := \
     $(ALL_MODULES.$(LOCAL_MODULE).INSTALLED) $(SYMLINKS)
+
+# Runs the parallel coldboot walk against a synthetic sysfs tree.
+ifeq ($(HOST_OS),linux)
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := coldboot.c coldboot_test.c
+LOCAL_CFLAGS := -std=gnu99
+LOCAL_LDLIBS := -lpthread
+LOCAL_MODULE := coldboot_test
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
+endif
+
+# Replays a uevent stream against ueventd.rc rules, scanned and compiled.
+ifeq ($(HOST_OS),linux)
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := perms.c perms_bench.c
+LOCAL_CFLAGS := -std=gnu99
+LOCAL_MODULE := perms_bench
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
+endif
@@ -33,6 +33,7 @@
 #include <stdlib.h>
 #include <sys/stat.h>
 #include "bootchart.h"
+#include "boottrace.h"
 
 #define VERSION         "0.8"
 #define SAMPLE_PERIOD   0.2
@@ -42,6 +43,7 @@
 #define LOG_DISK        LOG_ROOT"/proc_diskstats.log"
 #define LOG_HEADER      LOG_ROOT"/header"
 #define LOG_ACCT        LOG_ROOT"/kernel_pacct"
+#define LOG_TIMELINE    LOG_ROOT"/timeline"
 
 #define LOG_STARTFILE   "/data/bootchart-start"
 #define LOG_STOPFILE    "/data/bootchart-stop"
@@ -356,6 +358,7 @@ int  bootchart_step( void )
     do_log_file(log_stat,   "/proc/stat");
     do_log_file(log_disks,  "/proc/diskstats");
     do_log_procs(log_procs);
+    boottrace_sample();
 
     /* we stop when /data/bootchart-stop contains 1 */
     {
@@ -375,4 +378,6 @@ void  bootchart_finish( void )
     file_buff_done(log_disks);
     file_buff_done(log_procs);
     acct(NULL);
+    boottrace_export(LOG_TIMELINE);
+    boottrace_stop();
 }
@@ -0,0 +1,394 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The timeline written by boottrace_export() is a text file, one line per
+ * action, command, service run or bootchart sample, in the order they
+ * started:
+ *
+ *   <start ms> <duration ms> action <trigger>
+ *   <start ms> <duration ms> command <arguments> r=<result>
+ *   <start ms> <duration ms> service <name> pid=<pid> status=<exit status>
+ *   <start ms> - sample jiffies=<uptime> cpu=<busy %> iowait=<%> running=<n>
+ *
+ * Times are CLOCK_MONOTONIC; the jiffies of a sample are those heading the
+ * matching entries of the bootchart logs. A service still running has a
+ * duration of -1 and no status. The slowest commands are listed at the end.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "init.h"
+#include "log.h"
+#include "boottrace.h"
+
+#define RING_SIZE       8192    /* events; a power of two */
+#define NAME_LEN        48
+#define SLOWEST         20
+
+enum {
+    EV_ACTION_START = 1,
+    EV_ACTION_END,
+    EV_COMMAND_START,
+    EV_COMMAND_END,
+    EV_SERVICE_START,
+    EV_SERVICE_EXIT,
+    EV_SAMPLE,
+};
+
+enum {
+    CPU_JIFFIES,    /* /proc/uptime, as bootchart logs it */
+    CPU_BUSY,       /* user, nice, system, irq and softirq */
+    CPU_IDLE,
+    CPU_IOWAIT,
+    CPU_RUNNING,    /* procs_running */
+    CPU_FIELDS,
+};
+
+typedef struct {
+    unsigned long long  ns;
+    int                 type;
+    int                 pid;    /* of a service */
+    int                 value;  /* command result or exit status */
+    union {
+        char                name[NAME_LEN];
+        unsigned long long  cpu[CPU_FIELDS];
+    } u;
+} BootEvent;
+
+static BootEvent*  ring;
+static unsigned    ring_head;  /* events recorded since the start */
+
+static unsigned long long
+now_ns(void)
+{
+    struct timespec  ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static BootEvent*
+record(int  type, int  pid, int  value)
+{
+    BootEvent*  ev;
+
+    if (!ring)
+        return NULL;
+    ev = &ring[ring_head++ & (RING_SIZE - 1)];
+    ev->ns    = now_ns();
+    ev->type  = type;
+    ev->pid   = pid;
+    ev->value = value;
+    return ev;
+}
+
+static void
+record_name(int  type, int  pid, int  value, const char*  name)
+{
+    BootEvent*  ev = record(type, pid, value);
+    if (ev) {
+        strncpy(ev->u.name, name ? name : "", NAME_LEN - 1);
+        ev->u.name[NAME_LEN - 1] = 0;
+    }
+}
+
+/* called as early as possible; events are kept until bootcharting either
+ * finishes or turns out not to be wanted */
+void  boottrace_start(void)
+{
+    if (!ring) {
+        ring = calloc(RING_SIZE, sizeof(*ring));
+        ring_head = 0;
+    }
+}
+
+void  boottrace_stop(void)
+{
+    free(ring);
+    ring = NULL;
+}
+
+void  boottrace_action_start(struct action *act)
+{
+    record_name(EV_ACTION_START, 0, 0, act->name);
+}
+
+void  boottrace_action_end(struct action *act)
+{
+    record_name(EV_ACTION_END, 0, 0, act->name);
+}
+
+void  boottrace_command_start(struct command *cmd)
+{
+    BootEvent*  ev = record(EV_COMMAND_START, 0, 0);
+    int         i, len = 0;
+
+    if (!ev)
+        return;
+    ev->u.name[0] = 0;
+    for (i = 0; i < cmd->nargs && len < NAME_LEN - 1; i++) {
+        int  n = snprintf(ev->u.name + len, NAME_LEN - len, "%s%s",
+                          i ? " " : "", cmd->args[i]);
+        if (n < 0)
+            break;
+        len += n;
+    }
+}
+
+void  boottrace_command_end(struct command *cmd, int ret)
+{
+    record(EV_COMMAND_END, 0, ret);
+}
+
+void  boottrace_service_start(struct service *svc)
+{
+    record_name(EV_SERVICE_START, svc->pid, 0, svc->name);
+}
+
+void  boottrace_service_exit(struct service *svc, int status)
+{
+    record_name(EV_SERVICE_EXIT, svc->pid, status, svc->name);
+}
+
+/* reads the cpu totals and procs_running from /proc/stat, a line at a time:
+ * with many irqs the "intr" line before procs_running alone runs to several
+ * KB. Returns 0 if both were found, -1 otherwise. */
+static int
+read_proc_stat(unsigned long long  v[7], unsigned long long*  running)
+{
+    char   line[256];
+    int    line_start = 1, have_cpu = 0, have_running = 0;
+    FILE*  f = fopen("/proc/stat", "r");
+
+    if (!f)
+        return -1;
+    while (!have_running && fgets(line, sizeof(line), f)) {
+        /* the rest of a line longer than the buffer is skipped */
+        int  start = line_start;
+        line_start = strchr(line, '\n') != NULL;
+        if (!start)
+            continue;
+        if (!strncmp(line, "cpu ", 4)) {
+            have_cpu = sscanf(line, "cpu %llu %llu %llu %llu %llu %llu %llu",
+                              &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6]) == 7;
+        } else if (!strncmp(line, "procs_running ", 14)) {
+            char*  end;
+            *running = strtoull(line + 14, &end, 10);
+            have_running = end != line + 14;
+        }
+    }
+    fclose(f);
+    return have_cpu && have_running ? 0 : -1;
+}
+
+/* called on each bootchart step, so that the timeline can show how busy
+ * the cpus were between two steps */
+void  boottrace_sample(void)
+{
+    static int  warned;
+    char        buff[64];
+    int         fd, len;
+    BootEvent*  ev;
+    unsigned long long  v[7], running;
+
+    if (!ring)
+        return;
+
+    /* a sample without the cpu fields would read as an idle machine */
+    if (read_proc_stat(v, &running) < 0) {
+        if (!warned) {
+            ERROR("boottrace: can't read cpu times from /proc/stat, not sampling\n");
+            warned = 1;
+        }
+        return;
+    }
+
+    ev = record(EV_SAMPLE, 0, 0);
+    memset(ev->u.cpu, 0, sizeof(ev->u.cpu));
+    ev->u.cpu[CPU_BUSY]    = v[0] + v[1] + v[2] + v[5] + v[6];
+    ev->u.cpu[CPU_IDLE]    = v[3];
+    ev->u.cpu[CPU_IOWAIT]  = v[4];
+    ev->u.cpu[CPU_RUNNING] = running;
+
+    fd = open("/proc/uptime", O_RDONLY);
+    if (fd >= 0) {
+        len = read(fd, buff, sizeof(buff) - 1);
+        close(fd);
+        if (len > 0) {
+            buff[len] = 0;
+            ev->u.cpu[CPU_JIFFIES] = 100LL * strtod(buff, NULL);
+        }
+    }
+}
+
+static void
+print_time(FILE*  out, unsigned long long  ns)
+{
+    unsigned long long  us = ns / 1000;
+    fprintf(out, "%llu.%03llu ", us / 1000, us % 1000);
+}
+
+static long long*  sort_dur;
+
+static int
+compare_slowest(const void*  a, const void*  b)
+{
+    long long  da = sort_dur[*(const int*)a];
+    long long  db = sort_dur[*(const int*)b];
+    return da < db ? 1 : da > db ? -1 : 0;
+}
+
+/* writes the events recorded so far as a timeline; returns 0 on success */
+int  boottrace_export(const char *path)
+{
+    FILE*       out;
+    BootEvent*  ev;
+    long long*  dur;
+    int*        status;
+    int*        slow;
+    int         count, first, i, j, nslow = 0;
+    int         action = -1, command = -1;
+    BootEvent*  prev_sample = NULL;
+
+    if (!ring)
+        return -1;
+
+    count = ring_head < RING_SIZE ? (int)ring_head : RING_SIZE;
+    first = ring_head < RING_SIZE ? 0 : (int)(ring_head & (RING_SIZE - 1));
+
+    /* lay the ring out oldest first, and work out how long everything took */
+    ev     = malloc(count * sizeof(*ev));
+    dur    = malloc(count * sizeof(*dur));
+    status = malloc(count * sizeof(*status));
+    slow   = malloc(count * sizeof(*slow));
+    out    = fopen(path, "w");
+    if (!ev || !dur || !status || !slow || !out) {
+        free(ev);
+        free(dur);
+        free(status);
+        free(slow);
+        if (out)
+            fclose(out);
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        ev[i]  = ring[(first + i) & (RING_SIZE - 1)];
+        dur[i] = -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        switch (ev[i].type) {
+        case EV_ACTION_START:
+            action = i;
+            break;
+        case EV_ACTION_END:
+            if (action >= 0)
+                dur[action] = ev[i].ns - ev[action].ns;
+            action = -1;
+            break;
+        case EV_COMMAND_START:
+            command = i;
+            break;
+        case EV_COMMAND_END:
+            if (command >= 0) {
+                dur[command] = ev[i].ns - ev[command].ns;
+                ev[command].value = ev[i].value;
+                slow[nslow++] = command;
+            }
+            command = -1;
+            break;
+        case EV_SERVICE_EXIT:
+            for (j = i - 1; j >= 0; j--) {
+                if (ev[j].type == EV_SERVICE_START && ev[j].pid == ev[i].pid) {
+                    if (dur[j] < 0) {
+                        dur[j] = ev[i].ns - ev[j].ns;
+                        status[j] = ev[i].value;
+                    }
+                    break;
+                }
+            }
+            break;
+        }
+    }
+
+    fprintf(out, "# init boot timeline, times in ms of CLOCK_MONOTONIC\n");
+    if (ring_head > RING_SIZE)
+        fprintf(out, "# %u earliest events were dropped\n", ring_head - RING_SIZE);
+
+    for (i = 0; i < count; i++) {
+        BootEvent*  e = &ev[i];
+
+        switch (e->type) {
+        case EV_ACTION_START:
+        case EV_COMMAND_START:
+        case EV_SERVICE_START:
+            print_time(out, e->ns);
+            if (dur[i] < 0)
+                fprintf(out, "-1 ");
+            else
+                print_time(out, dur[i]);
+            if (e->type == EV_ACTION_START) {
+                fprintf(out, "action %s\n", e->u.name);
+            } else if (e->type == EV_COMMAND_START) {
+                fprintf(out, "command %s r=%d\n", e->u.name, e->value);
+            } else {
+                fprintf(out, "service %s pid=%d", e->u.name, e->pid);
+                if (dur[i] >= 0)
+                    fprintf(out, " status=%d", status[i]);
+                fprintf(out, "\n");
+            }
+            break;
+        case EV_SAMPLE: {
+            int  busy = 0, iowait = 0;
+            if (prev_sample) {
+                unsigned long long  b = e->u.cpu[CPU_BUSY]   - prev_sample->u.cpu[CPU_BUSY];
+                unsigned long long  w = e->u.cpu[CPU_IOWAIT] - prev_sample->u.cpu[CPU_IOWAIT];
+                unsigned long long  total = b + w + e->u.cpu[CPU_IDLE] - prev_sample->u.cpu[CPU_IDLE];
+                if (total) {
+                    busy   = (int)(100 * b / total);
+                    iowait = (int)(100 * w / total);
+                }
+            }
+            print_time(out, e->ns);
+            fprintf(out, "- sample jiffies=%llu cpu=%d%% iowait=%d%% running=%llu\n",
+                    e->u.cpu[CPU_JIFFIES], busy, iowait, e->u.cpu[CPU_RUNNING]);
+            prev_sample = e;
+            break;
+        }
+        }
+    }
+
+    sort_dur = dur;
+    qsort(slow, nslow, sizeof(*slow), compare_slowest);
+    fprintf(out, "# slowest commands\n");
+    for (i = 0; i < nslow && i < SLOWEST; i++) {
+        fprintf(out, "# ");
+        print_time(out, dur[slow[i]]);
+        fprintf(out, "%s\n", ev[slow[i]].u.name);
+    }
+
+    fclose(out);
+    free(ev);
+    free(dur);
+    free(status);
+    free(slow);
+    return 0;
+}
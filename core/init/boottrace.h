@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _BOOTTRACE_H
+#define _BOOTTRACE_H
+
+#include "bootchart.h"
+
+/* Records what init itself does during a bootchart run: when each action,
+ * command and service started and finished. The events go into a fixed ring
+ * in memory and are written out with the bootchart samples as one timeline
+ * when bootcharting finishes. */
+
+#if BOOTCHART
+
+struct action;
+struct command;
+struct service;
+
+extern void  boottrace_start(void);
+extern void  boottrace_stop(void);
+extern void  boottrace_action_start(struct action *act);
+extern void  boottrace_action_end(struct action *act);
+extern void  boottrace_command_start(struct command *cmd);
+extern void  boottrace_command_end(struct command *cmd, int ret);
+extern void  boottrace_service_start(struct service *svc);
+extern void  boottrace_service_exit(struct service *svc, int status);
+extern void  boottrace_sample(void);
+extern int   boottrace_export(const char *path);
+
+#else
+
+# define boottrace_start()                  do {} while (0)
+# define boottrace_stop()                   do {} while (0)
+# define boottrace_action_start(act)        do {} while (0)
+# define boottrace_action_end(act)          do {} while (0)
+# define boottrace_command_start(cmd)       do {} while (0)
+# define boottrace_command_end(cmd, ret)    do {} while (0)
+# define boottrace_service_start(svc)       do {} while (0)
+# define boottrace_service_exit(svc, st)    do {} while (0)
+
+#endif /* BOOTCHART */
+
+#endif /* _BOOTTRACE_H */
@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "coldboot.h"
+
+/* Directories less than this deep below a root are queued one at a time,
+ * so the workers share out the top of the tree; deeper than that a worker
+ * walks the whole subtree by itself. */
+#define SPLIT_DEPTH     3
+
+/* How many events may be waiting in the socket before the workers hold off,
+ * and for how long at most (in case some trigger had no event after all). */
+#define WINDOW          256
+#define WINDOW_WAIT_MS  10
+
+#define MAX_WORKERS     16
+
+/* The coordinator also checks for the end of the walk this often, should
+ * the workers' note on the done pipe never arrive. */
+#define DONE_POLL_MS    100
+
+struct work {
+    struct work *next;
+    int depth;
+    char path[];
+};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;   /* work queued, or none left */
+    pthread_cond_t window_cond; /* events drained */
+    struct work *head;
+    struct work *tail;
+    int busy;                   /* directories queued or being walked */
+    int dirs;
+    int triggered;
+    int handled;
+    int inline_drain;           /* no workers: drain after each trigger */
+    const struct coldboot_ops *ops;
+    int done_pipe[2];
+} cb;
+
+int coldboot_trigger_add(int dfd, const char *path __attribute__((unused)))
+{
+    int fd = openat(dfd, "uevent", O_WRONLY);
+    if (fd < 0)
+        return -1;
+    int ret = write(fd, "add\n", 4) == 4 ? 0 : -1;
+    close(fd);
+    return ret;
+}
+
+/* Called with cb.lock held. */
+static void queue_work(const char *parent, const char *name, int depth)
+{
+    size_t len = strlen(parent) + (name ? strlen(name) + 1 : 0);
+    struct work *w = malloc(sizeof(*w) + len + 1);
+    if (!w)
+        return;
+    if (name)
+        sprintf(w->path, "%s/%s", parent, name);
+    else
+        strcpy(w->path, parent);
+    w->depth = depth;
+    w->next = NULL;
+    if (cb.tail)
+        cb.tail->next = w;
+    else
+        cb.head = w;
+    cb.tail = w;
+    cb.busy++;
+    pthread_cond_signal(&cb.work_cond);
+}
+
+static void trigger(int dfd, const char *path)
+{
+    int triggered = !cb.ops->trigger(dfd, path);
+
+    if (cb.inline_drain) {
+        cb.dirs++;
+        cb.triggered += triggered;
+        if (triggered)
+            cb.handled += cb.ops->drain();
+        return;
+    }
+
+    pthread_mutex_lock(&cb.lock);
+    cb.dirs++;
+    cb.triggered += triggered;
+    while (cb.triggered - cb.handled >= WINDOW) {
+        struct timeval now;
+        struct timespec until;
+        gettimeofday(&now, NULL);
+        until.tv_sec = now.tv_sec;
+        until.tv_nsec = now.tv_usec * 1000 + WINDOW_WAIT_MS * 1000000;
+        if (until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+        if (pthread_cond_timedwait(&cb.window_cond, &cb.lock, &until) == ETIMEDOUT)
+            break;
+    }
+    pthread_mutex_unlock(&cb.lock);
+}
+
+/* path is a PATH_MAX buffer holding the name of d, len characters long. */
+static void walk(char *path, size_t len, DIR *d, int depth)
+{
+    struct dirent *de;
+    int dfd = dirfd(d);
+
+    trigger(dfd, path);
+
+    while ((de = readdir(d))) {
+        if (de->d_type != DT_DIR || de->d_name[0] == '.')
+            continue;
+
+        if (depth + 1 < SPLIT_DEPTH && !cb.inline_drain) {
+            pthread_mutex_lock(&cb.lock);
+            queue_work(path, de->d_name, depth + 1);
+            pthread_mutex_unlock(&cb.lock);
+            continue;
+        }
+
+        size_t name_len = strlen(de->d_name);
+        if (len + 1 + name_len >= PATH_MAX)
+            continue;
+        int fd = openat(dfd, de->d_name, O_RDONLY | O_DIRECTORY);
+        if (fd < 0)
+            continue;
+        DIR *d2 = fdopendir(fd);
+        if (!d2) {
+            close(fd);
+            continue;
+        }
+        path[len] = '/';
+        memcpy(path + len + 1, de->d_name, name_len + 1);
+        walk(path, len + 1 + name_len, d2, depth + 1);
+        path[len] = '\0';
+        closedir(d2);
+    }
+}
+
+static void tell_done(void)
+{
+    ssize_t n;
+    do {
+        n = write(cb.done_pipe[1], "", 1);
+    } while (n < 0 && errno == EINTR);
+    /* On failure the coordinator still finds cb.busy at 0 within
+     * DONE_POLL_MS. */
+}
+
+static void *worker(void *arg __attribute__((unused)))
+{
+    char path[PATH_MAX];
+
+    pthread_mutex_lock(&cb.lock);
+    for (;;) {
+        while (!cb.head && cb.busy)
+            pthread_cond_wait(&cb.work_cond, &cb.lock);
+        if (!cb.head)
+            break;
+
+        struct work *w = cb.head;
+        cb.head = w->next;
+        if (!cb.head)
+            cb.tail = NULL;
+        pthread_mutex_unlock(&cb.lock);
+
+        DIR *d = NULL;
+        if (strlen(w->path) < sizeof(path)) {
+            strcpy(path, w->path);
+            d = opendir(path);
+        }
+        if (d) {
+            walk(path, strlen(path), d, w->depth);
+            closedir(d);
+        }
+        free(w);
+
+        pthread_mutex_lock(&cb.lock);
+        if (--cb.busy == 0) {
+            pthread_cond_broadcast(&cb.work_cond);
+            if (!cb.inline_drain)
+                tell_done();
+        }
+    }
+    pthread_mutex_unlock(&cb.lock);
+    return NULL;
+}
+
+static void drain(void)
+{
+    int n = cb.ops->drain();
+    pthread_mutex_lock(&cb.lock);
+    cb.handled += n;
+    pthread_cond_broadcast(&cb.window_cond);
+    pthread_mutex_unlock(&cb.lock);
+}
+
+void coldboot_run(const char **paths, int npaths, int nworkers,
+                  const struct coldboot_ops *ops, struct coldboot_stats *stats)
+{
+    pthread_t threads[MAX_WORKERS];
+    int i, started = 0;
+
+    memset(&cb, 0, sizeof(cb));
+    pthread_mutex_init(&cb.lock, NULL);
+    pthread_cond_init(&cb.work_cond, NULL);
+    pthread_cond_init(&cb.window_cond, NULL);
+    cb.ops = ops;
+
+    for (i = 0; i < npaths; i++)
+        queue_work(paths[i], NULL, 0);
+
+    if (nworkers > MAX_WORKERS)
+        nworkers = MAX_WORKERS;
+    if (cb.busy && !pipe(cb.done_pipe)) {
+        for (started = 0; started < nworkers; started++) {
+            if (pthread_create(&threads[started], NULL, worker, NULL))
+                break;
+        }
+        if (!started) {
+            close(cb.done_pipe[0]);
+            close(cb.done_pipe[1]);
+        }
+    }
+
+    if (!started) {
+        /* Walk everything on this thread, as coldboot used to. */
+        cb.inline_drain = 1;
+        worker(NULL);
+    } else {
+        struct pollfd fds[2];
+        fds[0].fd = ops->event_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = cb.done_pipe[0];
+        fds[1].events = POLLIN;
+        for (;;) {
+            int done;
+            fds[0].revents = fds[1].revents = 0;
+            if (poll(fds, 2, DONE_POLL_MS) < 0) {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+            if (fds[0].revents)
+                drain();
+            if (fds[1].revents)
+                break;
+            pthread_mutex_lock(&cb.lock);
+            done = cb.busy == 0;
+            pthread_mutex_unlock(&cb.lock);
+            if (done)
+                break;
+        }
+        for (i = 0; i < started; i++)
+            pthread_join(threads[i], NULL);
+        close(cb.done_pipe[0]);
+        close(cb.done_pipe[1]);
+    }
+
+    /* The kernel queues the event before the write returns, so whatever
+     * the last triggers caused is already waiting. */
+    drain();
+
+    if (stats) {
+        stats->workers = started;
+        stats->dirs = cb.dirs;
+        stats->triggered = cb.triggered;
+        stats->handled = cb.handled;
+    }
+    pthread_cond_destroy(&cb.window_cond);
+    pthread_cond_destroy(&cb.work_cond);
+    pthread_mutex_destroy(&cb.lock);
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_COLDBOOT_H
+#define _INIT_COLDBOOT_H
+
+struct coldboot_ops {
+    /* Called from the worker threads for each directory holding a uevent
+     * file: pokes it, and returns 0 if an event will follow. dfd is the
+     * directory, path its name for diagnostics. */
+    int (*trigger)(int dfd, const char *path);
+
+    /* Called on the thread running coldboot whenever event_fd is readable:
+     * handles the pending events and returns how many there were. */
+    int (*drain)(void);
+
+    int event_fd;
+};
+
+struct coldboot_stats {
+    int workers;
+    int dirs;       /* directories visited */
+    int triggered;  /* uevents triggered */
+    int handled;    /* events drained */
+};
+
+/* The default trigger: writes "add" to the uevent file. */
+int coldboot_trigger_add(int dfd, const char *path);
+
+/* Walks the trees under the given paths with several worker threads,
+ * triggering the uevent of every directory that has one, while the calling
+ * thread handles the resulting events. A directory's uevent is always
+ * triggered before those of its subdirectories. Workers stop triggering
+ * while more than a window of events is waiting to be drained, so that the
+ * socket does not overrun. */
+void coldboot_run(const char **paths, int npaths, int nworkers,
+                  const struct coldboot_ops *ops, struct coldboot_stats *stats);
+
+#endif /* _INIT_COLDBOOT_H */
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs coldboot over a synthetic sysfs tree: directories with uevent files,
+ * a few without, and symlinks that must not be followed. Each trigger writes
+ * a byte to a pipe standing in for the netlink socket. Checks that every
+ * uevent was triggered exactly once and always after its parent's, and
+ * prints how long the walk took with one worker and with several.
+ *
+ *   coldboot_test [-w workers] [-f fanout] [-d depth] [-u trigger cost in us]
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "coldboot.h"
+
+struct triggered {
+    char *path;
+    int seq;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct triggered *log_entries;
+static int log_count;
+static int log_capacity;
+static int event_pipe[2];
+static int outstanding;
+static int max_outstanding;
+static int trigger_cost_us;
+
+static long long now_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static int test_trigger(int dfd, const char *path)
+{
+    if (coldboot_trigger_add(dfd, path))
+        return -1;
+    if (trigger_cost_us)
+        usleep(trigger_cost_us);
+
+    pthread_mutex_lock(&lock);
+    if (log_count == log_capacity) {
+        log_capacity = log_capacity ? log_capacity * 2 : 1024;
+        log_entries = realloc(log_entries, log_capacity * sizeof(*log_entries));
+    }
+    log_entries[log_count].path = strdup(path);
+    log_entries[log_count].seq = log_count;
+    log_count++;
+    if (++outstanding > max_outstanding)
+        max_outstanding = outstanding;
+    pthread_mutex_unlock(&lock);
+
+    return write(event_pipe[1], "e", 1) == 1 ? 0 : -1;
+}
+
+static int test_drain(void)
+{
+    char buf[256];
+    int total = 0;
+    ssize_t n;
+    while ((n = read(event_pipe[0], buf, sizeof(buf))) > 0)
+        total += n;
+    pthread_mutex_lock(&lock);
+    outstanding -= total;
+    pthread_mutex_unlock(&lock);
+    return total;
+}
+
+/* Builds fanout^depth directories; every seventh has no uevent file, and
+ * each level also gets a symlink back up the tree. Returns the number of
+ * uevent files. */
+static int build_tree(char *path, int fanout, int depth, int *counter)
+{
+    int uevents = 0;
+    char file[PATH_MAX];
+
+    if (mkdir(path, 0755) && errno != EEXIST)
+        return 0;
+    if ((*counter)++ % 7) {
+        snprintf(file, sizeof(file), "%s/uevent", path);
+        int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            close(fd);
+            uevents++;
+        }
+    }
+    if (!depth)
+        return uevents;
+
+    snprintf(file, sizeof(file), "%s/link", path);
+    symlink("..", file);
+
+    size_t len = strlen(path);
+    for (int i = 0; i < fanout; i++) {
+        snprintf(path + len, PATH_MAX - len, "/dev%d", i);
+        uevents += build_tree(path, fanout, depth - 1, counter);
+        path[len] = '\0';
+    }
+    return uevents;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(((const struct triggered *) a)->path, ((const struct triggered *) b)->path);
+}
+
+/* Returns the number of problems found. */
+static int check_log(int expected)
+{
+    int errors = 0;
+
+    qsort(log_entries, log_count, sizeof(*log_entries), compare_paths);
+    for (int i = 0; i < log_count; i++) {
+        if (i && !strcmp(log_entries[i].path, log_entries[i - 1].path)) {
+            fprintf(stderr, "triggered twice: %s\n", log_entries[i].path);
+            errors++;
+        }
+
+        /* Find the nearest ancestor that was triggered. */
+        char parent[PATH_MAX];
+        strcpy(parent, log_entries[i].path);
+        char *slash;
+        while ((slash = strrchr(parent, '/')) && slash != parent) {
+            *slash = '\0';
+            struct triggered key = { parent, 0 };
+            struct triggered *found = bsearch(&key, log_entries, log_count,
+                                              sizeof(*log_entries), compare_paths);
+            if (found) {
+                if (found->seq > log_entries[i].seq) {
+                    fprintf(stderr, "%s triggered before its parent\n", log_entries[i].path);
+                    errors++;
+                }
+                break;
+            }
+        }
+    }
+    if (log_count != expected) {
+        fprintf(stderr, "triggered %d uevents, expected %d\n", log_count, expected);
+        errors++;
+    }
+    return errors;
+}
+
+static int run(const char *root, int workers, int expected)
+{
+    struct coldboot_ops ops = { test_trigger, test_drain, event_pipe[0] };
+    struct coldboot_stats stats;
+    const char *paths[] = { root };
+
+    for (int i = 0; i < log_count; i++)
+        free(log_entries[i].path);
+    log_count = 0;
+    outstanding = max_outstanding = 0;
+
+    long long t0 = now_us();
+    coldboot_run(paths, 1, workers, &ops, &stats);
+    long long t1 = now_us();
+
+    printf("coldboot %lld uS with %d workers: %d dirs, %d triggered, %d handled, "
+           "at most %d waiting\n", t1 - t0, stats.workers, stats.dirs, stats.triggered,
+           stats.handled, max_outstanding);
+
+    int errors = check_log(expected);
+    if (stats.handled != stats.triggered) {
+        fprintf(stderr, "handled %d events, triggered %d\n", stats.handled, stats.triggered);
+        errors++;
+    }
+    return errors;
+}
+
+static void remove_tree(const char *path)
+{
+    DIR *d = opendir(path);
+    if (d) {
+        struct dirent *de;
+        while ((de = readdir(d))) {
+            if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+                continue;
+            char child[PATH_MAX];
+            snprintf(child, sizeof(child), "%s/%s", path, de->d_name);
+            if (de->d_type == DT_DIR)
+                remove_tree(child);
+            else
+                unlink(child);
+        }
+        closedir(d);
+    }
+    rmdir(path);
+}
+
+int main(int argc, char **argv)
+{
+    int workers = 4, fanout = 5, depth = 5;
+    int c;
+
+    while ((c = getopt(argc, argv, "w:f:d:u:")) != -1) {
+        switch (c) {
+        case 'w': workers = atoi(optarg); break;
+        case 'f': fanout = atoi(optarg); break;
+        case 'd': depth = atoi(optarg); break;
+        case 'u': trigger_cost_us = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-w workers] [-f fanout] [-d depth] "
+                    "[-u trigger cost in us]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    char root[PATH_MAX];
+    snprintf(root, sizeof(root), "%s/coldboot_test.%d",
+             getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp", getpid());
+    int counter = 0;
+    char path[PATH_MAX];
+    strcpy(path, root);
+    int expected = build_tree(path, fanout, depth, &counter);
+
+    if (pipe(event_pipe))
+        return 1;
+    fcntl(event_pipe[0], F_SETFL, O_NONBLOCK);
+
+    int errors = run(root, 0, expected);
+    errors += run(root, 1, expected);
+    errors += run(root, workers, expected);
+
+    remove_tree(root);
+    printf("%s\n", errors ? "FAILED" : "PASSED");
+    return errors ? 1 : 0;
+}
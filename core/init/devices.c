@@ -44,7 +44,9 @@
 #include <cutils/list.h>
 #include <cutils/uevent.h>
 
+#include "coldboot.h"
 #include "devices.h"
+#include "perms.h"
 #include "util.h"
 #include "log.h"
 
@@ -53,6 +55,9 @@
 #define FIRMWARE_DIR2   "/vendor/firmware"
 #define FIRMWARE_DIR3   "/firmware/image"
 
+#define UEVENT_SOCKET_BUF_SZ    (1024*1024)
+#define COLDBOOT_MAX_WORKERS    8
+
 #ifdef HAVE_SELINUX
 extern struct selabel_handle *sehandle;
 #endif
@@ -71,110 +76,63 @@ struct uevent {
     int minor;
 };
 
-struct perms_ {
-    char *name;
-    char *attr;
-    mode_t perm;
-    unsigned int uid;
-    unsigned int gid;
-    unsigned short prefix;
-};
-
-struct perm_node {
-    struct perms_ dp;
-    struct listnode plist;
-};
-
 struct platform_node {
     char *name;
     int name_len;
     struct listnode list;
 };
 
-static list_declare(sys_perms);
-static list_declare(dev_perms);
+/* The /sys rules are looked up by uevent path, which lacks the "/sys". */
+static struct perms_table sys_perms = PERMS_TABLE_INIT(4);
+static struct perms_table dev_perms = PERMS_TABLE_INIT(0);
 static list_declare(platform_names);
 
 int add_dev_perms(const char *name, const char *attr,
                   mode_t perm, unsigned int uid, unsigned int gid,
                   unsigned short prefix) {
-    struct perm_node *node = calloc(1, sizeof(*node));
-    if (!node)
-        return -ENOMEM;
-
-    node->dp.name = strdup(name);
-    if (!node->dp.name)
-        return -ENOMEM;
-
-    if (attr) {
-        node->dp.attr = strdup(attr);
-        if (!node->dp.attr)
-            return -ENOMEM;
-    }
-
-    node->dp.perm = perm;
-    node->dp.uid = uid;
-    node->dp.gid = gid;
-    node->dp.prefix = prefix;
-
-    if (attr)
-        list_add_tail(&sys_perms, &node->plist);
-    else
-        list_add_tail(&dev_perms, &node->plist);
-
-    return 0;
+    return perms_table_add(attr ? &sys_perms : &dev_perms,
+                           name, attr, perm, uid, gid, prefix);
 }
 
 void fixup_sys_perms(const char *upath)
 {
     char buf[512];
-    struct listnode *node;
-    struct perms_ *dp;
-
-        /* upaths omit the "/sys" that paths in this list
-         * contain, so we add 4 when comparing...
-         */
-    list_for_each(node, &sys_perms) {
-        dp = &(node_to_item(node, struct perm_node, plist))->dp;
-        if (dp->prefix) {
-            if (strncmp(upath, dp->name + 4, strlen(dp->name + 4)))
-                continue;
-        } else {
-            if (strcmp(upath, dp->name + 4))
-                continue;
+    const struct perms_ *local[16];
+    const struct perms_ **matches = local;
+    const struct perms_ *dp;
+    int i, n;
+
+    n = perms_table_find_all(&sys_perms, upath, matches, 16);
+    if (n > 16) {
+        /* rare, but every matching rule still applies */
+        matches = malloc(n * sizeof(*matches));
+        if (!matches) {
+            ERROR("out of memory fixing up %s\n", upath);
+            return;
         }
-
+        perms_table_find_all(&sys_perms, upath, matches, n);
+    }
+    for (i = 0; i < n; i++) {
+        dp = matches[i];
         if ((strlen(upath) + strlen(dp->attr) + 6) > sizeof(buf))
-            return;
+            break;
 
         sprintf(buf,"/sys%s/%s", upath, dp->attr);
         INFO("fixup %s %d %d 0%o\n", buf, dp->uid, dp->gid, dp->perm);
         chown(buf, dp->uid, dp->gid);
         chmod(buf, dp->perm);
     }
+    if (matches != local)
+        free(matches);
 }
 
 static mode_t get_device_perm(const char *path, unsigned *uid, unsigned *gid)
 {
-    mode_t perm;
-    struct listnode *node;
-    struct perm_node *perm_node;
-    struct perms_ *dp;
-
-    /* search the perms list in reverse so that ueventd.$hardware can
+    /* the last matching rule wins so that ueventd.$hardware can
      * override ueventd.rc
      */
-    list_for_each_reverse(node, &dev_perms) {
-        perm_node = node_to_item(node, struct perm_node, plist);
-        dp = &perm_node->dp;
-
-        if (dp->prefix) {
-            if (strncmp(path, dp->name, strlen(dp->name)))
-                continue;
-        } else {
-            if (strcmp(path, dp->name))
-                continue;
-        }
+    const struct perms_ *dp = perms_table_find_last(&dev_perms, path);
+    if (dp) {
         *uid = dp->uid;
         *gid = dp->gid;
         return dp->perm;
@@ -786,6 +744,54 @@ root_free_out:
     free(root);
 }
 
+struct firmware_node {
+    char *path;
+    char *firmware;
+    struct listnode list;
+};
+
+static int coldboot_running;
+static list_declare(deferred_firmware);
+
+static void defer_firmware_event(struct uevent *uevent)
+{
+    struct firmware_node *node = malloc(sizeof(*node));
+    if (!node)
+        return;
+    node->path = strdup(uevent->path);
+    node->firmware = strdup(uevent->firmware);
+    if (!node->path || !node->firmware) {
+        free(node->path);
+        free(node->firmware);
+        free(node);
+        return;
+    }
+    list_add_tail(&deferred_firmware, &node->list);
+}
+
+static void handle_firmware_event(struct uevent *uevent);
+
+static void handle_deferred_firmware_events(void)
+{
+    while (!list_empty(&deferred_firmware)) {
+        struct listnode *node = list_head(&deferred_firmware);
+        struct firmware_node *fw = node_to_item(node, struct firmware_node, list);
+        struct uevent uevent;
+
+        memset(&uevent, 0, sizeof(uevent));
+        uevent.action = "add";
+        uevent.subsystem = "firmware";
+        uevent.path = fw->path;
+        uevent.firmware = fw->firmware;
+        handle_firmware_event(&uevent);
+
+        list_remove(node);
+        free(fw->path);
+        free(fw->firmware);
+        free(fw);
+    }
+}
+
 static void handle_firmware_event(struct uevent *uevent)
 {
     pid_t pid;
@@ -797,6 +803,13 @@ static void handle_firmware_event(struct uevent *uevent)
     if(strcmp(uevent->action, "add"))
         return;
 
+    /* forking while the coldboot workers may hold the malloc lock is
+     * not safe, so firmware requests wait until they are done */
+    if (coldboot_running) {
+        defer_firmware_event(uevent);
+        return;
+    }
+
     /* we fork, to avoid making large memory allocations in init proper */
     pid = fork();
     if (!pid) {
@@ -806,11 +819,12 @@ static void handle_firmware_event(struct uevent *uevent)
 }
 
 #define UEVENT_MSG_LEN  1024
-void handle_device_fd()
+static int drain_uevents(void)
 {
     char msg[UEVENT_MSG_LEN+2];
-    int n;
+    int n, count = 0;
     while ((n = uevent_kernel_multicast_recv(device_fd, msg, UEVENT_MSG_LEN)) > 0) {
+        count++;
         if(n >= UEVENT_MSG_LEN)   /* overflow -- discard */
             continue;
 
@@ -823,63 +837,58 @@ void handle_device_fd()
         handle_device_event(&uevent);
         handle_firmware_event(&uevent);
     }
+    if (n < 0 && errno == ENOBUFS)
+        ERROR("uevent socket overrun, events were lost\n");
+    return count;
+}
+
+void handle_device_fd()
+{
+    drain_uevents();
 }
 
 /* Coldboot walks parts of the /sys tree and pokes the uevent files
 ** to cause the kernel to regenerate device add events that happened
 ** before init's device manager was started
 **
-** We drain any pending events from the netlink socket every time
-** we poke another uevent file to make sure we don't overrun the
-** socket's buffer.  
+** Several workers walk the tree and poke the uevent files while this
+** thread drains the netlink socket and handles the events, so that
+** the socket's buffer is not overrun; see coldboot.c.
 */
 
-static void do_coldboot(DIR *d)
-{
-    struct dirent *de;
-    int dfd, fd;
-
-    dfd = dirfd(d);
-
-    fd = openat(dfd, "uevent", O_WRONLY);
-    if(fd >= 0) {
-        write(fd, "add\n", 4);
-        close(fd);
-        handle_device_fd();
-    }
-
-    while((de = readdir(d))) {
-        DIR *d2;
-
-        if(de->d_type != DT_DIR || de->d_name[0] == '.')
-            continue;
-
-        fd = openat(dfd, de->d_name, O_RDONLY | O_DIRECTORY);
-        if(fd < 0)
-            continue;
-
-        d2 = fdopendir(fd);
-        if(d2 == 0)
-            close(fd);
-        else {
-            do_coldboot(d2);
-            closedir(d2);
-        }
-    }
-}
-
-static void coldboot(const char *path)
+static void coldboot(void)
 {
-    DIR *d = opendir(path);
-    if(d) {
-        do_coldboot(d);
-        closedir(d);
-    }
+    static const char *paths[] = { "/sys/class", "/sys/block", "/sys/devices" };
+    struct coldboot_ops ops;
+    struct coldboot_stats stats;
+    suseconds_t t0, t1;
+    long cpus;
+    int workers;
+
+    ops.trigger = coldboot_trigger_add;
+    ops.drain = drain_uevents;
+    ops.event_fd = device_fd;
+
+    /* Writing a uevent file can block in the driver, so use more
+     * workers than cpus. */
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = cpus > 0 ? cpus * 2 : 2;
+    if (workers > COLDBOOT_MAX_WORKERS)
+        workers = COLDBOOT_MAX_WORKERS;
+
+    t0 = get_usecs();
+    coldboot_running = 1;
+    coldboot_run(paths, ARRAY_SIZE(paths), workers, &ops, &stats);
+    coldboot_running = 0;
+    t1 = get_usecs();
+    handle_deferred_firmware_events();
+
+    log_event_print("coldboot %ld uS (%d uevents from %d directories, %d workers)\n",
+                    ((long) (t1 - t0)), stats.handled, stats.dirs, stats.workers);
 }
 
 void device_init(void)
 {
-    suseconds_t t0, t1;
     struct stat info;
     int fd;
 #ifdef HAVE_SELINUX
@@ -888,8 +897,8 @@ void device_init(void)
         sehandle = selinux_android_file_context_handle();
     }
 #endif
-    /* is 64K enough? udev uses 16MB! */
-    device_fd = uevent_open_socket(64*1024, true);
+    /* coldboot can have a few hundred events in flight; udev uses 16MB */
+    device_fd = uevent_open_socket(UEVENT_SOCKET_BUF_SZ, true);
     if(device_fd < 0)
         return;
 
@@ -897,14 +906,9 @@ void device_init(void)
     fcntl(device_fd, F_SETFL, O_NONBLOCK);
 
     if (stat(coldboot_done, &info) < 0) {
-        t0 = get_usecs();
-        coldboot("/sys/class");
-        coldboot("/sys/block");
-        coldboot("/sys/devices");
-        t1 = get_usecs();
+        coldboot();
         fd = open(coldboot_done, O_WRONLY|O_CREAT, 0000);
         close(fd);
-        log_event_print("coldboot %ld uS\n", ((long) (t1 - t0)));
     } else {
         log_event_print("skipping coldboot, already done\n");
     }
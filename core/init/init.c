@@ -56,6 +56,7 @@
 #include "log.h"
 #include "property_service.h"
 #include "bootchart.h"
+#include "boottrace.h"
 #include "signal_handler.h"
 #include "keychords.h"
 #include "init_parser.h"
@@ -464,6 +465,7 @@ void service_start(struct service *svc, const char *dynamic_args)
     svc->time_started = gettime();
     svc->pid = pid;
     svc->flags |= SVC_RUNNING;
+    boottrace_service_start(svc);
 
     if (properties_inited())
         notify_service_state(svc->name, "running");
@@ -663,16 +665,23 @@ void execute_one_command(void)
         if (!cur_action)
             return;
         INFO("processing action %p (%s)\n", cur_action, cur_action->name);
+        boottrace_action_start(cur_action);
         cur_command = get_first_command(cur_action);
     } else {
         cur_command = get_next_command(cur_action, cur_command);
     }
 
-    if (!cur_command)
+    if (!cur_command) {
+        boottrace_action_end(cur_action);
         return;
+    }
 
+    boottrace_command_start(cur_command);
     ret = cur_command->func(cur_command->nargs, cur_command->args);
+    boottrace_command_end(cur_command, ret);
     INFO("command '%s' r=%d\n", cur_command->args[0], ret);
+    if (is_last_command(cur_action, cur_command))
+        boottrace_action_end(cur_action);
 }
 
 static int wait_for_coldboot_done_action(int nargs, char **args)
@@ -897,6 +906,10 @@ static int bootchart_init_action(int nargs, char **args)
     } else {
         NOTICE("bootcharting ignored\n");
     }
+    if (bootchart_count <= 0) {
+        /* nobody wants the timeline */
+        boottrace_stop();
+    }
 
     return 0;
 }
@@ -1037,6 +1050,7 @@ int main(int argc, char **argv)
          */
     open_devnull_stdio();
     klog_init();
+    boottrace_start();
     property_init();
 
     get_hardware_name(hardware, &revision);
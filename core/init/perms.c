@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "perms.h"
+
+/* More matches than this for one path and find_all scans the rules. */
+#define MAX_MATCHES 64
+
+struct perms_trie_node {
+    int child;      /* first child, or 0 */
+    int sibling;    /* next child of the same parent, or 0 */
+    int rule;       /* newest prefix rule ending here, or -1 */
+    unsigned char c;
+};
+
+int perms_table_add(struct perms_table *t, const char *name, const char *attr,
+                    mode_t perm, unsigned int uid, unsigned int gid,
+                    unsigned short prefix)
+{
+    struct perms_ *dp;
+
+    if (t->count == t->capacity) {
+        int capacity = t->capacity ? t->capacity * 2 : 64;
+        struct perms_ *rules = realloc(t->rules, capacity * sizeof(*rules));
+        if (!rules)
+            return -ENOMEM;
+        t->rules = rules;
+        t->capacity = capacity;
+    }
+
+    dp = &t->rules[t->count];
+    memset(dp, 0, sizeof(*dp));
+    dp->name = strdup(name);
+    if (!dp->name)
+        return -ENOMEM;
+
+    if (attr) {
+        dp->attr = strdup(attr);
+        if (!dp->attr) {
+            free(dp->name);
+            return -ENOMEM;
+        }
+    }
+
+    dp->perm = perm;
+    dp->uid = uid;
+    dp->gid = gid;
+    dp->prefix = prefix;
+
+    t->count++;
+    t->compiled = 0;
+    return 0;
+}
+
+static const char *key(const struct perms_table *t, int i)
+{
+    const char *name = t->rules[i].name;
+    size_t len = strlen(name);
+    return name + (len < (size_t) t->key_skip ? len : (size_t) t->key_skip);
+}
+
+static unsigned int hash(const char *s)
+{
+    unsigned int h = 2166136261u;
+    while (*s)
+        h = (h ^ (unsigned char) *s++) * 16777619u;
+    return h;
+}
+
+static int matches(const struct perms_table *t, int i, const char *path)
+{
+    const char *k = key(t, i);
+    if (t->rules[i].prefix)
+        return !strncmp(path, k, strlen(k));
+    return !strcmp(path, k);
+}
+
+static void release_index(struct perms_table *t)
+{
+    free(t->buckets);
+    free(t->next);
+    free(t->trie);
+    t->buckets = NULL;
+    t->next = NULL;
+    t->trie = NULL;
+    t->bucket_mask = 0;
+    t->trie_count = 0;
+}
+
+static void trie_insert(struct perms_table *t, const char *k, int rule)
+{
+    int node = 0;
+
+    for (; *k; k++) {
+        unsigned char c = *k;
+        int child = t->trie[node].child;
+        while (child && t->trie[child].c != c)
+            child = t->trie[child].sibling;
+        if (!child) {
+            child = t->trie_count++;
+            t->trie[child].c = c;
+            t->trie[child].child = 0;
+            t->trie[child].rule = -1;
+            t->trie[child].sibling = t->trie[node].child;
+            t->trie[node].child = child;
+        }
+        node = child;
+    }
+    t->next[rule] = t->trie[node].rule;
+    t->trie[node].rule = rule;
+}
+
+/* Builds the index, or leaves compiled unset if out of memory so that the
+ * lookups scan the rules instead. */
+static void compile(struct perms_table *t)
+{
+    int i, exact = 0, nodes = 1;
+    unsigned int nbuckets = 16;
+
+    release_index(t);
+
+    for (i = 0; i < t->count; i++) {
+        if (t->rules[i].prefix)
+            nodes += strlen(key(t, i));
+        else
+            exact++;
+    }
+    while (nbuckets < (unsigned int) exact * 2)
+        nbuckets *= 2;
+
+    t->buckets = malloc(nbuckets * sizeof(*t->buckets));
+    t->next = malloc((t->count ? t->count : 1) * sizeof(*t->next));
+    t->trie = malloc(nodes * sizeof(*t->trie));
+    if (!t->buckets || !t->next || !t->trie) {
+        release_index(t);
+        return;
+    }
+    memset(t->buckets, 0xff, nbuckets * sizeof(*t->buckets));
+    t->bucket_mask = nbuckets - 1;
+    t->trie[0].child = 0;
+    t->trie[0].sibling = 0;
+    t->trie[0].rule = -1;
+    t->trie[0].c = 0;
+    t->trie_count = 1;
+
+    /* Rules go in oldest first, so each chain runs newest to oldest. */
+    for (i = 0; i < t->count; i++) {
+        if (t->rules[i].prefix) {
+            trie_insert(t, key(t, i), i);
+        } else {
+            unsigned int b = hash(key(t, i)) & t->bucket_mask;
+            t->next[i] = t->buckets[b];
+            t->buckets[b] = i;
+        }
+    }
+    t->compiled = 1;
+}
+
+const struct perms_ *perms_table_find_last(struct perms_table *t,
+                                           const char *path)
+{
+    int i, best = -1, node;
+    const char *p;
+
+    if (!t->compiled)
+        compile(t);
+    if (!t->compiled) {
+        for (i = t->count - 1; i >= 0; i--) {
+            if (matches(t, i, path))
+                return &t->rules[i];
+        }
+        return NULL;
+    }
+
+    for (i = t->buckets[hash(path) & t->bucket_mask]; i >= 0; i = t->next[i]) {
+        if (!strcmp(path, key(t, i))) {
+            best = i;
+            break;
+        }
+    }
+
+    /* Every node on the way down is a prefix of path; the newest rule of
+     * each is the only one that can win. */
+    node = 0;
+    p = path;
+    for (;;) {
+        if (t->trie[node].rule > best)
+            best = t->trie[node].rule;
+        if (!*p)
+            break;
+        node = t->trie[node].child;
+        while (node && t->trie[node].c != (unsigned char) *p)
+            node = t->trie[node].sibling;
+        if (!node)
+            break;
+        p++;
+    }
+
+    return best >= 0 ? &t->rules[best] : NULL;
+}
+
+static int find_all_linear(struct perms_table *t, const char *path,
+                           const struct perms_ **matches_out, int max)
+{
+    int i, n = 0;
+    for (i = 0; i < t->count; i++) {
+        if (matches(t, i, path)) {
+            if (n < max)
+                matches_out[n] = &t->rules[i];
+            n++;
+        }
+    }
+    return n;
+}
+
+int perms_table_find_all(struct perms_table *t, const char *path,
+                         const struct perms_ **matches_out, int max)
+{
+    int found[MAX_MATCHES];
+    int i, j, n = 0, node;
+    const char *p;
+
+    if (!t->compiled)
+        compile(t);
+    if (!t->compiled)
+        return find_all_linear(t, path, matches_out, max);
+
+    for (i = t->buckets[hash(path) & t->bucket_mask]; i >= 0; i = t->next[i]) {
+        if (!strcmp(path, key(t, i))) {
+            if (n == MAX_MATCHES)
+                return find_all_linear(t, path, matches_out, max);
+            found[n++] = i;
+        }
+    }
+
+    node = 0;
+    p = path;
+    for (;;) {
+        for (i = t->trie[node].rule; i >= 0; i = t->next[i]) {
+            if (n == MAX_MATCHES)
+                return find_all_linear(t, path, matches_out, max);
+            found[n++] = i;
+        }
+        if (!*p)
+            break;
+        node = t->trie[node].child;
+        while (node && t->trie[node].c != (unsigned char) *p)
+            node = t->trie[node].sibling;
+        if (!node)
+            break;
+        p++;
+    }
+
+    /* Back into parse order; there are rarely more than a handful. */
+    for (i = 1; i < n; i++) {
+        int v = found[i];
+        for (j = i; j > 0 && found[j - 1] > v; j--)
+            found[j] = found[j - 1];
+        found[j] = v;
+    }
+    for (i = 0; i < n && i < max; i++)
+        matches_out[i] = &t->rules[found[i]];
+    return n;
+}
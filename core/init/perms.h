@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_PERMS_H
+#define _INIT_PERMS_H
+
+#include <sys/types.h>
+
+struct perms_ {
+    char *name;
+    char *attr;
+    mode_t perm;
+    unsigned int uid;
+    unsigned int gid;
+    unsigned short prefix;
+};
+
+struct perms_trie_node;
+
+/*
+ * The rules from ueventd.rc, in the order they were parsed. A rule matches a
+ * path equal to its name, or, for prefix rules (those whose name ended in
+ * '*'), any path starting with it. The first key_skip characters of each name
+ * are not part of what is matched, so that the /sys rules can be looked up by
+ * uevent path.
+ *
+ * Lookups go through an index built on first use after rules were added: a
+ * hash of the exact names and a trie of the prefixes, both holding rule
+ * numbers so that the parse order decides between several matches.
+ */
+struct perms_table {
+    struct perms_ *rules;
+    int count;
+    int capacity;
+    int key_skip;
+
+    int compiled;
+    int *buckets;                   /* newest exact rule per hash bucket */
+    unsigned int bucket_mask;
+    int *next;                      /* next older rule in a bucket or trie node */
+    struct perms_trie_node *trie;   /* trie[0] is the root */
+    int trie_count;
+};
+
+#define PERMS_TABLE_INIT(skip) { NULL, 0, 0, (skip), 0, NULL, 0, NULL, NULL, 0 }
+
+int perms_table_add(struct perms_table *t, const char *name, const char *attr,
+                    mode_t perm, unsigned int uid, unsigned int gid,
+                    unsigned short prefix);
+
+/* Returns the last rule matching path, or NULL. */
+const struct perms_ *perms_table_find_last(struct perms_table *t,
+                                           const char *path);
+
+/* Stores the rules matching path in the order they were added, up to max of
+ * them, and returns how many there are in all. */
+int perms_table_find_all(struct perms_table *t, const char *path,
+                         const struct perms_ **matches, int max);
+
+#endif /* _INIT_PERMS_H */
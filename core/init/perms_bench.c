@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays a stream of uevents against the rules of one or more ueventd.rc
+ * files, looking up each device node and /sys path both the way ueventd used
+ * to (a scan of every rule) and through the compiled perms tables. Checks the
+ * two agree and prints the time each took per event.
+ *
+ *   perms_bench [-n rounds] [-s stream] ueventd.rc [ueventd.hw.rc ...]
+ *
+ * Each line of the stream is a uevent path below /sys, optionally followed by
+ * the device node created for it. One can be recorded on a device with
+ *
+ *   find /sys/devices -name uevent | while read f; do
+ *       d=${f%/uevent}; n=$(grep ^DEVNAME= $f)
+ *       echo ${d#/sys} ${n:+/dev/${n#DEVNAME=}}
+ *   done
+ *
+ * Without a stream, one is made up from the rules: for each rule a path it
+ * matches, one below it if it is a prefix rule, and one it does not match.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "perms.h"
+
+struct event {
+    char *upath;
+    char *devpath;  /* or NULL */
+};
+
+static struct perms_table dev_perms = PERMS_TABLE_INIT(0);
+static struct perms_table sys_perms = PERMS_TABLE_INIT(4);
+
+static struct event *events;
+static int nevents;
+static int capacity;
+
+static long long now_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static void add_event(const char *upath, const char *devpath)
+{
+    if (nevents == capacity) {
+        capacity = capacity ? capacity * 2 : 1024;
+        events = realloc(events, capacity * sizeof(*events));
+        if (!events) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    events[nevents].upath = strdup(upath);
+    events[nevents].devpath = devpath ? strdup(devpath) : NULL;
+    nevents++;
+}
+
+/* Splits line into at most max whitespace separated words. */
+static int split(char *line, char **args, int max)
+{
+    int n = 0;
+    char *save = NULL, *tok;
+    for (tok = strtok_r(line, " \t\r\n", &save); tok && n < max;
+         tok = strtok_r(NULL, " \t\r\n", &save))
+        args[n++] = tok;
+    return n;
+}
+
+/* As ueventd's set_device_permission, less the user and group names. */
+static int load_rules(const char *file)
+{
+    char line[1024];
+    char *args[6];
+    FILE *f = fopen(file, "r");
+    if (!f) {
+        perror(file);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        int nargs = split(line, args, 6);
+        const char *attr = NULL;
+        char **a = args;
+        unsigned short prefix = 0;
+        size_t len;
+
+        if (!nargs || args[0][0] == '#')
+            continue;
+        if (!strncmp(args[0], "/sys/", 5) && nargs == 5) {
+            attr = args[1];
+            a[1] = a[0];
+            a++;
+            nargs--;
+        }
+        if (nargs != 4)
+            continue;
+        len = strlen(a[0]);
+        if (a[0][len - 1] == '*') {
+            prefix = 1;
+            a[0][len - 1] = '\0';
+        }
+        perms_table_add(attr ? &sys_perms : &dev_perms, a[0], attr,
+                        strtol(a[1], NULL, 8), 0, 0, prefix);
+    }
+    fclose(f);
+    return 0;
+}
+
+static int load_stream(const char *file)
+{
+    char line[1024];
+    char *args[3];
+    FILE *f = fopen(file, "r");
+    if (!f) {
+        perror(file);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        int nargs = split(line, args, 3);
+        if (nargs)
+            add_event(args[0], nargs > 1 ? args[1] : NULL);
+    }
+    fclose(f);
+    return 0;
+}
+
+static void make_stream(void)
+{
+    char path[1024];
+    int i;
+
+    for (i = 0; i < dev_perms.count; i++) {
+        const struct perms_ *dp = &dev_perms.rules[i];
+        snprintf(path, sizeof(path), "/devices/virtual/misc/d%d", i);
+        add_event(path, dp->name);
+        if (dp->prefix) {
+            snprintf(path, sizeof(path), "%s%d", dp->name, i);
+            add_event("/devices/virtual/misc/p", path);
+        }
+        snprintf(path, sizeof(path), "/dev/nothing%d", i);
+        add_event("/devices/virtual/misc/n", path);
+    }
+    for (i = 0; i < sys_perms.count; i++) {
+        const struct perms_ *dp = &sys_perms.rules[i];
+        add_event(dp->name + 4, NULL);
+        if (dp->prefix) {
+            snprintf(path, sizeof(path), "%s%d", dp->name + 4, i);
+            add_event(path, NULL);
+        }
+    }
+}
+
+/* The lookups as ueventd used to do them. */
+static const struct perms_ *scan_last(const struct perms_table *t, const char *path)
+{
+    int i;
+    for (i = t->count - 1; i >= 0; i--) {
+        const struct perms_ *dp = &t->rules[i];
+        const char *name = dp->name + t->key_skip;
+        if (dp->prefix ? !strncmp(path, name, strlen(name)) : !strcmp(path, name))
+            return dp;
+    }
+    return NULL;
+}
+
+static int scan_all(const struct perms_table *t, const char *path,
+                    const struct perms_ **matches, int max)
+{
+    int i, n = 0;
+    for (i = 0; i < t->count; i++) {
+        const struct perms_ *dp = &t->rules[i];
+        const char *name = dp->name + t->key_skip;
+        if (dp->prefix ? !strncmp(path, name, strlen(name)) : !strcmp(path, name)) {
+            if (n < max)
+                matches[n] = dp;
+            n++;
+        }
+    }
+    return n;
+}
+
+/* Returns a checksum of the rules found so the work is not optimized away. */
+static unsigned long replay(int compiled)
+{
+    const struct perms_ *matches[16];
+    unsigned long sum = 0;
+    int i, j, n;
+
+    for (i = 0; i < nevents; i++) {
+        if (compiled)
+            n = perms_table_find_all(&sys_perms, events[i].upath, matches, 16);
+        else
+            n = scan_all(&sys_perms, events[i].upath, matches, 16);
+        for (j = 0; j < n && j < 16; j++)
+            sum += matches[j]->perm;
+
+        if (events[i].devpath) {
+            const struct perms_ *dp = compiled
+                    ? perms_table_find_last(&dev_perms, events[i].devpath)
+                    : scan_last(&dev_perms, events[i].devpath);
+            sum += dp ? dp->perm : 0600;
+        }
+    }
+    return sum;
+}
+
+static int check(void)
+{
+    const struct perms_ *a[16], *b[16];
+    int errors = 0, i, j;
+
+    for (i = 0; i < nevents; i++) {
+        int na = scan_all(&sys_perms, events[i].upath, a, 16);
+        int nb = perms_table_find_all(&sys_perms, events[i].upath, b, 16);
+        int same = na == nb;
+        for (j = 0; same && j < na && j < 16; j++)
+            same = a[j] == b[j];
+        if (!same) {
+            fprintf(stderr, "%s: %d /sys rules scanned, %d compiled\n",
+                    events[i].upath, na, nb);
+            errors++;
+        }
+        if (events[i].devpath &&
+                scan_last(&dev_perms, events[i].devpath) !=
+                perms_table_find_last(&dev_perms, events[i].devpath)) {
+            fprintf(stderr, "%s: rules differ\n", events[i].devpath);
+            errors++;
+        }
+    }
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    const char *stream = NULL;
+    int rounds = 100;
+    int i, r;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            rounds = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            stream = argv[++i];
+        else
+            break;
+    }
+    if (i == argc) {
+        fprintf(stderr, "usage: perms_bench [-n rounds] [-s stream] "
+                "ueventd.rc [ueventd.hw.rc ...]\n");
+        return 2;
+    }
+    for (; i < argc; i++) {
+        if (load_rules(argv[i]))
+            return 1;
+    }
+    if (stream ? load_stream(stream) : (make_stream(), 0))
+        return 1;
+    if (!nevents || rounds < 1) {
+        fprintf(stderr, "nothing to replay\n");
+        return 1;
+    }
+
+    /* The first lookup compiles the tables; time that separately. */
+    long long t0 = now_us();
+    perms_table_find_last(&dev_perms, "");
+    perms_table_find_last(&sys_perms, "");
+    long long compile_us = now_us() - t0;
+
+    int errors = check();
+
+    unsigned long sums[2] = { 0, 0 };
+    long long elapsed[2];
+    for (int compiled = 0; compiled < 2; compiled++) {
+        t0 = now_us();
+        for (r = 0; r < rounds; r++)
+            sums[compiled] += replay(compiled);
+        elapsed[compiled] = now_us() - t0;
+    }
+    if (sums[0] != sums[1]) {
+        fprintf(stderr, "checksums differ\n");
+        errors++;
+    }
+
+    printf("%d dev rules, %d sys rules, %d events x %d rounds\n",
+           dev_perms.count, sys_perms.count, nevents, rounds);
+    printf("compile   %lld uS\n", compile_us);
+    printf("scan      %.3f uS/event\n", (double) elapsed[0] / rounds / nevents);
+    printf("compiled  %.3f uS/event\n", (double) elapsed[1] / rounds / nevents);
+    if (errors)
+        printf("%d mismatches\n", errors);
+    return errors ? 1 : 0;
+}
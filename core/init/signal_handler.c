@@ -29,6 +29,7 @@
 #include "init.h"
 #include "util.h"
 #include "log.h"
+#include "boottrace.h"
 
 static int signal_fd = -1;
 static int signal_recv_fd = -1;
@@ -62,6 +63,7 @@ static int wait_for_one_process(int block)
     }
 
     NOTICE("process '%s', pid %d exited\n", svc->name, pid);
+    boottrace_service_exit(svc, status);
 
     if (!(svc->flags & SVC_ONESHOT)) {
         kill(-pid, SIGKILL);
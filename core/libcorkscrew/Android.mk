@@ -19,6 +19,7 @@ generic_src_files := \
 	backtrace-helper.c \
 	demangle.c \
 	map_info.c \
+	profiler.c \
 	ptrace.c \
 	symbol_table.c
 
@@ -66,6 +67,24 @@ LOCAL_MODULE := libcorkscrew_test
 LOCAL_MODULE_TAGS := optional
 include $(BUILD_EXECUTABLE)
 
+# Build benchmark.
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := bench.c
+LOCAL_CFLAGS += -std=gnu99 -Werror
+LOCAL_SHARED_LIBRARIES := libcorkscrew
+LOCAL_MODULE := libcorkscrew_bench
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_EXECUTABLE)
+
+# Build profiler tool.
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := corkprof.c
+LOCAL_CFLAGS += -std=gnu99 -Werror
+LOCAL_SHARED_LIBRARIES := libcorkscrew
+LOCAL_MODULE := corkprof
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_EXECUTABLE)
+
 
 ifeq ($(HOST_OS)-$(HOST_ARCH),linux-x86)
 
@@ -75,7 +94,7 @@ LOCAL_SRC_FILES += $(generic_src_files) $(x86_src_files)
 LOCAL_CFLAGS += -DCORKSCREW_HAVE_ARCH
 LOCAL_SHARED_LIBRARIES += libgccdemangle
 LOCAL_STATIC_LIBRARIES += libcutils
-LOCAL_LDLIBS += -ldl -lrt
+LOCAL_LDLIBS += -ldl -lrt -lpthread
 LOCAL_CFLAGS += -std=gnu99 -Werror
 LOCAL_MODULE := libcorkscrew
 LOCAL_MODULE_TAGS := optional
@@ -90,4 +109,14 @@ LOCAL_MODULE := libcorkscrew_test
 LOCAL_MODULE_TAGS := optional
 include $(BUILD_HOST_EXECUTABLE)
 
+# Build benchmark.
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := bench.c
+LOCAL_CFLAGS += -std=gnu99 -Werror
+LOCAL_SHARED_LIBRARIES := libcorkscrew
+LOCAL_LDLIBS += -lrt -lpthread
+LOCAL_MODULE := libcorkscrew_bench
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
+
 endif # linux-x86
@@ -26,27 +26,27 @@
 #define PT_ARM_EXIDX 0x70000001
 #endif
 
-static void load_exidx_header(pid_t pid, map_info_t* mi,
+static void load_exidx_header(const memory_t* memory, map_info_t* mi,
         uintptr_t* out_exidx_start, size_t* out_exidx_size) {
     uint32_t elf_phoff;
     uint32_t elf_phentsize_phnum;
-    if (try_get_word_ptrace(pid, mi->start + offsetof(Elf32_Ehdr, e_phoff), &elf_phoff)
-            && try_get_word_ptrace(pid, mi->start + offsetof(Elf32_Ehdr, e_phnum),
+    if (try_get_word(memory, mi->start + offsetof(Elf32_Ehdr, e_phoff), &elf_phoff)
+            && try_get_word(memory, mi->start + offsetof(Elf32_Ehdr, e_phnum),
                     &elf_phentsize_phnum)) {
         uint32_t elf_phentsize = elf_phentsize_phnum >> 16;
         uint32_t elf_phnum = elf_phentsize_phnum & 0xffff;
         for (uint32_t i = 0; i < elf_phnum; i++) {
             uintptr_t elf_phdr = mi->start + elf_phoff + i * elf_phentsize;
             uint32_t elf_phdr_type;
-            if (!try_get_word_ptrace(pid, elf_phdr + offsetof(Elf32_Phdr, p_type), &elf_phdr_type)) {
+            if (!try_get_word(memory, elf_phdr + offsetof(Elf32_Phdr, p_type), &elf_phdr_type)) {
                 break;
             }
             if (elf_phdr_type == PT_ARM_EXIDX) {
                 uint32_t elf_phdr_offset;
                 uint32_t elf_phdr_filesz;
-                if (!try_get_word_ptrace(pid, elf_phdr + offsetof(Elf32_Phdr, p_offset),
+                if (!try_get_word(memory, elf_phdr + offsetof(Elf32_Phdr, p_offset),
                         &elf_phdr_offset)
-                        || !try_get_word_ptrace(pid, elf_phdr + offsetof(Elf32_Phdr, p_filesz),
+                        || !try_get_word(memory, elf_phdr + offsetof(Elf32_Phdr, p_filesz),
                                 &elf_phdr_filesz)) {
                     break;
                 }
@@ -62,8 +62,9 @@ static void load_exidx_header(pid_t pid, map_info_t* mi,
     *out_exidx_size = 0;
 }
 
-void load_ptrace_map_info_data_arch(pid_t pid, map_info_t* mi, map_info_data_t* data) {
-    load_exidx_header(pid, mi, &data->exidx_start, &data->exidx_size);
+void load_ptrace_map_info_data_arch(const memory_t* memory, map_info_t* mi,
+        map_info_data_t* data) {
+    load_exidx_header(memory, mi, &data->exidx_start, &data->exidx_size);
 }
 
 void free_ptrace_map_info_data_arch(map_info_t* mi, map_info_data_t* data) {
@@ -188,7 +188,7 @@ ssize_t unwind_backtrace_ptrace_arch(pid_t tid, const ptrace_context_t* context,
           ignore_depth, max_depth, state.pc, state.sp, state.ra);
 
     memory_t memory;
-    init_memory_ptrace(&memory, tid);
+    init_memory_ptrace_context(&memory, tid, context);
     return unwind_backtrace_common(&memory, context->map_info_list,
             &state, backtrace, ignore_depth, max_depth);
 }
@@ -21,7 +21,7 @@
 
 #include <cutils/log.h>
 
-void load_ptrace_map_info_data_arch(pid_t pid, map_info_t* mi, map_info_data_t* data) {
+void load_ptrace_map_info_data_arch(const memory_t* memory, map_info_t* mi, map_info_data_t* data) {
 }
 
 void free_ptrace_map_info_data_arch(map_info_t* mi, map_info_data_t* data) {
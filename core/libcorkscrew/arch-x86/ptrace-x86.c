@@ -21,7 +21,7 @@
 
 #include <cutils/log.h>
 
-void load_ptrace_map_info_data_arch(pid_t pid __attribute__((unused)),
+void load_ptrace_map_info_data_arch(const memory_t* memory __attribute__((unused)),
                                     map_info_t* mi __attribute__((unused)),
                                     map_info_data_t* data __attribute__((unused))) {
 }
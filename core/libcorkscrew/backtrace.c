@@ -225,9 +225,22 @@ ssize_t unwind_backtrace_thread(pid_t tid, backtrace_frame_t* backtrace,
 #endif
 }
 
+ssize_t unwind_backtrace_signal(siginfo_t* siginfo, void* sigcontext,
+        const map_info_t* map_info_list,
+        backtrace_frame_t* backtrace, size_t ignore_depth, size_t max_depth) {
+#ifdef CORKSCREW_HAVE_ARCH
+    return unwind_backtrace_signal_arch(siginfo, sigcontext, map_info_list,
+            backtrace, ignore_depth, max_depth);
+#else
+    return -1;
+#endif
+}
+
 ssize_t unwind_backtrace_ptrace(pid_t tid, const ptrace_context_t* context,
         backtrace_frame_t* backtrace, size_t ignore_depth, size_t max_depth) {
 #ifdef CORKSCREW_HAVE_ARCH
+    // The stack may have changed since the context last read it.
+    flush_ptrace_context_memory(context);
     return unwind_backtrace_ptrace_arch(tid, context, backtrace, ignore_depth, max_depth);
 #else
     return -1;
@@ -245,6 +258,9 @@ static void init_backtrace_symbol(backtrace_symbol_t* symbol, uintptr_t pc) {
 void get_backtrace_symbols(const backtrace_frame_t* backtrace, size_t frames,
         backtrace_symbol_t* backtrace_symbols) {
     map_info_t* milist = acquire_my_map_info_list();
+    // Consecutive frames are usually in the same library.
+    const map_info_t* table_mi = NULL;
+    symbol_table_t* table = NULL;
     for (size_t i = 0; i < frames; i++) {
         const backtrace_frame_t* frame = &backtrace[i];
         backtrace_symbol_t* symbol = &backtrace_symbols[i];
@@ -263,10 +279,26 @@ void get_backtrace_symbols(const backtrace_frame_t* backtrace, size_t frames,
                         - (uintptr_t)info.dli_fbase;
                 symbol->symbol_name = strdup(info.dli_sname);
                 symbol->demangled_name = demangle_symbol_name(symbol->symbol_name);
+                continue;
             }
 #endif
+            // Not exported (or no dladdr); try the file's own symbol table.
+            if (mi->name[0] == '/') {
+                if (mi != table_mi) {
+                    release_symbol_table(table);
+                    table = acquire_symbol_table(mi->name);
+                    table_mi = mi;
+                }
+                const symbol_t* s = find_symbol(table, symbol->relative_pc);
+                if (s) {
+                    symbol->relative_symbol_addr = s->start;
+                    symbol->symbol_name = strdup(s->name);
+                    symbol->demangled_name = demangle_symbol_name(symbol->symbol_name);
+                }
+            }
         }
     }
+    release_symbol_table(table);
     release_my_map_info_list(milist);
 }
 
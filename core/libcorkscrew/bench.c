@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Times symbolization of many backtraces: map lookups, symbolizing
+ * backtraces of this process, and symbolizing backtraces of a traced child
+ * with a fresh ptrace context every so often (as debuggerd does per crash).
+ * Also times a debuggerd-style dump of every thread of a traced child
+ * (backtrace plus the stack words around each frame), with and without the
+ * context's page cache.
+ */
+
+#include <corkscrew/backtrace.h>
+#include <corkscrew/map_info.h>
+#include <corkscrew/ptrace.h>
+#include <corkscrew/symbol_table.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static const size_t MAX_DEPTH = 32;
+
+static int iterations = 10000;
+static int contexts = 100;
+static int num_threads = 64;
+static int dumps = 10;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char* what, int n, double elapsed) {
+  printf("%-34s %8d in %8.3f s  %10.2f us each\n", what, n, elapsed, elapsed * 1e6 / n);
+}
+
+static const map_info_t* find_map_info_linear(const map_info_t* mi, uintptr_t addr) {
+  while (mi && !(addr >= mi->start && addr < mi->end)) {
+    mi = mi->next;
+  }
+  return mi;
+}
+
+static void bench_map_lookup(const backtrace_frame_t* frames, ssize_t frame_count) {
+  map_info_t* milist = acquire_my_map_info_list();
+  int lookups = iterations * frame_count;
+  size_t found = 0;
+
+  double t0 = now();
+  for (int i = 0; i < iterations; i++) {
+    for (ssize_t j = 0; j < frame_count; j++) {
+      found += find_map_info_linear(milist, frames[j].absolute_pc) != NULL;
+    }
+  }
+  report("map lookup, linear walk", lookups, now() - t0);
+
+  t0 = now();
+  for (int i = 0; i < iterations; i++) {
+    for (ssize_t j = 0; j < frame_count; j++) {
+      found -= find_map_info(milist, frames[j].absolute_pc) != NULL;
+    }
+  }
+  report("map lookup, find_map_info", lookups, now() - t0);
+  if (found) {
+    fprintf(stderr, "map lookups disagree!\n");
+  }
+  release_my_map_info_list(milist);
+}
+
+static void bench_local(const backtrace_frame_t* frames, ssize_t frame_count) {
+  backtrace_symbol_t symbols[MAX_DEPTH];
+
+  double t0 = now();
+  for (int i = 0; i < iterations; i++) {
+    get_backtrace_symbols(frames, frame_count, symbols);
+    free_backtrace_symbols(symbols, frame_count);
+  }
+  report("get_backtrace_symbols", iterations, now() - t0);
+}
+
+static void bench_ptrace(pid_t pid) {
+  backtrace_frame_t frames[MAX_DEPTH];
+  backtrace_symbol_t symbols[MAX_DEPTH];
+  int per_context = iterations / contexts;
+  int total = 0;
+
+  double t0 = now();
+  for (int c = 0; c < contexts; c++) {
+    ptrace_context_t* context = load_ptrace_context(pid);
+    if (!context) {
+      fprintf(stderr, "could not load ptrace context\n");
+      return;
+    }
+    ssize_t frame_count = unwind_backtrace_ptrace(pid, context, frames, 0, MAX_DEPTH);
+    for (int i = 0; frame_count > 0 && i < per_context; i++) {
+      get_backtrace_symbols_ptrace(context, frames, frame_count, symbols);
+      free_backtrace_symbols(symbols, frame_count);
+      total++;
+    }
+    free_ptrace_context(context);
+  }
+  if (total) {
+    report("get_backtrace_symbols_ptrace", total, now() - t0);
+  } else {
+    fprintf(stderr, "could not unwind child %d\n", pid);
+  }
+}
+
+static int list_threads(pid_t pid, pid_t* tids, int max) {
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%d/task", pid);
+  DIR* d = opendir(path);
+  if (!d) {
+    return 0;
+  }
+  int n = 0;
+  struct dirent* de;
+  while (n < max && (de = readdir(d))) {
+    pid_t tid = atoi(de->d_name);
+    if (tid > 0) {
+      tids[n++] = tid;
+    }
+  }
+  closedir(d);
+  return n;
+}
+
+// What debuggerd does for each thread of a crashed process.
+static void dump_threads(const ptrace_context_t* context, const pid_t* tids, int n) {
+  backtrace_frame_t frames[MAX_DEPTH];
+  backtrace_symbol_t symbols[MAX_DEPTH];
+  uint32_t stack[16];
+  for (int t = 0; t < n; t++) {
+    ssize_t frame_count = unwind_backtrace_ptrace(tids[t], context, frames, 0, MAX_DEPTH);
+    if (frame_count <= 0) {
+      continue;
+    }
+    get_backtrace_symbols_ptrace(context, frames, frame_count, symbols);
+    free_backtrace_symbols(symbols, frame_count);
+    for (ssize_t i = 0; i < frame_count; i++) {
+      if (!frames[i].stack_top) {
+        continue;
+      }
+      size_t words = 0;
+      if (context->remote_memory) {
+        words = read_memory_ptrace(context, frames[i].stack_top, stack, sizeof(stack)) / 4;
+      } else {
+        while (words < 16 && try_get_word_ptrace(tids[t], frames[i].stack_top + words * 4,
+                &stack[words])) {
+          words++;
+        }
+      }
+      for (size_t w = 0; w < words; w++) {
+        const map_info_t* mi;
+        const symbol_t* symbol;
+        find_symbol_ptrace(context, stack[w], &mi, &symbol);
+      }
+    }
+  }
+}
+
+static void bench_dump(pid_t pid) {
+  pid_t tids[1024];
+  int n = list_threads(pid, tids, 1024);
+  int attached = 0;
+  for (int i = 0; i < n; i++) {
+    if (tids[i] != pid) {
+      int status;
+      if (ptrace(PTRACE_ATTACH, tids[i], NULL, NULL) || waitpid(tids[i], &status, __WALL) < 0) {
+        continue;
+      }
+    }
+    tids[attached++] = tids[i];
+  }
+
+  ptrace_context_t* context = load_ptrace_context(pid);
+  if (!context) {
+    fprintf(stderr, "could not load ptrace context\n");
+    return;
+  }
+  char what[64];
+  snprintf(what, sizeof(what), "dump %d threads, page cache", attached);
+  double t0 = now();
+  for (int i = 0; i < dumps; i++) {
+    dump_threads(context, tids, attached);
+  }
+  report(what, dumps, now() - t0);
+
+  // Without the cache every word is a PTRACE_PEEKTEXT, as it used to be.
+  remote_memory_t* remote_memory = context->remote_memory;
+  context->remote_memory = NULL;
+  snprintf(what, sizeof(what), "dump %d threads, word at a time", attached);
+  t0 = now();
+  for (int i = 0; i < dumps; i++) {
+    dump_threads(context, tids, attached);
+  }
+  report(what, dumps, now() - t0);
+  context->remote_memory = remote_memory;
+  free_ptrace_context(context);
+
+  for (int i = 0; i < attached; i++) {
+    if (tids[i] != pid) {
+      ptrace(PTRACE_DETACH, tids[i], NULL, NULL);
+    }
+  }
+}
+
+static void* child_thread(void* arg __attribute__((unused))) {
+  for (;;) {
+    pause();
+  }
+  return NULL;
+}
+
+__attribute__ ((noinline)) static ssize_t capture(backtrace_frame_t* frames, int depth) {
+  if (depth) {
+    return capture(frames, depth - 1) + 0;
+  }
+  return unwind_backtrace(frames, 0, MAX_DEPTH);
+}
+
+int main(int argc, char** argv) {
+  int c;
+  while ((c = getopt(argc, argv, "n:c:t:d:")) != -1) {
+    switch (c) {
+    case 'n': iterations = atoi(optarg); break;
+    case 'c': contexts = atoi(optarg); break;
+    case 't': num_threads = atoi(optarg); break;
+    case 'd': dumps = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: %s [-n backtraces] [-c ptrace contexts] "
+              "[-t child threads] [-d dumps]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (iterations <= 0 || contexts <= 0 || contexts > iterations) {
+    fprintf(stderr, "need 0 < contexts <= backtraces\n");
+    return 1;
+  }
+
+  backtrace_frame_t frames[MAX_DEPTH];
+  ssize_t frame_count = capture(frames, 8);
+  if (frame_count <= 0) {
+    fprintf(stderr, "could not unwind this thread\n");
+    return 1;
+  }
+  printf("%d backtraces of %d frames\n", iterations, (int) frame_count);
+
+  bench_map_lookup(frames, frame_count);
+  bench_local(frames, frame_count);
+
+  int ready[2];
+  if (pipe(ready)) {
+    return 1;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    for (int i = 1; i < num_threads; i++) {
+      pthread_t thread;
+      pthread_create(&thread, NULL, child_thread, NULL);
+    }
+    if (write(ready[1], "", 1) != 1) {
+      _exit(1);
+    }
+    child_thread(NULL);
+  }
+  char byte;
+  if (pid < 0 || read(ready[0], &byte, 1) != 1) {
+    fprintf(stderr, "could not start child\n");
+    return 1;
+  }
+  usleep(100000); // let the threads reach pause()
+  if (pid > 0 && !ptrace(PTRACE_ATTACH, pid, NULL, NULL)) {
+    int status;
+    waitpid(pid, &status, __WALL);
+    bench_ptrace(pid);
+    bench_dump(pid);
+    ptrace(PTRACE_DETACH, pid, NULL, NULL);
+  } else {
+    fprintf(stderr, "could not trace child; skipping ptrace symbolization\n");
+  }
+  if (pid > 0) {
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+  }
+  return 0;
+}
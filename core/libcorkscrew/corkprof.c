@@ -0,0 +1,581 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Controls the sampling profiler in a process that called profiler_install()
+ * (vold, sdcard, ...) and turns its profile into folded stacks, one line per
+ * distinct stack with its sample count, outermost frame first. That is the
+ * input format of flame graph tools; with -t a call tree is printed instead.
+ *
+ *   corkprof record -p <pid> [-f <hz>] [-d <seconds>]
+ *   corkprof report [-t] <profile>
+ */
+
+#include <corkscrew/demangle.h>
+#include <corkscrew/profiler.h>
+#include <corkscrew/symbol_table.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+    char* name;
+    symbol_table_t* table;
+    bool loaded;
+} map_t;
+
+/* A distinct stack: its frames live in the stack pool, innermost first. */
+typedef struct {
+    uint32_t hash;
+    uint32_t offset;
+    uint32_t depth;
+    uint32_t count;
+} stack_entry_t;
+
+/* A distinct pc and its symbolized frame name. */
+typedef struct {
+    uint32_t pc;
+    const char* name;
+} frame_name_t;
+
+/* A symbolized stack, outermost frame first. */
+typedef struct {
+    const char** names;
+    uint32_t depth;
+    uint32_t count;
+} path_t;
+
+static uint32_t* g_pool;
+static size_t g_pool_size, g_pool_capacity;
+static stack_entry_t* g_stacks;
+static size_t g_num_stacks;
+static size_t g_stack_buckets;      // power of two, at least twice g_num_stacks
+static frame_name_t* g_frames;
+static size_t g_frame_buckets;
+static size_t g_num_frames;
+static char** g_names;
+static size_t g_name_buckets;
+static size_t g_num_names;
+static map_t* g_maps;
+static size_t g_num_maps;
+static uint32_t g_stats[6];
+static bool g_have_stats;
+
+static int usage() {
+    fprintf(stderr, "usage: corkprof record -p <pid> [-f <hz>] [-d <seconds>]\n"
+                    "       corkprof report [-t] <profile>\n");
+    return 1;
+}
+
+/* Queues the control signal with a value; bionic has no sigqueue(). */
+static int send_control(pid_t pid, int hz) {
+    siginfo_t info;
+    memset(&info, 0, sizeof(info));
+    info.si_signo = PROFILER_CONTROL_SIGNAL;
+    info.si_code = SI_QUEUE;
+    info.si_pid = getpid();
+    info.si_uid = getuid();
+    info.si_value.sival_int = hz;
+    return syscall(__NR_rt_sigqueueinfo, pid, PROFILER_CONTROL_SIGNAL, &info);
+}
+
+/* Returns true once the profile ends with the end record. */
+static bool is_complete(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    uint32_t end[2];
+    off_t size = lseek(fd, 0, SEEK_END);
+    bool complete = size >= (off_t) sizeof(end)
+            && pread(fd, end, sizeof(end), size - sizeof(end)) == sizeof(end)
+            && end[0] == PROFILER_RECORD_END && end[1] == PROFILER_MAGIC;
+    close(fd);
+    return complete;
+}
+
+static int record(int argc, char** argv) {
+    pid_t pid = 0;
+    int hz = 100;
+    int seconds = 10;
+    int c;
+    while ((c = getopt(argc, argv, "p:f:d:")) != -1) {
+        switch (c) {
+        case 'p': pid = atoi(optarg); break;
+        case 'f': hz = atoi(optarg); break;
+        case 'd': seconds = atoi(optarg); break;
+        default: return usage();
+        }
+    }
+    if (pid <= 0 || hz <= 0 || hz > 1000 || seconds <= 0) {
+        return usage();
+    }
+
+    // Daemons may not be able to create files in the profile's directory,
+    // so the profile is created here, fresh, and handed to the process's
+    // owner. Nobody else can read it, write it, or put something else there
+    // for the process to write into.
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d", pid);
+    struct stat st;
+    if (stat(path, &st)) {
+        fprintf(stderr, "no process %d: %s\n", pid, strerror(errno));
+        return 1;
+    }
+    snprintf(path, sizeof(path), PROFILER_DATA_PATH_FORMAT, pid);
+    if (unlink(path) && errno != ENOENT) {
+        fprintf(stderr, "could not remove %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "could not create %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (fchown(fd, st.st_uid, st.st_gid)) {
+        fprintf(stderr, "could not give %s to uid %d: %s\n", path, (int) st.st_uid,
+                strerror(errno));
+        close(fd);
+        unlink(path);
+        return 1;
+    }
+    close(fd);
+
+    if (send_control(pid, hz)) {
+        fprintf(stderr, "could not signal process %d: %s\n", pid, strerror(errno));
+        return 1;
+    }
+    fprintf(stderr, "profiling process %d at %d Hz for %d s...\n", pid, hz, seconds);
+    sleep(seconds);
+    send_control(pid, 0);
+
+    for (int i = 0; i < 50 && !is_complete(path); i++) {
+        usleep(100000);
+    }
+    if (!is_complete(path)) {
+        fprintf(stderr, "%s is incomplete; was profiler_install() called "
+                "and is ro.debuggable set?\n", path);
+        return 1;
+    }
+    printf("%s\n", path);
+    return 0;
+}
+
+static uint32_t hash_words(const uint32_t* words, size_t count) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < count; i++) {
+        hash = (hash ^ words[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void insert_stack(stack_entry_t* table, size_t buckets, const stack_entry_t* stack) {
+    size_t i = stack->hash & (buckets - 1);
+    while (table[i].depth) {
+        i = (i + 1) & (buckets - 1);
+    }
+    table[i] = *stack;
+}
+
+/* Counts one sample, adding its stack to the pool if it has not been seen. */
+static void add_stack(const uint32_t* pcs, uint32_t depth) {
+    if (!depth) {
+        return;
+    }
+    if (g_num_stacks * 2 >= g_stack_buckets) {
+        size_t buckets = g_stack_buckets ? g_stack_buckets * 2 : 1024;
+        stack_entry_t* table = calloc(buckets, sizeof(stack_entry_t));
+        for (size_t i = 0; i < g_stack_buckets; i++) {
+            if (g_stacks[i].depth) {
+                insert_stack(table, buckets, &g_stacks[i]);
+            }
+        }
+        free(g_stacks);
+        g_stacks = table;
+        g_stack_buckets = buckets;
+    }
+
+    uint32_t hash = hash_words(pcs, depth);
+    size_t i = hash & (g_stack_buckets - 1);
+    while (g_stacks[i].depth) {
+        stack_entry_t* s = &g_stacks[i];
+        if (s->hash == hash && s->depth == depth
+                && !memcmp(g_pool + s->offset, pcs, depth * sizeof(uint32_t))) {
+            s->count++;
+            return;
+        }
+        i = (i + 1) & (g_stack_buckets - 1);
+    }
+
+    if (g_pool_size + depth > g_pool_capacity) {
+        g_pool_capacity = (g_pool_capacity + depth) * 2;
+        g_pool = realloc(g_pool, g_pool_capacity * sizeof(uint32_t));
+    }
+    memcpy(g_pool + g_pool_size, pcs, depth * sizeof(uint32_t));
+    stack_entry_t* s = &g_stacks[i];
+    s->hash = hash;
+    s->offset = g_pool_size;
+    s->depth = depth;
+    s->count = 1;
+    g_pool_size += depth;
+    g_num_stacks++;
+}
+
+static int compare_maps(const void* a, const void* b) {
+    const map_t* x = a;
+    const map_t* y = b;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+static int read_profile(const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    uint32_t header[2];
+    if (fread(header, sizeof(uint32_t), 2, fp) != 2 || header[0] != PROFILER_MAGIC
+            || header[1] != PROFILER_VERSION) {
+        fprintf(stderr, "%s is not a corkprof profile\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    size_t maps_capacity = 0;
+    uint32_t words[3];
+    uint32_t pcs[256];
+    bool complete = false;
+    while (!complete && fread(words, sizeof(uint32_t), 1, fp) == 1) {
+        switch (words[0]) {
+        case PROFILER_RECORD_SAMPLE:
+            if (fread(words, sizeof(uint32_t), 2, fp) != 2 || words[1] > 256
+                    || fread(pcs, sizeof(uint32_t), words[1], fp) != words[1]) {
+                goto out;
+            }
+            add_stack(pcs, words[1]);
+            break;
+        case PROFILER_RECORD_MAP: {
+            if (fread(words, sizeof(uint32_t), 3, fp) != 3) {
+                goto out;
+            }
+            size_t padded = (words[2] + 3) & ~3;
+            char* name = malloc(padded + 1);
+            if (fread(name, 1, padded, fp) != padded) {
+                free(name);
+                goto out;
+            }
+            name[words[2]] = '\0';
+            if (g_num_maps == maps_capacity) {
+                maps_capacity = maps_capacity ? maps_capacity * 2 : 64;
+                g_maps = realloc(g_maps, maps_capacity * sizeof(map_t));
+            }
+            map_t* map = &g_maps[g_num_maps++];
+            map->start = words[0];
+            map->end = words[1];
+            map->name = name;
+            map->table = NULL;
+            map->loaded = false;
+            break;
+        }
+        case PROFILER_RECORD_STATS:
+            if (fread(g_stats, sizeof(uint32_t), 6, fp) != 6) {
+                goto out;
+            }
+            g_have_stats = true;
+            break;
+        case PROFILER_RECORD_END:
+            complete = true;
+            break;
+        default:
+            fprintf(stderr, "%s: unknown record type %u\n", path, words[0]);
+            goto out;
+        }
+    }
+out:
+    if (!complete) {
+        fprintf(stderr, "%s is truncated or corrupt; reporting what was read\n", path);
+    }
+    fclose(fp);
+    qsort(g_maps, g_num_maps, sizeof(map_t), compare_maps);
+    return 0;
+}
+
+static map_t* find_map(uint32_t pc) {
+    size_t lo = 0, hi = g_num_maps;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (pc < g_maps[mid].start) {
+            hi = mid;
+        } else if (pc >= g_maps[mid].end) {
+            lo = mid + 1;
+        } else {
+            return &g_maps[mid];
+        }
+    }
+    return NULL;
+}
+
+static uint32_t hash_string(const char* s) {
+    uint32_t hash = 2166136261u;
+    while (*s) {
+        hash = (hash ^ (unsigned char) *s++) * 16777619u;
+    }
+    return hash;
+}
+
+/* Returns the one copy of a frame name, so names can be compared as pointers. */
+static const char* intern(const char* name) {
+    if (g_num_names * 2 >= g_name_buckets) {
+        size_t buckets = g_name_buckets ? g_name_buckets * 2 : 1024;
+        char** table = calloc(buckets, sizeof(char*));
+        for (size_t i = 0; i < g_name_buckets; i++) {
+            if (g_names[i]) {
+                size_t j = hash_string(g_names[i]) & (buckets - 1);
+                while (table[j]) {
+                    j = (j + 1) & (buckets - 1);
+                }
+                table[j] = g_names[i];
+            }
+        }
+        free(g_names);
+        g_names = table;
+        g_name_buckets = buckets;
+    }
+    size_t i = hash_string(name) & (g_name_buckets - 1);
+    while (g_names[i]) {
+        if (!strcmp(g_names[i], name)) {
+            return g_names[i];
+        }
+        i = (i + 1) & (g_name_buckets - 1);
+    }
+    g_num_names++;
+    return g_names[i] = strdup(name);
+}
+
+static const char* symbolize(uint32_t pc) {
+    char buf[512];
+    map_t* map = find_map(pc);
+    if (!map) {
+        snprintf(buf, sizeof(buf), "0x%08x", pc);
+        return intern(buf);
+    }
+    if (!map->loaded) {
+        map->table = acquire_symbol_table(map->name);
+        map->loaded = true;
+    }
+    const char* base = strrchr(map->name, '/');
+    base = base ? base + 1 : map->name;
+    const symbol_t* symbol = map->table ? find_symbol(map->table, pc - map->start) : NULL;
+    if (!symbol) {
+        snprintf(buf, sizeof(buf), "%s+0x%x", base, pc - map->start);
+        return intern(buf);
+    }
+    char* demangled = demangle_symbol_name(symbol->name);
+    snprintf(buf, sizeof(buf), "%s", demangled ? demangled : symbol->name);
+    free(demangled);
+    // Frame separators would split the name in the folded output.
+    for (char* p = buf; *p; p++) {
+        if (*p == ';') {
+            *p = ':';
+        }
+    }
+    return intern(buf);
+}
+
+/* Each distinct pc is symbolized once, however many stacks it appears in. */
+static const char* frame_name(uint32_t pc) {
+    if (g_num_frames * 2 >= g_frame_buckets) {
+        size_t buckets = g_frame_buckets ? g_frame_buckets * 2 : 1024;
+        frame_name_t* table = calloc(buckets, sizeof(frame_name_t));
+        for (size_t i = 0; i < g_frame_buckets; i++) {
+            if (g_frames[i].name) {
+                size_t j = hash_words(&g_frames[i].pc, 1) & (buckets - 1);
+                while (table[j].name) {
+                    j = (j + 1) & (buckets - 1);
+                }
+                table[j] = g_frames[i];
+            }
+        }
+        free(g_frames);
+        g_frames = table;
+        g_frame_buckets = buckets;
+    }
+    size_t i = hash_words(&pc, 1) & (g_frame_buckets - 1);
+    while (g_frames[i].name) {
+        if (g_frames[i].pc == pc) {
+            return g_frames[i].name;
+        }
+        i = (i + 1) & (g_frame_buckets - 1);
+    }
+    g_frames[i].pc = pc;
+    g_frames[i].name = symbolize(pc);
+    g_num_frames++;
+    return g_frames[i].name;
+}
+
+/* Length of the common prefix of two paths. */
+static uint32_t common_depth(const path_t* x, const path_t* y) {
+    uint32_t depth = 0;
+    while (depth < x->depth && depth < y->depth && x->names[depth] == y->names[depth]) {
+        depth++;
+    }
+    return depth;
+}
+
+static int compare_paths(const void* a, const void* b) {
+    const path_t* x = a;
+    const path_t* y = b;
+    uint32_t depth = common_depth(x, y);
+    if (depth == x->depth || depth == y->depth) {
+        return (x->depth > y->depth) - (x->depth < y->depth);
+    }
+    return strcmp(x->names[depth], y->names[depth]);
+}
+
+static int compare_counts(const void* a, const void* b) {
+    const path_t* x = a;
+    const path_t* y = b;
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+/*
+ * Symbolizes the distinct stacks into paths of frame names, outermost first,
+ * and merges the paths that come out the same (different pcs in the same
+ * functions). Returns the paths sorted by name, so callers are adjacent.
+ */
+static path_t* build_paths(size_t* count) {
+    path_t* paths = malloc(g_num_stacks * sizeof(path_t));
+    size_t n = 0;
+    for (size_t i = 0; i < g_stack_buckets; i++) {
+        const stack_entry_t* s = &g_stacks[i];
+        if (s->depth) {
+            const uint32_t* pcs = g_pool + s->offset;
+            paths[n].names = malloc(s->depth * sizeof(char*));
+            for (uint32_t j = 0; j < s->depth; j++) {
+                paths[n].names[j] = frame_name(pcs[s->depth - 1 - j]);
+            }
+            paths[n].depth = s->depth;
+            paths[n].count = s->count;
+            n++;
+        }
+    }
+    qsort(paths, n, sizeof(path_t), compare_paths);
+
+    size_t merged = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (merged && !compare_paths(&paths[merged - 1], &paths[i])) {
+            paths[merged - 1].count += paths[i].count;
+            free(paths[i].names);
+        } else {
+            paths[merged++] = paths[i];
+        }
+    }
+    *count = merged;
+    return paths;
+}
+
+static void print_folded(path_t* paths, size_t count) {
+    qsort(paths, count, sizeof(path_t), compare_counts);
+    for (size_t i = 0; i < count; i++) {
+        for (uint32_t j = 0; j < paths[i].depth; j++) {
+            printf("%s%c", paths[i].names[j], j + 1 < paths[i].depth ? ';' : ' ');
+        }
+        printf("%u\n", paths[i].count);
+    }
+}
+
+/*
+ * Prints an indented call tree with inclusive sample counts. With the paths
+ * sorted by name, a node's samples are those of the run of paths sharing its
+ * prefix, and it only needs printing where a path first differs from the one
+ * before it.
+ */
+static void print_tree(const path_t* paths, size_t count, uint32_t total) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t level = i ? common_depth(&paths[i - 1], &paths[i]) : 0;
+        for (; level < paths[i].depth; level++) {
+            uint32_t inclusive = 0;
+            for (size_t k = i; k < count && common_depth(&paths[i], &paths[k]) > level; k++) {
+                inclusive += paths[k].count;
+            }
+            printf("%5.1f%% %6u %*s%s\n", inclusive * 100.0 / total, inclusive,
+                   (int) level * 2, "", paths[i].names[level]);
+        }
+    }
+}
+
+static int report(int argc, char** argv) {
+    bool tree = false;
+    int c;
+    while ((c = getopt(argc, argv, "t")) != -1) {
+        switch (c) {
+        case 't': tree = true; break;
+        default: return usage();
+        }
+    }
+    if (optind != argc - 1) {
+        return usage();
+    }
+    if (read_profile(argv[optind])) {
+        return 1;
+    }
+
+    size_t count;
+    path_t* paths = build_paths(&count);
+    uint32_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += paths[i].count;
+    }
+    if (tree) {
+        print_tree(paths, count, total);
+    } else {
+        print_folded(paths, count);
+    }
+
+    fprintf(stderr, "%u samples, %zu distinct stacks, %zu distinct pcs\n",
+            total, count, g_num_frames);
+    if (g_have_stats) {
+        // hz, samples, dropped, wall ms, cpu us, sampler us
+        fprintf(stderr, "%u Hz for %.1f s: %u samples, %u dropped; "
+                "sampler used %.2f%% of the process cpu time\n",
+                g_stats[0], g_stats[3] / 1000.0, g_stats[1], g_stats[2],
+                g_stats[4] ? g_stats[5] * 100.0 / g_stats[4] : 0.0);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        return usage();
+    }
+    if (!strcmp(argv[1], "record")) {
+        return record(argc - 1, argv + 1);
+    }
+    if (!strcmp(argv[1], "report")) {
+        return report(argc - 1, argv + 1);
+    }
+    return usage();
+}
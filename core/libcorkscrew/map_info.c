@@ -57,8 +57,10 @@ static map_info_t* parse_maps_line(const char* line)
         mi->start = start;
         mi->end = end;
         mi->is_readable = strlen(permissions) == 4 && permissions[0] == 'r';
+        mi->is_writable = strlen(permissions) == 4 && permissions[1] == 'w';
         mi->is_executable = strlen(permissions) == 4 && permissions[2] == 'x';
         mi->data = NULL;
+        mi->index = NULL;
         memcpy(mi->name, name, name_len);
         mi->name[name_len] = '\0';
         ALOGV("Parsed map: start=0x%08x, end=0x%08x, "
@@ -68,11 +70,38 @@ static map_info_t* parse_maps_line(const char* line)
     return mi;
 }
 
+// Maps of a loaded list sorted by ascending start address, for binary search.
+struct map_info_index {
+    size_t count;
+    const map_info_t* maps[];
+};
+
+// The list is built backwards, so walking it fills the index from the end.
+// Gives up (leaving lookups to walk the list) if the maps are not in order.
+static void build_map_info_index(map_info_t* milist, size_t count) {
+    struct map_info_index* index = malloc(sizeof(*index) + count * sizeof(map_info_t*));
+    if (!index) {
+        return;
+    }
+    index->count = count;
+    size_t i = count;
+    for (const map_info_t* mi = milist; mi; mi = mi->next) {
+        if (i < count && mi->end > index->maps[i]->start) {
+            ALOGV("Maps out of order at 0x%08x, not indexing.", mi->start);
+            free(index);
+            return;
+        }
+        index->maps[--i] = mi;
+    }
+    milist->index = index;
+}
+
 map_info_t* load_map_info_list(pid_t tid) {
     char path[PATH_MAX];
     char line[1024];
     FILE* fp;
     map_info_t* milist = NULL;
+    size_t count = 0;
 
     snprintf(path, PATH_MAX, "/proc/%d/maps", tid);
     fp = fopen(path, "r");
@@ -82,22 +111,45 @@ map_info_t* load_map_info_list(pid_t tid) {
             if (mi) {
                 mi->next = milist;
                 milist = mi;
+                count++;
             }
         }
         fclose(fp);
     }
+    if (milist) {
+        build_map_info_index(milist, count);
+    }
     return milist;
 }
 
 void free_map_info_list(map_info_t* milist) {
     while (milist) {
         map_info_t* next = milist->next;
+        free(milist->index);
         free(milist);
         milist = next;
     }
 }
 
 const map_info_t* find_map_info(const map_info_t* milist, uintptr_t addr) {
+    if (milist && milist->index) {
+        // Find the last map that starts at or below addr.
+        const struct map_info_index* index = milist->index;
+        size_t lo = 0, hi = index->count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (index->maps[mid]->start <= addr) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo && addr < index->maps[lo - 1]->end) {
+            return index->maps[lo - 1];
+        }
+        return NULL;
+    }
+
     const map_info_t* mi = milist;
     while (mi && !(addr >= mi->start && addr < mi->end)) {
         mi = mi->next;
@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Corkscrew"
+//#define LOG_NDEBUG 0
+
+#include <corkscrew/backtrace.h>
+#include <corkscrew/map_info.h>
+#include <corkscrew/profiler.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <cutils/atomic.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#if !defined(__BIONIC__)
+
+// glibc doesn't implement or export gettid.
+
+#include <sys/syscall.h>
+
+static pid_t gettid() {
+  return syscall(__NR_gettid);
+}
+
+#endif
+
+#define MAX_FRAMES 32
+#define MAX_THREADS 128
+#define RING_WORDS 4096    // per thread, a power of two
+#define DRAIN_INTERVAL_US 50000
+
+/*
+ * Each thread's samples go into a ring owned by that thread: only its own
+ * SIGPROF handler writes to it (and the handler does not nest), and only the
+ * drain thread reads from it, so head and tail need no locks.
+ * A sample is its frame count followed by the pcs.
+ */
+typedef struct {
+    volatile int32_t tid;     // 0 until claimed by a thread
+    volatile int32_t head;    // advanced by the owning thread
+    volatile int32_t tail;    // advanced by the drain thread
+    uint32_t samples;
+    uint32_t dropped;
+    uint64_t handler_ns;
+    uint32_t words[RING_WORDS];
+} ring_t;
+
+static pthread_mutex_t g_profiler_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+    bool running;
+    int hz;
+    ring_t* rings;
+    map_info_t* map_info_list;
+    FILE* out;
+    pthread_t drain_thread;
+    struct timespec wall_start;
+    struct timespec cpu_start;
+} g_profiler;
+
+static volatile int32_t g_active;       // the handler may sample
+static volatile int32_t g_in_handler;   // handlers that may be touching the rings
+static volatile int32_t g_unclaimed;    // samples dropped for lack of a free ring
+static volatile int32_t g_draining;
+
+static int g_control_pipe[2] = { -1, -1 };
+static volatile int32_t g_control_lost;     // requests the control pipe didn't take
+
+static int64_t elapsed_ns(const struct timespec* from, const struct timespec* to) {
+    return (to->tv_sec - from->tv_sec) * 1000000000LL + (to->tv_nsec - from->tv_nsec);
+}
+
+static ring_t* claim_ring(pid_t tid) {
+    for (int i = 0; i < MAX_THREADS; i++) {
+        ring_t* ring = &g_profiler.rings[(tid + i) % MAX_THREADS];
+        int32_t owner = android_atomic_acquire_load(&ring->tid);
+        if (owner == tid) {
+            return ring;
+        }
+        if (!owner && !android_atomic_acquire_cas(0, tid, &ring->tid)) {
+            return ring;
+        }
+    }
+    return NULL;
+}
+
+static void push_sample(ring_t* ring, const backtrace_frame_t* frames, size_t count) {
+    uint32_t head = ring->head;
+    uint32_t tail = android_atomic_acquire_load(&ring->tail);
+    if (RING_WORDS - (head - tail) < count + 1) {
+        ring->dropped++;
+        return;
+    }
+    ring->words[head++ % RING_WORDS] = count;
+    for (size_t i = 0; i < count; i++) {
+        ring->words[head++ % RING_WORDS] = frames[i].absolute_pc;
+    }
+    android_atomic_release_store(head, &ring->head);
+    ring->samples++;
+}
+
+static void profiler_signal_handler(int n __attribute__((unused)), siginfo_t* siginfo,
+        void* sigcontext) {
+    int saved_errno = errno;
+    android_atomic_inc(&g_in_handler);
+    if (android_atomic_acquire_load(&g_active)) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ring_t* ring = claim_ring(gettid());
+        if (ring) {
+            backtrace_frame_t frames[MAX_FRAMES];
+            ssize_t count = unwind_backtrace_signal(siginfo, sigcontext,
+                    g_profiler.map_info_list, frames, 0, MAX_FRAMES);
+            if (count > 0) {
+                push_sample(ring, frames, count);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            ring->handler_ns += elapsed_ns(&start, &end);
+        } else {
+            android_atomic_inc(&g_unclaimed);
+        }
+    }
+    android_atomic_dec(&g_in_handler);
+    errno = saved_errno;
+}
+
+static void write_words(const uint32_t* words, size_t count) {
+    fwrite(words, sizeof(uint32_t), count, g_profiler.out);
+}
+
+static void drain_rings() {
+    uint32_t record[3 + MAX_FRAMES];
+    for (int i = 0; i < MAX_THREADS; i++) {
+        ring_t* ring = &g_profiler.rings[i];
+        int32_t tid = android_atomic_acquire_load(&ring->tid);
+        if (!tid) {
+            continue;
+        }
+        uint32_t head = android_atomic_acquire_load(&ring->head);
+        uint32_t tail = ring->tail;
+        while (tail != head) {
+            uint32_t count = ring->words[tail++ % RING_WORDS];
+            record[0] = PROFILER_RECORD_SAMPLE;
+            record[1] = tid;
+            record[2] = count;
+            for (uint32_t j = 0; j < count; j++) {
+                record[3 + j] = ring->words[tail++ % RING_WORDS];
+            }
+            write_words(record, 3 + count);
+        }
+        android_atomic_release_store(tail, &ring->tail);
+    }
+}
+
+static void* drain_thread(void* arg __attribute__((unused))) {
+    while (android_atomic_acquire_load(&g_draining)) {
+        usleep(DRAIN_INTERVAL_US);
+        drain_rings();
+    }
+    return NULL;
+}
+
+/* Records the executable mappings, so the profile can be symbolized offline. */
+static void write_maps() {
+    map_info_t* milist = load_map_info_list(getpid());
+    for (const map_info_t* mi = milist; mi; mi = mi->next) {
+        if (!mi->is_executable || mi->name[0] != '/') {
+            continue;
+        }
+        uint32_t length = strlen(mi->name);
+        uint32_t header[4] = { PROFILER_RECORD_MAP, mi->start, mi->end, length };
+        uint32_t padding = 0;
+        write_words(header, 4);
+        fwrite(mi->name, 1, length, g_profiler.out);
+        fwrite(&padding, 1, (4 - length % 4) % 4, g_profiler.out);
+    }
+    free_map_info_list(milist);
+}
+
+int profiler_start(int hz, const char* path) {
+    int result = -1;
+    pthread_mutex_lock(&g_profiler_mutex);
+    if (g_profiler.running || hz <= 0 || hz > 1000) {
+        goto out;
+    }
+
+    // Only write to a profile corkprof made for us: a file of our own with no
+    // other names, not one that someone else created or linked there.
+    int fd = open(path, O_WRONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        ALOGE("Could not open profile %s: %s", path, strerror(errno));
+        goto out;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_uid != geteuid() || st.st_nlink != 1
+            || (st.st_mode & 077)) {
+        ALOGE("Not writing profile to %s: not a private file of ours", path);
+        close(fd);
+        goto out;
+    }
+    if (ftruncate(fd, 0)) {
+        close(fd);
+        goto out;
+    }
+    g_profiler.out = fdopen(fd, "w");
+    if (!g_profiler.out) {
+        close(fd);
+        goto out;
+    }
+    // Rings are only backed by memory once a thread actually uses them.
+    g_profiler.rings = mmap(NULL, MAX_THREADS * sizeof(ring_t), PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (g_profiler.rings == MAP_FAILED) {
+        fclose(g_profiler.out);
+        goto out;
+    }
+    uint32_t header[2] = { PROFILER_MAGIC, PROFILER_VERSION };
+    write_words(header, 2);
+
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    act.sa_sigaction = profiler_signal_handler;
+    act.sa_flags = SA_RESTART | SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&act.sa_mask);
+    // The handler stays installed after stopping, in case a SIGPROF is still
+    // pending then: the default action would kill the process.
+    sigaction(SIGPROF, &act, NULL);
+
+    g_profiler.hz = hz;
+    g_profiler.map_info_list = acquire_my_map_info_list();
+    android_atomic_release_store(0, &g_unclaimed);
+    android_atomic_release_store(1, &g_draining);
+    if (pthread_create(&g_profiler.drain_thread, NULL, drain_thread, NULL)) {
+        release_my_map_info_list(g_profiler.map_info_list);
+        munmap(g_profiler.rings, MAX_THREADS * sizeof(ring_t));
+        fclose(g_profiler.out);
+        goto out;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &g_profiler.wall_start);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &g_profiler.cpu_start);
+    android_atomic_release_store(1, &g_active);
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 1000000 / hz;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, NULL);
+
+    ALOGI("Profiling process %d at %d Hz into %s.", getpid(), hz, path);
+    g_profiler.running = true;
+    result = 0;
+out:
+    pthread_mutex_unlock(&g_profiler_mutex);
+    return result;
+}
+
+int profiler_stop() {
+    pthread_mutex_lock(&g_profiler_mutex);
+    if (!g_profiler.running) {
+        pthread_mutex_unlock(&g_profiler_mutex);
+        return -1;
+    }
+
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    android_atomic_release_store(0, &g_active);
+
+    struct timespec wall_end, cpu_end;
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+
+    // Handlers that saw g_active before it was cleared may still be writing.
+    while (android_atomic_acquire_load(&g_in_handler)) {
+        usleep(1000);
+    }
+    android_atomic_release_store(0, &g_draining);
+    pthread_join(g_profiler.drain_thread, NULL);
+    drain_rings();
+    write_maps();
+
+    uint32_t samples = 0;
+    uint32_t dropped = android_atomic_acquire_load(&g_unclaimed);
+    uint64_t handler_ns = 0;
+    for (int i = 0; i < MAX_THREADS; i++) {
+        samples += g_profiler.rings[i].samples;
+        dropped += g_profiler.rings[i].dropped;
+        handler_ns += g_profiler.rings[i].handler_ns;
+    }
+    uint32_t stats[7] = {
+        PROFILER_RECORD_STATS,
+        g_profiler.hz,
+        samples,
+        dropped,
+        elapsed_ns(&g_profiler.wall_start, &wall_end) / 1000000,
+        elapsed_ns(&g_profiler.cpu_start, &cpu_end) / 1000,
+        handler_ns / 1000,
+    };
+    write_words(stats, 7);
+    uint32_t end[2] = { PROFILER_RECORD_END, PROFILER_MAGIC };
+    write_words(end, 2);
+    fclose(g_profiler.out);
+
+    ALOGI("Stopped profiling process %d: %u samples, %u dropped.", getpid(), samples, dropped);
+    release_my_map_info_list(g_profiler.map_info_list);
+    munmap(g_profiler.rings, MAX_THREADS * sizeof(ring_t));
+    g_profiler.running = false;
+    pthread_mutex_unlock(&g_profiler_mutex);
+    return 0;
+}
+
+static void profiler_control_handler(int n __attribute__((unused)), siginfo_t* siginfo,
+        void* sigcontext __attribute__((unused))) {
+    if (siginfo->si_code == SI_QUEUE) {
+        int saved_errno = errno;
+        int hz = siginfo->si_value.sival_int;
+        ssize_t n;
+        do {
+            n = write(g_control_pipe[1], &hz, sizeof(hz));
+        } while (n < 0 && errno == EINTR);
+        if (n != sizeof(hz)) {
+            android_atomic_inc(&g_control_lost);
+        }
+        errno = saved_errno;
+    }
+}
+
+/* Starting and stopping take locks and allocate, so it happens here rather
+ * than in the signal handler. */
+static void* control_thread(void* arg __attribute__((unused))) {
+    char path[64];
+    snprintf(path, sizeof(path), PROFILER_DATA_PATH_FORMAT, getpid());
+    for (;;) {
+        int hz;
+        ssize_t n = read(g_control_pipe[0], &hz, sizeof(hz));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n != sizeof(hz)) {
+            break;
+        }
+        int32_t lost = android_atomic_and(0, &g_control_lost);
+        if (lost) {
+            ALOGW("Lost %d profiler control requests", lost);
+        }
+        if (hz > 0) {
+            profiler_start(hz, path);
+        } else {
+            profiler_stop();
+        }
+    }
+    return NULL;
+}
+
+void profiler_install() {
+    char value[PROPERTY_VALUE_MAX];
+    property_get("ro.debuggable", value, "0");
+    if (strcmp(value, "1") || g_control_pipe[0] >= 0) {
+        return;
+    }
+
+    if (pipe(g_control_pipe)) {
+        return;
+    }
+    fcntl(g_control_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(g_control_pipe[1], F_SETFD, FD_CLOEXEC);
+    // Never block the signal handler on a control thread that has fallen behind.
+    fcntl(g_control_pipe[1], F_SETFL, O_NONBLOCK);
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, control_thread, NULL)) {
+        close(g_control_pipe[0]);
+        close(g_control_pipe[1]);
+        g_control_pipe[0] = g_control_pipe[1] = -1;
+        return;
+    }
+
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    act.sa_sigaction = profiler_control_handler;
+    act.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigemptyset(&act.sa_mask);
+    sigaction(PROFILER_CONTROL_SIGNAL, &act, NULL);
+}
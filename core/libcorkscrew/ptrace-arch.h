@@ -37,7 +37,7 @@ typedef struct {
     symbol_table_t* symbol_table;
 } map_info_data_t;
 
-void load_ptrace_map_info_data_arch(pid_t pid, map_info_t* mi, map_info_data_t* data);
+void load_ptrace_map_info_data_arch(const memory_t* memory, map_info_t* mi, map_info_data_t* data);
 void free_ptrace_map_info_data_arch(map_info_t* mi, map_info_data_t* data);
 
 #ifdef __cplusplus
@@ -21,8 +21,14 @@
 #include <corkscrew/ptrace.h>
 
 #include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <cutils/log.h>
 
 static const uint32_t ELF_MAGIC = 0x464C457f; // "ELF\0177"
@@ -35,14 +41,119 @@ static const uint32_t ELF_MAGIC = 0x464C457f; // "ELF\0177"
 #define PAGE_MASK (~(PAGE_SIZE - 1))
 #endif
 
+// Number of pages in the direct-mapped cache of a remote process's memory.
+#define REMOTE_CACHE_PAGES 64
+
+enum {
+    PAGE_EMPTY = 0,
+    PAGE_VALID,
+    PAGE_UNREADABLE,
+};
+
+struct remote_memory {
+    pid_t pid;
+    const map_info_t* map_info_list;
+    bool use_vm_readv;
+    int mem_fd; // /proc/<pid>/mem, -1 if unusable, -2 if not yet opened
+    uintptr_t page_addr[REMOTE_CACHE_PAGES];
+    uint8_t page_state[REMOTE_CACHE_PAGES];
+    bool page_writable[REMOTE_CACHE_PAGES];
+    uint8_t pages[REMOTE_CACHE_PAGES][PAGE_SIZE];
+};
+
+static remote_memory_t* create_remote_memory(pid_t pid, const map_info_t* map_info_list) {
+    remote_memory_t* rm = (remote_memory_t*)calloc(1, sizeof(remote_memory_t));
+    if (rm) {
+        rm->pid = pid;
+        rm->map_info_list = map_info_list;
+#ifdef __NR_process_vm_readv
+        rm->use_vm_readv = true;
+#endif
+        rm->mem_fd = -2;
+    }
+    return rm;
+}
+
+static void free_remote_memory(remote_memory_t* rm) {
+    if (rm) {
+        if (rm->mem_fd >= 0) {
+            close(rm->mem_fd);
+        }
+        free(rm);
+    }
+}
+
+// Reads a page-aligned range with as few system calls as the kernel allows:
+// process_vm_readv() (Linux 3.2), then /proc/<pid>/mem, then PTRACE_PEEKTEXT.
+static ssize_t read_remote(remote_memory_t* rm, uintptr_t ptr, void* buf, size_t len) {
+#ifdef __NR_process_vm_readv
+    if (rm->use_vm_readv) {
+        struct iovec local = { buf, len };
+        struct iovec remote = { (void*)ptr, len };
+        ssize_t n = syscall(__NR_process_vm_readv, rm->pid, &local, 1, &remote, 1, 0);
+        if (n >= 0 || (errno != ENOSYS && errno != EPERM)) {
+            return n;
+        }
+        ALOGV("process_vm_readv() unavailable for pid %d, errno=%d", rm->pid, errno);
+        rm->use_vm_readv = false;
+    }
+#endif
+    if (rm->mem_fd == -2) {
+        char path[32];
+        snprintf(path, sizeof(path), "/proc/%d/mem", rm->pid);
+        rm->mem_fd = open(path, O_RDONLY);
+    }
+    if (rm->mem_fd >= 0) {
+        ssize_t n;
+        do {
+            n = pread64(rm->mem_fd, buf, len, ptr);
+        } while (n < 0 && errno == EINTR);
+        return n;
+    }
+
+    size_t done = 0;
+    while (done < len) {
+        errno = 0;
+        long value = ptrace(PTRACE_PEEKTEXT, rm->pid, (void*)(ptr + done), NULL);
+        if (value == -1 && errno) {
+            break;
+        }
+        memcpy((uint8_t*)buf + done, &value, sizeof(uint32_t));
+        done += sizeof(uint32_t);
+    }
+    return done ? (ssize_t)done : -1;
+}
+
+// Returns the cached copy of the page containing ptr, or NULL if it is unreadable.
+static const uint8_t* get_remote_page(remote_memory_t* rm, uintptr_t ptr) {
+    uintptr_t page = ptr & PAGE_MASK;
+    size_t slot = (page / PAGE_SIZE) % REMOTE_CACHE_PAGES;
+    if (rm->page_state[slot] == PAGE_EMPTY || rm->page_addr[slot] != page) {
+        const map_info_t* mi = find_map_info(rm->map_info_list, page);
+        rm->page_addr[slot] = page;
+        rm->page_writable[slot] = !mi || mi->is_writable;
+        rm->page_state[slot] = read_remote(rm, page, rm->pages[slot], PAGE_SIZE) == PAGE_SIZE
+                ? PAGE_VALID : PAGE_UNREADABLE;
+    }
+    return rm->page_state[slot] == PAGE_VALID ? rm->pages[slot] : NULL;
+}
+
 void init_memory(memory_t* memory, const map_info_t* map_info_list) {
     memory->tid = -1;
     memory->map_info_list = map_info_list;
+    memory->remote_memory = NULL;
 }
 
 void init_memory_ptrace(memory_t* memory, pid_t tid) {
     memory->tid = tid;
     memory->map_info_list = NULL;
+    memory->remote_memory = NULL;
+}
+
+void init_memory_ptrace_context(memory_t* memory, pid_t tid, const ptrace_context_t* context) {
+    memory->tid = tid;
+    memory->map_info_list = context->map_info_list;
+    memory->remote_memory = context->remote_memory;
 }
 
 bool try_get_word(const memory_t* memory, uintptr_t ptr, uint32_t* out_value) {
@@ -60,6 +171,15 @@ bool try_get_word(const memory_t* memory, uintptr_t ptr, uint32_t* out_value) {
         }
         *out_value = *(uint32_t*)ptr;
         return true;
+    } else if (memory->remote_memory) {
+        const uint8_t* page = get_remote_page(memory->remote_memory, ptr);
+        if (!page) {
+            ALOGV("try_get_word: invalid pointer 0x%08x reading from tid %d", ptr, memory->tid);
+            *out_value = 0xffffffffL;
+            return false;
+        }
+        *out_value = *(const uint32_t*)(page + (ptr & ~PAGE_MASK));
+        return true;
     } else {
         // ptrace() returns -1 and sets errno when the operation fails.
         // To disambiguate -1 from a valid result, we clear errno beforehand.
@@ -80,18 +200,48 @@ bool try_get_word_ptrace(pid_t tid, uintptr_t ptr, uint32_t* out_value) {
     return try_get_word(&memory, ptr, out_value);
 }
 
-static void load_ptrace_map_info_data(pid_t pid, map_info_t* mi) {
+size_t read_memory_ptrace(const ptrace_context_t* context, uintptr_t ptr, void* buf, size_t len) {
+    remote_memory_t* rm = context->remote_memory;
+    size_t done = 0;
+    while (done < len) {
+        size_t offset = (ptr + done) & ~PAGE_MASK;
+        size_t n = PAGE_SIZE - offset;
+        if (n > len - done) {
+            n = len - done;
+        }
+        const uint8_t* page = rm ? get_remote_page(rm, ptr + done) : NULL;
+        if (!page) {
+            break;
+        }
+        memcpy((uint8_t*)buf + done, page + offset, n);
+        done += n;
+    }
+    return done;
+}
+
+void flush_ptrace_context_memory(const ptrace_context_t* context) {
+    remote_memory_t* rm = context->remote_memory;
+    if (rm) {
+        for (size_t i = 0; i < REMOTE_CACHE_PAGES; i++) {
+            if (rm->page_state[i] != PAGE_VALID || rm->page_writable[i]) {
+                rm->page_state[i] = PAGE_EMPTY;
+            }
+        }
+    }
+}
+
+static void load_ptrace_map_info_data(const memory_t* memory, map_info_t* mi) {
     if (mi->is_executable && mi->is_readable) {
         uint32_t elf_magic;
-        if (try_get_word_ptrace(pid, mi->start, &elf_magic) && elf_magic == ELF_MAGIC) {
+        if (try_get_word(memory, mi->start, &elf_magic) && elf_magic == ELF_MAGIC) {
             map_info_data_t* data = (map_info_data_t*)calloc(1, sizeof(map_info_data_t));
             if (data) {
                 mi->data = data;
                 if (mi->name[0]) {
-                    data->symbol_table = load_symbol_table(mi->name);
+                    data->symbol_table = acquire_symbol_table(mi->name);
                 }
 #ifdef CORKSCREW_HAVE_ARCH
-                load_ptrace_map_info_data_arch(pid, mi, data);
+                load_ptrace_map_info_data_arch(memory, mi, data);
 #endif
             }
         }
@@ -103,8 +253,11 @@ ptrace_context_t* load_ptrace_context(pid_t pid) {
             (ptrace_context_t*)calloc(1, sizeof(ptrace_context_t));
     if (context) {
         context->map_info_list = load_map_info_list(pid);
+        context->remote_memory = create_remote_memory(pid, context->map_info_list);
+        memory_t memory;
+        init_memory_ptrace_context(&memory, pid, context);
         for (map_info_t* mi = context->map_info_list; mi; mi = mi->next) {
-            load_ptrace_map_info_data(pid, mi);
+            load_ptrace_map_info_data(&memory, mi);
         }
     }
     return context;
@@ -114,7 +267,7 @@ static void free_ptrace_map_info_data(map_info_t* mi) {
     map_info_data_t* data = (map_info_data_t*)mi->data;
     if (data) {
         if (data->symbol_table) {
-            free_symbol_table(data->symbol_table);
+            release_symbol_table(data->symbol_table);
         }
 #ifdef CORKSCREW_HAVE_ARCH
         free_ptrace_map_info_data_arch(mi, data);
@@ -129,6 +282,8 @@ void free_ptrace_context(ptrace_context_t* context) {
         free_ptrace_map_info_data(mi);
     }
     free_map_info_list(context->map_info_list);
+    free_remote_memory(context->remote_memory);
+    free(context);
 }
 
 void find_symbol_ptrace(const ptrace_context_t* context,
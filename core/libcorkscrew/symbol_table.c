@@ -23,7 +23,9 @@
 #include <stdlib.h>
 #include <elf.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <cutils/log.h>
@@ -76,7 +78,7 @@ symbol_table_t* load_symbol_table(const char *filename) {
     // Parse the file header
     Elf32_Ehdr *hdr = (Elf32_Ehdr*)base;
     if (!is_elf(hdr)) {
-        goto out_close;
+        goto out_unmap;
     }
     Elf32_Shdr *shdr = (Elf32_Shdr*)(base + hdr->e_shoff);
 
@@ -212,6 +214,107 @@ void free_symbol_table(symbol_table_t* table) {
     }
 }
 
+// Symbol tables handed out by acquire_symbol_table(), most recently used
+// first. Tables nobody holds stay cached, up to MAX_IDLE_SYMBOL_TABLES.
+typedef struct symbol_table_entry {
+    struct symbol_table_entry* next;
+    dev_t dev;
+    ino_t ino;
+    time_t mtime;
+    off_t size;
+    symbol_table_t* table; // NULL if the file has no symbols
+    uint32_t refs;
+    bool stale; // the file has changed; freed once the last reference is gone
+    char path[];
+} symbol_table_entry_t;
+
+static const size_t MAX_IDLE_SYMBOL_TABLES = 32;
+
+static pthread_mutex_t g_symbol_table_mutex = PTHREAD_MUTEX_INITIALIZER;
+static symbol_table_entry_t* g_symbol_tables = NULL;
+
+static void trim_symbol_tables_locked() {
+    size_t idle = 0;
+    symbol_table_entry_t** link = &g_symbol_tables;
+    while (*link) {
+        symbol_table_entry_t* e = *link;
+        if (!e->refs && (e->stale || ++idle > MAX_IDLE_SYMBOL_TABLES)) {
+            ALOGV("Evicting symbol table for '%s'.", e->path);
+            *link = e->next;
+            free_symbol_table(e->table);
+            free(e);
+        } else {
+            link = &e->next;
+        }
+    }
+}
+
+symbol_table_t* acquire_symbol_table(const char* filename) {
+    struct stat sb;
+    if (stat(filename, &sb)) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_symbol_table_mutex);
+
+    symbol_table_entry_t** link = &g_symbol_tables;
+    symbol_table_entry_t* e;
+    for (e = *link; e; link = &e->next, e = e->next) {
+        if (!e->stale && !strcmp(e->path, filename)) {
+            break;
+        }
+    }
+    if (e && (e->dev != sb.st_dev || e->ino != sb.st_ino
+            || e->mtime != sb.st_mtime || e->size != sb.st_size)) {
+        ALOGV("Symbol table for '%s' is out of date.", filename);
+        e->stale = true;
+        e = NULL;
+    }
+    if (e) {
+        *link = e->next;
+    } else {
+        size_t len = strlen(filename);
+        e = calloc(1, sizeof(symbol_table_entry_t) + len + 1);
+        if (!e) {
+            pthread_mutex_unlock(&g_symbol_table_mutex);
+            return NULL;
+        }
+        e->dev = sb.st_dev;
+        e->ino = sb.st_ino;
+        e->mtime = sb.st_mtime;
+        e->size = sb.st_size;
+        memcpy(e->path, filename, len + 1);
+        e->table = load_symbol_table(filename);
+    }
+    e->next = g_symbol_tables;
+    g_symbol_tables = e;
+
+    symbol_table_t* table = e->table;
+    if (table) {
+        e->refs += 1;
+    }
+    trim_symbol_tables_locked();
+
+    pthread_mutex_unlock(&g_symbol_table_mutex);
+    return table;
+}
+
+void release_symbol_table(symbol_table_t* table) {
+    if (!table) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_symbol_table_mutex);
+    for (symbol_table_entry_t* e = g_symbol_tables; e; e = e->next) {
+        if (e->table == table) {
+            e->refs -= 1;
+            break;
+        }
+    }
+    trim_symbol_tables_locked();
+    pthread_mutex_unlock(&g_symbol_table_mutex);
+}
+
 const symbol_t* find_symbol(const symbol_table_t* table, uintptr_t addr) {
     if (!table) return NULL;
     return (const symbol_t*)bsearch(&addr, table->symbols, table->num_symbols,
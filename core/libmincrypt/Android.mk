@@ -5,14 +5,31 @@ include $(CLEAR_VARS)
 
 LOCAL_MODULE := libmincrypt
 LOCAL_SRC_FILES := rsa.c rsa_e_3.c rsa_e_f4.c sha.c
+ifeq ($(TARGET_ARCH),arm)
+LOCAL_SRC_FILES += sha_neon.c
+endif
+ifeq ($(TARGET_ARCH),x86)
+LOCAL_SRC_FILES += sha_x86.c
+endif
 include $(BUILD_STATIC_LIBRARY)
 
 include $(CLEAR_VARS)
 
 LOCAL_MODULE := libmincrypt
 LOCAL_SRC_FILES := rsa.c rsa_e_3.c rsa_e_f4.c sha.c
+ifeq ($(HOST_ARCH),x86)
+LOCAL_SRC_FILES += sha_x86.c
+endif
 include $(BUILD_HOST_STATIC_LIBRARY)
 
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := sha_bench
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := sha_bench.c
+LOCAL_STATIC_LIBRARIES := libmincrypt
+include $(BUILD_HOST_EXECUTABLE)
+
 
 # TODO: drop the hyphen once these are checked in
 include $(LOCAL_PATH)/tools/Android.mk
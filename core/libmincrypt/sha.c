@@ -26,6 +26,7 @@
 */
 
 #include "mincrypt/sha.h"
+#include "sha_impl.h"
 
 // Some machines lack byteswap.h and endian.h.  These have to use the
 // slower code, even if they're little-endian.
@@ -48,20 +49,20 @@ static inline uint32_t ror31(uint32_t val) {
     return (val >> 31) | (val << 1);
 }
 
-static void SHA1_Transform(SHA_CTX* ctx) {
+static void SHA1_Transform(uint32_t* state, const uint32_t* block) {
     uint32_t W[80];
     register uint32_t A, B, C, D, E;
     int t;
 
-    A = ctx->state[0];
-    B = ctx->state[1];
-    C = ctx->state[2];
-    D = ctx->state[3];
-    E = ctx->state[4];
+    A = state[0];
+    B = state[1];
+    C = state[2];
+    D = state[3];
+    E = state[4];
 
 #define SHA_F1(A,B,C,D,E,t)                     \
     E += ror27(A) +                             \
-        (W[t] = bswap_32(ctx->buf.w[t])) +      \
+        (W[t] = bswap_32(block[t])) +           \
         (D^(B&(C^D))) + 0x5A827999;             \
     B = ror2(B);
 
@@ -137,49 +138,115 @@ static void SHA1_Transform(SHA_CTX* ctx) {
 
 #undef SHA_F4
 
-    ctx->state[0] += A;
-    ctx->state[1] += B;
-    ctx->state[2] += C;
-    ctx->state[3] += D;
-    ctx->state[4] += E;
+    state[0] += A;
+    state[1] += B;
+    state[2] += C;
+    state[3] += D;
+    state[4] += E;
+}
+
+static void SHA1_portable_blocks(uint32_t* state, const uint8_t* data, int nblocks) {
+    uint32_t block[16];
+
+    for (; nblocks > 0; nblocks--, data += sizeof(block)) {
+        memcpy(block, data, sizeof(block));
+        SHA1_Transform(state, block);
+    }
+}
+
+static const SHA1Impl sha1_portable = { "portable", SHA1_portable_blocks, 0, NULL };
+
+// Chosen on first use. Threads racing to choose all store the same pointer.
+static const SHA1Impl* sha1_impl;
+
+int SHA1_impls(const SHA1Impl** impls, int max) {
+    int n = 0;
+#ifdef SHA_HAVE_X86
+    n += SHA1_x86_impls(impls + n, max - n);
+#endif
+#ifdef SHA_HAVE_NEON
+    n += SHA1_neon_impls(impls + n, max - n);
+#endif
+    if (n < max) {
+        impls[n++] = &sha1_portable;
+    }
+    return n;
+}
+
+void SHA1_use_impl(const SHA1Impl* impl) {
+    if (impl == NULL) {
+        const SHA1Impl* impls[SHA_MAX_LANES];
+        SHA1_impls(impls, SHA_MAX_LANES);
+        impl = impls[0];
+    }
+    sha1_impl = impl;
+}
+
+static const SHA1Impl* SHA1_get_impl(void) {
+    const SHA1Impl* impl = sha1_impl;
+    if (impl == NULL) {
+        SHA1_use_impl(NULL);
+        impl = sha1_impl;
+    }
+    return impl;
 }
 
 void SHA_update(SHA_CTX* ctx, const void* data, int len) {
     int i = ctx->count % sizeof(ctx->buf);
     const uint8_t* p = (const uint8_t*)data;
+    const SHA1Impl* impl = SHA1_get_impl();
+    void (*blocks)(uint32_t*, const uint8_t*, int) =
+            impl->blocks ? impl->blocks : SHA1_portable_blocks;
+    int n;
 
     ctx->count += len;
 
-    while (len > sizeof(ctx->buf) - i) {
-        memcpy(&ctx->buf.b[i], p, sizeof(ctx->buf) - i);
-        len -= sizeof(ctx->buf) - i;
-        p += sizeof(ctx->buf) - i;
-        SHA1_Transform(ctx);
-        i = 0;
+    if (i) {
+        n = sizeof(ctx->buf) - i;
+        if (len < n) {
+            memcpy(&ctx->buf.b[i], p, len);
+            return;
+        }
+        memcpy(&ctx->buf.b[i], p, n);
+        blocks(ctx->state, ctx->buf.b, 1);
+        p += n;
+        len -= n;
     }
 
-    while (len--) {
-        ctx->buf.b[i++] = *p++;
-        if (i == sizeof(ctx->buf)) {
-            SHA1_Transform(ctx);
-            i = 0;
-        }
+    // Whole blocks are hashed where they are, without copying them.
+    n = len / sizeof(ctx->buf);
+    if (n) {
+        blocks(ctx->state, p, n);
+        p += n * sizeof(ctx->buf);
+        len -= n * sizeof(ctx->buf);
     }
+
+    memcpy(ctx->buf.b, p, len);
 }
 
 
 const uint8_t* SHA_final(SHA_CTX* ctx) {
     uint64_t cnt = ctx->count * 8;
-    int i;
-
-    SHA_update(ctx, (uint8_t*)"\x80", 1);
-    while ((ctx->count % sizeof(ctx->buf)) != (sizeof(ctx->buf) - 8)) {
-        SHA_update(ctx, (uint8_t*)"\0", 1);
+    unsigned int i = ctx->count % sizeof(ctx->buf);
+    const SHA1Impl* impl = SHA1_get_impl();
+    void (*blocks)(uint32_t*, const uint8_t*, int) =
+            impl->blocks ? impl->blocks : SHA1_portable_blocks;
+
+    ctx->count = (ctx->count + 1 + 8 + 63) & ~(uint64_t)63;
+
+    // The padding is laid out in the buffer directly rather than fed
+    // through SHA_update() a byte at a time.
+    ctx->buf.b[i++] = 0x80;
+    if (i > sizeof(ctx->buf) - 8) {
+        memset(&ctx->buf.b[i], 0, sizeof(ctx->buf) - i);
+        blocks(ctx->state, ctx->buf.b, 1);
+        i = 0;
     }
+    memset(&ctx->buf.b[i], 0, sizeof(ctx->buf) - 8 - i);
     for (i = 0; i < 8; ++i) {
-        uint8_t tmp = cnt >> ((7 - i) * 8);
-        SHA_update(ctx, &tmp, 1);
+        ctx->buf.b[sizeof(ctx->buf) - 8 + i] = cnt >> ((7 - i) * 8);
     }
+    blocks(ctx->state, ctx->buf.b, 1);
 
     for (i = 0; i < 5; i++) {
         ctx->buf.w[i] = bswap_32(ctx->state[i]);
@@ -305,3 +372,147 @@ const uint8_t* SHA(const void *data, int len, uint8_t *digest) {
     }
     return digest;
 }
+
+#if defined(HAVE_ENDIAN_H) && defined(HAVE_LITTLE_ENDIAN)
+
+// One message being hashed in a lane of SHA_multi(): its whole blocks are
+// read in place, then the one or two blocks of what is left and the padding.
+typedef struct {
+    int msg;                // or -1 if the lane is idle
+    const uint8_t* p;       // next block
+    int blocks;             // blocks left at p
+    int pad_blocks;         // blocks left in pad after those
+    uint8_t pad[128];
+} SHA1Lane;
+
+static void SHA1_lane_start(SHA1Lane* lane, uint32_t* state, int lanes, int l,
+                            int msg, const uint8_t* data, int len) {
+    static const uint32_t iv[5] = {
+        0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+    };
+    uint64_t bits = (uint64_t)len * 8;
+    int rem = len % 64;
+    int i;
+
+    lane->msg = msg;
+    lane->p = data;
+    lane->blocks = len / 64;
+    lane->pad_blocks = rem < 56 ? 1 : 2;
+    memset(lane->pad, 0, sizeof(lane->pad));
+    memcpy(lane->pad, data + len - rem, rem);
+    lane->pad[rem] = 0x80;
+    for (i = 0; i < 8; i++) {
+        lane->pad[lane->pad_blocks * 64 - 1 - i] = bits >> (i * 8);
+    }
+    for (i = 0; i < 5; i++) {
+        state[i * lanes + l] = iv[i];
+    }
+}
+
+static const uint8_t* SHA1_lane_next(SHA1Lane* lane) {
+    const uint8_t* p;
+
+    if (lane->blocks == 0) {
+        lane->p = lane->pad;
+        lane->blocks = lane->pad_blocks;
+        lane->pad_blocks = 0;
+    }
+    p = lane->p;
+    lane->p += 64;
+    lane->blocks--;
+    return p;
+}
+
+static void SHA1_lane_digest(const uint32_t* state, int lanes, int l, uint8_t* digest) {
+    int i;
+    for (i = 0; i < 5; i++) {
+        uint32_t v = state[i * lanes + l];
+        *digest++ = v >> 24;
+        *digest++ = v >> 16;
+        *digest++ = v >> 8;
+        *digest++ = v;
+    }
+}
+
+void SHA_multi(const void* const* data, const int* len, int count, uint8_t* digests) {
+    static const uint8_t idle[64];
+    const SHA1Impl* impl = SHA1_get_impl();
+    SHA1Lane lane[SHA_MAX_LANES];
+    const uint8_t* blocks[SHA_MAX_LANES];
+    uint32_t state[5 * SHA_MAX_LANES];
+    int lanes = impl->lanes;
+    int next = 0, active = 0;
+    int i, l;
+
+    if (lanes == 0) {
+        for (i = 0; i < count; i++) {
+            SHA(data[i], len[i], digests + i * SHA_DIGEST_SIZE);
+        }
+        return;
+    }
+
+    memset(state, 0, sizeof(state));
+    for (l = 0; l < lanes; l++) {
+        lane[l].msg = -1;
+        if (next < count) {
+            SHA1_lane_start(&lane[l], state, lanes, l, next, data[next], len[next]);
+            next++;
+            active++;
+        }
+    }
+
+    while (active > 1 || (active == 1 && next < count)) {
+        for (l = 0; l < lanes; l++) {
+            blocks[l] = lane[l].msg >= 0 ? SHA1_lane_next(&lane[l]) : idle;
+        }
+        impl->lanes_block(state, blocks);
+
+        for (l = 0; l < lanes; l++) {
+            if (lane[l].msg < 0 || lane[l].blocks || lane[l].pad_blocks) {
+                continue;
+            }
+            SHA1_lane_digest(state, lanes, l, digests + lane[l].msg * SHA_DIGEST_SIZE);
+            if (next < count) {
+                SHA1_lane_start(&lane[l], state, lanes, l, next, data[next], len[next]);
+                next++;
+            } else {
+                lane[l].msg = -1;
+                active--;
+            }
+        }
+    }
+
+    // The last message is finished on its own rather than with every other
+    // lane idle.
+    for (l = 0; active && l < lanes; l++) {
+        uint32_t single[5];
+        if (lane[l].msg < 0) {
+            continue;
+        }
+        for (i = 0; i < 5; i++) {
+            single[i] = state[i * lanes + l];
+        }
+        SHA1_portable_blocks(single, lane[l].p, lane[l].blocks);
+        SHA1_portable_blocks(single, lane[l].pad, lane[l].pad_blocks);
+        SHA1_lane_digest(single, 1, 0, digests + lane[l].msg * SHA_DIGEST_SIZE);
+    }
+}
+
+#else   // #if defined(HAVE_ENDIAN_H) && defined(HAVE_LITTLE_ENDIAN)
+
+int SHA1_impls(const SHA1Impl** impls __attribute__((unused)),
+               int max __attribute__((unused))) {
+    return 0;
+}
+
+void SHA1_use_impl(const SHA1Impl* impl __attribute__((unused))) {
+}
+
+void SHA_multi(const void* const* data, const int* len, int count, uint8_t* digests) {
+    int i;
+    for (i = 0; i < count; i++) {
+        SHA(data[i], len[i], digests + i * SHA_DIGEST_SIZE);
+    }
+}
+
+#endif // endianness
@@ -0,0 +1,217 @@
+/* sha_bench.c
+**
+** Copyright 2013, The Android Open Source Project
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of Google Inc. nor the names of its contributors may
+**       be used to endorse or promote products derived from this software
+**       without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY Google Inc. ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+** MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+** EVENT SHALL Google Inc. BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+** OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+** WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+** OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+** ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Checks every SHA-1 implementation this cpu can run against the portable
+// one, then times each hashing one large buffer and many small messages
+// with SHA_multi().
+//
+//   sha_bench [-s megabytes] [-n messages] [-l message length]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "mincrypt/sha.h"
+#include "sha_impl.h"
+
+#define CHECK_LEN 1100
+
+static long long now_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+// What the portable code makes of data, hashed every way the others will be.
+typedef struct {
+    uint8_t whole[CHECK_LEN + 1][SHA_DIGEST_SIZE];
+} Reference;
+
+static int check(const SHA1Impl* impl, const uint8_t* data, const Reference* ref) {
+    static const uint8_t abc[SHA_DIGEST_SIZE] = {
+        0xa9, 0x99, 0x3e, 0x36, 0x47, 0x06, 0x81, 0x6a, 0xba, 0x3e,
+        0x25, 0x71, 0x78, 0x50, 0xc2, 0x6c, 0x9c, 0xd0, 0xd8, 0x9d
+    };
+    const void* msgs[CHECK_LEN + 1];
+    int lens[CHECK_LEN + 1];
+    uint8_t* digests = malloc((CHECK_LEN + 1) * SHA_DIGEST_SIZE);
+    uint8_t digest[SHA_DIGEST_SIZE];
+    int errors = 0;
+    int len, off, count;
+
+    SHA1_use_impl(impl);
+
+    if (memcmp(SHA("abc", 3, digest), abc, SHA_DIGEST_SIZE)) {
+        fprintf(stderr, "%s: wrong digest of \"abc\"\n", impl->name);
+        errors++;
+    }
+
+    // Every length, from unaligned data, and fed in uneven pieces.
+    for (len = 0; len <= CHECK_LEN; len++) {
+        SHA_CTX ctx;
+        int done, piece;
+
+        for (off = 1; off < 4; off++) {
+            memcpy((uint8_t*)data + CHECK_LEN + 8 + off, data, len);
+            SHA(data + CHECK_LEN + 8 + off, len, digest);
+            if (memcmp(digest, ref->whole[len], SHA_DIGEST_SIZE)) {
+                fprintf(stderr, "%s: length %d at offset %d differs\n", impl->name, len, off);
+                errors++;
+            }
+        }
+
+        SHA_init(&ctx);
+        for (done = 0, piece = 1; done < len; done += piece, piece = piece * 3 % 97 + 1) {
+            SHA_update(&ctx, data + done, piece < len - done ? piece : len - done);
+        }
+        if (memcmp(SHA_final(&ctx), ref->whole[len], SHA_DIGEST_SIZE)) {
+            fprintf(stderr, "%s: length %d in pieces differs\n", impl->name, len);
+            errors++;
+        }
+    }
+
+    // Batches of every size up to a few times the lanes, of mixed lengths.
+    for (count = 0; count <= CHECK_LEN; count += count < 40 ? 1 : 97) {
+        int i;
+        for (i = 0; i < count; i++) {
+            lens[i] = (i * 389 + count * 7) % (CHECK_LEN + 1);
+            msgs[i] = data;
+        }
+        SHA_multi(msgs, lens, count, digests);
+        for (i = 0; i < count; i++) {
+            if (memcmp(digests + i * SHA_DIGEST_SIZE, ref->whole[lens[i]], SHA_DIGEST_SIZE)) {
+                fprintf(stderr, "%s: message %d of %d, length %d, differs\n",
+                        impl->name, i, count, lens[i]);
+                errors++;
+            }
+        }
+    }
+
+    free(digests);
+    return errors;
+}
+
+int main(int argc, char** argv) {
+    const SHA1Impl* impls[SHA_MAX_LANES];
+    int megabytes = 64;
+    int messages = 16384;
+    int msg_len = 512;
+    int nimpls, i, k, errors = 0;
+    size_t size;
+    uint8_t* buffer;
+    const void** msgs;
+    int* lens;
+    uint8_t* digests;
+    uint8_t digest[SHA_DIGEST_SIZE];
+    Reference* ref;
+
+    for (i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-s")) {
+            megabytes = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "-n")) {
+            messages = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "-l")) {
+            msg_len = atoi(argv[i + 1]);
+        }
+    }
+    if (megabytes < 1 || messages < 1 || msg_len < 0) {
+        fprintf(stderr, "usage: sha_bench [-s megabytes] [-n messages] [-l message length]\n");
+        return 1;
+    }
+
+    nimpls = SHA1_impls(impls, SHA_MAX_LANES);
+    if (nimpls == 0) {
+        printf("this build has only the portable code\n");
+        return 0;
+    }
+
+    size = (size_t)megabytes << 20;
+    if (size < (size_t)messages * msg_len) {
+        size = (size_t)messages * msg_len;
+    }
+    if (size < 2 * CHECK_LEN + 16) {
+        size = 2 * CHECK_LEN + 16;
+    }
+    buffer = malloc(size);
+    msgs = malloc(messages * sizeof(*msgs));
+    lens = malloc(messages * sizeof(*lens));
+    digests = malloc((size_t)messages * SHA_DIGEST_SIZE);
+    ref = malloc(sizeof(*ref));
+    if (!buffer || !msgs || !lens || !digests || !ref) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < (int)size; i++) {
+        buffer[i] = (i * 2654435761u) >> 17;
+    }
+    for (i = 0; i < messages; i++) {
+        msgs[i] = buffer + (size_t)i * msg_len;
+        lens[i] = msg_len;
+    }
+
+    // The portable implementation is always last.
+    SHA1_use_impl(impls[nimpls - 1]);
+    for (i = 0; i <= CHECK_LEN; i++) {
+        SHA(buffer, i, ref->whole[i]);
+    }
+
+    printf("%-10s %10s %10s %6s\n", "", "1 buffer", "multi", "lanes");
+    for (k = 0; k < nimpls; k++) {
+        const SHA1Impl* impl = impls[k];
+        long long t0, single_us, multi_us;
+
+        errors += check(impl, buffer, ref);
+        for (i = 0; i <= CHECK_LEN; i++) {
+            buffer[CHECK_LEN + 8 + i] = (i * 2654435761u) >> 17;
+        }
+
+        SHA1_use_impl(impl);
+        t0 = now_us();
+        SHA(buffer, size, digest);
+        single_us = now_us() - t0;
+
+        t0 = now_us();
+        SHA_multi(msgs, lens, messages, digests);
+        multi_us = now_us() - t0;
+
+        printf("%-10s %6.0f MB/s %6.0f MB/s %6d%s\n", impl->name,
+               (double)size / single_us, (double)messages * msg_len / multi_us,
+               impl->lanes, k == 0 ? "  (default)" : "");
+    }
+
+    SHA1_use_impl(NULL);
+    if (errors) {
+        printf("%d errors\n", errors);
+    }
+    free(buffer);
+    free(msgs);
+    free(lens);
+    free(digests);
+    free(ref);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+/* sha_impl.h
+**
+** Copyright 2013, The Android Open Source Project
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of Google Inc. nor the names of its contributors may
+**       be used to endorse or promote products derived from this software
+**       without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY Google Inc. ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+** MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+** EVENT SHALL Google Inc. BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+** OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+** WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+** OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+** ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// The SHA-1 compression functions sha.c can choose between. Not part of
+// the library's interface; sha_bench uses it to time each one.
+
+#ifndef _MINCRYPT_SHA_IMPL_H_
+#define _MINCRYPT_SHA_IMPL_H_
+
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Only the little-endian build of sha.c dispatches; the others always
+// run the portable code.
+#if defined(HAVE_ENDIAN_H) && defined(HAVE_LITTLE_ENDIAN)
+
+// The x86 code picks instructions at run time through target attributes,
+// which older compilers do not have.
+#if (defined(__i386__) || defined(__x86_64__)) && defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define SHA_HAVE_X86 1
+#endif
+
+#if defined(__ARM_NEON__)
+#define SHA_HAVE_NEON 1
+#endif
+
+#endif
+
+#define SHA_MAX_LANES 8
+
+typedef struct SHA1Impl {
+    const char* name;
+
+    // Runs nblocks 64 byte blocks of one message through state[5]. NULL if
+    // the implementation only hashes several messages at once.
+    void (*blocks)(uint32_t* state, const uint8_t* data, int nblocks);
+
+    // Runs one block of each of lanes messages at once. The state is five
+    // rows of lanes words: word i of message l is state[i * lanes + l].
+    int lanes;
+    void (*lanes_block)(uint32_t* state, const uint8_t* const* blocks);
+} SHA1Impl;
+
+// Fills impls with those that run on this cpu, the one used by default
+// first and the portable one last. Returns how many there are.
+int SHA1_impls(const SHA1Impl** impls, int max);
+
+// Makes SHA_update() and SHA_multi() use impl, or the default if NULL.
+// Single messages go through the portable code if impl has no blocks().
+void SHA1_use_impl(const SHA1Impl* impl);
+
+#ifdef SHA_HAVE_X86
+int SHA1_x86_impls(const SHA1Impl** impls, int max);
+#endif
+
+#ifdef SHA_HAVE_NEON
+int SHA1_neon_impls(const SHA1Impl** impls, int max);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
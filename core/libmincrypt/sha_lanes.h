@@ -0,0 +1,97 @@
+/* sha_lanes.h
+**
+** Copyright 2013, The Android Open Source Project
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of Google Inc. nor the names of its contributors may
+**       be used to endorse or promote products derived from this software
+**       without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY Google Inc. ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+** MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+** EVENT SHALL Google Inc. BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+** OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+** WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+** OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+** ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// The SHA-1 compression function run on one block of several messages at
+// once, one message per vector lane. Included once per vector unit, with
+// these defined:
+//
+//   LANES_FUNC        name of the function to define
+//   LANES_TARGET      attributes for it, or nothing
+//   LANES_N           number of lanes
+//   LANES_VEC         vector of LANES_N uint32_t
+//   LANES_LOAD(W, b)  sets W[0..15] to the big-endian words of the blocks
+//   V_LOAD(p), V_STORE(p, v), V_SET1(k)
+//   V_ADD(a, b), V_XOR(a, b), V_AND(a, b), V_OR(a, b), V_ROL(x, n)
+
+#define LANES_ROUND(F, K, t)                                            \
+    T = V_ADD(V_ADD(V_ROL(A, 5), F), V_ADD(V_ADD(E, K), W[(t) & 15]));  \
+    E = D;                                                              \
+    D = C;                                                              \
+    C = V_ROL(B, 30);                                                   \
+    B = A;                                                              \
+    A = T;
+
+#define LANES_SCHEDULE(t)                                               \
+    W[(t) & 15] = V_ROL(V_XOR(V_XOR(W[((t) - 3) & 15], W[((t) - 8) & 15]), \
+                              V_XOR(W[((t) - 14) & 15], W[(t) & 15])), 1);
+
+static LANES_TARGET void LANES_FUNC(uint32_t* state, const uint8_t* const* blocks) {
+    LANES_VEC W[16];
+    LANES_VEC A, B, C, D, E, T, K;
+    int t;
+
+    LANES_LOAD(W, blocks);
+
+    A = V_LOAD(state + 0 * LANES_N);
+    B = V_LOAD(state + 1 * LANES_N);
+    C = V_LOAD(state + 2 * LANES_N);
+    D = V_LOAD(state + 3 * LANES_N);
+    E = V_LOAD(state + 4 * LANES_N);
+
+    K = V_SET1(0x5A827999);
+    for (t = 0; t < 16; t++) {
+        LANES_ROUND(V_XOR(D, V_AND(B, V_XOR(C, D))), K, t);
+    }
+    for (; t < 20; t++) {
+        LANES_SCHEDULE(t);
+        LANES_ROUND(V_XOR(D, V_AND(B, V_XOR(C, D))), K, t);
+    }
+    K = V_SET1(0x6ED9EBA1);
+    for (; t < 40; t++) {
+        LANES_SCHEDULE(t);
+        LANES_ROUND(V_XOR(B, V_XOR(C, D)), K, t);
+    }
+    K = V_SET1(0x8F1BBCDC);
+    for (; t < 60; t++) {
+        LANES_SCHEDULE(t);
+        LANES_ROUND(V_OR(V_AND(B, C), V_AND(D, V_OR(B, C))), K, t);
+    }
+    K = V_SET1(0xCA62C1D6);
+    for (; t < 80; t++) {
+        LANES_SCHEDULE(t);
+        LANES_ROUND(V_XOR(B, V_XOR(C, D)), K, t);
+    }
+
+    V_STORE(state + 0 * LANES_N, V_ADD(A, V_LOAD(state + 0 * LANES_N)));
+    V_STORE(state + 1 * LANES_N, V_ADD(B, V_LOAD(state + 1 * LANES_N)));
+    V_STORE(state + 2 * LANES_N, V_ADD(C, V_LOAD(state + 2 * LANES_N)));
+    V_STORE(state + 3 * LANES_N, V_ADD(D, V_LOAD(state + 3 * LANES_N)));
+    V_STORE(state + 4 * LANES_N, V_ADD(E, V_LOAD(state + 4 * LANES_N)));
+}
+
+#undef LANES_ROUND
+#undef LANES_SCHEDULE
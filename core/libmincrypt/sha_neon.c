@@ -0,0 +1,80 @@
+/* sha_neon.c
+**
+** Copyright 2013, The Android Open Source Project
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of Google Inc. nor the names of its contributors may
+**       be used to endorse or promote products derived from this software
+**       without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY Google Inc. ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+** MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+** EVENT SHALL Google Inc. BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+** OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+** WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+** OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+** ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// SHA-1 of four messages at once with NEON. ARMv7 has nothing that speeds
+// up a single message, which keeps going through the portable code.
+
+#include "sha_impl.h"
+
+#ifdef SHA_HAVE_NEON
+
+#include <arm_neon.h>
+#include <stddef.h>
+
+// Words 4g to 4g + 3 of four blocks, one block per lane, big-endian.
+static inline void neon_load(uint32x4_t* W, const uint8_t* const* blocks) {
+    int g;
+    for (g = 0; g < 4; g++) {
+        uint32x4_t r0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks[0] + 16 * g)));
+        uint32x4_t r1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks[1] + 16 * g)));
+        uint32x4_t r2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks[2] + 16 * g)));
+        uint32x4_t r3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks[3] + 16 * g)));
+        uint32x4x2_t t01 = vtrnq_u32(r0, r1);   // r0.0 r1.0 r0.2 r1.2 / r0.1 r1.1 r0.3 r1.3
+        uint32x4x2_t t23 = vtrnq_u32(r2, r3);
+        W[4 * g + 0] = vcombine_u32(vget_low_u32(t01.val[0]), vget_low_u32(t23.val[0]));
+        W[4 * g + 1] = vcombine_u32(vget_low_u32(t01.val[1]), vget_low_u32(t23.val[1]));
+        W[4 * g + 2] = vcombine_u32(vget_high_u32(t01.val[0]), vget_high_u32(t23.val[0]));
+        W[4 * g + 3] = vcombine_u32(vget_high_u32(t01.val[1]), vget_high_u32(t23.val[1]));
+    }
+}
+
+#define LANES_FUNC      sha1_neon_lanes
+#define LANES_TARGET
+#define LANES_N         4
+#define LANES_VEC       uint32x4_t
+#define LANES_LOAD      neon_load
+#define V_LOAD(p)       vld1q_u32(p)
+#define V_STORE(p, v)   vst1q_u32(p, v)
+#define V_SET1(k)       vdupq_n_u32(k)
+#define V_ADD           vaddq_u32
+#define V_XOR           veorq_u32
+#define V_AND           vandq_u32
+#define V_OR            vorrq_u32
+#define V_ROL(x, n)     vsriq_n_u32(vshlq_n_u32(x, n), x, 32 - (n))
+#include "sha_lanes.h"
+
+static const SHA1Impl sha1_neon = { "neon", NULL, 4, sha1_neon_lanes };
+
+int SHA1_neon_impls(const SHA1Impl** impls, int max) {
+    if (max < 1) {
+        return 0;
+    }
+    impls[0] = &sha1_neon;
+    return 1;
+}
+
+#endif  // SHA_HAVE_NEON
@@ -0,0 +1,231 @@
+/* sha_x86.c
+**
+** Copyright 2013, The Android Open Source Project
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of Google Inc. nor the names of its contributors may
+**       be used to endorse or promote products derived from this software
+**       without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY Google Inc. ``AS IS'' AND ANY EXPRESS OR
+** IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+** MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+** EVENT SHALL Google Inc. BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+** SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+** PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+** OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+** WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+** OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+** ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// SHA-1 on x86: the SHA extensions for single messages, and SSE2 and AVX2
+// for hashing four or eight messages at once. Each is compiled for its own
+// instruction set and only used once cpuid says the cpu has it, so the rest
+// of the library still runs anywhere.
+
+#include "sha_impl.h"
+
+#ifdef SHA_HAVE_X86
+
+#include <cpuid.h>
+#include <stddef.h>
+#include <immintrin.h>
+
+// SHA extensions
+
+#define SHANI_TARGET __attribute__((target("sha,sse4.1,ssse3")))
+
+// Rounds 4k to 4k + 3, the message schedule for later rounds worked in
+// between as the instructions are meant to be used.
+#define SHANI_STEP(k)                                                   \
+    if ((k) < 4) {                                                      \
+        M[(k) & 3] = _mm_shuffle_epi8(                                  \
+            _mm_loadu_si128((const __m128i*) (data + 16 * (k))), BSWAP); \
+    }                                                                   \
+    if ((k) == 0) {                                                     \
+        E[0] = _mm_add_epi32(E[0], M[0]);                               \
+    } else {                                                            \
+        E[(k) & 1] = _mm_sha1nexte_epu32(E[(k) & 1], M[(k) & 3]);       \
+    }                                                                   \
+    E[((k) + 1) & 1] = ABCD;                                            \
+    if ((k) >= 3 && (k) <= 18) {                                        \
+        M[((k) + 1) & 3] = _mm_sha1msg2_epu32(M[((k) + 1) & 3], M[(k) & 3]); \
+    }                                                                   \
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E[(k) & 1], (k) / 5);              \
+    if ((k) >= 1 && (k) <= 16) {                                        \
+        M[((k) + 3) & 3] = _mm_sha1msg1_epu32(M[((k) + 3) & 3], M[(k) & 3]); \
+    }                                                                   \
+    if ((k) >= 2 && (k) <= 17) {                                        \
+        M[((k) + 2) & 3] = _mm_xor_si128(M[((k) + 2) & 3], M[(k) & 3]); \
+    }
+
+static SHANI_TARGET void sha1_shani_blocks(uint32_t* state, const uint8_t* data, int nblocks) {
+    const __m128i BSWAP = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+    __m128i ABCD, ABCD_SAVE, E_SAVE;
+    __m128i E[2], M[4];
+
+    ABCD = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) state), 0x1B);
+    E[0] = _mm_set_epi32(state[4], 0, 0, 0);
+
+    for (; nblocks > 0; nblocks--, data += 64) {
+        ABCD_SAVE = ABCD;
+        E_SAVE = E[0];
+
+        SHANI_STEP(0);  SHANI_STEP(1);  SHANI_STEP(2);  SHANI_STEP(3);
+        SHANI_STEP(4);  SHANI_STEP(5);  SHANI_STEP(6);  SHANI_STEP(7);
+        SHANI_STEP(8);  SHANI_STEP(9);  SHANI_STEP(10); SHANI_STEP(11);
+        SHANI_STEP(12); SHANI_STEP(13); SHANI_STEP(14); SHANI_STEP(15);
+        SHANI_STEP(16); SHANI_STEP(17); SHANI_STEP(18); SHANI_STEP(19);
+
+        E[0] = _mm_sha1nexte_epu32(E[0], E_SAVE);
+        ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+    }
+
+    _mm_storeu_si128((__m128i*) state, _mm_shuffle_epi32(ABCD, 0x1B));
+    state[4] = _mm_extract_epi32(E[0], 3);
+}
+
+#undef SHANI_STEP
+
+// Words 4g to 4g + 3 of four blocks, one block per lane.
+#define TRANSPOSE4(out, blocks, g) do {                                 \
+        __m128i r0 = _mm_loadu_si128((const __m128i*) ((blocks)[0] + 16 * (g))); \
+        __m128i r1 = _mm_loadu_si128((const __m128i*) ((blocks)[1] + 16 * (g))); \
+        __m128i r2 = _mm_loadu_si128((const __m128i*) ((blocks)[2] + 16 * (g))); \
+        __m128i r3 = _mm_loadu_si128((const __m128i*) ((blocks)[3] + 16 * (g))); \
+        __m128i t0 = _mm_unpacklo_epi32(r0, r1);                        \
+        __m128i t1 = _mm_unpacklo_epi32(r2, r3);                        \
+        __m128i t2 = _mm_unpackhi_epi32(r0, r1);                        \
+        __m128i t3 = _mm_unpackhi_epi32(r2, r3);                        \
+        (out)[0] = _mm_unpacklo_epi64(t0, t1);                          \
+        (out)[1] = _mm_unpackhi_epi64(t0, t1);                          \
+        (out)[2] = _mm_unpacklo_epi64(t2, t3);                          \
+        (out)[3] = _mm_unpackhi_epi64(t2, t3);                          \
+    } while (0)
+
+// SSE2, four lanes
+
+#define SSE2_TARGET __attribute__((target("sse2")))
+
+static SSE2_TARGET inline __m128i sse2_bswap(__m128i x) {
+    x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xB1), 0xB1);
+    return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+
+static SSE2_TARGET inline void sse2_load(__m128i* W, const uint8_t* const* blocks) {
+    int g, i;
+    for (g = 0; g < 4; g++) {
+        TRANSPOSE4(W + 4 * g, blocks, g);
+        for (i = 4 * g; i < 4 * g + 4; i++) {
+            W[i] = sse2_bswap(W[i]);
+        }
+    }
+}
+
+#define LANES_FUNC      sha1_sse2_lanes
+#define LANES_TARGET    SSE2_TARGET
+#define LANES_N         4
+#define LANES_VEC       __m128i
+#define LANES_LOAD      sse2_load
+#define V_LOAD(p)       _mm_loadu_si128((const __m128i*) (p))
+#define V_STORE(p, v)   _mm_storeu_si128((__m128i*) (p), v)
+#define V_SET1(k)       _mm_set1_epi32(k)
+#define V_ADD           _mm_add_epi32
+#define V_XOR           _mm_xor_si128
+#define V_AND           _mm_and_si128
+#define V_OR            _mm_or_si128
+#define V_ROL(x, n)     _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - (n)))
+#include "sha_lanes.h"
+#undef LANES_FUNC
+#undef LANES_TARGET
+#undef LANES_N
+#undef LANES_VEC
+#undef LANES_LOAD
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADD
+#undef V_XOR
+#undef V_AND
+#undef V_OR
+#undef V_ROL
+
+// AVX2, eight lanes
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+static AVX2_TARGET inline void avx2_load(__m256i* W, const uint8_t* const* blocks) {
+    const __m256i BSWAP = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                          12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    __m128i lo[4], hi[4];
+    int g, i;
+    for (g = 0; g < 4; g++) {
+        TRANSPOSE4(lo, blocks, g);
+        TRANSPOSE4(hi, blocks + 4, g);
+        for (i = 0; i < 4; i++) {
+            W[4 * g + i] = _mm256_shuffle_epi8(
+                _mm256_inserti128_si256(_mm256_castsi128_si256(lo[i]), hi[i], 1), BSWAP);
+        }
+    }
+}
+
+#define LANES_FUNC      sha1_avx2_lanes
+#define LANES_TARGET    AVX2_TARGET
+#define LANES_N         8
+#define LANES_VEC       __m256i
+#define LANES_LOAD      avx2_load
+#define V_LOAD(p)       _mm256_loadu_si256((const __m256i*) (p))
+#define V_STORE(p, v)   _mm256_storeu_si256((__m256i*) (p), v)
+#define V_SET1(k)       _mm256_set1_epi32(k)
+#define V_ADD           _mm256_add_epi32
+#define V_XOR           _mm256_xor_si256
+#define V_AND           _mm256_and_si256
+#define V_OR            _mm256_or_si256
+#define V_ROL(x, n)     _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+#include "sha_lanes.h"
+
+static const SHA1Impl sha1_shani = { "sha-ni", sha1_shani_blocks, 0, NULL };
+static const SHA1Impl sha1_avx2 = { "avx2", NULL, 8, sha1_avx2_lanes };
+static const SHA1Impl sha1_sse2 = { "sse2", NULL, 4, sha1_sse2_lanes };
+
+// Whether the OS saves the ymm registers across context switches.
+static int ymm_enabled(void) {
+    uint32_t lo, hi;
+    __asm__ (".byte 0x0f, 0x01, 0xd0" : "=a" (lo), "=d" (hi) : "c" (0));  // xgetbv
+    return (lo & 6) == 6;
+}
+
+int SHA1_x86_impls(const SHA1Impl** impls, int max) {
+    unsigned int eax, ebx, ecx, edx;
+    unsigned int ebx7 = 0;
+    int n = 0;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    if (__get_cpuid_max(0, NULL) >= 7) {
+        unsigned int a, c, d;
+        __cpuid_count(7, 0, a, ebx7, c, d);
+    }
+
+    // bit_SHA: ebx bit 29 of leaf 7; needs SSSE3 and SSE4.1 too.
+    if (n < max && (ebx7 & (1 << 29)) && (ecx & bit_SSSE3) && (ecx & bit_SSE4_1)) {
+        impls[n++] = &sha1_shani;
+    }
+    if (n < max && (ebx7 & (1 << 5)) && (ecx & bit_OSXSAVE) && ymm_enabled()) {
+        impls[n++] = &sha1_avx2;
+    }
+    if (n < max && (edx & bit_SSE2)) {
+        impls[n++] = &sha1_sse2;
+    }
+    return n;
+}
+
+#endif  // SHA_HAVE_X86
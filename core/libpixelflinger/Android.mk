@@ -26,6 +26,7 @@ PIXELFLINGER_SRC_FILES:= \
 	format.cpp \
 	clear.cpp \
 	raster.cpp \
+	tiler.cpp \
 	buffer.cpp
 
 ifeq ($(TARGET_ARCH),arm)
@@ -50,6 +51,10 @@ PIXELFLINGER_SRC_FILES += arch-mips/t32cb16blend.S
 PIXELFLINGER_CFLAGS += -fstrict-aliasing -fomit-frame-pointer
 endif
 
+ifeq ($(TARGET_ARCH),x86)
+PIXELFLINGER_SRC_FILES += arch-x86/scanline_sse2.c
+endif
+
 LOCAL_SHARED_LIBRARIES := libcutils
 
 ifneq ($(TARGET_ARCH),arm)
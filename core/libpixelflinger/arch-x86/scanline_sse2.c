@@ -0,0 +1,152 @@
+/* libs/pixelflinger/arch-x86/scanline_sse2.c
+**
+** Copyright 2013, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*
+ * SSE2 versions of the 8888 to 565 scanlines, for x86 where there is no
+ * code generator. Eight pixels are done at a time in 16-bit lanes, with
+ * the same arithmetic as the C versions in scanline.cpp so the results are
+ * identical, bit for bit:
+ *
+ *     f = 0x100 - (sA + (sA >> 7))
+ *     d = (sR + ((f * dR) >> 8)) << 11 |
+ *         (sG + ((f * dG) >> 8)) <<  5 |
+ *         (sB + ((f * dB) >> 8))
+ *
+ * where sR, sG and sB are the top 5, 6 and 5 bits of the source. This is
+ * also what a fully opaque (f == 0) or fully transparent (s == 0) source
+ * pixel comes to, so neither needs a branch.
+ */
+
+#ifdef __SSE2__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <emmintrin.h>
+
+static inline uint16_t blend_one(uint32_t s, uint16_t d)
+{
+    int sA = (s>>24);
+    int f = 0x100 - (sA + (sA>>7));
+    int sR = ((s >> (   3))&0x1F) + ((f*((d>>11)&0x1f))>>8);
+    int sG = ((s >> ( 8+2))&0x3F) + ((f*((d>>5)&0x3f))>>8);
+    int sB = ((s >> (16+3))&0x1F) + ((f*((d)&0x1f))>>8);
+    return (uint16_t)((sR<<11)|(sG<<5)|sB);
+}
+
+static inline uint16_t convert_one(uint32_t s)
+{
+    return (uint16_t)(((s << 8) & 0xf800) | ((s >> 5) & 0x07e0) | ((s >> 19) & 0x001f));
+}
+
+/* Splits eight ABGR pixels into their low (G:R) and high (A:B) halves. */
+static inline void split8(const uint32_t* src, __m128i* gr, __m128i* ab)
+{
+    __m128i s0 = _mm_loadu_si128((const __m128i*)src);
+    __m128i s1 = _mm_loadu_si128((const __m128i*)(src + 4));
+    /* packs saturates, so sign-extend the halves first to keep their bits */
+    *gr = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(s0, 16), 16),
+                          _mm_srai_epi32(_mm_slli_epi32(s1, 16), 16));
+    *ab = _mm_packs_epi32(_mm_srai_epi32(s0, 16), _mm_srai_epi32(s1, 16));
+}
+
+static inline __m128i blend8(__m128i sR, __m128i sG, __m128i sB, __m128i f, __m128i d)
+{
+    const __m128i mask5 = _mm_set1_epi16(0x1f);
+    const __m128i mask6 = _mm_set1_epi16(0x3f);
+    __m128i dR = _mm_srli_epi16(d, 11);
+    __m128i dG = _mm_and_si128(_mm_srli_epi16(d, 5), mask6);
+    __m128i dB = _mm_and_si128(d, mask5);
+    sR = _mm_add_epi16(sR, _mm_srli_epi16(_mm_mullo_epi16(f, dR), 8));
+    sG = _mm_add_epi16(sG, _mm_srli_epi16(_mm_mullo_epi16(f, dG), 8));
+    sB = _mm_add_epi16(sB, _mm_srli_epi16(_mm_mullo_epi16(f, dB), 8));
+    return _mm_or_si128(_mm_or_si128(_mm_slli_epi16(sR, 11), _mm_slli_epi16(sG, 5)), sB);
+}
+
+void scanline_t32cb16blend_sse2(uint16_t* dst, uint32_t* src, size_t ct)
+{
+    const __m128i mask5 = _mm_set1_epi16(0x1f);
+    const __m128i mask6 = _mm_set1_epi16(0x3f);
+    const __m128i k100 = _mm_set1_epi16(0x100);
+
+    while (ct >= 8) {
+        __m128i gr, ab, sA, f, d;
+        split8(src, &gr, &ab);
+        sA = _mm_srli_epi16(ab, 8);
+        f = _mm_sub_epi16(k100, _mm_add_epi16(sA, _mm_srli_epi16(sA, 7)));
+        d = _mm_loadu_si128((const __m128i*)dst);
+        d = blend8(_mm_and_si128(_mm_srli_epi16(gr, 3), mask5),
+                   _mm_and_si128(_mm_srli_epi16(gr, 10), mask6),
+                   _mm_and_si128(_mm_srli_epi16(ab, 3), mask5), f, d);
+        _mm_storeu_si128((__m128i*)dst, d);
+        src += 8;
+        dst += 8;
+        ct -= 8;
+    }
+    while (ct--) {
+        uint32_t s = *src++;
+        /* like the C version, leave the pixel alone if the source is clear */
+        if (s) {
+            *dst = blend_one(s, *dst);
+        }
+        dst++;
+    }
+}
+
+void scanline_t32cb16_sse2(uint16_t* dst, uint32_t* src, size_t ct)
+{
+    const __m128i maskR = _mm_set1_epi16((short)0xf800);
+    const __m128i maskG = _mm_set1_epi16(0x07e0);
+    const __m128i mask5 = _mm_set1_epi16(0x1f);
+
+    while (ct >= 8) {
+        __m128i gr, ab, d;
+        split8(src, &gr, &ab);
+        d = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(gr, 8), maskR),
+                         _mm_and_si128(_mm_srli_epi16(gr, 5), maskG));
+        d = _mm_or_si128(d, _mm_and_si128(_mm_srli_epi16(ab, 3), mask5));
+        _mm_storeu_si128((__m128i*)dst, d);
+        src += 8;
+        dst += 8;
+        ct -= 8;
+    }
+    while (ct--) {
+        *dst++ = convert_one(*src++);
+    }
+}
+
+void scanline_col32cb16blend_sse2(uint16_t* dst, uint32_t s, size_t ct)
+{
+    int sA = (s>>24);
+    int f = 0x100 - (sA + (sA>>7));
+    const __m128i vR = _mm_set1_epi16((s >> (   3))&0x1F);
+    const __m128i vG = _mm_set1_epi16((s >> ( 8+2))&0x3F);
+    const __m128i vB = _mm_set1_epi16((s >> (16+3))&0x1F);
+    const __m128i vf = _mm_set1_epi16(f);
+
+    while (ct >= 8) {
+        __m128i d = _mm_loadu_si128((const __m128i*)dst);
+        _mm_storeu_si128((__m128i*)dst, blend8(vR, vG, vB, vf, d));
+        dst += 8;
+        ct -= 8;
+    }
+    while (ct--) {
+        *dst = blend_one(s, *dst);
+        dst++;
+    }
+}
+
+#endif // __SSE2__
@@ -17,10 +17,16 @@
 
 
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <cutils/ashmem.h>
 #include <cutils/atomic.h>
@@ -150,14 +156,39 @@ ssize_t Assembly::resize(size_t newSize)
 
 // ----------------------------------------------------------------------------
 
+// on the clock pthread_cond_timedwait() uses
+static int64_t now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return int64_t(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
 CodeCache::CodeCache(size_t size)
-    : mCacheSize(size), mCacheInUse(0)
+    : mWhen(0), mCacheSize(size), mCacheInUse(0),
+      mHits(0), mMisses(0), mEvictions(0), mLoaded(0), mSaves(0),
+      mPath(0), mFingerprint(0), mLoader(0),
+      mSaverRunning(false), mStopping(false), mDirty(false),
+      mFirstChange(0), mLastChange(0)
 {
     pthread_mutex_init(&mLock, 0);
+    pthread_cond_init(&mSaveCond, 0);
 }
 
 CodeCache::~CodeCache()
 {
+    // the saver writes what is left before it goes
+    pthread_mutex_lock(&mLock);
+    mStopping = true;
+    pthread_cond_signal(&mSaveCond);
+    bool running = mSaverRunning;
+    pthread_mutex_unlock(&mLock);
+    if (running) {
+        pthread_join(mSaver, 0);
+    }
+    free(mPath);
+    free(mFingerprint);
+    pthread_cond_destroy(&mSaveCond);
     pthread_mutex_destroy(&mLock);
 }
 
@@ -170,6 +201,9 @@ sp<Assembly> CodeCache::lookup(const AssemblyKeyBase& keyBase) const
         const cache_entry_t& e = mCacheData.valueAt(index);
         e.when = mWhen++;
         r = e.entry;
+        mHits++;
+    } else {
+        mMisses++;
     }
     pthread_mutex_unlock(&mLock);
     return r;
@@ -179,9 +213,29 @@ int CodeCache::cache(  const AssemblyKeyBase& keyBase,
                             const sp<Assembly>& assembly)
 {
     pthread_mutex_lock(&mLock);
+    ssize_t err = add(keyBase, assembly);
+    if (err >= 0 && mPath) {
+        // just note the change; the saver writes the file later
+        const int64_t now = now_ms();
+        if (!mDirty) {
+            mFirstChange = now;
+        }
+        mDirty = true;
+        mLastChange = now;
+        if (!mSaverRunning && !mStopping) {
+            mSaverRunning = pthread_create(&mSaver, 0, saverMain, this) == 0;
+            ALOGW_IF(!mSaverRunning, "can't start the thread saving %s", mPath);
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+    return err;
+}
 
+ssize_t CodeCache::add(const AssemblyKeyBase& keyBase,
+                       const sp<Assembly>& assembly)
+{
     const ssize_t assemblySize = assembly->size();
-    while (mCacheInUse + assemblySize > mCacheSize) {
+    while (mCacheInUse + assemblySize > mCacheSize && mCacheData.size()) {
         // evict the LRU
         size_t lru = 0;
         size_t count = mCacheData.size();
@@ -194,8 +248,8 @@ int CodeCache::cache(  const AssemblyKeyBase& keyBase,
         const cache_entry_t& e = mCacheData.valueAt(lru);
         mCacheInUse -= e.entry->size();
         mCacheData.removeItemsAt(lru);
+        mEvictions++;
     }
-
     ssize_t err = mCacheData.add(key_t(keyBase), cache_entry_t(assembly, mWhen));
     if (err >= 0) {
         mCacheInUse += assemblySize;
@@ -209,9 +263,332 @@ int CodeCache::cache(  const AssemblyKeyBase& keyBase,
                  strerror(errno));
 #endif
     }
+    return err;
+}
 
+void CodeCache::getStats(CodeCacheStats* stats) const
+{
+    pthread_mutex_lock(&mLock);
+    stats->hits = mHits;
+    stats->misses = mMisses;
+    stats->evictions = mEvictions;
+    stats->loaded = mLoaded;
+    stats->saves = mSaves;
+    stats->entries = mCacheData.size();
+    stats->inUse = mCacheInUse;
+    stats->size = mCacheSize;
+    pthread_mutex_unlock(&mLock);
+}
+
+// ----------------------------------------------------------------------------
+
+// The persistent cache is a header, then the payload: the fingerprint, and
+// for each assembly its key and code sizes followed by the key and the code.
+// The header gives the payload's size and checksum, and a file is only used
+// if both match in full.
+
+static const uint32_t kCacheFileMagic = 0x434c4747;  // 'GGLC'
+static const uint32_t kCacheFileVersion = 2;
+static const size_t kMaxKeySize = 64;
+
+static const int64_t kSaveIdleMs = 1000;
+static const int64_t kSaveMaxDelayMs = 5000;
+
+struct cache_file_header_t {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    fingerprintSize;
+    uint32_t    count;
+    uint32_t    payloadSize;
+    uint32_t    checksum;   // of the payload
+};
+
+struct cache_file_entry_t {
+    uint32_t    keySize;
+    uint32_t    codeSize;
+};
+
+// FNV-1a
+static uint32_t checksum(const uint8_t* p, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    while (size--) {
+        hash = (hash ^ *p++) * 16777619u;
+    }
+    return hash;
+}
+
+void CodeCache::setPersistentPath(const char* path, const char* fingerprint,
+                                  loader_t loader)
+{
+    pthread_mutex_lock(&mLock);
+    free(mPath);
+    free(mFingerprint);
+    mPath = strdup(path);
+    mFingerprint = strdup(fingerprint);
+    mLoader = loader;
+    if (mPath && mFingerprint) {
+        load();
+    } else {
+        free(mPath);
+        mPath = 0;
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+void CodeCache::load()
+{
+    int fd = open(mPath, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    // this is code we're about to run, make sure nobody else wrote it
+    struct stat st;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) ||
+            (st.st_uid != geteuid() && st.st_uid != 0) ||
+            (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        ALOGW("not loading %s, it isn't ours or others can write it", mPath);
+        close(fd);
+        return;
+    }
+
+    FILE* f = fdopen(fd, "r");
+    if (!f) {
+        close(fd);
+        return;
+    }
+
+    cache_file_header_t header;
+    const size_t fingerprintSize = strlen(mFingerprint);
+    uint8_t* payload = 0;
+    const uint8_t* p;
+    const uint8_t* end;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+            header.magic != kCacheFileMagic ||
+            header.version != kCacheFileVersion ||
+            header.fingerprintSize != fingerprintSize) {
+        goto done;
+    }
+    if (header.count > kMaxCodeCacheCapacity ||
+            header.payloadSize < fingerprintSize ||
+            header.payloadSize > fingerprintSize + kMaxCodeCacheCapacity +
+                header.count * (sizeof(cache_file_entry_t) + kMaxKeySize) ||
+            off_t(sizeof(header) + header.payloadSize) != st.st_size) {
+        ALOGW("%s is truncated or corrupt", mPath);
+        goto done;
+    }
+    payload = (uint8_t*)malloc(header.payloadSize);
+    if (!payload) {
+        goto done;
+    }
+    if (fread(payload, header.payloadSize, 1, f) != 1 ||
+            checksum(payload, header.payloadSize) != header.checksum) {
+        ALOGW("%s is truncated or corrupt", mPath);
+        goto done;
+    }
+    if (memcmp(payload, mFingerprint, fingerprintSize)) {
+        // another build or another layout of context_t
+        goto done;
+    }
+
+    // check every entry before loading any of them
+    p = payload + fingerprintSize;
+    end = payload + header.payloadSize;
+    for (uint32_t i=0 ; i<header.count ; i++) {
+        cache_file_entry_t entry;
+        if (size_t(end - p) < sizeof(entry)) {
+            p = 0;
+            break;
+        }
+        memcpy(&entry, p, sizeof(entry));
+        p += sizeof(entry);
+        if (entry.keySize == 0 || entry.keySize > kMaxKeySize ||
+                entry.codeSize == 0 || entry.codeSize > mCacheSize ||
+                size_t(end - p) < entry.keySize + entry.codeSize) {
+            p = 0;
+            break;
+        }
+        p += entry.keySize + entry.codeSize;
+    }
+    if (p != end) {
+        ALOGW("%s is corrupt", mPath);
+        goto done;
+    }
+
+    p = payload + fingerprintSize;
+    for (uint32_t i=0 ; i<header.count ; i++) {
+        cache_file_entry_t entry;
+        memcpy(&entry, p, sizeof(entry));
+        p += sizeof(entry);
+        const AssemblyKeyBase* key = 0;
+        sp<Assembly> a = mLoader(p, entry.keySize,
+                p + entry.keySize, entry.codeSize, &key);
+        p += entry.keySize + entry.codeSize;
+        if (a == 0 || !key) {
+            continue;
+        }
+        if (mCacheData.indexOfKey(key_t(*key)) < 0 && add(*key, a) >= 0) {
+            mLoaded++;
+        }
+    }
+
+done:
+    free(payload);
+    fclose(f);
+}
+
+uint8_t* CodeCache::serialize(size_t* size) const
+{
+    const size_t fingerprintSize = strlen(mFingerprint);
+    size_t payloadSize = fingerprintSize;
+    for (size_t i=0 ; i<mCacheData.size() ; i++) {
+        payloadSize += sizeof(cache_file_entry_t) +
+                mCacheData.keyAt(i).key().size() +
+                mCacheData.valueAt(i).entry->size();
+    }
+
+    uint8_t* image = (uint8_t*)malloc(sizeof(cache_file_header_t) + payloadSize);
+    if (!image) {
+        return 0;
+    }
+    uint8_t* payload = image + sizeof(cache_file_header_t);
+    uint8_t* p = payload;
+    memcpy(p, mFingerprint, fingerprintSize);
+    p += fingerprintSize;
+    for (size_t i=0 ; i<mCacheData.size() ; i++) {
+        const AssemblyKeyBase& key = mCacheData.keyAt(i).key();
+        const sp<Assembly>& a = mCacheData.valueAt(i).entry;
+        cache_file_entry_t entry;
+        entry.keySize = key.size();
+        entry.codeSize = a->size();
+        memcpy(p, &entry, sizeof(entry));
+        p += sizeof(entry);
+        memcpy(p, key.data(), entry.keySize);
+        p += entry.keySize;
+        memcpy(p, a->base(), entry.codeSize);
+        p += entry.codeSize;
+    }
+
+    cache_file_header_t header;
+    header.magic = kCacheFileMagic;
+    header.version = kCacheFileVersion;
+    header.fingerprintSize = fingerprintSize;
+    header.count = mCacheData.size();
+    header.payloadSize = payloadSize;
+    header.checksum = checksum(payload, payloadSize);
+    memcpy(image, &header, sizeof(header));
+    *size = sizeof(header) + payloadSize;
+    return image;
+}
+
+static bool write_fully(int fd, const uint8_t* p, size_t size)
+{
+    while (size) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool write_cache_file(const char* path, const uint8_t* image, size_t size)
+{
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        ALOGW("can't write %s (%s)", tmp, strerror(errno));
+        return false;
+    }
+    // the data has to be on disk before the rename is, or a crash could
+    // leave an empty file under the real name
+    bool ok = write_fully(fd, image, size) && fsync(fd) == 0;
+    if (close(fd) != 0) {
+        ok = false;
+    }
+    // a reader sees either the previous file or this one, never half of it
+    if (!ok || rename(tmp, path)) {
+        ALOGW("can't write %s (%s)", path, strerror(errno));
+        unlink(tmp);
+        return false;
+    }
+
+    // and the rename itself is only durable once the directory is synced
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char* slash = strrchr(dir, '/');
+    if (slash == dir) {
+        slash[1] = 0;
+    } else if (slash) {
+        *slash = 0;
+    } else {
+        strcpy(dir, ".");
+    }
+    int dirfd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (dirfd >= 0) {
+        if (fsync(dirfd)) {
+            ALOGW("can't sync %s (%s)", dir, strerror(errno));
+        }
+        close(dirfd);
+    }
+    return true;
+}
+
+void* CodeCache::saverMain(void* cache)
+{
+    static_cast<CodeCache*>(cache)->saverLoop();
+    return 0;
+}
+
+// Writes the cache once new assemblies have stopped coming for
+// kSaveIdleMs, or kSaveMaxDelayMs after the first of them at the latest,
+// so that a burst of new code, as at startup, is written once.
+void CodeCache::saverLoop()
+{
+    pthread_mutex_lock(&mLock);
+    for (;;) {
+        if (!mDirty) {
+            if (mStopping) {
+                break;
+            }
+            pthread_cond_wait(&mSaveCond, &mLock);
+            continue;
+        }
+        if (!mStopping) {
+            int64_t due = mLastChange + kSaveIdleMs;
+            if (due > mFirstChange + kSaveMaxDelayMs) {
+                due = mFirstChange + kSaveMaxDelayMs;
+            }
+            if (now_ms() < due) {
+                struct timespec ts;
+                ts.tv_sec = due / 1000;
+                ts.tv_nsec = (due % 1000) * 1000000;
+                pthread_cond_timedwait(&mSaveCond, &mLock, &ts);
+                continue;
+            }
+        }
+
+        size_t size = 0;
+        uint8_t* image = serialize(&size);
+        char* path = strdup(mPath);
+        mDirty = false;
+        pthread_mutex_unlock(&mLock);
+        bool saved = image && path && write_cache_file(path, image, size);
+        free(path);
+        free(image);
+        pthread_mutex_lock(&mLock);
+        if (saved) {
+            mSaves++;
+        }
+    }
     pthread_mutex_unlock(&mLock);
-    return err;
 }
 
 // ----------------------------------------------------------------------------
@@ -34,6 +34,9 @@ class AssemblyKeyBase {
 public:
     virtual ~AssemblyKeyBase() { }
     virtual int compare_type(const AssemblyKeyBase& key) const = 0;
+    // the key's bytes, as saved in the persistent cache
+    virtual const void* data() const = 0;
+    virtual size_t size() const = 0;
 };
 
 template  <typename T>
@@ -45,6 +48,8 @@ public:
         const T& rhs = static_cast<const AssemblyKey&>(key).mKey;
         return android::compare_type(mKey, rhs);
     }
+    virtual const void* data() const { return &mKey; }
+    virtual size_t size() const { return sizeof(T); }
 private:
     T mKey;
 };
@@ -74,9 +79,26 @@ private:
 
 // ----------------------------------------------------------------------------
 
+struct CodeCacheStats {
+    uint32_t    hits;
+    uint32_t    misses;
+    uint32_t    evictions;
+    uint32_t    loaded;     // assemblies read from the persistent cache
+    uint32_t    saves;      // times the persistent cache was written
+    uint32_t    entries;
+    size_t      inUse;      // bytes of code
+    size_t      size;
+};
+
 class CodeCache
 {
 public:
+    // makes an assembly out of a key and code read back from disk, and
+    // points 'assemblyKey' at the key it keeps
+    typedef sp<Assembly> (*loader_t)(const void* key, size_t keySize,
+                                     const void* code, size_t codeSize,
+                                     const AssemblyKeyBase** assemblyKey);
+
 // pretty simple cache API...
                 CodeCache(size_t size);
                 ~CodeCache();
@@ -86,7 +108,25 @@ public:
             int                 cache(  const AssemblyKeyBase& key,
                                         const sp<Assembly>& assembly);
 
+    // Keeps a copy of the cache in 'path', and loads the assemblies already
+    // there if the file was written with the same fingerprint and is whole.
+    // Only files owned by this user (or root) that nobody else can write are
+    // loaded. New assemblies are written by a background thread, once they
+    // stop coming for a while, and when the cache is destroyed.
+            void                setPersistentPath(const char* path,
+                                        const char* fingerprint,
+                                        loader_t loader);
+
+            void                getStats(CodeCacheStats* stats) const;
+
 private:
+            ssize_t             add(const AssemblyKeyBase& key,
+                                    const sp<Assembly>& assembly);
+            void                load();
+            uint8_t*            serialize(size_t* size) const;
+    static  void*               saverMain(void* cache);
+            void                saverLoop();
+
     // nothing to see here...
     struct cache_entry_t {
         inline cache_entry_t() { }
@@ -104,6 +144,7 @@ private:
     public:
         key_t() { };
         key_t(const AssemblyKeyBase& k) : mKey(&k)  { }
+        const AssemblyKeyBase& key() const { return *mKey; }
     };
 
     mutable pthread_mutex_t             mLock;
@@ -112,6 +153,26 @@ private:
     size_t                              mCacheInUse;
     KeyedVector<key_t, cache_entry_t>   mCacheData;
 
+    mutable uint32_t                    mHits;
+    mutable uint32_t                    mMisses;
+    uint32_t                            mEvictions;
+    uint32_t                            mLoaded;
+    uint32_t                            mSaves;
+
+    char*                               mPath;
+    char*                               mFingerprint;
+    loader_t                            mLoader;
+
+    // The file is only written by the saver thread, started on the first
+    // change, so that the threads generating code never wait for the disk.
+    pthread_cond_t                      mSaveCond;
+    pthread_t                           mSaver;
+    bool                                mSaverRunning;
+    bool                                mStopping;
+    bool                                mDirty;
+    int64_t                             mFirstChange;   // unsaved, in ms
+    int64_t                             mLastChange;
+
     friend int compare_type(
         const key_value_pair_t<key_t, cache_entry_t>&,
         const key_value_pair_t<key_t, cache_entry_t>&);
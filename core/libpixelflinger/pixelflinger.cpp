@@ -30,6 +30,7 @@
 #include "picker.h"
 #include "raster.h"
 #include "scanline.h"
+#include "tiler.h"
 #include "trap.h"
 
 #include "codeflinger/GGLAssembler.h"
@@ -808,6 +809,7 @@ void ggl_init_context(context_t* c)
 
 void ggl_uninit_context(context_t* c)
 {
+    ggl_uninit_tiler(c);
     ggl_uninit_scanline(c);
 }
 
@@ -842,3 +844,8 @@ ssize_t gglUninit(GGLContext* con)
 	return 0;
 }
 
+ssize_t gglSetThreads(GGLContext* con, int count)
+{
+    GGL_CONTEXT(c, (void*)con);
+    return ggl_set_threads(c, count);
+}
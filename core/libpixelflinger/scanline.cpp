@@ -25,6 +25,7 @@
 
 #include <cutils/memory.h>
 #include <cutils/log.h>
+#include <cutils/properties.h>
 
 #include "buffer.h"
 #include "scanline.h"
@@ -124,6 +125,10 @@ extern "C" void scanline_col32cb16blend_neon(uint16_t *dst, uint32_t *col, size_
 extern "C" void scanline_col32cb16blend_arm(uint16_t *dst, uint32_t col, size_t ct);
 #elif defined(__mips__)
 extern "C" void scanline_t32cb16blend_mips(uint16_t*, uint32_t*, size_t);
+#elif defined(__SSE2__)
+extern "C" void scanline_t32cb16blend_sse2(uint16_t* dst, uint32_t* src, size_t ct);
+extern "C" void scanline_t32cb16_sse2(uint16_t* dst, uint32_t* src, size_t ct);
+extern "C" void scanline_col32cb16blend_sse2(uint16_t* dst, uint32_t col, size_t ct);
 #endif
 
 // ----------------------------------------------------------------------------
@@ -274,10 +279,11 @@ static  const needs_filter_t fill16noblend = {
 
 #if ANDROID_ARM_CODEGEN
 
+// room for a few dozen pipelines, out of the 1MB executable store
 #if defined(__mips__)
-static CodeCache gCodeCache(32 * 1024);
+static CodeCache gCodeCache(128 * 1024);
 #else
-static CodeCache gCodeCache(12 * 1024);
+static CodeCache gCodeCache(64 * 1024);
 #endif
 
 class ScanlineAssembly : public Assembly {
@@ -287,6 +293,43 @@ public:
         : Assembly(size), mKey(needs) { }
     const AssemblyKey<needs_t>& key() const { return mKey; }
 };
+
+// Bump whenever the generated code changes in a way the build fingerprint
+// wouldn't catch.
+static const int SCANLINE_CACHE_VERSION = 1;
+
+static pthread_once_t gCodeCacheOnce = PTHREAD_ONCE_INIT;
+
+static sp<Assembly> load_scanline(const void* key, size_t keySize,
+        const void* code, size_t codeSize, const AssemblyKeyBase** assemblyKey)
+{
+    if (keySize != sizeof(needs_t)) {
+        return 0;
+    }
+    needs_t needs;
+    memcpy(&needs, key, sizeof(needs_t));
+    sp<ScanlineAssembly> a = new ScanlineAssembly(needs, codeSize);
+    memcpy(a->base(), code, codeSize);
+    *assemblyKey = &a->key();
+    return a;
+}
+
+// ro.pf.codecache names a file where the generated scanlines are kept
+// across runs. The code is only valid for the build that made it, and
+// refers to context_t by offsets, so both go in the fingerprint.
+static void init_code_cache()
+{
+    char path[PROPERTY_VALUE_MAX];
+    if (property_get("ro.pf.codecache", path, 0) <= 0) {
+        return;
+    }
+    char build[PROPERTY_VALUE_MAX];
+    property_get("ro.build.fingerprint", build, "");
+    char fingerprint[PROPERTY_VALUE_MAX + 32];
+    snprintf(fingerprint, sizeof(fingerprint), "%s/%d/%u", build,
+            SCANLINE_CACHE_VERSION, unsigned(sizeof(context_t)));
+    gCodeCache.setPersistentPath(path, fingerprint, load_scanline);
+}
 #endif
 
 // ----------------------------------------------------------------------------
@@ -380,6 +423,7 @@ static void pick_scanline(context_t* c)
 #if ANDROID_ARM_CODEGEN
     // we're going to have to generate some code...
     // here, generate code for our pixel pipeline
+    pthread_once(&gCodeCacheOnce, init_code_cache);
     const AssemblyKey<needs_t> key(c->state.needs);
     sp<Assembly> assembly = gCodeCache.lookup(key);
     if (assembly == 0) {
@@ -2085,6 +2129,8 @@ void scanline_col32cb16blend(context_t* c)
 #else  // defined(__ARM_HAVE_NEON) && BYTE_ORDER == LITTLE_ENDIAN
     scanline_col32cb16blend_arm(dst, GGL_RGBA_TO_HOST(c->packed8888), ct);
 #endif // defined(__ARM_HAVE_NEON) && BYTE_ORDER == LITTLE_ENDIAN
+#elif ((ANDROID_CODEGEN >= ANDROID_CODEGEN_ASM) && defined(__SSE2__))
+    scanline_col32cb16blend_sse2(dst, GGL_RGBA_TO_HOST(c->packed8888), ct);
 #else
     uint32_t s = GGL_RGBA_TO_HOST(c->packed8888);
     int sA = (s>>24);
@@ -2122,6 +2168,10 @@ void scanline_t32cb16(context_t* c)
     const int32_t u = (c->state.texture[0].shade.is0>>16) + x;
     const int32_t v = (c->state.texture[0].shade.it0>>16) + y;
     uint32_t *src = reinterpret_cast<uint32_t*>(tex->data)+(u+(tex->stride*v));
+
+#if ((ANDROID_CODEGEN >= ANDROID_CODEGEN_ASM) && defined(__SSE2__))
+    scanline_t32cb16_sse2(dst, src, ct);
+#else
     int sR, sG, sB;
     uint32_t s, d;
 
@@ -2153,11 +2203,13 @@ last_one:
     if (ct > 0) {
         goto last_one;
     }
+#endif
 }
 
 void scanline_t32cb16blend(context_t* c)
 {
-#if ((ANDROID_CODEGEN >= ANDROID_CODEGEN_ASM) && (defined(__arm__) || defined(__mips)))
+#if ((ANDROID_CODEGEN >= ANDROID_CODEGEN_ASM) && \
+     (defined(__arm__) || defined(__mips) || defined(__SSE2__)))
     int32_t x = c->iterators.xl;
     size_t ct = c->iterators.xr - x;
     int32_t y = c->iterators.y;
@@ -2169,10 +2221,12 @@ void scanline_t32cb16blend(context_t* c)
     const int32_t v = (c->state.texture[0].shade.it0>>16) + y;
     uint32_t *src = reinterpret_cast<uint32_t*>(tex->data)+(u+(tex->stride*v));
 
-#ifdef __arm__
+#if defined(__arm__)
     scanline_t32cb16blend_arm(dst, src, ct);
-#else
+#elif defined(__mips)
     scanline_t32cb16blend_mips(dst, src, ct);
+#else
+    scanline_t32cb16blend_sse2(dst, src, ct);
 #endif
 #else
     dst_iterator16  di(c);
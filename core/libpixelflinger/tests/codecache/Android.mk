@@ -0,0 +1,23 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	codecache_test.cpp \
+	../../codeflinger/CodeCache.cpp \
+	../../tinyutils/SharedBuffer.cpp \
+	../../tinyutils/VectorImpl.cpp
+
+LOCAL_STATIC_LIBRARIES := \
+	libcutils \
+	liblog
+
+LOCAL_C_INCLUDES := \
+	system/core/libpixelflinger
+
+LOCAL_LDLIBS := -lpthread
+
+LOCAL_MODULE:= test-pixelflinger-codecache
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_HOST_EXECUTABLE)
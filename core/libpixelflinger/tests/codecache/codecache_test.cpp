@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Round-trips a few assemblies through the persistent code cache, checking
+// that adding them doesn't write the file and that it is then written once.
+// Then checks that a truncated file, a corrupted one, and one written with
+// another format version or fingerprint are not loaded.
+//
+//   test-pixelflinger-codecache [directory]
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "codeflinger/CodeCache.h"
+
+using namespace android;
+
+static const char* FINGERPRINT = "test/1";
+static const uint32_t NUM_ENTRIES = 3;
+static const size_t CODE_SIZE = 256;
+
+class TestAssembly : public Assembly {
+    AssemblyKey<uint32_t> mKey;
+public:
+    TestAssembly(uint32_t key, size_t size)
+        : Assembly(size), mKey(key) { }
+    const AssemblyKey<uint32_t>& key() const { return mKey; }
+};
+
+static void fill(uint32_t key, uint32_t* code)
+{
+    for (size_t i=0 ; i<CODE_SIZE/4 ; i++) {
+        code[i] = key * 0x9e3779b9 + i;
+    }
+}
+
+static sp<Assembly> load_test(const void* key, size_t keySize,
+        const void* code, size_t codeSize, const AssemblyKeyBase** assemblyKey)
+{
+    if (keySize != sizeof(uint32_t)) {
+        return 0;
+    }
+    uint32_t k;
+    memcpy(&k, key, sizeof(k));
+    sp<TestAssembly> a = new TestAssembly(k, codeSize);
+    memcpy(a->base(), code, codeSize);
+    *assemblyKey = &a->key();
+    return a;
+}
+
+// Loads path into a new cache and returns how many assemblies came back,
+// or -1 if one of them isn't what was saved.
+static int load(const char* path, const char* fingerprint)
+{
+    CodeCache cache(64 * 1024);
+    cache.setPersistentPath(path, fingerprint, load_test);
+    CodeCacheStats stats;
+    cache.getStats(&stats);
+    for (uint32_t k=0 ; k<stats.loaded ; k++) {
+        sp<Assembly> a = cache.lookup(AssemblyKey<uint32_t>(k));
+        uint32_t expected[CODE_SIZE/4];
+        fill(k, expected);
+        if (a == 0 || a->size() != ssize_t(CODE_SIZE) ||
+                memcmp(a->base(), expected, CODE_SIZE)) {
+            return -1;
+        }
+    }
+    return stats.loaded;
+}
+
+static bool copy(const char* from, const char* to, off_t length)
+{
+    FILE* in = fopen(from, "r");
+    if (!in) {
+        return false;
+    }
+    int fd = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    FILE* out = fd >= 0 ? fdopen(fd, "w") : 0;
+    bool ok = out != 0;
+    char buf[4096];
+    size_t n;
+    while (ok && length > 0 &&
+            (n = fread(buf, 1, length < off_t(sizeof(buf)) ? length : sizeof(buf), in)) > 0) {
+        ok = fwrite(buf, 1, n, out) == n;
+        length -= n;
+    }
+    fclose(in);
+    if (out) {
+        ok = fclose(out) == 0 && ok;
+    }
+    return ok;
+}
+
+static bool patch(const char* path, off_t offset, uint32_t value)
+{
+    int fd = open(path, O_WRONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = pwrite(fd, &value, sizeof(value), offset) == sizeof(value);
+    close(fd);
+    return ok;
+}
+
+static int failures = 0;
+
+static void check(const char* what, int loaded, int expected)
+{
+    printf("%-24s loaded %2d, expected %2d  %s\n", what, loaded, expected,
+            loaded == expected ? "ok" : "FAILED");
+    if (loaded != expected) {
+        failures++;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* dir = argc > 1 ? argv[1] : "/tmp";
+    char path[256], other[256 + 8];
+    snprintf(path, sizeof(path), "%s/codecache-test-%d", dir, getpid());
+    snprintf(other, sizeof(other), "%s.copy", path);
+
+    {
+        CodeCache cache(64 * 1024);
+        cache.setPersistentPath(path, FINGERPRINT, load_test);
+        for (uint32_t k=0 ; k<NUM_ENTRIES ; k++) {
+            sp<TestAssembly> a = new TestAssembly(k, CODE_SIZE);
+            fill(k, a->base());
+            cache.cache(a->key(), a);
+        }
+        CodeCacheStats stats;
+        cache.getStats(&stats);
+        check("saves while adding", stats.saves, 0);
+        // past the second the cache waits for more code
+        sleep(2);
+        cache.getStats(&stats);
+        check("saves once idle", stats.saves, 1);
+    }
+
+    struct stat st;
+    if (stat(path, &st)) {
+        perror(path);
+        return 1;
+    }
+    check("round trip", load(path, FINGERPRINT), NUM_ENTRIES);
+    check("other fingerprint", load(path, "test/2"), 0);
+
+    // the header is six words, the version is the second
+    copy(path, other, st.st_size);
+    patch(other, 4, 1);
+    check("version mismatch", load(other, FINGERPRINT), 0);
+
+    copy(path, other, st.st_size - 1);
+    check("truncated by a byte", load(other, FINGERPRINT), 0);
+
+    copy(path, other, st.st_size - CODE_SIZE - 12);
+    check("truncated by an entry", load(other, FINGERPRINT), 0);
+
+    copy(path, other, st.st_size);
+    patch(other, st.st_size - 8, 0xdeadbeef);
+    check("corrupted code", load(other, FINGERPRINT), 0);
+
+    copy(path, other, 8);
+    check("header only", load(other, FINGERPRINT), 0);
+
+    unlink(other);
+    unlink(path);
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Fill rate of the scanlines pick_scanline() chooses for the common states,
+// drawn through the public API as a client would. Prints the needs key of
+// each state (in the form test-opengl-codegen takes) and Mpixels/s, and
+// checks the pixels of the 8888 to 565 states against a plain C version.
+//
+//   test-pixelflinger-scanline-bench [width height [frames]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "private/pixelflinger/ggl_context.h"
+
+using namespace android;
+
+enum {
+    KEY_T32CB16,
+    KEY_T32CB16BLEND,
+    KEY_COL32CB16BLEND,
+    KEY_MEMCPY,
+    KEY_MEMSET16,
+};
+
+static const struct {
+    int         key;
+    const char* name;
+} gKeys[] = {
+    { KEY_T32CB16,          "t32cb16" },
+    { KEY_T32CB16BLEND,     "t32cb16blend" },
+    { KEY_COL32CB16BLEND,   "col32cb16blend" },
+    { KEY_MEMCPY,           "memcpy" },
+    { KEY_MEMSET16,         "memset16" },
+};
+
+// premultiplied, as SRC_OVER expects: 0x80 alpha, 0x40 red. The context
+// rounds it through 16.16, so the checks use the color it packed.
+static const uint32_t COLOR = 0x80000040;
+
+static int64_t now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static uint16_t to565(uint32_t s)
+{
+    return uint16_t(((s << 8) & 0xf800) | ((s >> 5) & 0x07e0) | ((s >> 19) & 0x001f));
+}
+
+static uint16_t blend565(uint32_t s, uint16_t d)
+{
+    int sA = (s>>24);
+    int f = 0x100 - (sA + (sA>>7));
+    int sR = ((s >> (   3))&0x1F) + ((f*((d>>11)&0x1f))>>8);
+    int sG = ((s >> ( 8+2))&0x3F) + ((f*((d>>5)&0x3f))>>8);
+    int sB = ((s >> (16+3))&0x1F) + ((f*((d)&0x1f))>>8);
+    return uint16_t((sR<<11)|(sG<<5)|sB);
+}
+
+static void fill(uint16_t* fb, size_t n)
+{
+    for (size_t i=0 ; i<n ; i++) {
+        fb[i] = uint16_t(i * 2654435761u >> 13);
+    }
+}
+
+static void setup(GGLContext* gl, int key, GGLSurface* tex8888, GGLSurface* tex565)
+{
+    gl->disable(gl, GGL_DITHER);
+    gl->disable(gl, GGL_TEXTURE_2D);
+    gl->disable(gl, GGL_BLEND);
+    gl->shadeModel(gl, GGL_FLAT);
+
+    if (key == KEY_T32CB16 || key == KEY_T32CB16BLEND || key == KEY_MEMCPY) {
+        gl->activeTexture(gl, 0);
+        gl->bindTexture(gl, key == KEY_MEMCPY ? tex565 : tex8888);
+        gl->texEnvi(gl, GGL_TEXTURE_ENV, GGL_TEXTURE_ENV_MODE, GGL_REPLACE);
+        gl->texGeni(gl, GGL_S, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+        gl->texGeni(gl, GGL_T, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+        gl->texCoord2i(gl, 0, 0);
+        gl->enable(gl, GGL_TEXTURE_2D);
+    } else {
+        const GGLclampx color[4] = {
+            GGLclampx(((COLOR      ) & 0xff) * 0x10000 / 0xff),
+            GGLclampx(((COLOR >>  8) & 0xff) * 0x10000 / 0xff),
+            GGLclampx(((COLOR >> 16) & 0xff) * 0x10000 / 0xff),
+            GGLclampx(((COLOR >> 24) & 0xff) * 0x10000 / 0xff)
+        };
+        gl->color4xv(gl, color);
+    }
+
+    if (key == KEY_T32CB16BLEND || key == KEY_COL32CB16BLEND) {
+        gl->blendFunc(gl, GGL_ONE, GGL_ONE_MINUS_SRC_ALPHA);
+        gl->enable(gl, GGL_BLEND);
+    }
+}
+
+// Compares what one frame drew with what the C scanlines would have.
+static int check(int key, const uint16_t* fb, const uint16_t* before,
+        const uint32_t* texels, const uint16_t* texels565, uint32_t color,
+        size_t n)
+{
+    for (size_t i=0 ; i<n ; i++) {
+        uint16_t expected;
+        switch (key) {
+        case KEY_T32CB16:
+            expected = to565(texels[i]);
+            break;
+        case KEY_T32CB16BLEND:
+            expected = texels[i] ? blend565(texels[i], before[i]) : before[i];
+            break;
+        case KEY_COL32CB16BLEND:
+            expected = blend565(color, before[i]);
+            break;
+        case KEY_MEMCPY:
+            expected = texels565[i];
+            break;
+        default:
+            // the color went through 16.16, so only look that it's flat
+            expected = fb[0];
+            break;
+        }
+        if (fb[i] != expected) {
+            printf("  pixel %u is %04x, expected %04x\n",
+                    unsigned(i), fb[i], expected);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    int w = 480;
+    int h = 800;
+    int frames = 200;
+    if (argc >= 3) {
+        w = atoi(argv[1]);
+        h = atoi(argv[2]);
+    }
+    if (argc >= 4) {
+        frames = atoi(argv[3]);
+    }
+    if (w <= 0 || h <= 0 || frames <= 0) {
+        printf("usage: %s [width height [frames]]\n", argv[0]);
+        return 1;
+    }
+
+    const size_t n = size_t(w) * h;
+    uint16_t* fb = new uint16_t[n];
+    uint16_t* before = new uint16_t[n];
+    uint32_t* texels = new uint32_t[n];
+    uint16_t* texels565 = new uint16_t[n];
+    for (size_t i=0 ; i<n ; i++) {
+        // a premultiplied mix of clear, opaque and translucent texels
+        uint32_t a = (i % 7 == 0) ? 0 : (i % 5 == 0) ? 0xff : (i * 37) & 0xff;
+        uint32_t c = uint32_t(i * 2246822519u);
+        uint32_t r = ((c      ) & 0xff) * a / 0xff;
+        uint32_t g = ((c >>  8) & 0xff) * a / 0xff;
+        uint32_t b = ((c >> 16) & 0xff) * a / 0xff;
+        texels[i] = (a << 24) | (b << 16) | (g << 8) | r;
+        texels565[i] = uint16_t(c >> 7);
+    }
+
+    GGLSurface color;
+    memset(&color, 0, sizeof(color));
+    color.version = sizeof(GGLSurface);
+    color.width = w;
+    color.height = h;
+    color.stride = w;
+    color.data = reinterpret_cast<GGLubyte*>(fb);
+    color.format = GGL_PIXEL_FORMAT_RGB_565;
+
+    GGLSurface tex8888 = color;
+    tex8888.data = reinterpret_cast<GGLubyte*>(texels);
+    tex8888.format = GGL_PIXEL_FORMAT_RGBA_8888;
+
+    GGLSurface tex565 = color;
+    tex565.data = reinterpret_cast<GGLubyte*>(texels565);
+
+    int errors = 0;
+    printf("%-16s %-36s %10s\n", "scanline", "needs", "Mpixels/s");
+    for (size_t k=0 ; k<sizeof(gKeys)/sizeof(gKeys[0]) ; k++) {
+        GGLContext* gl;
+        gglInit(&gl);
+        gl->colorBuffer(gl, &color);
+        setup(gl, gKeys[k].key, &tex8888, &tex565);
+
+        // the first frame picks the scanline, and is the one checked
+        fill(fb, n);
+        memcpy(before, fb, n * sizeof(uint16_t));
+        gl->recti(gl, 0, 0, w, h);
+        const context_t* c = reinterpret_cast<context_t*>(gl);
+        const needs_t& needs = c->state.needs;
+        errors += check(gKeys[k].key, fb, before, texels, texels565,
+                GGL_RGBA_TO_HOST(c->packed8888), n);
+
+        const int64_t t0 = now_us();
+        for (int i=0 ; i<frames ; i++) {
+            gl->recti(gl, 0, 0, w, h);
+        }
+        const int64_t t = now_us() - t0;
+
+        char key[40];
+        snprintf(key, sizeof(key), "%08x:%08x_%08x_%08x",
+                needs.p, needs.n, needs.t[0], needs.t[1]);
+        printf("%-16s %-36s %10.1f\n", gKeys[k].name, key,
+                double(n) * frames / (t ? t : 1));
+        gglUninit(gl);
+    }
+
+    delete [] fb;
+    delete [] before;
+    delete [] texels;
+    delete [] texels565;
+    if (errors) {
+        printf("%d scanlines drew the wrong pixels\n", errors);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,15 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	tiler_bench.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+    libpixelflinger
+
+LOCAL_MODULE:= test-pixelflinger-tiler
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
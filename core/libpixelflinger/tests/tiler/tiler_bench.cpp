@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Fill rate of rects and triangles drawn with gglSetThreads() at 1, 2, 4...
+// threads. Every thread count must draw exactly the same pixels as one
+// thread does; the frames are compared after the first one.
+//
+//   test-pixelflinger-tiler [width height [frames [max threads]]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include <pixelflinger/pixelflinger.h>
+
+static int64_t now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+struct scene_t {
+    int         w;
+    int         h;
+    GGLSurface  color;
+    GGLSurface  texture;
+};
+
+// Draws one frame and returns how many pixels it covered, about.
+static size_t draw(GGLContext* gl, const scene_t& s)
+{
+    const int w = s.w;
+    const int h = s.h;
+    size_t pixels = 0;
+
+    // background: 1:1 texture blended over the previous frame
+    gl->disable(gl, GGL_DITHER);
+    gl->shadeModel(gl, GGL_FLAT);
+    gl->bindTexture(gl, &s.texture);
+    gl->texEnvi(gl, GGL_TEXTURE_ENV, GGL_TEXTURE_ENV_MODE, GGL_REPLACE);
+    gl->texGeni(gl, GGL_S, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+    gl->texGeni(gl, GGL_T, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+    gl->texCoord2i(gl, 0, 0);
+    gl->enable(gl, GGL_TEXTURE_2D);
+    gl->blendFunc(gl, GGL_ONE, GGL_ONE_MINUS_SRC_ALPHA);
+    gl->enable(gl, GGL_BLEND);
+    gl->recti(gl, 0, 0, w, h);
+    pixels += size_t(w) * h;
+
+    // translucent panel, dithered
+    gl->disable(gl, GGL_TEXTURE_2D);
+    gl->enable(gl, GGL_DITHER);
+    const GGLclampx panel[4] = { 0x2000, 0x4000, 0x6000, 0x8000 };
+    gl->color4xv(gl, panel);
+    gl->recti(gl, w/8, h/8, w - w/8, h - h/8);
+    pixels += size_t(w - 2*(w/8)) * (h - 2*(h/8));
+
+    // smooth shaded triangles, which step their colors down the rows
+    gl->disable(gl, GGL_BLEND);
+    gl->shadeModel(gl, GGL_SMOOTH);
+    const GGLcolor grad[12] = {
+        0x00400000, 0x00008000, 0x00002000,     // r, dr/dx, dr/dy
+        0x00800000, 0,          0x00004000,     // g
+        0x00200000, 0x00004000, 0,              // b
+        0x00ff0000, 0,          0               // a
+    };
+    gl->colorGrad12xv(gl, grad);
+    const GGLcoord v0[2] = { (w/2) << 4, 3 << 4 };
+    const GGLcoord v1[2] = { (w - 5) << 4, (h - 9) << 4 };
+    const GGLcoord v2[2] = { (3 << 4) + 7, (h*2/3) << 4 };
+    gl->trianglex(gl, v0, v1, v2);
+    pixels += size_t(w) * h / 2;
+
+    // a thin one, which shouldn't be worth splitting
+    const GGLcoord t0[2] = { 10 << 4, 10 << 4 };
+    const GGLcoord t1[2] = { 40 << 4, 12 << 4 };
+    const GGLcoord t2[2] = { 20 << 4, (h - 10) << 4 };
+    gl->trianglex(gl, t0, t1, t2);
+    pixels += size_t(h) * 15;
+    return pixels;
+}
+
+int main(int argc, char** argv)
+{
+    int w = 480;
+    int h = 800;
+    int frames = 100;
+    int max_threads = 4;
+    if (argc >= 3) {
+        w = atoi(argv[1]);
+        h = atoi(argv[2]);
+    }
+    if (argc >= 4) {
+        frames = atoi(argv[3]);
+    }
+    if (argc >= 5) {
+        max_threads = atoi(argv[4]);
+    }
+    if (w <= 0 || h <= 0 || frames <= 0 || max_threads <= 0) {
+        printf("usage: %s [width height [frames [max threads]]]\n", argv[0]);
+        return 1;
+    }
+
+    const size_t n = size_t(w) * h;
+    uint16_t* fb = new uint16_t[n];
+    uint16_t* reference = new uint16_t[n];
+    uint32_t* texels = new uint32_t[n];
+    for (size_t i=0 ; i<n ; i++) {
+        uint32_t a = (i % 7 == 0) ? 0 : (i * 37) & 0xff;
+        uint32_t c = uint32_t(i * 2246822519u);
+        uint32_t r = ((c      ) & 0xff) * a / 0xff;
+        uint32_t g = ((c >>  8) & 0xff) * a / 0xff;
+        uint32_t b = ((c >> 16) & 0xff) * a / 0xff;
+        texels[i] = (a << 24) | (b << 16) | (g << 8) | r;
+    }
+
+    scene_t s;
+    s.w = w;
+    s.h = h;
+    memset(&s.color, 0, sizeof(GGLSurface));
+    s.color.version = sizeof(GGLSurface);
+    s.color.width = w;
+    s.color.height = h;
+    s.color.stride = w;
+    s.color.data = reinterpret_cast<GGLubyte*>(fb);
+    s.color.format = GGL_PIXEL_FORMAT_RGB_565;
+    s.texture = s.color;
+    s.texture.data = reinterpret_cast<GGLubyte*>(texels);
+    s.texture.format = GGL_PIXEL_FORMAT_RGBA_8888;
+
+    int errors = 0;
+    double single = 0;
+    printf("%8s %10s %8s\n", "threads", "Mpixels/s", "speedup");
+    for (int threads=1 ; threads<=max_threads ; threads*=2) {
+        GGLContext* gl;
+        gglInit(&gl);
+        if (gglSetThreads(gl, threads) < 0) {
+            printf("can't start %d threads\n", threads);
+            gglUninit(gl);
+            break;
+        }
+        gl->colorBuffer(gl, &s.color);
+
+        memset(fb, 0, n * sizeof(uint16_t));
+        draw(gl, s);
+        if (threads == 1) {
+            memcpy(reference, fb, n * sizeof(uint16_t));
+        } else if (memcmp(reference, fb, n * sizeof(uint16_t))) {
+            size_t i = 0;
+            while (reference[i] == fb[i]) i++;
+            printf("%d threads: pixel (%d, %d) is %04x, one thread drew %04x\n",
+                    threads, int(i % w), int(i / w), fb[i], reference[i]);
+            errors++;
+        }
+
+        size_t pixels = 0;
+        const int64_t t0 = now_us();
+        for (int i=0 ; i<frames ; i++) {
+            pixels += draw(gl, s);
+        }
+        const int64_t t = now_us() - t0;
+        const double rate = double(pixels) / (t ? t : 1);
+        if (threads == 1) {
+            single = rate;
+        }
+        printf("%8d %10.1f %7.2fx\n", threads, rate, rate / single);
+        gglUninit(gl);
+    }
+
+    delete [] fb;
+    delete [] reference;
+    delete [] texels;
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,230 @@
+/* libs/pixelflinger/tiler.cpp
+**
+** Copyright 2013, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/log.h>
+
+#include "tiler.h"
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+// The color buffer is cut in bands of this many rows, dealt out to the
+// threads in turn, so which thread draws a row depends only on its y.
+const int TILER_BAND_SHIFT = 4;
+
+const int TILER_MAX_THREADS = 8;
+
+struct tiler_worker_t {
+    tiler_t*        tiler;
+    int             index;
+    pthread_t       thread;
+    void*           base;
+    // copy of the caller's context, with its own iterators
+    context_t*      c;
+};
+
+struct tiler_t {
+    pthread_mutex_t lock;
+    pthread_cond_t  work;
+    pthread_cond_t  done;
+    int             workers;    // threads drawing, the caller included
+    int             started;
+    bool            quit;
+    uint32_t        job;
+    int             pending;
+    const sweep_t*  sweeps;
+    int             count;
+    tiler_worker_t  worker[TILER_MAX_THREADS];
+};
+
+// ----------------------------------------------------------------------------
+
+void ggl_sweep_rows(context_t* c, const sweep_t& sweep, int worker, int workers)
+{
+    int count = sweep.count;
+    if (count <= 0) return;
+
+    int32_t left_x = sweep.left_x;
+    int32_t right_x = sweep.right_x;
+    const int32_t left_xi = sweep.left_xi;
+    const int32_t right_xi = sweep.right_xi;
+    const int32_t xmin = c->state.scissor.left;
+    const int32_t xmax = c->state.scissor.right;
+    do {
+        if (workers == 1 ||
+            ((c->iterators.y >> TILER_BAND_SHIFT) % workers) == worker)
+        {
+            // horizontal scissoring
+            int32_t xl = left_x  >> 16;
+            int32_t xr = right_x >> 16;
+            if (xl < xmin) xl = xmin;
+            if (xr > xmax) xr = xmax;
+            // invoke the scanline rasterizer
+            if (ggl_likely(xl < xr)) {
+                c->iterators.xl = xl;
+                c->iterators.xr = xr;
+                c->scanline(c);
+            }
+        }
+        left_x  += left_xi;
+        right_x += right_xi;
+        c->step_y(c);
+    } while (--count);
+}
+
+static void* tiler_thread(void* arg)
+{
+    tiler_worker_t* w = static_cast<tiler_worker_t*>(arg);
+    tiler_t* t = w->tiler;
+    uint32_t job = 0;
+
+    pthread_mutex_lock(&t->lock);
+    while (true) {
+        while (!t->quit && t->job == job) {
+            pthread_cond_wait(&t->work, &t->lock);
+        }
+        if (t->quit) {
+            break;
+        }
+        job = t->job;
+        const sweep_t* sweeps = t->sweeps;
+        const int count = t->count;
+        pthread_mutex_unlock(&t->lock);
+
+        for (int i=0 ; i<count ; i++) {
+            ggl_sweep_rows(w->c, sweeps[i], w->index, t->workers);
+        }
+
+        pthread_mutex_lock(&t->lock);
+        if (--t->pending == 0) {
+            pthread_cond_signal(&t->done);
+        }
+    }
+    pthread_mutex_unlock(&t->lock);
+    return 0;
+}
+
+void ggl_tile_sweeps(context_t* c, const sweep_t* sweeps, int count)
+{
+    tiler_t* t = c->tiler;
+
+    // the workers start from where the caller is, but step on their own
+    for (int i=1 ; i<t->workers ; i++) {
+        memcpy(t->worker[i].c, c, sizeof(context_t));
+    }
+
+    pthread_mutex_lock(&t->lock);
+    t->sweeps = sweeps;
+    t->count = count;
+    t->pending = t->workers - 1;
+    t->job++;
+    pthread_cond_broadcast(&t->work);
+    pthread_mutex_unlock(&t->lock);
+
+    for (int i=0 ; i<count ; i++) {
+        ggl_sweep_rows(c, sweeps[i], 0, t->workers);
+    }
+
+    pthread_mutex_lock(&t->lock);
+    while (t->pending) {
+        pthread_cond_wait(&t->done, &t->lock);
+    }
+    pthread_mutex_unlock(&t->lock);
+}
+
+// ----------------------------------------------------------------------------
+
+void ggl_uninit_tiler(context_t* c)
+{
+    tiler_t* t = c->tiler;
+    if (!t) return;
+    c->tiler = 0;
+
+    pthread_mutex_lock(&t->lock);
+    t->quit = true;
+    pthread_cond_broadcast(&t->work);
+    pthread_mutex_unlock(&t->lock);
+
+    for (int i=1 ; i<t->started ; i++) {
+        pthread_join(t->worker[i].thread, 0);
+    }
+    for (int i=1 ; i<t->workers ; i++) {
+        free(t->worker[i].base);
+    }
+    pthread_cond_destroy(&t->done);
+    pthread_cond_destroy(&t->work);
+    pthread_mutex_destroy(&t->lock);
+    free(t);
+}
+
+ssize_t ggl_set_threads(context_t* c, int count)
+{
+    if (count < 1) count = 1;
+    if (count > TILER_MAX_THREADS) count = TILER_MAX_THREADS;
+
+    if (c->tiler ? (c->tiler->workers == count) : (count == 1)) {
+        return 0;
+    }
+    ggl_uninit_tiler(c);
+    if (count == 1) {
+        return 0;
+    }
+
+    tiler_t* t = (tiler_t*)calloc(1, sizeof(tiler_t));
+    if (!t) {
+        return -ENOMEM;
+    }
+    pthread_mutex_init(&t->lock, 0);
+    pthread_cond_init(&t->work, 0);
+    pthread_cond_init(&t->done, 0);
+    t->workers = count;
+    t->started = 1;
+    c->tiler = t;
+
+    for (int i=1 ; i<count ; i++) {
+        tiler_worker_t& w = t->worker[i];
+        w.tiler = t;
+        w.index = i;
+        // aligned like the context itself, see gglInit()
+        w.base = malloc(sizeof(context_t) + 32);
+        if (!w.base) {
+            ggl_uninit_tiler(c);
+            return -ENOMEM;
+        }
+        w.c = (context_t *)((ptrdiff_t(w.base)+31) & ~0x1FL);
+    }
+    for (int i=1 ; i<count ; i++) {
+        int err = pthread_create(&t->worker[i].thread, 0,
+                tiler_thread, &t->worker[i]);
+        if (err) {
+            ALOGE("can't start rasterizer thread (%s)", strerror(err));
+            ggl_uninit_tiler(c);
+            return -err;
+        }
+        t->started++;
+    }
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
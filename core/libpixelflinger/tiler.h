@@ -0,0 +1,59 @@
+/* libs/pixelflinger/tiler.h
+**
+** Copyright 2013, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+
+#ifndef ANDROID_GGL_TILER_H
+#define ANDROID_GGL_TILER_H
+
+#include <private/pixelflinger/ggl_context.h>
+
+namespace android {
+
+// Primitives smaller than this aren't worth waking the workers for.
+const size_t GGL_TILER_MIN_PIXELS = 16384;
+
+// Consecutive rows between two edges, in 16.16, that move by the given
+// increments from one row to the next. A rect's edges don't move.
+struct sweep_t {
+    int32_t     count;
+    int32_t     left_x;
+    int32_t     left_xi;
+    int32_t     right_x;
+    int32_t     right_xi;
+};
+
+void ggl_uninit_tiler(context_t* c);
+ssize_t ggl_set_threads(context_t* c, int count);
+
+// Whether a primitive of about this many pixels should be split between
+// the context's threads.
+inline bool ggl_tiling(const context_t* c, size_t pixels) {
+    return c->tiler && pixels >= GGL_TILER_MIN_PIXELS;
+}
+
+// Draws the sweeps, one after the other from the row c's iterators are on,
+// with each thread drawing the rows in its own bands of the color buffer.
+// c is stepped past the last row, as ggl_sweep_rows() would leave it.
+void ggl_tile_sweeps(context_t* c, const sweep_t* sweeps, int count);
+
+// Steps c over every row of the sweep, drawing those in the bands owned by
+// 'worker' of 'workers' -- all of them when there is just one.
+void ggl_sweep_rows(context_t* c, const sweep_t& sweep, int worker, int workers);
+
+}; // namespace android
+
+#endif // ANDROID_GGL_TILER_H
@@ -21,6 +21,7 @@
 
 #include "trap.h"
 #include "picker.h"
+#include "tiler.h"
 
 #include <cutils/log.h>
 #include <cutils/memory.h>
@@ -436,7 +437,12 @@ void recti(void* con, GGLint l, GGLint t, GGLint r, GGLint b)
         c->iterators.xl = l;
         c->iterators.xr = r;
         c->init_y(c, t);
-        c->rect(c, yc);
+        if (ggl_tiling(c, size_t(xc)*yc)) {
+            const sweep_t sweep = { yc, l<<16, 0, r<<16, 0 };
+            ggl_tile_sweeps(c, &sweep, 1);
+        } else {
+            c->rect(c, yc);
+        }
     }
 }
 
@@ -715,15 +721,15 @@ void edge_setup(
 }
 
 
-static void
+static int
 triangle_sweep_edges( Edge*  left,
                       Edge*  right,
 					  int            ytop,
 					  int            ybot,
-					  context_t*     c )
+					  sweep_t*       sweep )
 {
     int count = ((ybot - ytop)>>TRI_FRACTION_BITS) + 1;
-    if (count<=0) return;
+    if (count<=0) return 0;
 
     // sort the edges horizontally
     if ((left->x > right->x) || 
@@ -731,29 +737,28 @@ triangle_sweep_edges( Edge*  left,
         swap(left, right);
     }
 
-    int left_x = left->x;
-    int right_x = right->x;
-    const int left_xi = left->x_incr;
-    const int right_xi  = right->x_incr;
-    left->x  += left_xi * count;
-    right->x += right_xi * count;
+    sweep->count    = count;
+    sweep->left_x   = left->x;
+    sweep->left_xi  = left->x_incr;
+    sweep->right_x  = right->x;
+    sweep->right_xi = right->x_incr;
+    left->x  += left->x_incr * count;
+    right->x += right->x_incr * count;
+    return 1;
+}
 
-	const int xmin = c->state.scissor.left;
-	const int xmax = c->state.scissor.right;
-    do {
-        // horizontal scissoring
-        const int32_t xl = max(left_x  >> TRI_ITERATORS_BITS, xmin);
-        const int32_t xr = min(right_x >> TRI_ITERATORS_BITS, xmax);
-        left_x  += left_xi;
-        right_x += right_xi;
-        // invoke the scanline rasterizer
-        if (ggl_likely(xl < xr)) {
-            c->iterators.xl = xl;
-            c->iterators.xr = xr;
-            c->scanline(c);
-        }
-		c->step_y(c);
-	} while (--count);
+// about how many pixels the sweeps cover, to decide whether to tile them
+static size_t
+triangle_sweeps_area( const sweep_t* sweeps, int count )
+{
+    size_t area = 0;
+    for (int i=0 ; i<count ; i++) {
+        const sweep_t& s = sweeps[i];
+        const int32_t top = s.right_x - s.left_x;
+        const int32_t bot = top + (s.right_xi - s.left_xi) * (s.count - 1);
+        area += size_t(s.count) * (max(top, bot) >> TRI_ITERATORS_BITS);
+    }
+    return area;
 }
 
 
@@ -792,10 +797,12 @@ void trianglex_big(void* con,
 		}
     }
 
-    c->init_y(c, y_top >> TRI_FRACTION_BITS);
+    sweep_t sweeps[2];
+    int num_sweeps = 0;
 
     int32_t y_mid = min(left->y_bot, right->y_bot);
-    triangle_sweep_edges( left, right, y_top, y_mid, c );
+    num_sweeps += triangle_sweep_edges( left, right, y_top, y_mid,
+            &sweeps[num_sweeps] );
 
     // second scanline sweep loop, if necessary
     y_mid += TRI_ONE;
@@ -804,7 +811,18 @@ void trianglex_big(void* con,
         if (other->y_top < y_mid) {
             other->x += other->x_incr;
         }
-        triangle_sweep_edges( left, right, y_mid, y_bot, c );
+        num_sweeps += triangle_sweep_edges( left, right, y_mid, y_bot,
+                &sweeps[num_sweeps] );
+    }
+
+    c->init_y(c, y_top >> TRI_FRACTION_BITS);
+
+    if (ggl_tiling(c, triangle_sweeps_area(sweeps, num_sweeps))) {
+        ggl_tile_sweeps(c, sweeps, num_sweeps);
+    } else {
+        for (int i=0 ; i<num_sweeps ; i++) {
+            ggl_sweep_rows(c, sweeps[i], 0, 1);
+        }
     }
 }
 
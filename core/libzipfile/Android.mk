@@ -46,3 +46,17 @@ LOCAL_MODULE := test_zipfile
 LOCAL_C_INCLUDES += external/zlib
 
 include $(BUILD_HOST_EXECUTABLE)
+
+# build zipfile_bench
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	zipfile_bench.c
+
+LOCAL_STATIC_LIBRARIES := libzipfile libunz
+
+LOCAL_MODULE := zipfile_bench
+
+LOCAL_C_INCLUDES += external/zlib
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -72,7 +72,6 @@ read_central_directory_entry(Zipfile* file, Zipentry* entry,
     unsigned short  compressionMethod;
     unsigned short  lastModFileTime;
     unsigned short  lastModFileDate;
-    unsigned long   crc32;
     unsigned short  extraFieldLength;
     unsigned short  fileCommentLength;
     unsigned short  diskNumberStart;
@@ -103,7 +102,7 @@ read_central_directory_entry(Zipfile* file, Zipentry* entry,
     entry->compressionMethod = read_le_short(&p[0x0a]);
     lastModFileTime = read_le_short(&p[0x0c]);
     lastModFileDate = read_le_short(&p[0x0e]);
-    crc32 = read_le_int(&p[0x10]);
+    entry->crc32 = read_le_int(&p[0x10]);
     entry->compressedSize = read_le_int(&p[0x14]);
     entry->uncompressedSize = read_le_int(&p[0x18]);
     entry->fileNameLength = read_le_short(&p[0x1c]);
@@ -159,6 +158,35 @@ read_central_directory_entry(Zipfile* file, Zipentry* entry,
     return 0;
 }
 
+unsigned int
+hash_entry_name(const unsigned char* name, unsigned long len)
+{
+    // FNV-1a
+    unsigned int hash = 2166136261u;
+    while (len--) {
+        hash = (hash ^ *name++) * 16777619u;
+    }
+    return hash;
+}
+
+static void
+add_to_hash_table(Zipfile* file, Zipentry* entry)
+{
+    unsigned int mask = file->hashTableSize - 1;
+    unsigned int i = hash_entry_name(entry->fileName, entry->fileNameLength) & mask;
+
+    while (file->hashTable[i] != NULL) {
+        Zipentry* other = file->hashTable[i];
+        if (other->fileNameLength == entry->fileNameLength
+                && memcmp(other->fileName, entry->fileName, entry->fileNameLength) == 0) {
+            // a name that appears twice finds the later entry, as the list does
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    file->hashTable[i] = entry;
+}
+
 /*
  * Find the central directory and read the contents.
  *
@@ -228,6 +256,16 @@ read_central_dir(Zipfile *file)
         goto bail;
     }
 
+    // Keep the table at most three quarters full.
+    file->hashTableSize = 1;
+    while (file->hashTableSize < file->totalEntryCount + file->totalEntryCount / 3 + 1) {
+        file->hashTableSize <<= 1;
+    }
+    file->hashTable = calloc(file->hashTableSize, sizeof(Zipentry*));
+    if (file->hashTable == NULL) {
+        goto bail;
+    }
+
     // Loop through and read the central dir entries.
     p = buf + file->centralDirOffest;
     len = (buf+bufsize)-p;
@@ -245,6 +283,7 @@ read_central_dir(Zipfile *file)
         // add it to our list
         entry->next = file->entries;
         file->entries = entry;
+        add_to_hash_table(file, entry);
     }
 
     return 0;
@@ -13,6 +13,7 @@ typedef struct Zipentry {
     unsigned short compressionMethod;
     unsigned int uncompressedSize;
     unsigned int compressedSize;
+    unsigned int crc32;
     const unsigned char* data;
     
     struct Zipentry* next;
@@ -34,10 +35,16 @@ typedef struct Zipfile
     const unsigned char*  comment;            //mComment;
 
     Zipentry* entries;
+
+    // Open-addressed table of the entries by name, a power of two in size.
+    Zipentry** hashTable;
+    unsigned int hashTableSize;
 } Zipfile;
 
 int read_central_dir(Zipfile* file);
 
+unsigned int hash_entry_name(const unsigned char* name, unsigned long len);
+
 unsigned int read_le_int(const unsigned char* buf);
 unsigned int read_le_short(const unsigned char* buf);
 
@@ -1,8 +1,10 @@
 #include <zipfile/zipfile.h>
 
 #include "private.h"
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <zlib.h>
 #define DEF_MEM_LEVEL 8                // normally in zutil.h?
 
@@ -22,7 +24,7 @@ init_zipfile(const void* data, size_t size)
 
     return file;
 fail:
-    free(file);
+    release_zipfile(file);
     return NULL;
 }
 
@@ -36,6 +38,7 @@ release_zipfile(zipfile_t f)
         free(entry);
         entry = next;
     }
+    free(file->hashTable);
     free(file);
 }
 
@@ -43,12 +46,17 @@ zipentry_t
 lookup_zipentry(zipfile_t f, const char* entryName)
 {
     Zipfile* file = (Zipfile*)f;
-    Zipentry* entry = file->entries;
-    while (entry) {
-        if (0 == memcmp(entryName, entry->fileName, entry->fileNameLength)) {
+    size_t len = strlen(entryName);
+    unsigned int mask = file->hashTableSize - 1;
+    unsigned int i = hash_entry_name((const unsigned char*)entryName, len) & mask;
+    Zipentry* entry;
+
+    while ((entry = file->hashTable[i]) != NULL) {
+        if (entry->fileNameLength == len
+                && 0 == memcmp(entryName, entry->fileName, len)) {
             return entry;
         }
-        entry = entry->next;
+        i = (i + 1) & mask;
     }
     return NULL;
 }
@@ -128,6 +136,139 @@ decompress_zipentry(zipentry_t e, void* buf, int bufsize)
     }
 }
 
+typedef struct Zipstream {
+    Zipentry* entry;
+    z_stream zstream;
+    unsigned long crc;
+    unsigned int produced;
+    int finished;
+} Zipstream;
+
+zipstream_t
+open_zipentry_stream(zipentry_t e)
+{
+    Zipentry* entry = (Zipentry*)e;
+    Zipstream* stream;
+
+    if (entry->compressionMethod != STORED && entry->compressionMethod != DEFLATED) {
+        return NULL;
+    }
+
+    stream = malloc(sizeof(Zipstream));
+    if (stream == NULL) return NULL;
+    memset(stream, 0, sizeof(Zipstream));
+    stream->entry = entry;
+    stream->crc = crc32(0L, Z_NULL, 0);
+
+    if (entry->compressionMethod == DEFLATED) {
+        stream->zstream.next_in = (void*)entry->data;
+        stream->zstream.avail_in = entry->compressedSize;
+        stream->zstream.data_type = Z_UNKNOWN;
+        // No zlib header, as in uninflate().
+        if (inflateInit2(&stream->zstream, -MAX_WBITS) != Z_OK) {
+            free(stream);
+            return NULL;
+        }
+    }
+    return stream;
+}
+
+int
+read_zipentry_stream(zipstream_t s, void* buf, int bufsize)
+{
+    Zipstream* stream = (Zipstream*)s;
+    Zipentry* entry = stream->entry;
+    unsigned int n;
+
+    if (stream->finished) {
+        return 0;
+    }
+
+    if (entry->compressionMethod == STORED) {
+        n = entry->uncompressedSize - stream->produced;
+        if (n > (unsigned int)bufsize) {
+            n = bufsize;
+        }
+        memcpy(buf, entry->data + stream->produced, n);
+        if (stream->produced + n == entry->uncompressedSize) {
+            stream->finished = 1;
+        }
+    } else {
+        int zerr;
+        stream->zstream.next_out = (Bytef*)buf;
+        stream->zstream.avail_out = bufsize;
+        do {
+            zerr = inflate(&stream->zstream, Z_NO_FLUSH);
+        } while (zerr == Z_OK && stream->zstream.avail_out == (unsigned int)bufsize
+                && stream->zstream.avail_in > 0);
+        n = bufsize - stream->zstream.avail_out;
+        if (zerr == Z_STREAM_END) {
+            stream->finished = 1;
+        } else if (zerr != Z_OK || (n == 0 && bufsize > 0)) {
+            fprintf(stderr, "zerr=%d total_out=%lu\n", zerr, stream->zstream.total_out);
+            return -1;
+        }
+    }
+
+    stream->crc = crc32(stream->crc, buf, n);
+    stream->produced += n;
+
+    if (stream->finished) {
+        if (stream->produced != entry->uncompressedSize || stream->crc != entry->crc32) {
+            fprintf(stderr, "entry size or crc mismatch\n");
+            return -1;
+        }
+    }
+    return n;
+}
+
+void
+close_zipentry_stream(zipstream_t s)
+{
+    Zipstream* stream = (Zipstream*)s;
+    if (stream->entry->compressionMethod == DEFLATED) {
+        inflateEnd(&stream->zstream);
+    }
+    free(stream);
+}
+
+int
+decompress_zipentry_to_fd(zipentry_t entry, int fd)
+{
+    unsigned char buf[64 * 1024];
+    zipstream_t stream;
+    int err = 0;
+    int n;
+
+    stream = open_zipentry_stream(entry);
+    if (stream == NULL) {
+        return -1;
+    }
+    while ((n = read_zipentry_stream(stream, buf, sizeof(buf))) > 0) {
+        unsigned char* p = buf;
+        while (n > 0) {
+            ssize_t w = write(fd, p, n);
+            if (w < 0 && errno == EINTR) {
+                continue;
+            }
+            if (w <= 0) {
+                err = -1;
+                break;
+            }
+            p += w;
+            n -= w;
+        }
+        if (err) {
+            break;
+        }
+    }
+    if (n < 0) {
+        err = -1;
+    }
+    close_zipentry_stream(stream);
+    return err;
+}
+
 void
 dump_zipfile(FILE* to, zipfile_t file)
 {
@@ -0,0 +1,325 @@
+#include <zipfile/zipfile.h>
+#include "private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <zlib.h>
+
+// Builds an archive in memory with many small entries, a few large ones and
+// some stored ones, then times looking every entry up by name against the
+// linear scan lookup_zipentry() used to do, and decompressing every entry
+// into one whole buffer against streaming it through a small one. Checks
+// that both ways find and produce the same thing.
+//
+//   zipfile_bench [-n entries] [-r rounds]
+
+static unsigned char* archive;
+static size_t archive_size;
+static size_t archive_capacity;
+
+static long long
+now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static void
+put(const void* data, size_t len)
+{
+    while (archive_size + len > archive_capacity) {
+        archive_capacity = archive_capacity ? archive_capacity * 2 : 1024 * 1024;
+        archive = realloc(archive, archive_capacity);
+        if (archive == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    memcpy(archive + archive_size, data, len);
+    archive_size += len;
+}
+
+static void
+put_short(unsigned int v)
+{
+    unsigned char b[2] = { v, v >> 8 };
+    put(b, 2);
+}
+
+static void
+put_int(unsigned int v)
+{
+    unsigned char b[4] = { v, v >> 8, v >> 16, v >> 24 };
+    put(b, 4);
+}
+
+static void
+entry_name(char* name, size_t size, int i)
+{
+    snprintf(name, size, "res/drawable-hdpi/icon_%05d.png", i);
+}
+
+// Every 97th entry is large, every 13th stored; the contents are
+// compressible but differ from entry to entry.
+static size_t
+entry_contents(unsigned char** out, int i)
+{
+    size_t len = i % 97 == 0 ? 1024 * 1024 : 200 + (i * 37) % 4000;
+    unsigned char* data = malloc(len);
+    size_t j;
+    for (j = 0; j < len; j++) {
+        data[j] = "abcdefgh"[(j / 7 + i) & 7] ^ (j % 251 == 0 ? i : 0);
+    }
+    *out = data;
+    return len;
+}
+
+static void
+build_archive(int count)
+{
+    struct {
+        unsigned int offset, crc, csize, usize;
+        int method;
+    }* dir = malloc(count * sizeof(*dir));
+    char name[64];
+    size_t cd_start;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        unsigned char* data;
+        unsigned char* cdata;
+        size_t len = entry_contents(&data, i);
+        uLongf clen = compressBound(len);
+        z_stream z;
+
+        dir[i].method = i % 13 == 0 ? 0 : 8;
+        dir[i].crc = crc32(crc32(0L, Z_NULL, 0), data, len);
+        dir[i].usize = len;
+        if (dir[i].method == 8) {
+            cdata = malloc(clen);
+            memset(&z, 0, sizeof(z));
+            deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                         Z_DEFAULT_STRATEGY);
+            z.next_in = data;
+            z.avail_in = len;
+            z.next_out = cdata;
+            z.avail_out = clen;
+            deflate(&z, Z_FINISH);
+            clen = z.total_out;
+            deflateEnd(&z);
+        } else {
+            cdata = data;
+            clen = len;
+        }
+        dir[i].csize = clen;
+        dir[i].offset = archive_size;
+
+        entry_name(name, sizeof(name), i);
+        put_int(0x04034b50);
+        put_short(20);
+        put_short(0);
+        put_short(dir[i].method);
+        put_int(0);
+        put_int(dir[i].crc);
+        put_int(dir[i].csize);
+        put_int(dir[i].usize);
+        put_short(strlen(name));
+        put_short(0);
+        put(name, strlen(name));
+        put(cdata, clen);
+
+        if (cdata != data) {
+            free(cdata);
+        }
+        free(data);
+    }
+
+    cd_start = archive_size;
+    for (i = 0; i < count; i++) {
+        entry_name(name, sizeof(name), i);
+        put_int(0x02014b50);
+        put_short(20);
+        put_short(20);
+        put_short(0);
+        put_short(dir[i].method);
+        put_int(0);
+        put_int(dir[i].crc);
+        put_int(dir[i].csize);
+        put_int(dir[i].usize);
+        put_short(strlen(name));
+        put_short(0);
+        put_short(0);
+        put_short(0);
+        put_short(0);
+        put_int(0);
+        put_int(dir[i].offset);
+        put(name, strlen(name));
+    }
+
+    put_int(0x06054b50);
+    put_short(0);
+    put_short(0);
+    put_short(count);
+    put_short(count);
+    put_int(archive_size - cd_start - 12);
+    put_int(cd_start);
+    put_short(0);
+    free(dir);
+}
+
+// As lookup_zipentry() used to look.
+static Zipentry*
+scan_zipentry(Zipfile* file, const char* name)
+{
+    size_t len = strlen(name);
+    Zipentry* entry;
+    for (entry = file->entries; entry; entry = entry->next) {
+        if (entry->fileNameLength == len && 0 == memcmp(name, entry->fileName, len)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+int
+main(int argc, char** argv)
+{
+    int count = 10000;
+    int rounds = 5;
+    int errors = 0;
+    int i, r;
+    char name[64];
+    zipfile_t zip;
+    long long t0, scan_us, hash_us, whole_us, stream_us;
+    size_t largest = 0;
+    unsigned char chunk[64 * 1024];
+
+    for (i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) {
+            count = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-r") == 0) {
+            rounds = atoi(argv[i + 1]);
+        }
+    }
+    if (count < 1 || count > 65535 || rounds < 1) {
+        fprintf(stderr, "usage: zipfile_bench [-n entries (at most 65535)] [-r rounds]\n");
+        return 1;
+    }
+
+    build_archive(count);
+    t0 = now_us();
+    zip = init_zipfile(archive, archive_size);
+    if (zip == NULL) {
+        fprintf(stderr, "init_zipfile failed\n");
+        return 1;
+    }
+    printf("%d entries, %zu bytes, opened in %lld us\n", count, archive_size, now_us() - t0);
+
+    t0 = now_us();
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < count; i++) {
+            entry_name(name, sizeof(name), i);
+            if (scan_zipentry(zip, name) == NULL) {
+                errors++;
+            }
+        }
+    }
+    scan_us = now_us() - t0;
+
+    for (i = 0; i < count; i++) {
+        entry_name(name, sizeof(name), i);
+        if (lookup_zipentry(zip, name) != scan_zipentry(zip, name)) {
+            fprintf(stderr, "lookup of %s differs\n", name);
+            errors++;
+        }
+    }
+    t0 = now_us();
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < count; i++) {
+            entry_name(name, sizeof(name), i);
+            if (lookup_zipentry(zip, name) == NULL) {
+                errors++;
+            }
+        }
+    }
+    hash_us = now_us() - t0;
+    if (lookup_zipentry(zip, "res/drawable-hdpi/icon_") != NULL
+            || lookup_zipentry(zip, "res/drawable-hdpi/icon_00000.png.orig") != NULL) {
+        fprintf(stderr, "found an entry by a partial name\n");
+        errors++;
+    }
+
+    printf("lookup   scan %.3f us  hashed %.3f us per entry\n",
+           (double)scan_us / rounds / count, (double)hash_us / rounds / count);
+
+    whole_us = 0;
+    stream_us = 0;
+    for (i = 0; i < count; i++) {
+        zipentry_t entry;
+        unsigned char* whole;
+        size_t size, offset = 0;
+        zipstream_t stream;
+        int n;
+
+        entry_name(name, sizeof(name), i);
+        entry = lookup_zipentry(zip, name);
+        if (entry == NULL) {
+            continue;
+        }
+        size = get_zipentry_size(entry);
+        if (size > largest) {
+            largest = size;
+        }
+
+        t0 = now_us();
+        whole = malloc(size * 1.001 + 1);
+        if (decompress_zipentry(entry, whole, size * 1.001 + 1) != 0) {
+            fprintf(stderr, "decompressing %s failed\n", name);
+            errors++;
+        }
+        whole_us += now_us() - t0;
+
+        t0 = now_us();
+        stream = open_zipentry_stream(entry);
+        while (stream && (n = read_zipentry_stream(stream, chunk, sizeof(chunk))) > 0) {
+            offset += n;
+        }
+        if (stream) {
+            close_zipentry_stream(stream);
+        }
+        stream_us += now_us() - t0;
+        if (stream == NULL || n != 0 || offset != size) {
+            fprintf(stderr, "streaming %s failed at %zu\n", name, offset);
+            errors++;
+        }
+
+        // And again, comparing what comes out with the whole buffer.
+        offset = 0;
+        stream = open_zipentry_stream(entry);
+        while (stream && (n = read_zipentry_stream(stream, chunk, sizeof(chunk))) > 0) {
+            if (offset + n > size || memcmp(whole + offset, chunk, n) != 0) {
+                fprintf(stderr, "streamed %s differs at %zu\n", name, offset);
+                errors++;
+                break;
+            }
+            offset += n;
+        }
+        if (stream) {
+            close_zipentry_stream(stream);
+        }
+        free(whole);
+    }
+    printf("inflate  whole %lld us with a buffer of up to %zu bytes,"
+           " streamed with crc check %lld us through %zu bytes\n",
+           whole_us, largest, stream_us, sizeof(chunk));
+
+    release_zipfile(zip);
+    free(archive);
+    if (errors) {
+        printf("%d errors\n", errors);
+    }
+    return errors ? 1 : 0;
+}
@@ -6,6 +6,6 @@ LOCAL_SRC_FILES:= sdcard.c
 LOCAL_MODULE:= sdcard
 LOCAL_CFLAGS := -Wall -Wno-unused-parameter
 
-LOCAL_SHARED_LIBRARIES := libc
+LOCAL_SHARED_LIBRARIES := libc libcorkscrew
 
 include $(BUILD_EXECUTABLE)
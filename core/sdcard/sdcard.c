@@ -29,6 +29,7 @@
 #include <ctype.h>
 #include <pthread.h>
 
+#include <corkscrew/profiler.h>
 #include <private/android_filesystem_config.h>
 
 #include "fuse.h"
@@ -1283,6 +1284,9 @@ static int run(const char* source_path, const char* dest_path, uid_t uid, gid_t
         goto error;
     }
 
+    /* after dropping privileges, so the profiler runs as the fuse threads do */
+    profiler_install();
+
     fuse_init(&fuse, fd, source_path);
 
     umask(0);
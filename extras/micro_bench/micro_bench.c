@@ -15,187 +15,495 @@
 */
 
 /*
- * Some quick and dirty micro-benchmarks
+ * Some quick micro-benchmarks.
+ *
+ * Each benchmark is a kernel run some number of times per sample. That
+ * number is picked so a sample takes about -t milliseconds; the first -w
+ * samples are thrown away, then -n samples are kept and summed up as the
+ * min, median, 99th percentile, mean and standard deviation of the time per
+ * run, in nanoseconds. Kernels over a buffer take its size as ARG, and with
+ * -s are run at every power of two from 256 bytes up to it, to go through
+ * each level of cache. -f json or -f csv prints results for scripts to
+ * compare from one build to the next.
  */
 
-#include <stdlib.h>
-#include <stdio.h>
+#define _GNU_SOURCE
+
 #include <errno.h>
-#include <sys/uio.h>
-#include <unistd.h>
-#include <sys/time.h>
+#include <malloc.h>
+#include <math.h>
+#include <sched.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 
-/* tv2 -= tv1 */
-static void tv_sub(struct timeval *tv2, struct timeval *tv1) {
-        tv2->tv_sec -= tv1->tv_sec;
-        tv2->tv_usec -= tv1->tv_usec;
-        while (tv2->tv_usec < 0) {
-            tv2->tv_usec += 1000000;
-            tv2->tv_sec -= 1;
-        }
-}
+#define SWEEP_MIN           256
+#define SWEEP_MAX           (32 * 1024 * 1024)
+#define BUFFER_ALIGNMENT    64
 
-static int do_sleep(int iters, int delay) {
-    struct timeval tv1;
-    struct timeval tv2;
-    int i;
+/* Keeps the compiler from moving or dropping calls whose result is unused
+ * or the same every time round a loop. */
+#define barrier()   __asm__ __volatile__("" : : : "memory")
+
+/* ARG is a buffer size in bytes: the kernel can be swept over sizes, and
+ * throughput is reported. */
+#define BENCH_SIZE  1
+/* One run per sample, without calibrating, and not part of "all". */
+#define BENCH_ONCE  2
 
-    for (i = 0; iters == -1 || i < iters; i++) {
-        gettimeofday(&tv1, NULL);
-        sleep(delay);
-        gettimeofday(&tv2, NULL);
+struct bench_ctx {
+    int arg;
+    uint8_t *a;
+    uint8_t *b;
+};
 
-        tv_sub(&tv2, &tv1);
+struct bench {
+    const char *name;
+    const char *arg_name;       /* what ARG is, for the usage */
+    int default_arg;
+    int flags;
+    void (*run)(struct bench_ctx *ctx, long reps);
+};
 
-        printf("sleep(%d) took %ld.%06ld seconds\n", delay, tv2.tv_sec, tv2.tv_usec);
-    }
+struct stats {
+    double min;
+    double median;
+    double p99;
+    double mean;
+    double stddev;
+};
 
-    return 0;
+enum format {
+    FORMAT_TEXT,
+    FORMAT_JSON,
+    FORMAT_CSV,
+};
+
+static int g_cpu = -1;
+static int g_warmup = 1;
+static int g_samples = 10;
+static long long g_sample_ns = 10 * 1000000LL;
+static int g_sweep;
+static enum format g_format = FORMAT_TEXT;
+static int g_rows;
+
+/* Where kernels leave their results so they are not optimized away */
+volatile int cpu_foo;
+int foo;
+size_t sink;
+int atomic_word;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void do_sleep(struct bench_ctx *ctx, long reps) {
+    long i;
+    for (i = 0; i < reps; i++)
+        sleep(ctx->arg);
 }
 
-int cpu_foo;
+static void do_cpu(struct bench_ctx *ctx, long reps) {
+    long i;
+    for (i = 0; i < reps; i++)
+        for (cpu_foo = 0; cpu_foo < ctx->arg; cpu_foo++);
+}
 
-static int do_cpu(int iters, int a) {
-    struct timeval tv1;
-    struct timeval tv2;
-    int i;
+static void do_memset(struct bench_ctx *ctx, long reps) {
+    long i;
+    for (i = 0; i < reps; i++) {
+        memset(ctx->a, (int) i, ctx->arg);
+        barrier();
+    }
+}
 
-    for (i = 0; iters == -1 || i < iters; i++) {
-        gettimeofday(&tv1, NULL);
-        for (cpu_foo = 0; cpu_foo < 100000000; cpu_foo++);
-        gettimeofday(&tv2, NULL);
+static void do_memcpy(struct bench_ctx *ctx, long reps) {
+    long i;
+    for (i = 0; i < reps; i++) {
+        memcpy(ctx->b, ctx->a, ctx->arg);
+        barrier();
+    }
+}
 
-        tv_sub(&tv2, &tv1);
+/* Moves the buffer one byte up onto itself, the overlap memcpy can't do */
+static void do_memmove(struct bench_ctx *ctx, long reps) {
+    long i;
+    for (i = 0; i < reps; i++) {
+        memmove(ctx->a + 1, ctx->a, ctx->arg - 1);
+        barrier();
+    }
+}
 
-        printf("cpu took %ld.%06ld seconds\n", tv2.tv_sec, tv2.tv_usec);
+static void do_memread(struct bench_ctx *ctx, long reps) {
+    const int *b = (const int *) ctx->a;
+    int n = ctx->arg / 4;
+    int sum = 0;
+    long i;
+    int k;
+
+    for (i = 0; i < reps; i++) {
+        for (k = 0; k < n; k++)
+            sum += b[k];
+        barrier();
+    }
+    foo = sum;
+}
+
+static void do_strlen(struct bench_ctx *ctx, long reps) {
+    long i;
+    for (i = 0; i < reps; i++) {
+        sink += strlen((const char *) ctx->a);
+        barrier();
     }
-    return 0;
 }
 
-static double mb_sec(unsigned long bytes, struct timeval *delta) {
-    unsigned long us = delta->tv_sec * 1000000 + delta->tv_usec;
-    return (double)bytes * 1000000.0 / 1048576.0 / (double)us;
+/* Looks for the terminating 0, so the whole buffer is searched */
+static void do_memchr(struct bench_ctx *ctx, long reps) {
+    long i;
+    for (i = 0; i < reps; i++) {
+        sink += (size_t) memchr(ctx->a, 0, ctx->arg);
+        barrier();
+    }
 }
 
-static int do_memset(int iters, int sz) {
-    struct timeval tv1;
-    struct timeval tv2;
-    int i, j;
+/* Compares two equal strings, so both are read to the end */
+static void do_strcmp(struct bench_ctx *ctx, long reps) {
+    long i;
+    for (i = 0; i < reps; i++) {
+        sink += strcmp((const char *) ctx->a, (const char *) ctx->b);
+        barrier();
+    }
+}
 
-    uint8_t *b = malloc(sz);
-    if (!b) return -1;
-    int c = 1000000000/sz;
+static void do_atomic_add(struct bench_ctx *ctx __attribute__((unused)), long reps) {
+    long i;
+    for (i = 0; i < reps; i++)
+        __sync_fetch_and_add(&atomic_word, 1);
+}
 
-    for (i = 0; iters == -1 || i < iters; i++) {
-        gettimeofday(&tv1, NULL);
-        for (j = 0; j < c; j++)
-            memset(b, 0, sz);
+static void do_atomic_cas(struct bench_ctx *ctx __attribute__((unused)), long reps) {
+    long i;
+    for (i = 0; i < reps; i++) {
+        int old = atomic_word;
+        __sync_bool_compare_and_swap(&atomic_word, old, old + 1);
+    }
+}
 
-        gettimeofday(&tv2, NULL);
+/* A system call that does next to nothing, made directly so no C library
+ * can answer it from a cache */
+static void do_syscall(struct bench_ctx *ctx __attribute__((unused)), long reps) {
+    long i;
+    for (i = 0; i < reps; i++)
+        sink += syscall(__NR_getppid);
+}
 
-        tv_sub(&tv2, &tv1);
+static const struct bench bench_table[] = {
+    {"sleep", "seconds", 1, BENCH_ONCE, do_sleep},
+    {"cpu", "loops", 1000000, 0, do_cpu},
+    {"memset", "bytes", 4096, BENCH_SIZE, do_memset},
+    {"memcpy", "bytes", 4096, BENCH_SIZE, do_memcpy},
+    {"memmove", "bytes", 4096, BENCH_SIZE, do_memmove},
+    {"memread", "bytes", 4096, BENCH_SIZE, do_memread},
+    {"strlen", "bytes", 4096, BENCH_SIZE, do_strlen},
+    {"memchr", "bytes", 4096, BENCH_SIZE, do_memchr},
+    {"strcmp", "bytes", 4096, BENCH_SIZE, do_strcmp},
+    {"atomic_add", NULL, 0, 0, do_atomic_add},
+    {"atomic_cas", NULL, 0, 0, do_atomic_cas},
+    {"syscall", NULL, 0, 0, do_syscall},
+    {NULL, NULL, 0, 0, NULL},
+};
 
-        printf("memset %dx%d bytes took %ld.%06ld seconds (%f MB/s)\n",
-                c, sz, tv2.tv_sec, tv2.tv_usec, mb_sec(c*sz, &tv2));
+/* Two buffers of arg bytes, each a string of 'x' filling it, faulted in
+ * before anything is timed */
+static int alloc_buffers(struct bench_ctx *ctx) {
+    ctx->a = memalign(BUFFER_ALIGNMENT, ctx->arg);
+    ctx->b = memalign(BUFFER_ALIGNMENT, ctx->arg);
+    if (!ctx->a || !ctx->b) {
+        free(ctx->a);
+        free(ctx->b);
+        return -1;
     }
+    memset(ctx->a, 'x', ctx->arg);
+    ctx->a[ctx->arg - 1] = 0;
+    memcpy(ctx->b, ctx->a, ctx->arg);
     return 0;
 }
 
-static int do_memcpy(int iters, int sz) {
-    struct timeval tv1;
-    struct timeval tv2;
-    int i, j;
+/* How many runs make a sample of about g_sample_ns */
+static long calibrate(const struct bench *b, struct bench_ctx *ctx) {
+    long reps = 1;
+    long long ns;
+
+    if (b->flags & BENCH_ONCE)
+        return 1;
+    for (;;) {
+        long long start = now_ns();
+        b->run(ctx, reps);
+        ns = now_ns() - start;
+        if (ns >= g_sample_ns / 8 || reps >= (1L << 28))
+            break;
+        reps *= 8;
+    }
+    if (ns > 0)
+        reps = (long) ((double) reps * g_sample_ns / ns);
+    return reps > 0 ? reps : 1;
+}
 
-    uint8_t *a = malloc(sz);
-    if (!a) return -1;
-    uint8_t *b = malloc(sz);
-    if (!b) return -1;
-    int c = 1000000000/sz;
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
 
-    for (i = 0; iters == -1 || i < iters; i++) {
-        gettimeofday(&tv1, NULL);
-        for (j = 0; j < c; j++)
-            memcpy(b, a, sz);
+/* Sorts samples, n of them */
+static void summarize(double *samples, int n, struct stats *s) {
+    double sum = 0, squares = 0;
+    int i;
 
-        gettimeofday(&tv2, NULL);
+    qsort(samples, n, sizeof(samples[0]), compare_doubles);
+    s->min = samples[0];
+    s->median = n & 1 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    s->p99 = samples[(int) ceil(n * 0.99) - 1];
+    for (i = 0; i < n; i++)
+        sum += samples[i];
+    s->mean = sum / n;
+    for (i = 0; i < n; i++)
+        squares += (samples[i] - s->mean) * (samples[i] - s->mean);
+    s->stddev = n > 1 ? sqrt(squares / (n - 1)) : 0;
+}
 
-        tv_sub(&tv2, &tv1);
+static void report_begin(void) {
+    switch (g_format) {
+    case FORMAT_TEXT:
+        printf("%-12s %10s %10s %12s %12s %12s %12s %12s %10s\n", "ns per run", "arg", "runs",
+                "min", "median", "p99", "mean", "stddev", "MB/s");
+        break;
+    case FORMAT_JSON:
+        printf("[");
+        break;
+    case FORMAT_CSV:
+        printf("name,arg,cpu,runs,samples,min_ns,median_ns,p99_ns,mean_ns,stddev_ns,mb_per_s\n");
+        break;
+    }
+}
 
-        printf("memcpy %dx%d bytes took %ld.%06ld seconds (%f MB/s)\n",
-                c, sz, tv2.tv_sec, tv2.tv_usec, mb_sec(c*sz, &tv2));
+static void report(const struct bench *b, int arg, long reps, const struct stats *s) {
+    /* from the median, which a stray slow sample doesn't move */
+    double mb_per_s = b->flags & BENCH_SIZE ? arg * 1000.0 / 1.048576 / s->median : 0;
+
+    switch (g_format) {
+    case FORMAT_TEXT:
+        printf("%-12s %10d %10ld %12.1f %12.1f %12.1f %12.1f %12.1f", b->name, arg, reps,
+                s->min, s->median, s->p99, s->mean, s->stddev);
+        if (b->flags & BENCH_SIZE)
+            printf(" %10.1f", mb_per_s);
+        printf("\n");
+        break;
+    case FORMAT_JSON:
+        printf("%s\n  {\"name\": \"%s\", \"arg\": %d, \"cpu\": %d, \"runs\": %ld, "
+                "\"samples\": %d, \"min_ns\": %.1f, \"median_ns\": %.1f, \"p99_ns\": %.1f, "
+                "\"mean_ns\": %.1f, \"stddev_ns\": %.1f", g_rows ? "," : "", b->name, arg,
+                g_cpu, reps, g_samples, s->min, s->median, s->p99, s->mean, s->stddev);
+        if (b->flags & BENCH_SIZE)
+            printf(", \"mb_per_s\": %.1f", mb_per_s);
+        printf("}");
+        break;
+    case FORMAT_CSV:
+        printf("%s,%d,%d,%ld,%d,%.1f,%.1f,%.1f,%.1f,%.1f,", b->name, arg, g_cpu, reps,
+                g_samples, s->min, s->median, s->p99, s->mean, s->stddev);
+        if (b->flags & BENCH_SIZE)
+            printf("%.1f", mb_per_s);
+        printf("\n");
+        break;
     }
-    return 0;
+    fflush(stdout);
+    g_rows++;
 }
 
-int foo;
+static void report_end(void) {
+    if (g_format == FORMAT_JSON)
+        printf("\n]\n");
+}
 
-static int do_memread(int iters, int sz) {
-    struct timeval tv1;
-    struct timeval tv2;
-    int i, j, k;
+static int run_bench(const struct bench *b, int arg) {
+    struct bench_ctx ctx;
+    struct stats s;
+    double *samples;
+    long reps;
+    int i;
 
-    int *b = malloc(sz);
-    if (!b) return -1;
-    int c = 1000000000/sz;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.arg = arg;
+    if ((b->flags & BENCH_SIZE) && alloc_buffers(&ctx) != 0) {
+        fprintf(stderr, "%s: cannot allocate %d bytes\n", b->name, arg);
+        return -1;
+    }
+    samples = malloc(g_samples * sizeof(samples[0]));
+    if (!samples) {
+        free(ctx.a);
+        free(ctx.b);
+        return -1;
+    }
 
-    for (i = 0; iters == -1 || i < iters; i++) {
-        gettimeofday(&tv1, NULL);
-        for (j = 0; j < c; j++)
-            for (k = 0; k < sz/4; k++)
-                foo = b[k];
+    reps = calibrate(b, &ctx);
+    for (i = -g_warmup; i < g_samples; i++) {
+        long long start = now_ns();
+        b->run(&ctx, reps);
+        if (i >= 0)
+            samples[i] = (double) (now_ns() - start) / reps;
+    }
+    summarize(samples, g_samples, &s);
+    report(b, arg, reps, &s);
 
-        gettimeofday(&tv2, NULL);
+    free(samples);
+    free(ctx.a);
+    free(ctx.b);
+    return 0;
+}
 
-        tv_sub(&tv2, &tv1);
+/* Runs b at arg, or at every size up to it when sweeping */
+static int run_sizes(const struct bench *b, int arg) {
+    int size;
 
-        printf("read %dx%d bytes took %ld.%06ld seconds (%f MB/s)\n",
-                c, sz, tv2.tv_sec, tv2.tv_usec, mb_sec(c*sz, &tv2));
+    if (!g_sweep || !(b->flags & BENCH_SIZE))
+        return run_bench(b, arg);
+    for (size = SWEEP_MIN; size > 0 && size <= arg; size *= 2) {
+        if (run_bench(b, size) != 0)
+            return -1;
     }
     return 0;
 }
 
-struct {
-    char *name;
-    int (*ptr)(int, int);
-} function_table[]  = {
-    {"sleep", do_sleep},
-    {"cpu", do_cpu},
-    {"memset", do_memset},
-    {"memcpy", do_memcpy},
-    {"memread", do_memread},
-    {NULL, NULL},
-};
+static int pin_to_cpu(int cpu) {
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        fprintf(stderr, "cannot run on cpu %d: %s\n", cpu, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
 
 static void usage() {
     int i;
 
     printf("Usage:\n");
-    for (i = 0; function_table[i].name; i++) {
-        printf("\tmicro_bench %s ARG [ITERS]\n", function_table[i].name);
+    for (i = 0; bench_table[i].name; i++) {
+        if (bench_table[i].arg_name)
+            printf("\tmicro_bench [OPTIONS] %s [%s [SAMPLES]]\n", bench_table[i].name,
+                    bench_table[i].arg_name);
+        else
+            printf("\tmicro_bench [OPTIONS] %s\n", bench_table[i].name);
     }
+    printf("\tmicro_bench [OPTIONS] all\n");
+    printf("Options:\n");
+    printf("\t-c CPU\t\trun on CPU only\n");
+    printf("\t-f FORMAT\ttext, json or csv\n");
+    printf("\t-n SAMPLES\tsamples to keep (%d)\n", g_samples);
+    printf("\t-s\t\tsweep sizes from %d bytes up to ARG (%d)\n", SWEEP_MIN, SWEEP_MAX);
+    printf("\t-t MS\t\tmilliseconds per sample (%lld)\n", g_sample_ns / 1000000);
+    printf("\t-w SAMPLES\twarm-up samples to throw away (%d)\n", g_warmup);
 }
 
 int main(int argc, char **argv) {
-    int i;
-    int iters;
-
-    if (argc < 3 || argc > 4) {
+    const struct bench *b = NULL;
+    int errors = 0;
+    int opt, i, arg;
+
+    while ((opt = getopt(argc, argv, "c:f:n:st:w:")) != -1) {
+        switch (opt) {
+        case 'c':
+            g_cpu = atoi(optarg);
+            break;
+        case 'f':
+            if (!strcmp(optarg, "text")) {
+                g_format = FORMAT_TEXT;
+            } else if (!strcmp(optarg, "json")) {
+                g_format = FORMAT_JSON;
+            } else if (!strcmp(optarg, "csv")) {
+                g_format = FORMAT_CSV;
+            } else {
+                usage();
+                return -1;
+            }
+            break;
+        case 'n':
+            g_samples = atoi(optarg);
+            break;
+        case 's':
+            g_sweep = 1;
+            break;
+        case 't':
+            g_sample_ns = atoi(optarg) * 1000000LL;
+            break;
+        case 'w':
+            g_warmup = atoi(optarg);
+            break;
+        default:
+            usage();
+            return -1;
+        }
+    }
+    if (optind >= argc || argc - optind > 3 || g_sample_ns <= 0 || g_warmup < 0) {
         usage();
         return -1;
     }
-    if (argc == 3) {
-        iters = -1;
-    } else {
-        iters = atoi(argv[3]);
+    if (argc - optind == 3)
+        g_samples = atoi(argv[optind + 2]);
+    if (g_samples <= 0) {
+        usage();
+        return -1;
     }
-    for (i = 0; function_table[i].name; i++) {
-        if (!strcmp(argv[1], function_table[i].name)) {
-            printf("%s\n", function_table[i].name);
-            return (*function_table[i].ptr)(iters, atoi(argv[2]));
+    if (g_cpu >= 0 && pin_to_cpu(g_cpu) != 0)
+        return -1;
+
+    if (!strcmp(argv[optind], "all")) {
+        if (argc - optind > 1) {
+            usage();
+            return -1;
+        }
+        report_begin();
+        for (i = 0; bench_table[i].name; i++) {
+            b = &bench_table[i];
+            if (b->flags & BENCH_ONCE)
+                continue;
+            arg = g_sweep && (b->flags & BENCH_SIZE) ? SWEEP_MAX : b->default_arg;
+            if (run_sizes(b, arg) != 0)
+                errors++;
         }
+        report_end();
+        return errors ? -1 : 0;
     }
-    usage();
-    return -1;
+
+    for (i = 0; bench_table[i].name; i++) {
+        if (!strcmp(argv[optind], bench_table[i].name)) {
+            b = &bench_table[i];
+            break;
+        }
+    }
+    if (!b) {
+        usage();
+        return -1;
+    }
+    if (argc - optind > 1)
+        arg = atoi(argv[optind + 1]);
+    else
+        arg = g_sweep && (b->flags & BENCH_SIZE) ? SWEEP_MAX : b->default_arg;
+    if ((b->flags & BENCH_SIZE) && arg < 1) {
+        usage();
+        return -1;
+    }
+
+    report_begin();
+    errors = run_sizes(b, arg);
+    report_end();
+    return errors ? -1 : 0;
 }
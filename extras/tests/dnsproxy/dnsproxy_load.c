@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Load test for netd's dnsproxyd.
+ *
+ * Runs a stub DNS server on 127.0.0.1:53 that answers every A query with a
+ * fixed address after an optional delay, points the resolver at it with ndc,
+ * and then hammers getaddrinfo() (which bionic proxies through dnsproxyd)
+ * from many threads over a small set of names.  Reports p50/p99 latency,
+ * throughput, the number of queries that actually reached the stub, and the
+ * peak thread count of the netd process.  On exit the resolver is pointed
+ * back at the interface of the default route and the servers it had.
+ */
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/system_properties.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DNS_PORT 53
+
+static int num_threads = 64;
+static int queries_per_thread = 200;
+static int num_names = 16;
+static int stub_delay_ms = 20;
+
+static volatile int done;
+static volatile int stub_queries;
+static int netd_pid;
+static int peak_netd_threads;
+
+/* What the resolver pointed at before, to put back on exit */
+static char saved_iface[32];
+static char saved_dns[4][PROP_VALUE_MAX];
+
+static long long now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Minimal DNS responder: echoes the question back and appends a single
+ * A record (10.0.0.1, TTL 300) for it.
+ */
+static void *stub_server(void *arg)
+{
+    int s = (int) (long) arg;
+    unsigned char buf[512];
+
+    while (!done) {
+        struct sockaddr_in from;
+        socklen_t fromlen = sizeof(from);
+        ssize_t len = recvfrom(s, buf, sizeof(buf) - 16, 0,
+                               (struct sockaddr *) &from, &fromlen);
+        if (len < 12)
+            continue;
+        __sync_fetch_and_add(&stub_queries, 1);
+        if (stub_delay_ms)
+            usleep(stub_delay_ms * 1000);
+
+        unsigned short qtype = 0;
+        ssize_t q = 12;
+        while (q < len && buf[q])
+            q += buf[q] + 1;
+        if (q + 5 <= len)
+            qtype = (buf[q + 1] << 8) | buf[q + 2];
+        len = q + 5;
+
+        buf[2] = 0x81;                    /* QR, RD */
+        buf[3] = 0x80;                    /* RA, NOERROR */
+        buf[6] = 0; buf[7] = 0;           /* ANCOUNT */
+        buf[8] = 0; buf[9] = 0;
+        buf[10] = 0; buf[11] = 0;
+        if (qtype == 1) {
+            static const unsigned char answer[] = {
+                0xc0, 0x0c,               /* name: pointer to question */
+                0x00, 0x01, 0x00, 0x01,   /* type A, class IN */
+                0x00, 0x00, 0x01, 0x2c,   /* TTL 300 */
+                0x00, 0x04, 10, 0, 0, 1,
+            };
+            buf[7] = 1;
+            memcpy(buf + len, answer, sizeof(answer));
+            len += sizeof(answer);
+        }
+        sendto(s, buf, len, 0, (struct sockaddr *) &from, fromlen);
+    }
+    return NULL;
+}
+
+static int find_netd(void)
+{
+    DIR *d = opendir("/proc");
+    struct dirent *de;
+    int pid = 0;
+
+    if (!d)
+        return 0;
+    while (!pid && (de = readdir(d))) {
+        char path[64], cmd[64];
+        FILE *f;
+        if (!atoi(de->d_name))
+            continue;
+        snprintf(path, sizeof(path), "/proc/%s/cmdline", de->d_name);
+        f = fopen(path, "r");
+        if (!f)
+            continue;
+        if (fgets(cmd, sizeof(cmd), f) && strstr(cmd, "/netd"))
+            pid = atoi(de->d_name);
+        fclose(f);
+    }
+    closedir(d);
+    return pid;
+}
+
+static int thread_count(int pid)
+{
+    char path[64], line[128];
+    FILE *f;
+    int n = 0;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    f = fopen(path, "r");
+    if (!f)
+        return 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "Threads: %d", &n) == 1)
+            break;
+    }
+    fclose(f);
+    return n;
+}
+
+static void *thread_sampler(void *arg)
+{
+    while (!done) {
+        int n = thread_count(netd_pid);
+        if (n > peak_netd_threads)
+            peak_netd_threads = n;
+        usleep(1000);
+    }
+    return NULL;
+}
+
+/* The interface of the default route, or "" if there is none */
+static void default_route_iface(char *iface, size_t size)
+{
+    char line[256], name[32];
+    unsigned long dest;
+    FILE *f = fopen("/proc/net/route", "r");
+
+    iface[0] = 0;
+    if (!f)
+        return;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%31s %lx", name, &dest) == 2 && dest == 0) {
+            snprintf(iface, size, "%s", name);
+            break;
+        }
+    }
+    fclose(f);
+}
+
+static void save_resolver(void)
+{
+    int i;
+
+    default_route_iface(saved_iface, sizeof(saved_iface));
+    for (i = 0; i < 4; i++) {
+        char name[PROP_NAME_MAX];
+        snprintf(name, sizeof(name), "net.dns%d", i + 1);
+        __system_property_get(name, saved_dns[i]);
+    }
+}
+
+static void restore_resolver(void)
+{
+    char cmd[256];
+    int i;
+
+    system("ndc resolver flushif lo >/dev/null");
+    if (!saved_iface[0]) {
+        fprintf(stderr, "warning: no default route, resolver left on lo\n");
+        return;
+    }
+    snprintf(cmd, sizeof(cmd), "ndc resolver setifdns %s", saved_iface);
+    for (i = 0; i < 4; i++) {
+        if (saved_dns[i][0]) {
+            strncat(cmd, " ", sizeof(cmd) - strlen(cmd) - 1);
+            strncat(cmd, saved_dns[i], sizeof(cmd) - strlen(cmd) - 1);
+        }
+    }
+    strncat(cmd, " >/dev/null", sizeof(cmd) - strlen(cmd) - 1);
+    system(cmd);
+    snprintf(cmd, sizeof(cmd), "ndc resolver setdefaultif %s >/dev/null", saved_iface);
+    system(cmd);
+    system("ndc resolver flushdefaultif >/dev/null");
+}
+
+static void on_signal(int sig)
+{
+    /* restore_resolver() runs from atexit() */
+    exit(128 + sig);
+}
+
+struct worker {
+    pthread_t thread;
+    int id;
+    long long *lat;
+    int failures;
+};
+
+static void *worker_main(void *arg)
+{
+    struct worker *w = arg;
+    struct addrinfo hints;
+    int i;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    for (i = 0; i < queries_per_thread; i++) {
+        char name[64];
+        struct addrinfo *res = NULL;
+        long long t0;
+
+        snprintf(name, sizeof(name), "host%d.load.test",
+                 (w->id * 7 + i) % num_names);
+        t0 = now_us();
+        if (getaddrinfo(name, "80", &hints, &res))
+            w->failures++;
+        w->lat[i] = now_us() - t0;
+        if (res)
+            freeaddrinfo(res);
+    }
+    return NULL;
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+    long long x = *(const long long *) a, y = *(const long long *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void usage(const char *me)
+{
+    fprintf(stderr, "usage: %s [-t threads] [-q queries/thread] [-n names] "
+            "[-d stub delay ms] [-k (leave the resolver alone)]\n", me);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_in addr;
+    pthread_t stub, sampler;
+    struct worker *workers;
+    long long *all, t0, elapsed;
+    int total, failures = 0, configure = 1;
+    int s, c, i;
+
+    while ((c = getopt(argc, argv, "t:q:n:d:k")) != -1) {
+        switch (c) {
+        case 't': num_threads = atoi(optarg); break;
+        case 'q': queries_per_thread = atoi(optarg); break;
+        case 'n': num_names = atoi(optarg); break;
+        case 'd': stub_delay_ms = atoi(optarg); break;
+        case 'k': configure = 0; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (num_threads <= 0 || queries_per_thread <= 0 || num_names <= 0)
+        usage(argv[0]);
+
+    s = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(DNS_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (s < 0 || bind(s, (struct sockaddr *) &addr, sizeof(addr))) {
+        fprintf(stderr, "cannot bind stub resolver to 127.0.0.1:%d: %s\n",
+                DNS_PORT, strerror(errno));
+        return 1;
+    }
+    pthread_create(&stub, NULL, stub_server, (void *) (long) s);
+
+    if (configure) {
+        save_resolver();
+        atexit(restore_resolver);
+        signal(SIGINT, on_signal);
+        signal(SIGTERM, on_signal);
+        system("ndc resolver setifdns lo 127.0.0.1 >/dev/null");
+        system("ndc resolver setdefaultif lo >/dev/null");
+        system("ndc resolver flushdefaultif >/dev/null");
+    }
+
+    netd_pid = find_netd();
+    if (netd_pid)
+        pthread_create(&sampler, NULL, thread_sampler, NULL);
+    else
+        fprintf(stderr, "warning: netd not found, not sampling thread count\n");
+
+    workers = calloc(num_threads, sizeof(*workers));
+    total = num_threads * queries_per_thread;
+    all = malloc(total * sizeof(*all));
+
+    t0 = now_us();
+    for (i = 0; i < num_threads; i++) {
+        workers[i].id = i;
+        workers[i].lat = all + i * queries_per_thread;
+        pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+    }
+    for (i = 0; i < num_threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        failures += workers[i].failures;
+    }
+    elapsed = now_us() - t0;
+    done = 1;
+    if (netd_pid)
+        pthread_join(sampler, NULL);
+
+    qsort(all, total, sizeof(*all), cmp_ll);
+    printf("threads %d, queries %d, names %d, stub delay %d ms\n",
+           num_threads, total, num_names, stub_delay_ms);
+    printf("elapsed %lld ms, %.1f queries/s, %d failures\n",
+           elapsed / 1000, total * 1e6 / elapsed, failures);
+    printf("latency us: p50 %lld  p99 %lld  max %lld\n",
+           all[total / 2], all[total * 99 / 100], all[total - 1]);
+    printf("queries reaching stub resolver: %d\n", stub_queries);
+    if (netd_pid)
+        printf("netd threads: peak %d\n", peak_netd_threads);
+
+    free(all);
+    free(workers);
+    return failures ? 1 : 0;
+}
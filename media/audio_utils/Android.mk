@@ -8,9 +8,21 @@ LOCAL_MODULE_TAGS := optional
 LOCAL_SRC_FILES:= \
 	fixedfft.cpp.arm \
 	primitives.c \
+	polyphase.c \
 	resampler.c \
 	echo_reference.c
 
+ifeq ($(TARGET_ARCH),x86)
+LOCAL_SRC_FILES += primitives_x86.c
+endif
+ifeq ($(TARGET_ARCH),arm)
+# empty unless built for NEON
+LOCAL_SRC_FILES += primitives_neon.c
+endif
+
+# the primitives round each product before adding it, vectors or not
+LOCAL_CFLAGS += -ffp-contract=off
+
 LOCAL_C_INCLUDES += $(call include-path-for, speex)
 LOCAL_C_INCLUDES += \
 	$(call include-path-for, speex) \
@@ -21,3 +33,5 @@ LOCAL_SHARED_LIBRARIES := \
 	libspeexresampler
 
 include $(BUILD_SHARED_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
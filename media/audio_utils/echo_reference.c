@@ -19,9 +19,13 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
+#include <cutils/atomic.h>
+#include <cutils/atomic-inline.h>
 #include <cutils/log.h>
 #include <system/audio.h>
+#include <audio_utils/primitives.h>
 #include <audio_utils/resampler.h>
 #include <audio_utils/echo_reference.h>
 
@@ -32,10 +36,28 @@ enum state {
     ECHOREF_WRITING = 0x02      // writing is active
 };
 
+// The reference frames go from write() to read() through a ring allocated once, of at least
+// ECHOREF_BUFFER_MS at the read sampling rate: more than the playback and capture delays add up
+// to. write() and read() run on different threads, and neither ever waits for the other: write()
+// alone advances wr_pos and read() alone advances rd_pos, so the frames between them belong to
+// read() and the rest of the ring to write().
+#define ECHOREF_BUFFER_MS 500
+
+// Each write() also queues the time stamp and delays of the frames it wrote, in a ring of its own,
+// so that read() knows when the last frame it can see was rendered.
+#define ECHOREF_STAMPS 16
+
+struct echo_reference_stamp {
+    int32_t pos;                    // wr_pos after the write
+    struct timespec time_stamp;     // render time indicated by write()
+    int32_t delay_ns;               // playback buffer delay indicated by write()
+    int32_t rsmp_delay_ns;          // delay of the frames still in the resampler
+};
+
 struct echo_reference {
     struct echo_reference_itfe itfe;
     int status;                     // init status
-    uint32_t state;                 // active state: reading, writing or both
+    volatile int32_t state;         // active state: reading, writing or both
     audio_format_t rd_format;       // read sample format
     uint32_t rd_channel_count;      // read number of channels
     uint32_t rd_sampling_rate;      // read sampling rate in Hz
@@ -44,9 +66,19 @@ struct echo_reference {
     uint32_t wr_channel_count;      // write number of channels
     uint32_t wr_sampling_rate;      // write sampling rate in Hz
     size_t wr_frame_size;           // write frame size (bytes per sample)
-    void *buffer;                   // main buffer
-    size_t buf_size;                // main buffer size in frames
-    size_t frames_in;               // number of frames in main buffer
+    void *buffer;                   // ring of reference frames
+    size_t buf_size;                // ring size in frames, a power of 2
+    volatile int32_t wr_pos;        // frames written to the ring, modulo 2^32
+    volatile int32_t rd_pos;        // frames read or skipped from the ring, modulo 2^32
+    volatile int32_t wr_stop_pos;   // wr_pos when write() last stopped: read() skips what's before
+    volatile int32_t wr_stops;      // times write() stopped, counted after wr_stop_pos is set
+    volatile int32_t rd_waiting;    // read() is waiting on cond for frames
+    struct echo_reference_stamp stamps[ECHOREF_STAMPS];
+    volatile int32_t stamps_wr;     // stamps queued by write()
+    volatile int32_t stamps_rd;     // stamps taken by read()
+    volatile int32_t overruns;      // writes the ring had no room for, or only part of
+
+    // owned by write()
     void *wr_buf;                   // buffer for input conversions
     size_t wr_buf_size;             // size of conversion buffer in frames
     size_t wr_frames_in;            // number of frames in conversion buffer
@@ -54,14 +86,21 @@ struct echo_reference {
     void *wr_src_buf;               // resampler input buf (either wr_buf or buffer used by write())
     struct timespec wr_render_time; // latest render time indicated by write()
                                     // default ALSA gettimeofday() format
-    int32_t  playback_delay;        // playback buffer delay indicated by last write()
+    struct resampler_itfe *resampler;          // input resampler
+    struct resampler_buffer_provider provider; // resampler buffer provider
+
+    // owned by read()
+    int32_t rd_stops;               // wr_stops when read() last skipped to wr_stop_pos
+    struct echo_reference_stamp rd_stamp;   // latest stamp taken
+    size_t rd_silence;              // frames of silence to read before the ring's, which delay
+                                    // the reference when it is ahead of the microphone
     int16_t prev_delta_sign;        // sign of previous delay difference:
                                     //  1: positive, -1: negative, 0: unknown
     uint16_t delta_count;           // number of consecutive delay differences with same sign
-    pthread_mutex_t lock;                      // mutex protecting read/write concurrency
-    pthread_cond_t cond;                       // condition signaled when data is ready to read
-    struct resampler_itfe *resampler;          // input resampler
-    struct resampler_buffer_provider provider; // resampler buffer provider
+
+    pthread_mutex_t lock;           // only for read() to wait on cond; write() only takes it
+                                    // to signal when rd_waiting is set
+    pthread_cond_t cond;            // condition signaled when data is ready to read
 };
 
 
@@ -105,22 +144,68 @@ void echo_reference_release_buffer(struct resampler_buffer_provider *buffer_prov
     er->wr_frames_in -= buffer->frame_count;
 }
 
-static void echo_reference_reset_l(struct echo_reference *er)
+// write() side of a reset: the ring itself is emptied by read().
+static void echo_reference_reset_wr(struct echo_reference *er)
 {
-    ALOGV("echo_reference_reset_l()");
-    free(er->buffer);
-    er->buffer = NULL;
-    er->buf_size = 0;
-    er->frames_in = 0;
-    free(er->wr_buf);
-    er->wr_buf = NULL;
-    er->wr_buf_size = 0;
+    ALOGV("echo_reference_reset_wr()");
     er->wr_render_time.tv_sec = 0;
     er->wr_render_time.tv_nsec = 0;
+    if (er->resampler != NULL) {
+        er->resampler->reset(er->resampler);
+    }
+}
+
+// read() side of a reset: drops whatever write() has put in the ring so far.
+static void echo_reference_reset_rd(struct echo_reference *er)
+{
+    ALOGV("echo_reference_reset_rd()");
+    android_atomic_release_store(android_atomic_acquire_load(&er->wr_pos), &er->rd_pos);
+    android_atomic_release_store(android_atomic_acquire_load(&er->stamps_wr), &er->stamps_rd);
+    er->rd_stops = android_atomic_acquire_load(&er->wr_stops);
+    memset(&er->rd_stamp, 0, sizeof(er->rd_stamp));
+    er->rd_silence = 0;
     er->delta_count = 0;
     er->prev_delta_sign = 0;
 }
 
+// Copies frames into the ring, or as many as there is room for. Returns the number copied.
+static size_t echo_reference_ring_write(struct echo_reference *er, const void *src,
+                                        size_t frames)
+{
+    const int32_t wrPos = er->wr_pos;
+    const size_t used = (uint32_t)(wrPos - android_atomic_acquire_load(&er->rd_pos));
+    const size_t offset = (uint32_t)wrPos & (er->buf_size - 1);
+    size_t part;
+
+    if (frames > er->buf_size - used) {
+        frames = er->buf_size - used;
+    }
+    part = er->buf_size - offset;
+    if (part > frames) {
+        part = frames;
+    }
+    memcpy((char *)er->buffer + offset * er->rd_frame_size, src, part * er->rd_frame_size);
+    memcpy(er->buffer, (const char *)src + part * er->rd_frame_size,
+           (frames - part) * er->rd_frame_size);
+    return frames;
+}
+
+// Copies frames out of the ring, which must hold that many.
+static void echo_reference_ring_read(struct echo_reference *er, void *dst, size_t frames)
+{
+    const int32_t rdPos = er->rd_pos;
+    const size_t offset = (uint32_t)rdPos & (er->buf_size - 1);
+    size_t part = er->buf_size - offset;
+
+    if (part > frames) {
+        part = frames;
+    }
+    memcpy(dst, (char *)er->buffer + offset * er->rd_frame_size, part * er->rd_frame_size);
+    memcpy((char *)dst + part * er->rd_frame_size, er->buffer,
+           (frames - part) * er->rd_frame_size);
+    android_atomic_release_store(rdPos + (int32_t)frames, &er->rd_pos);
+}
+
 /* additional space in resampler buffer allowing for extra samples to be returned
  * by speex resampler when sample rates ratio is not an integer.
  */
@@ -136,19 +221,19 @@ static int echo_reference_write(struct echo_reference_itfe *echo_reference,
         return -EINVAL;
     }
 
-    pthread_mutex_lock(&er->lock);
-
     if (buffer == NULL) {
         ALOGV("echo_reference_write() stop write");
-        er->state &= ~ECHOREF_WRITING;
-        echo_reference_reset_l(er);
+        android_atomic_and(~ECHOREF_WRITING, &er->state);
+        android_atomic_release_store(er->wr_pos, &er->wr_stop_pos);
+        android_atomic_inc(&er->wr_stops);
+        echo_reference_reset_wr(er);
         goto exit;
     }
 
     ALOGV("echo_reference_write() START trying to write %d frames", buffer->frame_count);
-    ALOGV("echo_reference_write() playbackTimestamp:[%d].[%d], er->playback_delay:[%d]",
+    ALOGV("echo_reference_write() playbackTimestamp:[%d].[%d], playback_delay:[%d]",
             (int)buffer->time_stamp.tv_sec,
-            (int)buffer->time_stamp.tv_nsec, er->playback_delay);
+            (int)buffer->time_stamp.tv_nsec, buffer->delay_ns);
 
     //ALOGV("echo_reference_write() %d frames", buffer->frame_count);
     // discard writes until a valid time stamp is provided.
@@ -158,23 +243,21 @@ static int echo_reference_write(struct echo_reference_itfe *echo_reference,
         goto exit;
     }
 
-    if ((er->state & ECHOREF_WRITING) == 0) {
+    if ((android_atomic_acquire_load(&er->state) & ECHOREF_WRITING) == 0) {
         ALOGV("echo_reference_write() start write");
         if (er->resampler != NULL) {
             er->resampler->reset(er->resampler);
         }
-        er->state |= ECHOREF_WRITING;
+        android_atomic_or(ECHOREF_WRITING, &er->state);
     }
 
-    if ((er->state & ECHOREF_READING) == 0) {
+    if ((android_atomic_acquire_load(&er->state) & ECHOREF_READING) == 0) {
         goto exit;
     }
 
     er->wr_render_time.tv_sec  = buffer->time_stamp.tv_sec;
     er->wr_render_time.tv_nsec = buffer->time_stamp.tv_nsec;
 
-    er->playback_delay = buffer->delay_ns;
-
     // this will be used in the get_next_buffer, to support variable input buffer sizes
     er->wr_curr_frame_size = buffer->frame_count;
 
@@ -197,6 +280,7 @@ static int echo_reference_write(struct echo_reference_itfe *echo_reference,
             }
         }
 
+        // only write() uses this buffer, and it only grows when the frame count does
         if (er->wr_buf_size < wrBufSize) {
             ALOGV("echo_reference_write() increasing write buffer size from %d to %d",
                     er->wr_buf_size, wrBufSize);
@@ -206,13 +290,9 @@ static int echo_reference_write(struct echo_reference_itfe *echo_reference,
 
         if (er->rd_channel_count != er->wr_channel_count) {
             // must be stereo to mono
-            int16_t *src16 = (int16_t *)buffer->raw;
-            int16_t *dst16 = (int16_t *)er->wr_buf;
-            size_t frames = buffer->frame_count;
-            while (frames--) {
-                *dst16++ = (int16_t)(((int32_t)*src16 + (int32_t)*(src16 + 1)) >> 1);
-                src16 += 2;
-            }
+            downmix_to_mono_i16_from_stereo_i16((int16_t *)er->wr_buf,
+                                                (const int16_t *)buffer->raw,
+                                                buffer->frame_count);
         }
         if (er->wr_sampling_rate != er->rd_sampling_rate) {
             if (er->resampler == NULL) {
@@ -221,10 +301,12 @@ static int echo_reference_write(struct echo_reference_itfe *echo_reference,
                       er->wr_sampling_rate, er->rd_sampling_rate);
                 er->provider.get_next_buffer = echo_reference_get_next_buffer;
                 er->provider.release_buffer = echo_reference_release_buffer;
-                rc = create_resampler(er->wr_sampling_rate,
+                // the provider takes back any part of the frames it gave
+                rc = create_resampler_ex(er->wr_sampling_rate,
                                  er->rd_sampling_rate,
                                  er->rd_channel_count,
                                  RESAMPLER_QUALITY_DEFAULT,
+                                 RESAMPLER_FLAG_IN_PLACE,
                                  &er->provider,
                                  &er->resampler);
                 if (rc != 0) {
@@ -258,25 +340,43 @@ static int echo_reference_write(struct echo_reference_itfe *echo_reference,
         srcBuf = buffer->raw;
     }
 
-    if (er->frames_in + inFrames > er->buf_size) {
-        ALOGV("echo_reference_write() increasing buffer size from %d to %d",
-                er->buf_size, er->frames_in + inFrames);
-                er->buf_size = er->frames_in + inFrames;
-                er->buffer = realloc(er->buffer, er->buf_size * er->rd_frame_size);
+    size_t written = echo_reference_ring_write(er, srcBuf, inFrames);
+    if (written < inFrames) {
+        // read() has stopped taking frames: it will find the ring full and catch up
+        ALOGV("echo_reference_write() overrun, %d of %d frames written", written, inFrames);
+        android_atomic_inc(&er->overruns);
     }
-    memcpy((char *)er->buffer + er->frames_in * er->rd_frame_size,
-           srcBuf,
-           inFrames * er->rd_frame_size);
-    er->frames_in += inFrames;
 
-    ALOGV("echo_reference_write() frames written:[%d], frames total:[%d] buffer size:[%d]\n"
-          "                       er->wr_render_time:[%d].[%d], er->playback_delay:[%d]",
-          inFrames, er->frames_in, er->buf_size,
-          (int)er->wr_render_time.tv_sec, (int)er->wr_render_time.tv_nsec, er->playback_delay);
+    // the stamp first, so that read() has it for every frame it can see
+    int32_t wrPos = er->wr_pos + (int32_t)written;
+    int32_t stampsWr = er->stamps_wr;
+    if (stampsWr - android_atomic_acquire_load(&er->stamps_rd) < ECHOREF_STAMPS) {
+        struct echo_reference_stamp *stamp = &er->stamps[stampsWr & (ECHOREF_STAMPS - 1)];
+        stamp->pos = wrPos;
+        stamp->time_stamp = buffer->time_stamp;
+        stamp->delay_ns = buffer->delay_ns;
+        stamp->rsmp_delay_ns = er->resampler != NULL ? er->resampler->delay_ns(er->resampler) : 0;
+        android_atomic_release_store(stampsWr + 1, &er->stamps_wr);
+    }
+    android_atomic_release_store(wrPos, &er->wr_pos);
 
-    pthread_cond_signal(&er->cond);
+    ALOGV("echo_reference_write() frames written:[%d], frames total:[%d] buffer size:[%d]\n"
+          "                       er->wr_render_time:[%d].[%d], playback_delay:[%d]",
+          written, (uint32_t)(wrPos - er->rd_pos), er->buf_size,
+          (int)er->wr_render_time.tv_sec, (int)er->wr_render_time.tv_nsec, buffer->delay_ns);
+
+    // Wake read() up only if it is waiting, so that write() doesn't touch the lock
+    // otherwise. read() sets rd_waiting before it checks wr_pos, and write() stores
+    // wr_pos before it checks rd_waiting: either read() sees the new frames or this sees
+    // it waiting. In that case read() holds the lock until it is in the wait, so taking
+    // the lock here keeps the signal from falling between its check and its wait.
+    ANDROID_MEMBAR_FULL();
+    if (android_atomic_acquire_load(&er->rd_waiting)) {
+        pthread_mutex_lock(&er->lock);
+        pthread_cond_signal(&er->cond);
+        pthread_mutex_unlock(&er->lock);
+    }
 exit:
-    pthread_mutex_unlock(&er->lock);
     ALOGV("echo_reference_write() END");
     return status;
 }
@@ -297,25 +397,24 @@ static int echo_reference_read(struct echo_reference_itfe *echo_reference,
         return -EINVAL;
     }
 
-    pthread_mutex_lock(&er->lock);
-
     if (buffer == NULL) {
         ALOGV("echo_reference_read() stop read");
-        er->state &= ~ECHOREF_READING;
+        android_atomic_and(~ECHOREF_READING, &er->state);
         goto exit;
     }
 
-    ALOGV("echo_reference_read() START, delayCapture:[%d], "
-            "er->frames_in:[%d],buffer->frame_count:[%d]",
-    buffer->delay_ns, er->frames_in, buffer->frame_count);
+    ALOGV("echo_reference_read() START, delayCapture:[%d], buffer->frame_count:[%d]",
+          buffer->delay_ns, buffer->frame_count);
 
-    if ((er->state & ECHOREF_READING) == 0) {
+    if ((android_atomic_acquire_load(&er->state) & ECHOREF_READING) == 0) {
         ALOGV("echo_reference_read() start read");
-        echo_reference_reset_l(er);
-        er->state |= ECHOREF_READING;
+        echo_reference_reset_rd(er);
+        android_atomic_or(ECHOREF_READING, &er->state);
     }
 
-    if ((er->state & ECHOREF_WRITING) == 0) {
+    if ((android_atomic_acquire_load(&er->state) & ECHOREF_WRITING) == 0) {
+        // what write() left before it stopped is no use any more
+        echo_reference_reset_rd(er);
         memset(buffer->raw, 0, er->rd_frame_size * buffer->frame_count);
         buffer->delay_ns = 0;
         goto exit;
@@ -323,58 +422,92 @@ static int echo_reference_read(struct echo_reference_itfe *echo_reference,
 
 //    ALOGV("echo_reference_read() %d frames", buffer->frame_count);
 
+    // frames from before write() stopped and started again are no use either. Each stop
+    // is applied once, right after it: positions wrap, so a stop position compared with
+    // rd_pos long after would look ahead of it again.
+    int32_t stops = android_atomic_acquire_load(&er->wr_stops);
+    if (stops != er->rd_stops) {
+        int32_t stopPos = android_atomic_acquire_load(&er->wr_stop_pos);
+        er->rd_stops = stops;
+        if (stopPos - er->rd_pos > 0) {
+            android_atomic_release_store(stopPos, &er->rd_pos);
+        }
+    }
+
+    size_t framesIn = (uint32_t)(android_atomic_acquire_load(&er->wr_pos) - er->rd_pos);
+
     // allow some time for new frames to arrive if not enough frames are ready for read
-    if (er->frames_in < buffer->frame_count) {
+    if (framesIn + er->rd_silence < buffer->frame_count) {
         uint32_t timeoutMs = (uint32_t)((1000 * buffer->frame_count) / er->rd_sampling_rate / 2);
         struct timespec ts;
 
         ts.tv_sec  = timeoutMs/1000;
-        ts.tv_nsec = timeoutMs%1000;
-        pthread_cond_timedwait_relative_np(&er->cond, &er->lock, &ts);
+        ts.tv_nsec = (timeoutMs%1000) * 1000000;
+        pthread_mutex_lock(&er->lock);
+        android_atomic_release_store(1, &er->rd_waiting);
+        ANDROID_MEMBAR_FULL();
+        // write() may have come and gone before rd_waiting was set
+        framesIn = (uint32_t)(android_atomic_acquire_load(&er->wr_pos) - er->rd_pos);
+        if (framesIn + er->rd_silence < buffer->frame_count) {
+            pthread_cond_timedwait_relative_np(&er->cond, &er->lock, &ts);
+        }
+        android_atomic_release_store(0, &er->rd_waiting);
+        pthread_mutex_unlock(&er->lock);
+        framesIn = (uint32_t)(android_atomic_acquire_load(&er->wr_pos) - er->rd_pos);
 
-        ALOGV_IF((er->frames_in < buffer->frame_count),
+        ALOGV_IF((framesIn + er->rd_silence < buffer->frame_count),
                  "echo_reference_read() waited %d ms but still not enough frames"\
-                 " er->frames_in: %d, buffer->frame_count = %d",
-                 timeoutMs, er->frames_in, buffer->frame_count);
+                 " frames in: %d, buffer->frame_count = %d",
+                 timeoutMs, framesIn + er->rd_silence, buffer->frame_count);
+    }
+
+    // the latest stamp, which was queued before the frames it covers
+    int32_t stampsWr = android_atomic_acquire_load(&er->stamps_wr);
+    if (stampsWr != er->stamps_rd) {
+        er->rd_stamp = er->stamps[(stampsWr - 1) & (ECHOREF_STAMPS - 1)];
+        android_atomic_release_store(stampsWr, &er->stamps_rd);
     }
 
     int64_t timeDiff;
     struct timespec tmp;
+    const struct echo_reference_stamp *stamp = &er->rd_stamp;
 
-    if ((er->wr_render_time.tv_sec == 0 && er->wr_render_time.tv_nsec == 0) ||
+    if ((stamp->time_stamp.tv_sec == 0 && stamp->time_stamp.tv_nsec == 0) ||
         (buffer->time_stamp.tv_sec == 0 && buffer->time_stamp.tv_nsec == 0)) {
         ALOGV("echo_reference_read(): NEW:timestamp is zero---------setting timeDiff = 0, "\
              "not updating delay this time");
         timeDiff = 0;
     } else {
-        if (buffer->time_stamp.tv_nsec < er->wr_render_time.tv_nsec) {
-            tmp.tv_sec = buffer->time_stamp.tv_sec - er->wr_render_time.tv_sec - 1;
-            tmp.tv_nsec = 1000000000 + buffer->time_stamp.tv_nsec - er->wr_render_time.tv_nsec;
+        if (buffer->time_stamp.tv_nsec < stamp->time_stamp.tv_nsec) {
+            tmp.tv_sec = buffer->time_stamp.tv_sec - stamp->time_stamp.tv_sec - 1;
+            tmp.tv_nsec = 1000000000 + buffer->time_stamp.tv_nsec - stamp->time_stamp.tv_nsec;
         } else {
-            tmp.tv_sec = buffer->time_stamp.tv_sec - er->wr_render_time.tv_sec;
-            tmp.tv_nsec = buffer->time_stamp.tv_nsec - er->wr_render_time.tv_nsec;
+            tmp.tv_sec = buffer->time_stamp.tv_sec - stamp->time_stamp.tv_sec;
+            tmp.tv_nsec = buffer->time_stamp.tv_nsec - stamp->time_stamp.tv_nsec;
         }
         timeDiff = (((int64_t)tmp.tv_sec * 1000000000 + tmp.tv_nsec));
 
-        int64_t expectedDelayNs =  er->playback_delay + buffer->delay_ns - timeDiff;
-
-        if (er->resampler != NULL) {
-            // Resampler already compensates part of the delay
-            int32_t rsmp_delay = er->resampler->delay_ns(er->resampler);
-            expectedDelayNs -= rsmp_delay;
-        }
+        // Resampler already compensates part of the delay
+        int64_t expectedDelayNs =  stamp->delay_ns + buffer->delay_ns - timeDiff -
+                stamp->rsmp_delay_ns;
 
         ALOGV("echo_reference_read(): expectedDelayNs[%lld] = "
-                "er->playback_delay[%d] + delayCapture[%d] - timeDiff[%lld]",
-                expectedDelayNs, er->playback_delay, buffer->delay_ns, timeDiff);
+                "playback_delay[%d] + delayCapture[%d] - timeDiff[%lld]",
+                expectedDelayNs, stamp->delay_ns, buffer->delay_ns, timeDiff);
 
         if (expectedDelayNs > 0) {
-            int64_t delayNs = ((int64_t)er->frames_in * 1000000000) / er->rd_sampling_rate;
+            // the frames ahead of the last one the stamp covers
+            int32_t stampFrames = stamp->pos - er->rd_pos;
+            if (stampFrames < 0) {
+                stampFrames = 0;
+            }
+            size_t delayFrames = (size_t)stampFrames + er->rd_silence;
+            int64_t delayNs = ((int64_t)delayFrames * 1000000000) / er->rd_sampling_rate;
 
             int64_t  deltaNs = delayNs - expectedDelayNs;
 
             ALOGV("echo_reference_read(): EchoPathDelayDeviation between reference and DMA [%lld]", deltaNs);
-            if (abs(deltaNs) >= MIN_DELAY_DELTA_NS) {
+            if (llabs(deltaNs) >= MIN_DELAY_DELTA_NS) {
                 // smooth the variation and update the reference buffer only
                 // if a deviation in the same direction is observed for more than MIN_DELTA_NUM
                 // consecutive reads.
@@ -387,36 +520,33 @@ static int echo_reference_read(struct echo_reference_itfe *echo_reference,
                 er->prev_delta_sign = delay_sign;
 
                 if (er->delta_count > MIN_DELTA_NUM) {
-                    size_t previousFrameIn = er->frames_in;
-                    er->frames_in = (size_t)((expectedDelayNs * er->rd_sampling_rate)/1000000000);
-                    int offset = er->frames_in - previousFrameIn;
+                    size_t expectedFrames =
+                            (size_t)((expectedDelayNs * er->rd_sampling_rate)/1000000000);
 
                     ALOGV("echo_reference_read(): deltaNs ENOUGH and %s: "
-                            "er->frames_in: %d, previousFrameIn = %d",
-                         delay_sign ? "positive" : "negative", er->frames_in, previousFrameIn);
+                            "expected frames: %d, frames = %d",
+                         delay_sign > 0 ? "positive" : "negative", expectedFrames, delayFrames);
 
                     if (deltaNs < 0) {
                         // Less data available in the reference buffer than expected
-                        if (er->frames_in > er->buf_size) {
-                            er->buf_size = er->frames_in;
-                            er->buffer  = realloc(er->buffer, er->buf_size * er->rd_frame_size);
-                            ALOGV("echo_reference_read(): increasing buffer size to %d",
-                                  er->buf_size);
-                        }
-
-                        if (offset > 0) {
-                            memset((char *)er->buffer + previousFrameIn * er->rd_frame_size,
-                                   0, offset * er->rd_frame_size);
-                            ALOGV("echo_reference_read(): pushing ref buffer by [%d]", offset);
-                        }
+                        er->rd_silence += expectedFrames - delayFrames;
+                        ALOGV("echo_reference_read(): pushing ref buffer by [%d]",
+                              expectedFrames - delayFrames);
                     } else {
                         // More data available in the reference buffer than expected
-                        offset = -offset;
-                        if (offset > 0) {
-                            memcpy(er->buffer, (char *)er->buffer + (offset * er->rd_frame_size),
-                                   er->frames_in * er->rd_frame_size);
-                            ALOGV("echo_reference_read(): shifting ref buffer by [%d]",
-                                  er->frames_in);
+                        size_t skip = delayFrames - expectedFrames;
+                        ALOGV("echo_reference_read(): shifting ref buffer by [%d]", skip);
+                        if (skip > er->rd_silence) {
+                            skip -= er->rd_silence;
+                            er->rd_silence = 0;
+                            if (skip > framesIn) {
+                                skip = framesIn;
+                            }
+                            framesIn -= skip;
+                            android_atomic_release_store(er->rd_pos + (int32_t)skip,
+                                                         &er->rd_pos);
+                        } else {
+                            er->rd_silence -= skip;
                         }
                     }
                 }
@@ -428,42 +558,35 @@ static int echo_reference_read(struct echo_reference_itfe *echo_reference,
             }
         } else {
             ALOGV("echo_reference_read(): NEGATIVE expectedDelayNs[%lld] =  "\
-                 "er->playback_delay[%d] + delayCapture[%d] - timeDiff[%lld]",
-                 expectedDelayNs, er->playback_delay, buffer->delay_ns, timeDiff);
+                 "playback_delay[%d] + delayCapture[%d] - timeDiff[%lld]",
+                 expectedDelayNs, stamp->delay_ns, buffer->delay_ns, timeDiff);
         }
     }
 
-    if (er->frames_in < buffer->frame_count) {
-        if (buffer->frame_count > er->buf_size) {
-            er->buf_size = buffer->frame_count;
-            er->buffer  = realloc(er->buffer, er->buf_size * er->rd_frame_size);
-            ALOGV("echo_reference_read(): increasing buffer size to %d", er->buf_size);
-        }
-        // filling up the reference buffer with 0s to match the expected delay.
-        memset((char *)er->buffer + er->frames_in * er->rd_frame_size,
-            0, (buffer->frame_count - er->frames_in) * er->rd_frame_size);
-        er->frames_in = buffer->frame_count;
-    }
+    // the silence owed, then the ring, then silence again if the ring runs out
+    size_t frames = buffer->frame_count;
+    char *dst = (char *)buffer->raw;
+    size_t silence = er->rd_silence < frames ? er->rd_silence : frames;
+    memset(dst, 0, silence * er->rd_frame_size);
+    er->rd_silence -= silence;
+    dst += silence * er->rd_frame_size;
+    frames -= silence;
 
-    memcpy(buffer->raw,
-           (char *)er->buffer,
-           buffer->frame_count * er->rd_frame_size);
+    size_t ring = framesIn < frames ? framesIn : frames;
+    echo_reference_ring_read(er, dst, ring);
+    dst += ring * er->rd_frame_size;
+    frames -= ring;
 
-    er->frames_in -= buffer->frame_count;
-    memcpy(er->buffer,
-           (char *)er->buffer + buffer->frame_count * er->rd_frame_size,
-           er->frames_in * er->rd_frame_size);
+    // filling up the reference buffer with 0s to match the expected delay.
+    memset(dst, 0, frames * er->rd_frame_size);
 
     // As the reference buffer is now time aligned to the microphone signal there is a zero delay
     buffer->delay_ns = 0;
 
     ALOGV("echo_reference_read() END %d frames, total frames in %d",
-          buffer->frame_count, er->frames_in);
-
-    pthread_cond_signal(&er->cond);
+          buffer->frame_count, framesIn - ring);
 
 exit:
-    pthread_mutex_unlock(&er->lock);
     return 0;
 }
 
@@ -498,6 +621,9 @@ int create_echo_reference(audio_format_t rdFormat,
     }
 
     er = (struct echo_reference *)calloc(1, sizeof(struct echo_reference));
+    if (er == NULL) {
+        return -ENOMEM;
+    }
 
     er->itfe.read = echo_reference_read;
     er->itfe.write = echo_reference_write;
@@ -511,6 +637,20 @@ int create_echo_reference(audio_format_t rdFormat,
     er->wr_sampling_rate = wrSamplingRate;
     er->rd_frame_size = audio_bytes_per_sample(rdFormat) * rdChannelCount;
     er->wr_frame_size = audio_bytes_per_sample(wrFormat) * wrChannelCount;
+
+    size_t frames = (size_t)rdSamplingRate * ECHOREF_BUFFER_MS / 1000;
+    er->buf_size = 1;
+    while (er->buf_size < frames) {
+        er->buf_size <<= 1;
+    }
+    er->buffer = malloc(er->buf_size * er->rd_frame_size);
+    if (er->buffer == NULL) {
+        free(er);
+        return -ENOMEM;
+    }
+    pthread_mutex_init(&er->lock, NULL);
+    pthread_cond_init(&er->cond, NULL);
+
     *echo_reference = &er->itfe;
     return 0;
 }
@@ -523,10 +663,13 @@ void release_echo_reference(struct echo_reference_itfe *echo_reference) {
     }
 
     ALOGV("EchoReference dstor");
-    echo_reference_reset_l(er);
+    ALOGW_IF(er->overruns != 0, "echo reference overran %d times", er->overruns);
     if (er->resampler != NULL) {
         release_resampler(er->resampler);
     }
+    pthread_cond_destroy(&er->cond);
+    pthread_mutex_destroy(&er->lock);
+    free(er->buffer);
+    free(er->wr_buf);
     free(er);
 }
-
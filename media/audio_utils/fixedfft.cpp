@@ -22,16 +22,32 @@
  * keep it small, only radix-2 Cooley-Tukey algorithm is implemented, and only
  * half of the twiddle factors are stored. Although there are still ways to make
  * it even faster or smaller, it costs too much on one of the aspects.
+ *
+ * The radix-2 code below is the reference. The default implementation gives
+ * exactly the same output, as every butterfly does the same arithmetic, but
+ * takes the twiddles of each stage and the swaps of the bit reversal from
+ * tables built once, and runs the stages two at a time, four points at a
+ * time: the memory traffic of radix-4, without changing where each stage
+ * halves and rounds. Built for SSE2 or NEON, it does four butterflies at a
+ * time as well.
  */
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
 #ifdef __arm__
 #include <machine/cpu-features.h>
 #endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 
 #include <audio_utils/fixedfft.h>
 
+#include "fixedfft_impl.h"
+
 #define LOG_FFT_SIZE 10
 #define MAX_FFT_SIZE (1 << LOG_FFT_SIZE)
 
@@ -106,7 +122,11 @@ static inline int32_t half(int32_t a)
 #endif
 }
 
-void fixed_fft(int n, int32_t *v)
+//------------------------------------------------------------------------------
+// reference radix-2 implementation
+//------------------------------------------------------------------------------
+
+static void radix2_fft(int n, int32_t *v)
 {
     int scale = LOG_FFT_SIZE, i, p, r;
 
@@ -143,11 +163,12 @@ void fixed_fft(int n, int32_t *v)
     }
 }
 
-void fixed_fft_real(int n, int32_t *v)
+// Turns the FFT of n complex points, made of pairs of real samples, into the
+// first half of the FFT of the 2n real samples.
+static void real_from_complex(int n, int32_t *v)
 {
     int scale = LOG_FFT_SIZE, m = n >> 1, i;
 
-    fixed_fft(n, v);
     for (i = 1; i <= n; i <<= 1, --scale);
     v[0] = mult(~v[0], 0x80008000);
     v[m] = half(v[m]);
@@ -162,3 +183,473 @@ void fixed_fft_real(int n, int32_t *v)
         v[n - i] = (x + y) ^ 0xFFFF;
     }
 }
+
+static void radix2_fft_real(int n, int32_t *v)
+{
+    radix2_fft(n, v);
+    real_from_complex(n, v);
+}
+
+//------------------------------------------------------------------------------
+// tables
+//------------------------------------------------------------------------------
+
+// The twiddle radix2_fft() works out for butterfly r of the stage where the
+// points are p apart is stage_twiddles[p + r], for 0 < r < p.
+static int32_t stage_twiddles[MAX_FFT_SIZE];
+
+// The pairs of points the bit reversal of 1 << k points swaps are from
+// bitrev_pairs[2 * bitrev_start[k]] up to bitrev_pairs[2 * bitrev_start[k + 1]].
+static uint16_t bitrev_pairs[MAX_FFT_SIZE * 2];
+static int bitrev_start[LOG_FFT_SIZE + 2];
+
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void init_tables()
+{
+    int scale = LOG_FFT_SIZE, count = 0, i, k, p, r;
+
+    for (p = 1; p < MAX_FFT_SIZE; p <<= 1) {
+        --scale;
+        stage_twiddles[p] = 0;
+        for (r = 1; r < p; ++r) {
+            int32_t w = MAX_FFT_SIZE / 4 - (r << scale);
+            i = w >> 31;
+            stage_twiddles[p + r] = twiddle[(w ^ i) - i] ^ (i << 16);
+        }
+    }
+
+    for (k = 0; k <= LOG_FFT_SIZE; ++k) {
+        int n = 1 << k;
+        bitrev_start[k] = count;
+        for (r = 0, i = 1; i < n; ++i) {
+            for (p = n; !(p & r); p >>= 1, r ^= p);
+            if (i < r) {
+                bitrev_pairs[2 * count] = i;
+                bitrev_pairs[2 * count + 1] = r;
+                ++count;
+            }
+        }
+    }
+    bitrev_start[LOG_FFT_SIZE + 1] = count;
+}
+
+static inline int log2_size(int n)
+{
+    int k = 0;
+    while ((1 << k) < n) {
+        ++k;
+    }
+    return k;
+}
+
+static void bit_reverse(int n, int32_t *v)
+{
+    int k = log2_size(n);
+    const uint16_t *pair = bitrev_pairs + 2 * bitrev_start[k];
+    const uint16_t *end = bitrev_pairs + 2 * bitrev_start[k + 1];
+
+    for (; pair < end; pair += 2) {
+        int32_t t = v[pair[0]];
+        v[pair[0]] = v[pair[1]];
+        v[pair[1]] = t;
+    }
+}
+
+//------------------------------------------------------------------------------
+// scalar passes
+//------------------------------------------------------------------------------
+
+// The butterfly of radix2_fft() on *a and *b, with twiddle w unless r is 0.
+// Its first butterfly adds where the others subtract, which is the same as
+// subtracting the negated half.
+static inline void butterfly(int32_t *a, int32_t *b, int r, int32_t w)
+{
+    int32_t x = half(*a);
+    int32_t y = r ? mult(w, *b) : -half(*b);
+    *a = x - y;
+    *b = x + y;
+}
+
+// The stage where the points are p apart.
+static void pass2(int n, int32_t *v, int p)
+{
+    const int32_t *tw = stage_twiddles + p;
+    int i, r;
+
+    for (i = 0; i < n; i += p << 1) {
+        for (r = 0; r < p; ++r) {
+            butterfly(v + i + r, v + i + r + p, r, tw[r]);
+        }
+    }
+}
+
+// The stages where the points are p and then 2p apart, four points at a time.
+static void pass4(int n, int32_t *v, int p)
+{
+    const int32_t *tw1 = stage_twiddles + p;
+    const int32_t *tw2 = stage_twiddles + (p << 1);
+    int i, r;
+
+    for (i = 0; i < n; i += p << 2) {
+        for (r = 0; r < p; ++r) {
+            int32_t *a = v + i + r;
+            butterfly(a, a + p, r, tw1[r]);
+            butterfly(a + 2 * p, a + 3 * p, r, tw1[r]);
+            butterfly(a, a + 2 * p, r, tw2[r]);
+            butterfly(a + p, a + 3 * p, r + p, tw2[r + p]);
+        }
+    }
+}
+
+static void scalar_fft(int n, int32_t *v)
+{
+    int p = 1;
+
+    bit_reverse(n, v);
+    for (; p << 2 <= n; p <<= 2) {
+        pass4(n, v, p);
+    }
+    if (p << 1 <= n) {
+        pass2(n, v, p);
+    }
+}
+
+static void scalar_fft_real(int n, int32_t *v)
+{
+    scalar_fft(n, v);
+    real_from_complex(n, v);
+}
+
+//------------------------------------------------------------------------------
+// vector passes: the same as the scalar ones, four butterflies at a time
+//------------------------------------------------------------------------------
+
+#if defined(__SSE2__) || defined(__ARM_NEON__)
+#define FIXED_FFT_HAVE_VECTOR 1
+
+#if defined(__SSE2__)
+
+typedef __m128i vec_t;
+
+static inline vec_t vload(const int32_t *p) { return _mm_loadu_si128((const __m128i *) p); }
+static inline void vstore(int32_t *p, vec_t a) { _mm_storeu_si128((__m128i *) p, a); }
+static inline vec_t vdup(int32_t a) { return _mm_set1_epi32(a); }
+static inline vec_t vadd(vec_t a, vec_t b) { return _mm_add_epi32(a, b); }
+static inline vec_t vsub(vec_t a, vec_t b) { return _mm_sub_epi32(a, b); }
+static inline vec_t vxor(vec_t a, vec_t b) { return _mm_xor_si128(a, b); }
+
+static inline vec_t vhalf(vec_t a)
+{
+    const vec_t m = _mm_set1_epi32(0x8000);
+    return _mm_or_si128(_mm_andnot_si128(m, _mm_srai_epi32(a, 1)), _mm_and_si128(m, a));
+}
+
+static inline vec_t vmult(vec_t a, vec_t b)
+{
+    const vec_t hi = _mm_set1_epi32(0xFFFF0000);
+    vec_t re = _mm_and_si128(_mm_madd_epi16(a, b), hi);
+    // b with its real and imaginary parts swapped, against only one part of a
+    vec_t bs = _mm_shufflehi_epi16(_mm_shufflelo_epi16(b, _MM_SHUFFLE(2, 3, 0, 1)),
+                                   _MM_SHUFFLE(2, 3, 0, 1));
+    vec_t im = _mm_sub_epi32(_mm_madd_epi16(_mm_and_si128(a, hi), bs),
+                             _mm_madd_epi16(_mm_andnot_si128(hi, a), bs));
+    return _mm_or_si128(re, _mm_srli_epi32(im, 16));
+}
+
+// b in the first lane, a in the others
+static inline vec_t vfirst(vec_t a, vec_t b)
+{
+    const vec_t m = _mm_set_epi32(0, 0, 0, -1);
+    return _mm_or_si128(_mm_and_si128(m, b), _mm_andnot_si128(m, a));
+}
+
+static inline vec_t vreverse(vec_t a) { return _mm_shuffle_epi32(a, _MM_SHUFFLE(0, 1, 2, 3)); }
+
+static inline void vtranspose(vec_t *a, vec_t *b, vec_t *c, vec_t *d)
+{
+    vec_t t0 = _mm_unpacklo_epi32(*a, *b);
+    vec_t t1 = _mm_unpacklo_epi32(*c, *d);
+    vec_t t2 = _mm_unpackhi_epi32(*a, *b);
+    vec_t t3 = _mm_unpackhi_epi32(*c, *d);
+    *a = _mm_unpacklo_epi64(t0, t1);
+    *b = _mm_unpackhi_epi64(t0, t1);
+    *c = _mm_unpacklo_epi64(t2, t3);
+    *d = _mm_unpackhi_epi64(t2, t3);
+}
+
+#define VECTOR_NAME "sse2"
+
+#else
+
+typedef int32x4_t vec_t;
+
+static inline vec_t vload(const int32_t *p) { return vld1q_s32(p); }
+static inline void vstore(int32_t *p, vec_t a) { vst1q_s32(p, a); }
+static inline vec_t vdup(int32_t a) { return vdupq_n_s32(a); }
+static inline vec_t vadd(vec_t a, vec_t b) { return vaddq_s32(a, b); }
+static inline vec_t vsub(vec_t a, vec_t b) { return vsubq_s32(a, b); }
+static inline vec_t vxor(vec_t a, vec_t b) { return veorq_s32(a, b); }
+
+static inline vec_t vhalf(vec_t a)
+{
+    return vbslq_s32(vdupq_n_u32(0x8000), a, vshrq_n_s32(a, 1));
+}
+
+static inline vec_t vmult(vec_t a, vec_t b)
+{
+    vec_t ar = vshrq_n_s32(a, 16);
+    vec_t ai = vshrq_n_s32(vshlq_n_s32(a, 16), 16);
+    vec_t br = vshrq_n_s32(b, 16);
+    vec_t bi = vshrq_n_s32(vshlq_n_s32(b, 16), 16);
+    vec_t re = vmlaq_s32(vmulq_s32(ar, br), ai, bi);
+    vec_t im = vmlsq_s32(vmulq_s32(ar, bi), ai, br);
+    return vorrq_s32(vandq_s32(re, vdupq_n_s32(0xFFFF0000)),
+                     vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(im), 16)));
+}
+
+static inline vec_t vfirst(vec_t a, vec_t b)
+{
+    return vsetq_lane_s32(vgetq_lane_s32(b, 0), a, 0);
+}
+
+static inline vec_t vreverse(vec_t a)
+{
+    vec_t r = vrev64q_s32(a);
+    return vcombine_s32(vget_high_s32(r), vget_low_s32(r));
+}
+
+static inline void vtranspose(vec_t *a, vec_t *b, vec_t *c, vec_t *d)
+{
+    int32x4x2_t ab = vtrnq_s32(*a, *b);
+    int32x4x2_t cd = vtrnq_s32(*c, *d);
+    *a = vcombine_s32(vget_low_s32(ab.val[0]), vget_low_s32(cd.val[0]));
+    *b = vcombine_s32(vget_low_s32(ab.val[1]), vget_low_s32(cd.val[1]));
+    *c = vcombine_s32(vget_high_s32(ab.val[0]), vget_high_s32(cd.val[0]));
+    *d = vcombine_s32(vget_high_s32(ab.val[1]), vget_high_s32(cd.val[1]));
+}
+
+#define VECTOR_NAME "neon"
+
+#endif
+
+static inline void vbutterfly(vec_t *a, vec_t *b, vec_t y)
+{
+    vec_t x = vhalf(*a);
+    *a = vsub(x, y);
+    *b = vadd(x, y);
+}
+
+// y of butterfly() for butterflies r to r + 3
+static inline vec_t vtwiddle(vec_t w, vec_t b, int r)
+{
+    vec_t y = vmult(w, b);
+    if (r == 0) {
+        y = vfirst(y, vsub(vdup(0), vhalf(b)));
+    }
+    return y;
+}
+
+static void vector_pass2(int n, int32_t *v, int p)
+{
+    const int32_t *tw = stage_twiddles + p;
+    int i, r;
+
+    for (i = 0; i < n; i += p << 1) {
+        for (r = 0; r < p; r += 4) {
+            vec_t a = vload(v + i + r);
+            vec_t b = vload(v + i + r + p);
+            vbutterfly(&a, &b, vtwiddle(vload(tw + r), b, r));
+            vstore(v + i + r, a);
+            vstore(v + i + r + p, b);
+        }
+    }
+}
+
+static void vector_pass4(int n, int32_t *v, int p)
+{
+    const int32_t *tw1 = stage_twiddles + p;
+    const int32_t *tw2 = stage_twiddles + (p << 1);
+    int i, r;
+
+    for (i = 0; i < n; i += p << 2) {
+        for (r = 0; r < p; r += 4) {
+            int32_t *q = v + i + r;
+            vec_t a = vload(q);
+            vec_t b = vload(q + p);
+            vec_t c = vload(q + 2 * p);
+            vec_t d = vload(q + 3 * p);
+            vec_t w1 = vload(tw1 + r);
+            vbutterfly(&a, &b, vtwiddle(w1, b, r));
+            vbutterfly(&c, &d, vtwiddle(w1, d, r));
+            vbutterfly(&a, &c, vtwiddle(vload(tw2 + r), c, r));
+            vbutterfly(&b, &d, vmult(vload(tw2 + r + p), d));
+            vstore(q, a);
+            vstore(q + p, b);
+            vstore(q + 2 * p, c);
+            vstore(q + 3 * p, d);
+        }
+    }
+}
+
+// The first two stages, which have too few butterflies in a row for the
+// passes above: four groups of four points at a time, transposed.
+static void vector_pass4_first(int n, int32_t *v)
+{
+    const vec_t zero = vdup(0);
+    const vec_t w = vdup(stage_twiddles[3]);
+    int i;
+
+    for (i = 0; i < n; i += 16) {
+        vec_t a = vload(v + i);
+        vec_t b = vload(v + i + 4);
+        vec_t c = vload(v + i + 8);
+        vec_t d = vload(v + i + 12);
+        vtranspose(&a, &b, &c, &d);
+        vbutterfly(&a, &b, vsub(zero, vhalf(b)));
+        vbutterfly(&c, &d, vsub(zero, vhalf(d)));
+        vbutterfly(&a, &c, vsub(zero, vhalf(c)));
+        vbutterfly(&b, &d, vmult(w, d));
+        vtranspose(&a, &b, &c, &d);
+        vstore(v + i, a);
+        vstore(v + i + 4, b);
+        vstore(v + i + 8, c);
+        vstore(v + i + 12, d);
+    }
+}
+
+static void vector_fft(int n, int32_t *v)
+{
+    int p = 4;
+
+    if (n < 16) {
+        scalar_fft(n, v);
+        return;
+    }
+    bit_reverse(n, v);
+    vector_pass4_first(n, v);
+    for (; p << 2 <= n; p <<= 2) {
+        vector_pass4(n, v, p);
+    }
+    if (p << 1 <= n) {
+        vector_pass2(n, v, p);
+    }
+}
+
+static void vector_fft_real(int n, int32_t *v)
+{
+    int scale = LOG_FFT_SIZE, m = n >> 1, i;
+
+    if (n < 16) {
+        scalar_fft_real(n, v);
+        return;
+    }
+    vector_fft(n, v);
+    for (i = 1; i <= n; i <<= 1, --scale);
+    v[0] = mult(~v[0], 0x80008000);
+    v[m] = half(v[m]);
+
+    // four from the start going up against four from the end going down
+    const vec_t inv = vdup(0xFFFF);
+    for (i = 1; i + 3 < m; i += 4) {
+        int32_t w[4] = {
+            twiddle[i << scale], twiddle[(i + 1) << scale],
+            twiddle[(i + 2) << scale], twiddle[(i + 3) << scale],
+        };
+        vec_t x = vhalf(vload(v + i));
+        vec_t z = vhalf(vreverse(vload(v + n - i - 3)));
+        vec_t y = vsub(z, vxor(x, inv));
+        x = vhalf(vadd(x, vxor(z, inv)));
+        y = vmult(y, vload(w));
+        vstore(v + i, vsub(x, y));
+        vstore(v + n - i - 3, vreverse(vxor(vadd(x, y), inv)));
+    }
+    for (; i < m; ++i) {
+        int32_t x = half(v[i]);
+        int32_t z = half(v[n - i]);
+        int32_t y = z - (x ^ 0xFFFF);
+        x = half(x + (z ^ 0xFFFF));
+        y = mult(y, twiddle[i << scale]);
+        v[i] = x - y;
+        v[n - i] = (x + y) ^ 0xFFFF;
+    }
+}
+
+#endif // __SSE2__ || __ARM_NEON__
+
+//------------------------------------------------------------------------------
+// choice of implementation
+//------------------------------------------------------------------------------
+
+static const fixed_fft_impl_t impl_radix2 = { "radix2", radix2_fft, radix2_fft_real };
+static const fixed_fft_impl_t impl_scalar = { "scalar", scalar_fft, scalar_fft_real };
+#ifdef FIXED_FFT_HAVE_VECTOR
+static const fixed_fft_impl_t impl_vector = { VECTOR_NAME, vector_fft, vector_fft_real };
+#endif
+
+static const fixed_fft_impl_t *fft_impl;
+
+int fixed_fft_impls(const fixed_fft_impl_t **impls, int max)
+{
+    int n = 0;
+
+    pthread_once(&tables_once, init_tables);
+#ifdef FIXED_FFT_HAVE_VECTOR
+    if (n < max) {
+        impls[n++] = &impl_vector;
+    }
+#endif
+    if (n < max) {
+        impls[n++] = &impl_scalar;
+    }
+    if (n < max) {
+        impls[n++] = &impl_radix2;
+    }
+    return n;
+}
+
+void fixed_fft_use_impl(const fixed_fft_impl_t *impl)
+{
+    if (impl == NULL) {
+        const fixed_fft_impl_t *impls[FIXED_FFT_MAX_IMPLS];
+        fixed_fft_impls(impls, FIXED_FFT_MAX_IMPLS);
+        impl = impls[0];
+    }
+    fft_impl = impl;
+}
+
+// Also makes sure the tables are there for whichever thread calls first.
+static inline const fixed_fft_impl_t *get_impl()
+{
+    pthread_once(&tables_once, init_tables);
+    if (fft_impl == NULL) {
+        fixed_fft_use_impl(NULL);
+    }
+    return fft_impl;
+}
+
+void fixed_fft(int n, int32_t *v)
+{
+    get_impl()->fft(n, v);
+}
+
+void fixed_fft_real(int n, int32_t *v)
+{
+    get_impl()->fft_real(n, v);
+}
+
+void fixed_fft_batch(int n, int32_t *v, size_t count)
+{
+    const fixed_fft_impl_t *impl = get_impl();
+    for (; count > 0; --count, v += n) {
+        impl->fft(n, v);
+    }
+}
+
+void fixed_fft_real_batch(int n, int32_t *v, size_t count)
+{
+    const fixed_fft_impl_t *impl = get_impl();
+    for (; count > 0; --count, v += n) {
+        impl->fft_real(n, v);
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The implementations of the FFT fixedfft.cpp can choose between. Not part
+ * of the library's interface; fixedfft_bench uses it to check and time each
+ * one.
+ */
+
+#ifndef ANDROID_AUDIO_FIXEDFFT_IMPL_H
+#define ANDROID_AUDIO_FIXEDFFT_IMPL_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+#define FIXED_FFT_MAX_IMPLS 3
+
+/* One implementation of fixed_fft() and fixed_fft_real(), which must give
+ * exactly the same output as the reference radix-2 one.
+ */
+typedef struct fixed_fft_impl {
+    const char *name;
+    void (*fft)(int n, int32_t *v);
+    void (*fft_real)(int n, int32_t *v);
+} fixed_fft_impl_t;
+
+/* Fills impls with those built in, the one used by default first and the
+ * reference one last. Returns how many there are.
+ */
+int fixed_fft_impls(const fixed_fft_impl_t **impls, int max);
+
+/* Makes fixed_fft() and the others use impl, or the default if NULL. */
+void fixed_fft_use_impl(const fixed_fft_impl_t *impl);
+
+__END_DECLS
+
+#endif  // ANDROID_AUDIO_FIXEDFFT_IMPL_H
@@ -46,6 +46,10 @@ struct echo_reference_buffer {
  *      - frame_count is updated with the actual number of frames returned
  */
 
+/* read() and write() can be called from different threads, the capture and playback ones: they
+ * share a ring of reference frames allocated by create_echo_reference(). write() never waits
+ * for read(); read() waits for write() at most half the duration of the frames it asked for.
+ */
 struct echo_reference_itfe {
     int (*read)(struct echo_reference_itfe *echo_reference, struct echo_reference_buffer *buffer);
     int (*write)(struct echo_reference_itfe *echo_reference, struct echo_reference_buffer *buffer);
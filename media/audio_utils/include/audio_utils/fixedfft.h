@@ -17,6 +17,7 @@
 #ifndef ANDROID_AUDIO_FIXEDFFT_H
 #define ANDROID_AUDIO_FIXEDFFT_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/cdefs.h>
 
@@ -25,6 +26,17 @@ __BEGIN_DECLS
 /* See description in fixedfft.cpp */
 extern void fixed_fft_real(int n, int32_t *v);
 
+/* The FFT of n complex points in place, scaled down by n, n a power of 2 up
+ * to 1024. The points come out in order; fixed_fft_real() builds on it.
+ */
+extern void fixed_fft(int n, int32_t *v);
+
+/* fixed_fft() and fixed_fft_real() on count frames of n one after the
+ * other, starting at v.
+ */
+extern void fixed_fft_batch(int n, int32_t *v, size_t count);
+extern void fixed_fft_real_batch(int n, int32_t *v, size_t count);
+
 __END_DECLS
 
 #endif  // ANDROID_AUDIO_FIXEDFFT_H
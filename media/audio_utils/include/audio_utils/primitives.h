@@ -17,6 +17,8 @@
 #ifndef ANDROID_AUDIO_PRIMITIVES_H
 #define ANDROID_AUDIO_PRIMITIVES_H
 
+#include <math.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/cdefs.h>
 
@@ -64,6 +66,100 @@ void downmix_to_mono_i16_from_stereo_i16(int16_t *dst, const int16_t *src, size_
  */
 void upmix_to_stereo_i16_from_mono_i16(int16_t *dst, const int16_t *src, size_t count);
 
+/* Downmix frames of interleaved multichannel input 16-bit samples to mono output 16-bit
+ * samples, by averaging the channels.
+ * Parameters:
+ *  dst     Destination buffer
+ *  src     Source buffer
+ *  channels Number of channels per input frame, at least 1
+ *  count   Number of frames to downmix
+ * The destination and source buffers must be completely separate (non-overlapping).
+ * The sum is multiplied by 65536 / channels, truncated, and the product shifted right by 16.
+ * This is exact for a power of two channels, and for 2 channels is the same as
+ * downmix_to_mono_i16_from_stereo_i16().
+ */
+void downmix_to_mono_i16_from_multi_i16(int16_t *dst, const int16_t *src,
+        size_t channels, size_t count);
+
+/* Convert signed 16-bit samples to float samples in the range [-1.0, 1.0).
+ * Parameters:
+ *  dst     Destination buffer
+ *  src     Source buffer
+ *  count   Number of samples to copy
+ * The destination and source buffers must either be completely separate (non-overlapping), or
+ * they must both start at the same address.  Partially overlapping buffers are not supported.
+ */
+void memcpy_to_float_from_i16(float *dst, const int16_t *src, size_t count);
+
+/* Convert float samples to signed 16-bit samples, scaling 1.0 to 32768, rounding to the
+ * nearest integer (ties to even) and clamping.  See clamp16_from_float().
+ * Parameters:
+ *  dst     Destination buffer
+ *  src     Source buffer
+ *  count   Number of samples to copy
+ * The destination and source buffers must either be completely separate (non-overlapping), or
+ * they must both start at the same address.  Partially overlapping buffers are not supported.
+ * The result for a NaN sample is undefined.
+ */
+void memcpy_to_i16_from_float(int16_t *dst, const float *src, size_t count);
+
+/* Convert signed Q0.31 samples to float samples in the range [-1.0, 1.0].
+ * Parameters:
+ *  dst     Destination buffer
+ *  src     Source buffer
+ *  count   Number of samples to copy
+ * The destination and source buffers must either be completely separate (non-overlapping), or
+ * they must both start at the same address.  Partially overlapping buffers are not supported.
+ * Samples are rounded to the nearest float, so only the top 24 bits are kept.
+ */
+void memcpy_to_float_from_i32(float *dst, const int32_t *src, size_t count);
+
+/* Convert float samples to signed Q0.31 samples, scaling 1.0 to 2^31, rounding to the
+ * nearest integer (ties to even) and clamping.  See clamp32_from_float().
+ * Parameters:
+ *  dst     Destination buffer
+ *  src     Source buffer
+ *  count   Number of samples to copy
+ * The destination and source buffers must either be completely separate (non-overlapping), or
+ * they must both start at the same address.  Partially overlapping buffers are not supported.
+ * The result for a NaN sample is undefined.
+ */
+void memcpy_to_i32_from_float(int32_t *dst, const float *src, size_t count);
+
+/* Mix signed 16-bit samples, scaled by a volume, into 32-bit sums: dst[i] += src[i] * vol.
+ * With a Q4.12 volume the sums are the Q19.12 that ditherAndClamp() takes.
+ * Parameters:
+ *  dst     Destination buffer of sums, which wrap around on overflow
+ *  src     Source buffer
+ *  count   Number of samples to mix
+ *  vol     Volume
+ * The destination and source buffers must be completely separate (non-overlapping).
+ */
+void mix_to_i32_from_i16(int32_t *dst, const int16_t *src, size_t count, int16_t vol);
+
+/* Like mix_to_i32_from_i16() for interleaved stereo, with a volume per channel.
+ * Parameters:
+ *  dst     Destination buffer of interleaved sums, which wrap around on overflow
+ *  src     Source buffer
+ *  count   Number of stereo frames to mix
+ *  vl      Volume of the left channel
+ *  vr      Volume of the right channel
+ * The destination and source buffers must be completely separate (non-overlapping).
+ */
+void mix_to_i32_from_stereo_i16(int32_t *dst, const int16_t *src, size_t count,
+        int16_t vl, int16_t vr);
+
+/* Mix float samples, scaled by a volume, into float sums: dst[i] += src[i] * vol.
+ * The product and the sum are each rounded to float.
+ * Parameters:
+ *  dst     Destination buffer of sums
+ *  src     Source buffer
+ *  count   Number of samples to mix
+ *  vol     Volume
+ * The destination and source buffers must be completely separate (non-overlapping).
+ */
+void mix_to_float_from_float(float *dst, const float *src, size_t count, float vol);
+
 /**
  * Clamp (aka hard limit or clip) a signed 32-bit sample to 16-bit range.
  */
@@ -74,6 +170,36 @@ static inline int16_t clamp16(int32_t sample)
     return sample;
 }
 
+/**
+ * Convert a float sample to signed 16-bit, scaling 1.0 to 32768, rounding to the nearest
+ * integer (ties to even, in the default rounding mode) and clamping.
+ */
+static inline int16_t clamp16_from_float(float f)
+{
+    f *= 32768.0f;
+    if (f > 32767.0f) {
+        f = 32767.0f;
+    } else if (f < -32768.0f) {
+        f = -32768.0f;
+    }
+    return (int16_t) lrintf(f);
+}
+
+/**
+ * Convert a float sample to signed Q0.31, scaling 1.0 to 2^31, rounding to the nearest
+ * integer (ties to even, in the default rounding mode) and clamping.
+ */
+static inline int32_t clamp32_from_float(float f)
+{
+    f *= 2147483648.0f;
+    if (f >= 2147483648.0f) {
+        return INT32_MAX;
+    } else if (f <= -2147483648.0f) {
+        return INT32_MIN;
+    }
+    return (int32_t) lrintf(f);
+}
+
 /**
  * Multiply-accumulate 16-bit terms with 32-bit result: return a + in*v.
  */
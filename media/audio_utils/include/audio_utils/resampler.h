@@ -17,7 +17,9 @@
 #ifndef ANDROID_RESAMPLER_H
 #define ANDROID_RESAMPLER_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <sys/cdefs.h>
 #include <sys/time.h>
 
 __BEGIN_DECLS
@@ -29,11 +31,24 @@ __BEGIN_DECLS
 #define RESAMPLER_QUALITY_VOIP 3
 #define RESAMPLER_QUALITY_DESKTOP 5
 
+/* flags for create_resampler_ex() */
+/* Use the built-in polyphase resampler instead of speex. Only ratios it has filters for
+ * are supported, see create_resampler_ex(). */
+#define RESAMPLER_FLAG_POLYPHASE 0x1
+/* Samples are float: only the _float calls can be made, and the buffer provider returns
+ * float samples. Implies RESAMPLER_FLAG_POLYPHASE. */
+#define RESAMPLER_FLAG_FLOAT     0x2
+/* Resample straight from the buffer provider's buffers instead of copying them first.
+ * The provider must accept release_buffer() for fewer frames than get_next_buffer() gave,
+ * and give the rest again on the next call. */
+#define RESAMPLER_FLAG_IN_PLACE  0x4
+
 struct resampler_buffer {
     union {
         void*       raw;
         short*      i16;
         int8_t*     i8;
+        float*      f;
     };
     size_t frame_count;
 };
@@ -85,6 +100,20 @@ struct resampler_itfe {
      * return the latency introduced by the resampler in ns.
      */
     int32_t (*delay_ns)(struct resampler_itfe *resampler);
+    /**
+     * as resample_from_provider(), for a resampler created with RESAMPLER_FLAG_FLOAT.
+     */
+    int (*resample_from_provider_float)(struct resampler_itfe *resampler,
+                    float *out,
+                    size_t *outFrameCount);
+    /**
+     * as resample_from_input(), for a resampler created with RESAMPLER_FLAG_FLOAT.
+     */
+    int (*resample_from_input_float)(struct resampler_itfe *resampler,
+                    float *in,
+                    size_t *inFrameCount,
+                    float *out,
+                    size_t *outFrameCount);
 };
 
 /**
@@ -99,6 +128,21 @@ int create_resampler(uint32_t inSampleRate,
           struct resampler_buffer_provider *provider,
           struct resampler_itfe **);
 
+/**
+ * create a resampler as create_resampler() does, with RESAMPLER_FLAG_xxx flags.
+ * The built-in polyphase resampler has filters for ratios whose reduced form
+ * outSampleRate / inSampleRate = L / M has L <= 320 and M <= 8 L, such as
+ * 44.1 kHz <-> 48 kHz or 8 kHz and 16 kHz <-> 48 kHz. Asking for it with another
+ * ratio returns -EINVAL.
+ */
+int create_resampler_ex(uint32_t inSampleRate,
+          uint32_t outSampleRate,
+          uint32_t channelCount,
+          uint32_t quality,
+          uint32_t flags,
+          struct resampler_buffer_provider *provider,
+          struct resampler_itfe **);
+
 /**
  * release resampler resources.
  */
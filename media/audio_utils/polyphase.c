@@ -0,0 +1,765 @@
+/*
+** Copyright 2013, The Android Open-Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "polyphase"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cutils/log.h>
+#include <audio_utils/primitives.h>
+
+#include "polyphase.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+// Output frame k is input frame k * M / L, which falls between input frames n
+// and n + 1 at phase p / L. It is a dot product of the taps input frames up
+// to n with the coefficients of phase p, which are the prototype filter at
+// p, p + L, p + 2L... stored in reverse so that both run forward in memory.
+
+#define POLYPHASE_MAX_L         320
+#define POLYPHASE_MAX_DECIMATION 8
+
+// The filter banks, shared by all the resamplers with the same ratio and quality.
+struct polyphase_bank {
+    struct polyphase_bank *next;
+    int refs;
+    uint32_t L;
+    uint32_t M;
+    uint32_t quality;           // index in qualities[]
+    uint32_t taps;              // per phase, a multiple of 8
+    int shift;                  // the int16 coefficients are Q(shift)
+    int16_t *coefs_i16;         // L phases of taps, or NULL if not fixed
+    float *coefs_float;
+};
+
+static pthread_mutex_t banks_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct polyphase_bank *banks;
+
+struct polyphase {
+    struct polyphase_bank *bank;
+    uint32_t channels;
+    size_t frame_size;
+    uint32_t in_rate;
+    uint32_t step_int;          // M / L
+    uint32_t step_frac;         // M % L
+    size_t n;                   // newest frame of the next output, from the next input
+    uint32_t phase;             // and its phase
+    // taps - 1 frames of history, then room for as many new frames, so the
+    // outputs that need both have them side by side
+    char *bridge;
+};
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while (b != 0) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+int polyphase_supported(uint32_t in_rate, uint32_t out_rate)
+{
+    if (in_rate == 0 || out_rate == 0) {
+        return 0;
+    }
+    uint32_t g = gcd(in_rate, out_rate);
+    uint32_t L = out_rate / g;
+    uint32_t M = in_rate / g;
+    return L <= POLYPHASE_MAX_L && M <= POLYPHASE_MAX_DECIMATION * L;
+}
+
+//------------------------------------------------------------------------------
+// filter design
+//------------------------------------------------------------------------------
+
+static double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    int k;
+    for (k = 1; k < 64; k++) {
+        double t = x / (2 * k);
+        term *= t * t;
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+// Taps per phase before decimation, Kaiser beta and passband, as a fraction
+// of the lower Nyquist frequency, for RESAMPLER_QUALITY_VOIP and below, up to
+// RESAMPLER_QUALITY_DESKTOP, and above. Rounding the coefficients to 16 bits
+// brings images up to about -80 dB, so the longest filter runs its int16
+// samples through the float coefficients instead.
+static const struct {
+    uint32_t taps;
+    double beta;
+    double cutoff;
+    int fixed;                  // int16 samples use int16 coefficients
+} qualities[] = {
+    { 16, 6.0,  0.88, 1 },      // about 60 dB of stop band
+    { 32, 8.5,  0.91, 1 },      // about 85 dB
+    { 48, 10.0, 0.94, 0 },      // about 100 dB
+};
+
+static uint32_t quality_index(uint32_t quality)
+{
+    return quality <= 3 ? 0 : quality <= 5 ? 1 : 2;
+}
+
+static struct polyphase_bank *bank_create(uint32_t L, uint32_t M, uint32_t quality)
+{
+    struct polyphase_bank *b;
+    uint32_t taps = qualities[quality].taps;
+    const double beta = qualities[quality].beta;
+    const double cutoff = qualities[quality].cutoff;
+    uint32_t p, j;
+    double *proto;
+    double max_sum = 0;
+    size_t i, N;
+
+    // decimating needs a filter as many times longer
+    if (M > L) {
+        taps = (taps * M + L - 1) / L;
+    }
+    taps = (taps + 7) & ~7;
+    N = (size_t) L * taps;
+
+    b = calloc(1, sizeof(*b));
+    proto = malloc(N * sizeof(double));
+    if (b != NULL) {
+        if (qualities[quality].fixed) {
+            b->coefs_i16 = malloc(N * sizeof(int16_t));
+        }
+        b->coefs_float = malloc(N * sizeof(float));
+    }
+    if (b == NULL || proto == NULL || b->coefs_float == NULL ||
+            (qualities[quality].fixed && b->coefs_i16 == NULL)) {
+        if (b != NULL) {
+            free(b->coefs_i16);
+            free(b->coefs_float);
+        }
+        free(b);
+        free(proto);
+        return NULL;
+    }
+    b->L = L;
+    b->M = M;
+    b->quality = quality;
+    b->taps = taps;
+
+    // windowed sinc at L times the input rate, with a gain of L to make up
+    // for the zeros between the input samples
+    const double fc = cutoff * 0.5 / (L > M ? L : M);
+    const double i0_beta = bessel_i0(beta);
+    for (i = 0; i < N; i++) {
+        double t = i - (N - 1) / 2.0;
+        double x = 2.0 * i / (N - 1) - 1.0;
+        double s = 2.0 * fc * t;
+        double sinc = (s == 0) ? 1.0 : sin(M_PI * s) / (M_PI * s);
+        double w = bessel_i0(beta * sqrt(1.0 - x * x)) / i0_beta;
+        proto[i] = 2.0 * fc * L * sinc * w;
+    }
+
+    // the int16 coefficients get as many bits as keep every sum of products
+    // of full scale samples within 32 bits
+    for (p = 0; p < L; p++) {
+        double sum = 0;
+        for (j = 0; j < taps; j++) {
+            sum += fabs(proto[p + j * L]);
+        }
+        if (sum > max_sum) {
+            max_sum = sum;
+        }
+    }
+    b->shift = 15;
+    while (b->shift > 1 && max_sum * (1 << b->shift) >= 65535.0) {
+        b->shift--;
+    }
+
+    for (p = 0; p < L; p++) {
+        for (j = 0; j < taps; j++) {
+            double h = proto[p + j * L];
+            b->coefs_float[p * taps + taps - 1 - j] = (float) h;
+            if (b->coefs_i16 != NULL) {
+                long q = lrint(h * (1 << b->shift));
+                if (q > 32767) q = 32767;
+                if (q < -32767) q = -32767;
+                b->coefs_i16[p * taps + taps - 1 - j] = (int16_t) q;
+            }
+        }
+    }
+    free(proto);
+
+    ALOGV("bank_create() L %u M %u quality %u: %u taps, Q%d", L, M, quality, taps, b->shift);
+    return b;
+}
+
+static struct polyphase_bank *bank_get(uint32_t L, uint32_t M, uint32_t quality)
+{
+    struct polyphase_bank *b;
+
+    pthread_mutex_lock(&banks_lock);
+    for (b = banks; b != NULL; b = b->next) {
+        if (b->L == L && b->M == M && b->quality == quality) {
+            break;
+        }
+    }
+    if (b == NULL) {
+        b = bank_create(L, M, quality);
+        if (b != NULL) {
+            b->next = banks;
+            banks = b;
+        }
+    }
+    if (b != NULL) {
+        b->refs++;
+    }
+    pthread_mutex_unlock(&banks_lock);
+    return b;
+}
+
+static void bank_put(struct polyphase_bank *bank)
+{
+    struct polyphase_bank **b;
+
+    pthread_mutex_lock(&banks_lock);
+    if (--bank->refs == 0) {
+        for (b = &banks; *b != NULL; b = &(*b)->next) {
+            if (*b == bank) {
+                *b = bank->next;
+                break;
+            }
+        }
+        free(bank->coefs_i16);
+        free(bank->coefs_float);
+        free(bank);
+    }
+    pthread_mutex_unlock(&banks_lock);
+}
+
+//------------------------------------------------------------------------------
+// dot products of taps coefficients with taps frames
+//------------------------------------------------------------------------------
+
+// The sums can't overflow: the coefficients of a phase add up to less than
+// 65536 in magnitude, see bank_create().
+
+static inline int32_t dot_i16_mono(const int16_t *h, const int16_t *x, uint32_t taps)
+{
+    uint32_t j;
+#if defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for (j = 0; j < taps; j += 8) {
+        __m128i hv = _mm_loadu_si128((const __m128i *) (h + j));
+        __m128i xv = _mm_loadu_si128((const __m128i *) (x + j));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(hv, xv));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc);
+#elif defined(__ARM_NEON__)
+    int32x4_t acc = vdupq_n_s32(0);
+    for (j = 0; j < taps; j += 8) {
+        int16x8_t hv = vld1q_s16(h + j);
+        int16x8_t xv = vld1q_s16(x + j);
+        acc = vmlal_s16(acc, vget_low_s16(hv), vget_low_s16(xv));
+        acc = vmlal_s16(acc, vget_high_s16(hv), vget_high_s16(xv));
+    }
+    int32x2_t sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    return vget_lane_s32(vpadd_s32(sum, sum), 0);
+#else
+    int32_t acc = 0;
+    for (j = 0; j < taps; j++) {
+        acc += h[j] * x[j];
+    }
+    return acc;
+#endif
+}
+
+static inline void dot_i16_stereo(const int16_t *h, const int16_t *x, uint32_t taps,
+        int32_t *l, int32_t *r)
+{
+    uint32_t j;
+#if defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for (j = 0; j < taps; j += 8) {
+        __m128i hv = _mm_loadu_si128((const __m128i *) (h + j));
+        // h0 h1 h0 h1 h2 h3 h2 h3 and h4 h5 h4 h5 h6 h7 h6 h7
+        __m128i hlo = _mm_unpacklo_epi32(hv, hv);
+        __m128i hhi = _mm_unpackhi_epi32(hv, hv);
+        // L0 R0 L1 R1 L2 R2 L3 R3 to L0 L1 R0 R1 L2 L3 R2 R3
+        __m128i x0 = _mm_loadu_si128((const __m128i *) (x + 2 * j));
+        __m128i x1 = _mm_loadu_si128((const __m128i *) (x + 2 * j + 8));
+        x0 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x0, _MM_SHUFFLE(3, 1, 2, 0)),
+                _MM_SHUFFLE(3, 1, 2, 0));
+        x1 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x1, _MM_SHUFFLE(3, 1, 2, 0)),
+                _MM_SHUFFLE(3, 1, 2, 0));
+        // lanes L R L R
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(x0, hlo));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(x1, hhi));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    *l = _mm_cvtsi128_si32(acc);
+    *r = _mm_cvtsi128_si32(_mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 1, 1, 1)));
+#elif defined(__ARM_NEON__)
+    int32x4_t accl = vdupq_n_s32(0);
+    int32x4_t accr = vdupq_n_s32(0);
+    for (j = 0; j < taps; j += 8) {
+        int16x8_t hv = vld1q_s16(h + j);
+        int16x8x2_t xv = vld2q_s16(x + 2 * j);
+        accl = vmlal_s16(accl, vget_low_s16(hv), vget_low_s16(xv.val[0]));
+        accl = vmlal_s16(accl, vget_high_s16(hv), vget_high_s16(xv.val[0]));
+        accr = vmlal_s16(accr, vget_low_s16(hv), vget_low_s16(xv.val[1]));
+        accr = vmlal_s16(accr, vget_high_s16(hv), vget_high_s16(xv.val[1]));
+    }
+    int32x2_t sl = vadd_s32(vget_low_s32(accl), vget_high_s32(accl));
+    int32x2_t sr = vadd_s32(vget_low_s32(accr), vget_high_s32(accr));
+    int32x2_t s = vpadd_s32(sl, sr);
+    *l = vget_lane_s32(s, 0);
+    *r = vget_lane_s32(s, 1);
+#else
+    int32_t al = 0;
+    int32_t ar = 0;
+    for (j = 0; j < taps; j++) {
+        al += h[j] * x[2 * j];
+        ar += h[j] * x[2 * j + 1];
+    }
+    *l = al;
+    *r = ar;
+#endif
+}
+
+static inline float dot_float_mono(const float *h, const float *x, uint32_t taps)
+{
+    uint32_t j;
+#if defined(__SSE2__)
+    __m128 a0 = _mm_setzero_ps();
+    __m128 a1 = _mm_setzero_ps();
+    for (j = 0; j < taps; j += 8) {
+        a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(h + j), _mm_loadu_ps(x + j)));
+        a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(h + j + 4), _mm_loadu_ps(x + j + 4)));
+    }
+    a0 = _mm_add_ps(a0, a1);
+    a0 = _mm_add_ps(a0, _mm_movehl_ps(a0, a0));
+    a0 = _mm_add_ss(a0, _mm_shuffle_ps(a0, a0, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(a0);
+#elif defined(__ARM_NEON__)
+    float32x4_t a0 = vdupq_n_f32(0);
+    float32x4_t a1 = vdupq_n_f32(0);
+    for (j = 0; j < taps; j += 8) {
+        a0 = vmlaq_f32(a0, vld1q_f32(h + j), vld1q_f32(x + j));
+        a1 = vmlaq_f32(a1, vld1q_f32(h + j + 4), vld1q_f32(x + j + 4));
+    }
+    a0 = vaddq_f32(a0, a1);
+    float32x2_t s = vadd_f32(vget_low_f32(a0), vget_high_f32(a0));
+    return vget_lane_f32(vpadd_f32(s, s), 0);
+#else
+    float acc = 0;
+    for (j = 0; j < taps; j++) {
+        acc += h[j] * x[j];
+    }
+    return acc;
+#endif
+}
+
+static inline void dot_float_stereo(const float *h, const float *x, uint32_t taps,
+        float *l, float *r)
+{
+    uint32_t j;
+#if defined(__SSE2__)
+    __m128 acc = _mm_setzero_ps();
+    for (j = 0; j < taps; j += 4) {
+        __m128 hv = _mm_loadu_ps(h + j);
+        // h0 h0 h1 h1 against L0 R0 L1 R1, then h2 h2 h3 h3
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_unpacklo_ps(hv, hv), _mm_loadu_ps(x + 2 * j)));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_unpackhi_ps(hv, hv), _mm_loadu_ps(x + 2 * j + 4)));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    *l = _mm_cvtss_f32(acc);
+    *r = _mm_cvtss_f32(_mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 1, 1, 1)));
+#elif defined(__ARM_NEON__)
+    float32x4_t accl = vdupq_n_f32(0);
+    float32x4_t accr = vdupq_n_f32(0);
+    for (j = 0; j < taps; j += 4) {
+        float32x4_t hv = vld1q_f32(h + j);
+        float32x4x2_t xv = vld2q_f32(x + 2 * j);
+        accl = vmlaq_f32(accl, hv, xv.val[0]);
+        accr = vmlaq_f32(accr, hv, xv.val[1]);
+    }
+    float32x2_t sl = vadd_f32(vget_low_f32(accl), vget_high_f32(accl));
+    float32x2_t sr = vadd_f32(vget_low_f32(accr), vget_high_f32(accr));
+    float32x2_t s = vpadd_f32(sl, sr);
+    *l = vget_lane_f32(s, 0);
+    *r = vget_lane_f32(s, 1);
+#else
+    float al = 0;
+    float ar = 0;
+    for (j = 0; j < taps; j++) {
+        al += h[j] * x[2 * j];
+        ar += h[j] * x[2 * j + 1];
+    }
+    *l = al;
+    *r = ar;
+#endif
+}
+
+// int16 samples against float coefficients, for the filters that aren't fixed
+
+static inline float dot_i16f_mono(const float *h, const int16_t *x, uint32_t taps)
+{
+    uint32_t j;
+#if defined(__SSE2__)
+    __m128 a0 = _mm_setzero_ps();
+    __m128 a1 = _mm_setzero_ps();
+    for (j = 0; j < taps; j += 8) {
+        __m128i xv = _mm_loadu_si128((const __m128i *) (x + j));
+        __m128 x0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(xv, xv), 16));
+        __m128 x1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(xv, xv), 16));
+        a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(h + j), x0));
+        a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(h + j + 4), x1));
+    }
+    a0 = _mm_add_ps(a0, a1);
+    a0 = _mm_add_ps(a0, _mm_movehl_ps(a0, a0));
+    a0 = _mm_add_ss(a0, _mm_shuffle_ps(a0, a0, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(a0);
+#elif defined(__ARM_NEON__)
+    float32x4_t a0 = vdupq_n_f32(0);
+    float32x4_t a1 = vdupq_n_f32(0);
+    for (j = 0; j < taps; j += 8) {
+        int16x8_t xv = vld1q_s16(x + j);
+        float32x4_t x0 = vcvtq_f32_s32(vmovl_s16(vget_low_s16(xv)));
+        float32x4_t x1 = vcvtq_f32_s32(vmovl_s16(vget_high_s16(xv)));
+        a0 = vmlaq_f32(a0, vld1q_f32(h + j), x0);
+        a1 = vmlaq_f32(a1, vld1q_f32(h + j + 4), x1);
+    }
+    a0 = vaddq_f32(a0, a1);
+    float32x2_t s = vadd_f32(vget_low_f32(a0), vget_high_f32(a0));
+    return vget_lane_f32(vpadd_f32(s, s), 0);
+#else
+    float acc = 0;
+    for (j = 0; j < taps; j++) {
+        acc += h[j] * x[j];
+    }
+    return acc;
+#endif
+}
+
+static inline void dot_i16f_stereo(const float *h, const int16_t *x, uint32_t taps,
+        float *l, float *r)
+{
+    uint32_t j;
+#if defined(__SSE2__)
+    __m128 acc = _mm_setzero_ps();
+    for (j = 0; j < taps; j += 4) {
+        __m128 hv = _mm_loadu_ps(h + j);
+        __m128i xv = _mm_loadu_si128((const __m128i *) (x + 2 * j));
+        __m128 x0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(xv, xv), 16));
+        __m128 x1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(xv, xv), 16));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_unpacklo_ps(hv, hv), x0));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_unpackhi_ps(hv, hv), x1));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    *l = _mm_cvtss_f32(acc);
+    *r = _mm_cvtss_f32(_mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 1, 1, 1)));
+#elif defined(__ARM_NEON__)
+    float32x4_t accl = vdupq_n_f32(0);
+    float32x4_t accr = vdupq_n_f32(0);
+    for (j = 0; j < taps; j += 4) {
+        float32x4_t hv = vld1q_f32(h + j);
+        int16x4x2_t xv = vld2_s16(x + 2 * j);
+        accl = vmlaq_f32(accl, hv, vcvtq_f32_s32(vmovl_s16(xv.val[0])));
+        accr = vmlaq_f32(accr, hv, vcvtq_f32_s32(vmovl_s16(xv.val[1])));
+    }
+    float32x2_t sl = vadd_f32(vget_low_f32(accl), vget_high_f32(accl));
+    float32x2_t sr = vadd_f32(vget_low_f32(accr), vget_high_f32(accr));
+    float32x2_t s = vpadd_f32(sl, sr);
+    *l = vget_lane_f32(s, 0);
+    *r = vget_lane_f32(s, 1);
+#else
+    float al = 0;
+    float ar = 0;
+    for (j = 0; j < taps; j++) {
+        al += h[j] * x[2 * j];
+        ar += h[j] * x[2 * j + 1];
+    }
+    *l = al;
+    *r = ar;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// resampling
+//------------------------------------------------------------------------------
+
+// Advances to the next output.
+#define POLYPHASE_STEP(pp, n, phase) do {           \
+        (phase) += (pp)->step_frac;                 \
+        (n) += (pp)->step_int;                      \
+        if ((phase) >= (pp)->bank->L) {             \
+            (phase) -= (pp)->bank->L;               \
+            (n)++;                                  \
+        }                                           \
+    } while (0)
+
+// Writes the outputs whose newest frame is before avail, at most max_out of
+// them. The taps - 1 frames before x must be there too.
+static size_t run_i16(struct polyphase *pp, const void *in, size_t avail, void *dst,
+        size_t max_out)
+{
+    const struct polyphase_bank *b = pp->bank;
+    const int16_t *x = (const int16_t *) in;
+    int16_t *out = (int16_t *) dst;
+    const uint32_t taps = b->taps;
+    const uint32_t channels = pp->channels;
+    const int shift = b->shift;
+    const int32_t round = 1 << (shift - 1);
+    size_t n = pp->n;
+    uint32_t phase = pp->phase;
+    size_t k = 0;
+
+    while (n < avail && k < max_out) {
+        const int16_t *w = x + ((ptrdiff_t) n - (ptrdiff_t) (taps - 1)) * (ptrdiff_t) channels;
+        const int16_t *h = b->coefs_i16 + phase * taps;
+        if (channels == 1) {
+            out[k] = clamp16((dot_i16_mono(h, w, taps) + round) >> shift);
+        } else if (channels == 2) {
+            int32_t l, r;
+            dot_i16_stereo(h, w, taps, &l, &r);
+            out[2 * k] = clamp16((l + round) >> shift);
+            out[2 * k + 1] = clamp16((r + round) >> shift);
+        } else {
+            uint32_t c, j;
+            for (c = 0; c < channels; c++) {
+                int32_t acc = 0;
+                for (j = 0; j < taps; j++) {
+                    acc += h[j] * w[j * channels + c];
+                }
+                out[k * channels + c] = clamp16((acc + round) >> shift);
+            }
+        }
+        k++;
+        POLYPHASE_STEP(pp, n, phase);
+    }
+    pp->n = n;
+    pp->phase = phase;
+    return k;
+}
+
+static size_t run_i16f(struct polyphase *pp, const void *in, size_t avail, void *dst,
+        size_t max_out)
+{
+    const struct polyphase_bank *b = pp->bank;
+    const int16_t *x = (const int16_t *) in;
+    int16_t *out = (int16_t *) dst;
+    const uint32_t taps = b->taps;
+    const uint32_t channels = pp->channels;
+    const float scale = 1.0f / 32768;
+    size_t n = pp->n;
+    uint32_t phase = pp->phase;
+    size_t k = 0;
+
+    while (n < avail && k < max_out) {
+        const int16_t *w = x + ((ptrdiff_t) n - (ptrdiff_t) (taps - 1)) * (ptrdiff_t) channels;
+        const float *h = b->coefs_float + phase * taps;
+        if (channels == 1) {
+            out[k] = clamp16_from_float(dot_i16f_mono(h, w, taps) * scale);
+        } else if (channels == 2) {
+            float l, r;
+            dot_i16f_stereo(h, w, taps, &l, &r);
+            out[2 * k] = clamp16_from_float(l * scale);
+            out[2 * k + 1] = clamp16_from_float(r * scale);
+        } else {
+            uint32_t c, j;
+            for (c = 0; c < channels; c++) {
+                float acc = 0;
+                for (j = 0; j < taps; j++) {
+                    acc += h[j] * w[j * channels + c];
+                }
+                out[k * channels + c] = clamp16_from_float(acc * scale);
+            }
+        }
+        k++;
+        POLYPHASE_STEP(pp, n, phase);
+    }
+    pp->n = n;
+    pp->phase = phase;
+    return k;
+}
+
+static size_t run_float(struct polyphase *pp, const void *in, size_t avail, void *dst,
+        size_t max_out)
+{
+    const struct polyphase_bank *b = pp->bank;
+    const float *x = (const float *) in;
+    float *out = (float *) dst;
+    const uint32_t taps = b->taps;
+    const uint32_t channels = pp->channels;
+    size_t n = pp->n;
+    uint32_t phase = pp->phase;
+    size_t k = 0;
+
+    while (n < avail && k < max_out) {
+        const float *w = x + ((ptrdiff_t) n - (ptrdiff_t) (taps - 1)) * (ptrdiff_t) channels;
+        const float *h = b->coefs_float + phase * taps;
+        if (channels == 1) {
+            out[k] = dot_float_mono(h, w, taps);
+        } else if (channels == 2) {
+            dot_float_stereo(h, w, taps, &out[2 * k], &out[2 * k + 1]);
+        } else {
+            uint32_t c, j;
+            for (c = 0; c < channels; c++) {
+                float acc = 0;
+                for (j = 0; j < taps; j++) {
+                    acc += h[j] * w[j * channels + c];
+                }
+                out[k * channels + c] = acc;
+            }
+        }
+        k++;
+        POLYPHASE_STEP(pp, n, phase);
+    }
+    pp->n = n;
+    pp->phase = phase;
+    return k;
+}
+
+typedef size_t (*run_t)(struct polyphase *pp, const void *in, size_t avail, void *out,
+        size_t max_out);
+
+// Runs the filter straight from in, but for the first few outputs, which
+// also need the end of the previous input: those run from a copy of both.
+static void process(struct polyphase *pp, run_t run, const void *in, size_t *in_frames,
+        void *out, size_t *out_frames)
+{
+    const size_t fs = pp->frame_size;
+    const size_t hist = pp->bank->taps - 1;
+    const char *src = (const char *) in;
+    char *dst = (char *) out;
+    size_t avail = *in_frames;
+    size_t max_out = *out_frames;
+    size_t done = 0;
+    size_t used;
+
+    if (pp->n < hist && avail > 0) {
+        size_t m = avail < hist ? avail : hist;
+        memcpy(pp->bridge + hist * fs, src, m * fs);
+        done = run(pp, pp->bridge + hist * fs, m, dst, max_out);
+    }
+    if (pp->n >= hist) {
+        done += run(pp, src, avail, dst + done * fs, max_out - done);
+    }
+
+    // keep the hist frames before the first one still needed
+    used = pp->n < avail ? pp->n : avail;
+    if (used >= hist) {
+        memcpy(pp->bridge, src + (used - hist) * fs, hist * fs);
+    } else {
+        memmove(pp->bridge, pp->bridge + used * fs, (hist - used) * fs);
+        memcpy(pp->bridge + (hist - used) * fs, src, used * fs);
+    }
+    pp->n -= used;
+
+    *in_frames = used;
+    *out_frames = done;
+}
+
+void polyphase_process_i16(struct polyphase *pp, const int16_t *in, size_t *in_frames,
+        int16_t *out, size_t *out_frames)
+{
+    process(pp, pp->bank->coefs_i16 != NULL ? run_i16 : run_i16f, in, in_frames,
+            out, out_frames);
+}
+
+void polyphase_process_float(struct polyphase *pp, const float *in, size_t *in_frames,
+        float *out, size_t *out_frames)
+{
+    process(pp, run_float, in, in_frames, out, out_frames);
+}
+
+void polyphase_reset(struct polyphase *pp)
+{
+    pp->n = 0;
+    pp->phase = 0;
+    memset(pp->bridge, 0, (pp->bank->taps - 1) * pp->frame_size);
+}
+
+int32_t polyphase_delay_ns(const struct polyphase *pp)
+{
+    // the middle of the prototype filter, in input frames
+    const struct polyphase_bank *b = pp->bank;
+    double frames = ((double) b->L * b->taps - 1) / (2.0 * b->L);
+    return (int32_t) (frames * 1000000000.0 / pp->in_rate);
+}
+
+struct polyphase *polyphase_create(uint32_t in_rate, uint32_t out_rate, uint32_t channels,
+        uint32_t quality, int is_float)
+{
+    struct polyphase *pp;
+    uint32_t g, L, M;
+
+    if (channels == 0 || !polyphase_supported(in_rate, out_rate)) {
+        return NULL;
+    }
+    g = gcd(in_rate, out_rate);
+    L = out_rate / g;
+    M = in_rate / g;
+
+    pp = calloc(1, sizeof(*pp));
+    if (pp == NULL) {
+        return NULL;
+    }
+    pp->bank = bank_get(L, M, quality_index(quality));
+    if (pp->bank == NULL) {
+        free(pp);
+        return NULL;
+    }
+    pp->channels = channels;
+    pp->frame_size = channels * (is_float ? sizeof(float) : sizeof(int16_t));
+    pp->in_rate = in_rate;
+    pp->step_int = M / L;
+    pp->step_frac = M % L;
+    pp->bridge = malloc(2 * (pp->bank->taps - 1) * pp->frame_size);
+    if (pp->bridge == NULL) {
+        bank_put(pp->bank);
+        free(pp);
+        return NULL;
+    }
+    polyphase_reset(pp);
+    return pp;
+}
+
+void polyphase_destroy(struct polyphase *pp)
+{
+    if (pp == NULL) {
+        return;
+    }
+    bank_put(pp->bank);
+    free(pp->bridge);
+    free(pp);
+}
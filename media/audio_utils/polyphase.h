@@ -0,0 +1,60 @@
+/*
+** Copyright 2013, The Android Open-Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/* The built-in polyphase resampler behind RESAMPLER_FLAG_POLYPHASE, for the ratios
+ * it has filters for. Not part of the library's interface.
+ */
+
+#ifndef ANDROID_AUDIO_POLYPHASE_H
+#define ANDROID_AUDIO_POLYPHASE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+struct polyphase;
+
+/* Whether there is a filter for in_rate to out_rate: the reduced ratio
+ * out_rate / in_rate = L / M must have L at most 320 and M at most 8 L.
+ */
+int polyphase_supported(uint32_t in_rate, uint32_t out_rate);
+
+/* Returns NULL if the ratio isn't supported or memory runs out. */
+struct polyphase *polyphase_create(uint32_t in_rate, uint32_t out_rate, uint32_t channels,
+        uint32_t quality, int is_float);
+void polyphase_destroy(struct polyphase *pp);
+
+void polyphase_reset(struct polyphase *pp);
+
+/* Latency of the filter, in ns. */
+int32_t polyphase_delay_ns(const struct polyphase *pp);
+
+/* Resamples interleaved frames from in into at most *out_frames frames of out,
+ * as speex_resampler_process_interleaved_int() does: *in_frames is updated
+ * with the number of frames consumed, and *out_frames with the number
+ * written. The frames the filter still needs are kept, so the frames not
+ * consumed are the only ones to pass again.
+ */
+void polyphase_process_i16(struct polyphase *pp, const int16_t *in, size_t *in_frames,
+        int16_t *out, size_t *out_frames);
+void polyphase_process_float(struct polyphase *pp, const float *in, size_t *in_frames,
+        float *out, size_t *out_frames);
+
+__END_DECLS
+
+#endif // ANDROID_AUDIO_POLYPHASE_H
@@ -16,7 +16,9 @@
 
 #include <audio_utils/primitives.h>
 
-void ditherAndClamp(int32_t* out, int32_t const *sums, size_t c)
+#include "primitives_impl.h"
+
+static void dither_and_clamp_portable(int32_t* out, int32_t const *sums, size_t c)
 {
     size_t i;
     for (i=0 ; i<c ; i++) {
@@ -30,7 +32,7 @@ void ditherAndClamp(int32_t* out, int32_t const *sums, size_t c)
     }
 }
 
-void memcpy_to_i16_from_u8(int16_t *dst, const uint8_t *src, size_t count)
+static void memcpy_to_i16_from_u8_portable(int16_t *dst, const uint8_t *src, size_t count)
 {
     dst += count;
     src += count;
@@ -39,7 +41,8 @@ void memcpy_to_i16_from_u8(int16_t *dst, const uint8_t *src, size_t count)
     }
 }
 
-void downmix_to_mono_i16_from_stereo_i16(int16_t *dst, const int16_t *src, size_t count)
+static void downmix_to_mono_i16_from_stereo_i16_portable(int16_t *dst, const int16_t *src,
+        size_t count)
 {
     while (count--) {
         *dst++ = (int16_t)(((int32_t)src[0] + (int32_t)src[1]) >> 1);
@@ -47,7 +50,8 @@ void downmix_to_mono_i16_from_stereo_i16(int16_t *dst, const int16_t *src, size_
     }
 }
 
-void upmix_to_stereo_i16_from_mono_i16(int16_t *dst, const int16_t *src, size_t count)
+static void upmix_to_stereo_i16_from_mono_i16_portable(int16_t *dst, const int16_t *src,
+        size_t count)
 {
     while (count--) {
         int32_t temp = *src++;
@@ -56,3 +60,190 @@ void upmix_to_stereo_i16_from_mono_i16(int16_t *dst, const int16_t *src, size_t
         dst += 2;
     }
 }
+
+static int downmix_to_mono_i16_from_multi_i16_portable(int16_t *dst, const int16_t *src,
+        size_t channels, size_t count)
+{
+    // |sum| <= 32768 * channels, so the product fits in 32 bits
+    const int32_t recip = 65536 / channels;
+    while (count--) {
+        int32_t sum = 0;
+        size_t i;
+        for (i = 0; i < channels; i++) {
+            sum += *src++;
+        }
+        *dst++ = (int16_t)((sum * recip) >> 16);
+    }
+    return 1;
+}
+
+static void memcpy_to_float_from_i16_portable(float *dst, const int16_t *src, size_t count)
+{
+    dst += count;
+    src += count;
+    while (count--) {
+        *--dst = *--src * (1.0f / 32768.0f);
+    }
+}
+
+static void memcpy_to_i16_from_float_portable(int16_t *dst, const float *src, size_t count)
+{
+    while (count--) {
+        *dst++ = clamp16_from_float(*src++);
+    }
+}
+
+static void memcpy_to_float_from_i32_portable(float *dst, const int32_t *src, size_t count)
+{
+    while (count--) {
+        *dst++ = *src++ * (1.0f / 2147483648.0f);
+    }
+}
+
+static void memcpy_to_i32_from_float_portable(int32_t *dst, const float *src, size_t count)
+{
+    while (count--) {
+        *dst++ = clamp32_from_float(*src++);
+    }
+}
+
+static void mix_to_i32_from_i16_portable(int32_t *dst, const int16_t *src, size_t count,
+        int16_t vl, int16_t vr)
+{
+    size_t i;
+    for (i = 0; i < count; i++) {
+        const int32_t vol = (i & 1) ? vr : vl;
+        // the sums wrap, as the vector code's do
+        dst[i] = (int32_t)((uint32_t)dst[i] + (uint32_t)(src[i] * vol));
+    }
+}
+
+static void mix_to_float_from_float_portable(float *dst, const float *src, size_t count,
+        float vol)
+{
+    while (count--) {
+        *dst++ += *src++ * vol;
+    }
+}
+
+static const audio_primitives_impl_t primitives_portable = {
+    "portable",
+    dither_and_clamp_portable,
+    memcpy_to_i16_from_u8_portable,
+    downmix_to_mono_i16_from_stereo_i16_portable,
+    upmix_to_stereo_i16_from_mono_i16_portable,
+    downmix_to_mono_i16_from_multi_i16_portable,
+    memcpy_to_float_from_i16_portable,
+    memcpy_to_i16_from_float_portable,
+    memcpy_to_float_from_i32_portable,
+    memcpy_to_i32_from_float_portable,
+    mix_to_i32_from_i16_portable,
+    mix_to_float_from_float_portable,
+};
+
+// Chosen on first use. Threads racing to choose all store the same pointer.
+static const audio_primitives_impl_t *primitives_impl;
+
+int audio_primitives_impls(const audio_primitives_impl_t **impls, int max)
+{
+    int n = 0;
+#ifdef PRIMITIVES_HAVE_X86
+    n += audio_primitives_x86_impls(impls + n, max - n);
+#endif
+#ifdef PRIMITIVES_HAVE_NEON
+    n += audio_primitives_neon_impls(impls + n, max - n);
+#endif
+    if (n < max) {
+        impls[n++] = &primitives_portable;
+    }
+    return n;
+}
+
+void audio_primitives_use_impl(const audio_primitives_impl_t *impl)
+{
+    if (impl == NULL) {
+        const audio_primitives_impl_t *impls[PRIMITIVES_MAX_IMPLS];
+        audio_primitives_impls(impls, PRIMITIVES_MAX_IMPLS);
+        impl = impls[0];
+    }
+    primitives_impl = impl;
+}
+
+static inline const audio_primitives_impl_t *get_impl(void)
+{
+    const audio_primitives_impl_t *impl = primitives_impl;
+    if (impl == NULL) {
+        audio_primitives_use_impl(NULL);
+        impl = primitives_impl;
+    }
+    return impl;
+}
+
+// The primitives each run the chosen implementation, or the portable code
+// where it has none.
+#define PRIMITIVE(name) \
+        (get_impl()->name ? get_impl()->name : primitives_portable.name)
+
+void ditherAndClamp(int32_t* out, int32_t const *sums, size_t c)
+{
+    PRIMITIVE(dither_and_clamp)(out, sums, c);
+}
+
+void memcpy_to_i16_from_u8(int16_t *dst, const uint8_t *src, size_t count)
+{
+    PRIMITIVE(memcpy_to_i16_from_u8)(dst, src, count);
+}
+
+void downmix_to_mono_i16_from_stereo_i16(int16_t *dst, const int16_t *src, size_t count)
+{
+    PRIMITIVE(downmix_to_mono_i16_from_stereo_i16)(dst, src, count);
+}
+
+void upmix_to_stereo_i16_from_mono_i16(int16_t *dst, const int16_t *src, size_t count)
+{
+    PRIMITIVE(upmix_to_stereo_i16_from_mono_i16)(dst, src, count);
+}
+
+void downmix_to_mono_i16_from_multi_i16(int16_t *dst, const int16_t *src,
+        size_t channels, size_t count)
+{
+    if (!PRIMITIVE(downmix_to_mono_i16_from_multi_i16)(dst, src, channels, count)) {
+        downmix_to_mono_i16_from_multi_i16_portable(dst, src, channels, count);
+    }
+}
+
+void memcpy_to_float_from_i16(float *dst, const int16_t *src, size_t count)
+{
+    PRIMITIVE(memcpy_to_float_from_i16)(dst, src, count);
+}
+
+void memcpy_to_i16_from_float(int16_t *dst, const float *src, size_t count)
+{
+    PRIMITIVE(memcpy_to_i16_from_float)(dst, src, count);
+}
+
+void memcpy_to_float_from_i32(float *dst, const int32_t *src, size_t count)
+{
+    PRIMITIVE(memcpy_to_float_from_i32)(dst, src, count);
+}
+
+void memcpy_to_i32_from_float(int32_t *dst, const float *src, size_t count)
+{
+    PRIMITIVE(memcpy_to_i32_from_float)(dst, src, count);
+}
+
+void mix_to_i32_from_i16(int32_t *dst, const int16_t *src, size_t count, int16_t vol)
+{
+    PRIMITIVE(mix_to_i32_from_i16)(dst, src, count, vol, vol);
+}
+
+void mix_to_i32_from_stereo_i16(int32_t *dst, const int16_t *src, size_t count,
+        int16_t vl, int16_t vr)
+{
+    PRIMITIVE(mix_to_i32_from_i16)(dst, src, count * 2, vl, vr);
+}
+
+void mix_to_float_from_float(float *dst, const float *src, size_t count, float vol)
+{
+    PRIMITIVE(mix_to_float_from_float)(dst, src, count, vol);
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The implementations of the primitives primitives.c can choose between.
+ * Not part of the library's interface; primitives_bench uses it to check and
+ * time each one.
+ */
+
+#ifndef ANDROID_AUDIO_PRIMITIVES_IMPL_H
+#define ANDROID_AUDIO_PRIMITIVES_IMPL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/* The x86 code picks instructions at run time through target attributes,
+ * which older compilers do not have.
+ */
+#if (defined(__i386__) || defined(__x86_64__)) && defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define PRIMITIVES_HAVE_X86 1
+#endif
+
+#if defined(__ARM_NEON__)
+#define PRIMITIVES_HAVE_NEON 1
+#endif
+
+#define PRIMITIVES_MAX_IMPLS 4
+
+/* One implementation of the primitives in audio_utils/primitives.h, which
+ * must give exactly the same samples as the portable one. A NULL entry
+ * means the portable code is used for that primitive.
+ */
+typedef struct audio_primitives_impl {
+    const char *name;
+
+    void (*dither_and_clamp)(int32_t *out, const int32_t *sums, size_t c);
+    void (*memcpy_to_i16_from_u8)(int16_t *dst, const uint8_t *src, size_t count);
+    void (*downmix_to_mono_i16_from_stereo_i16)(int16_t *dst, const int16_t *src,
+            size_t count);
+    void (*upmix_to_stereo_i16_from_mono_i16)(int16_t *dst, const int16_t *src, size_t count);
+
+    /* Returns 0, having done nothing, for channel counts it has no code for. */
+    int (*downmix_to_mono_i16_from_multi_i16)(int16_t *dst, const int16_t *src,
+            size_t channels, size_t count);
+
+    void (*memcpy_to_float_from_i16)(float *dst, const int16_t *src, size_t count);
+    void (*memcpy_to_i16_from_float)(int16_t *dst, const float *src, size_t count);
+    void (*memcpy_to_float_from_i32)(float *dst, const int32_t *src, size_t count);
+    void (*memcpy_to_i32_from_float)(int32_t *dst, const float *src, size_t count);
+
+    /* dst[i] += src[i] * vol, where vol is vl for even i and vr for odd i. */
+    void (*mix_to_i32_from_i16)(int32_t *dst, const int16_t *src, size_t count,
+            int16_t vl, int16_t vr);
+    void (*mix_to_float_from_float)(float *dst, const float *src, size_t count, float vol);
+} audio_primitives_impl_t;
+
+/* Fills impls with those that run on this cpu, the one used by default
+ * first and the portable one last. Returns how many there are.
+ */
+int audio_primitives_impls(const audio_primitives_impl_t **impls, int max);
+
+/* Makes the primitives use impl, or the default if NULL. */
+void audio_primitives_use_impl(const audio_primitives_impl_t *impl);
+
+#ifdef PRIMITIVES_HAVE_X86
+int audio_primitives_x86_impls(const audio_primitives_impl_t **impls, int max);
+#endif
+
+#ifdef PRIMITIVES_HAVE_NEON
+int audio_primitives_neon_impls(const audio_primitives_impl_t **impls, int max);
+#endif
+
+__END_DECLS
+
+#endif  // ANDROID_AUDIO_PRIMITIVES_IMPL_H
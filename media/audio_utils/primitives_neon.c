@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The primitives with NEON. The loops do what the vectors can and finish the
+ * last few samples as the portable code does.
+ *
+ * NEON always rounds to nearest and flushes denormals to zero, so the float
+ * primitives only match the portable ones for normal numbers; samples are
+ * never small enough for that to matter.
+ */
+
+#include <audio_utils/primitives.h>
+
+#include "primitives_impl.h"
+
+#ifdef PRIMITIVES_HAVE_NEON
+
+#include <arm_neon.h>
+
+static void dither_and_clamp_neon(int32_t *out, const int32_t *sums, size_t c)
+{
+    for (; c >= 4; c -= 4, sums += 8, out += 4) {
+        int32x4_t a = vshrq_n_s32(vld1q_s32(sums), 12);
+        int32x4_t b = vshrq_n_s32(vld1q_s32(sums + 4), 12);
+        vst1q_s16((int16_t *) out, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+    }
+    for (; c > 0; c--, sums += 2) {
+        int32_t l = clamp16(sums[0] >> 12);
+        int32_t r = clamp16(sums[1] >> 12);
+        *out++ = (r << 16) | (l & 0xFFFF);
+    }
+}
+
+static void memcpy_to_i16_from_u8_neon(int16_t *dst, const uint8_t *src, size_t count)
+{
+    // from the end, as the portable code, so that dst may be src
+    const uint8x16_t bias = vdupq_n_u8(0x80);
+    size_t n = count & ~(size_t) 15;
+    while (count > n) {
+        count--;
+        dst[count] = (int16_t)(src[count] - 0x80) << 8;
+    }
+    while (n > 0) {
+        n -= 16;
+        int8x16_t x = vreinterpretq_s8_u8(veorq_u8(vld1q_u8(src + n), bias));
+        vst1q_s16(dst + n, vshll_n_s8(vget_low_s8(x), 8));
+        vst1q_s16(dst + n + 8, vshll_n_s8(vget_high_s8(x), 8));
+    }
+}
+
+static void downmix_to_mono_i16_from_stereo_i16_neon(int16_t *dst, const int16_t *src,
+        size_t count)
+{
+    for (; count >= 8; count -= 8, src += 16, dst += 8) {
+        int16x8x2_t x = vld2q_s16(src);
+        int32x4_t lo = vaddl_s16(vget_low_s16(x.val[0]), vget_low_s16(x.val[1]));
+        int32x4_t hi = vaddl_s16(vget_high_s16(x.val[0]), vget_high_s16(x.val[1]));
+        vst1q_s16(dst, vcombine_s16(vshrn_n_s32(lo, 1), vshrn_n_s32(hi, 1)));
+    }
+    for (; count > 0; count--, src += 2) {
+        *dst++ = (int16_t)(((int32_t)src[0] + (int32_t)src[1]) >> 1);
+    }
+}
+
+static void upmix_to_stereo_i16_from_mono_i16_neon(int16_t *dst, const int16_t *src,
+        size_t count)
+{
+    for (; count >= 8; count -= 8, src += 8, dst += 16) {
+        int16x8x2_t x;
+        x.val[0] = x.val[1] = vld1q_s16(src);
+        vst2q_s16(dst, x);
+    }
+    for (; count > 0; count--, dst += 2) {
+        dst[0] = dst[1] = *src++;
+    }
+}
+
+// Sums of the four rows of x, a half at a time.
+static inline int32x4_t neon_sum4_low(int16x8x4_t x)
+{
+    return vaddq_s32(vaddl_s16(vget_low_s16(x.val[0]), vget_low_s16(x.val[1])),
+                     vaddl_s16(vget_low_s16(x.val[2]), vget_low_s16(x.val[3])));
+}
+
+static inline int32x4_t neon_sum4_high(int16x8x4_t x)
+{
+    return vaddq_s32(vaddl_s16(vget_high_s16(x.val[0]), vget_high_s16(x.val[1])),
+                     vaddl_s16(vget_high_s16(x.val[2]), vget_high_s16(x.val[3])));
+}
+
+static int downmix_to_mono_i16_from_multi_i16_neon(int16_t *dst, const int16_t *src,
+        size_t channels, size_t count)
+{
+    // for a power of two channels the portable reciprocal is just a shift
+    int shift;
+    switch (channels) {
+    case 2:
+        downmix_to_mono_i16_from_stereo_i16_neon(dst, src, count);
+        return 1;
+    case 4:
+        shift = 2;
+        for (; count >= 8; count -= 8, src += 32, dst += 8) {
+            // one frame per lane
+            int16x8x4_t x = vld4q_s16(src);
+            vst1q_s16(dst, vcombine_s16(vshrn_n_s32(neon_sum4_low(x), 2),
+                                        vshrn_n_s32(neon_sum4_high(x), 2)));
+        }
+        break;
+    case 8:
+        shift = 3;
+        for (; count >= 4; count -= 4, src += 32, dst += 4) {
+            // half a frame per lane: frames 0 0 1 1 and 2 2 3 3
+            int16x8x4_t x = vld4q_s16(src);
+            int32x4_t lo = neon_sum4_low(x);
+            int32x4_t hi = neon_sum4_high(x);
+            int32x4_t sum = vcombine_s32(vpadd_s32(vget_low_s32(lo), vget_high_s32(lo)),
+                                         vpadd_s32(vget_low_s32(hi), vget_high_s32(hi)));
+            vst1_s16(dst, vshrn_n_s32(sum, 3));
+        }
+        break;
+    default:
+        return 0;
+    }
+    for (; count > 0; count--) {
+        int32_t sum = 0;
+        size_t i;
+        for (i = 0; i < channels; i++) {
+            sum += *src++;
+        }
+        *dst++ = (int16_t)(sum >> shift);
+    }
+    return 1;
+}
+
+static void memcpy_to_float_from_i16_neon(float *dst, const int16_t *src, size_t count)
+{
+    // from the end, so that dst may be src
+    size_t n = count & ~(size_t) 7;
+    while (count > n) {
+        count--;
+        dst[count] = src[count] * (1.0f / 32768.0f);
+    }
+    while (n > 0) {
+        n -= 8;
+        int16x8_t x = vld1q_s16(src + n);
+        float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(x)));
+        float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(x)));
+        vst1q_f32(dst + n, vmulq_n_f32(lo, 1.0f / 32768.0f));
+        vst1q_f32(dst + n + 4, vmulq_n_f32(hi, 1.0f / 32768.0f));
+    }
+}
+
+static inline int16x4_t neon_clamp16_from_float(float32x4_t f)
+{
+    f = vmulq_n_f32(f, 32768.0f);
+    f = vmaxq_f32(vminq_f32(f, vdupq_n_f32(32767.0f)), vdupq_n_f32(-32768.0f));
+    // ARMv7 only converts toward zero, so round by adding 1.5 * 2^23: the
+    // sum has a unit in the last place of 1, and the integer in its low bits
+    float32x4_t r = vaddq_f32(f, vdupq_n_f32(12582912.0f));
+    int32x4_t i = vsubq_s32(vreinterpretq_s32_f32(r), vdupq_n_s32(0x4B400000));
+    return vmovn_s32(i);
+}
+
+static void memcpy_to_i16_from_float_neon(int16_t *dst, const float *src, size_t count)
+{
+    for (; count >= 8; count -= 8, src += 8, dst += 8) {
+        int16x4_t a = neon_clamp16_from_float(vld1q_f32(src));
+        int16x4_t b = neon_clamp16_from_float(vld1q_f32(src + 4));
+        vst1q_s16(dst, vcombine_s16(a, b));
+    }
+    while (count--) {
+        *dst++ = clamp16_from_float(*src++);
+    }
+}
+
+static void memcpy_to_float_from_i32_neon(float *dst, const int32_t *src, size_t count)
+{
+    for (; count >= 4; count -= 4, src += 4, dst += 4) {
+        float32x4_t f = vcvtq_f32_s32(vld1q_s32(src));
+        vst1q_f32(dst, vmulq_n_f32(f, 1.0f / 2147483648.0f));
+    }
+    while (count--) {
+        *dst++ = *src++ * (1.0f / 2147483648.0f);
+    }
+}
+
+static void memcpy_to_i32_from_float_neon(int32_t *dst, const float *src, size_t count)
+{
+    const uint32x4_t sign = vdupq_n_u32(0x80000000);
+    const float32x4_t big = vdupq_n_f32(8388608.0f);
+    for (; count >= 4; count -= 4, src += 4, dst += 4) {
+        float32x4_t f = vmulq_n_f32(vld1q_f32(src), 2147483648.0f);
+        // below 2^23, round to an integer by adding and taking away 2^23 of
+        // the same sign; above, f is one already. The conversion saturates.
+        float32x4_t c = vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(big),
+                vandq_u32(vreinterpretq_u32_f32(f), sign)));
+        float32x4_t r = vsubq_f32(vaddq_f32(f, c), c);
+        f = vbslq_f32(vcltq_f32(vabsq_f32(f), big), r, f);
+        vst1q_s32(dst, vcvtq_s32_f32(f));
+    }
+    while (count--) {
+        *dst++ = clamp32_from_float(*src++);
+    }
+}
+
+static void mix_to_i32_from_i16_neon(int32_t *dst, const int16_t *src, size_t count,
+        int16_t vl, int16_t vr)
+{
+    const int16x4_t vol = vreinterpret_s16_u32(vdup_n_u32(((uint32_t)(uint16_t) vr << 16) |
+                                                          (uint16_t) vl));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t x = vld1q_s16(src + i);
+        vst1q_s32(dst + i, vmlal_s16(vld1q_s32(dst + i), vget_low_s16(x), vol));
+        vst1q_s32(dst + i + 4, vmlal_s16(vld1q_s32(dst + i + 4), vget_high_s16(x), vol));
+    }
+    for (; i < count; i++) {
+        const int32_t v = (i & 1) ? vr : vl;
+        dst[i] = (int32_t)((uint32_t)dst[i] + (uint32_t)(src[i] * v));
+    }
+}
+
+static void mix_to_float_from_float_neon(float *dst, const float *src, size_t count,
+        float vol)
+{
+    for (; count >= 4; count -= 4, src += 4, dst += 4) {
+        // not fused: the product is rounded, as it is everywhere else
+        vst1q_f32(dst, vaddq_f32(vld1q_f32(dst), vmulq_n_f32(vld1q_f32(src), vol)));
+    }
+    while (count--) {
+        *dst++ += *src++ * vol;
+    }
+}
+
+static const audio_primitives_impl_t primitives_neon = {
+    "neon",
+    dither_and_clamp_neon,
+    memcpy_to_i16_from_u8_neon,
+    downmix_to_mono_i16_from_stereo_i16_neon,
+    upmix_to_stereo_i16_from_mono_i16_neon,
+    downmix_to_mono_i16_from_multi_i16_neon,
+    memcpy_to_float_from_i16_neon,
+    memcpy_to_i16_from_float_neon,
+    memcpy_to_float_from_i32_neon,
+    memcpy_to_i32_from_float_neon,
+    mix_to_i32_from_i16_neon,
+    mix_to_float_from_float_neon,
+};
+
+int audio_primitives_neon_impls(const audio_primitives_impl_t **impls, int max)
+{
+    if (max < 1) {
+        return 0;
+    }
+    impls[0] = &primitives_neon;
+    return 1;
+}
+
+#endif  // PRIMITIVES_HAVE_NEON
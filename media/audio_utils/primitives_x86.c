@@ -0,0 +1,434 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The primitives with SSE2 and AVX2. Each is compiled for its own instruction
+ * set and only used once cpuid says the cpu has it, so the rest of the
+ * library still runs anywhere. The loops do what the vectors can and finish
+ * the last few samples as the portable code does.
+ */
+
+#include <audio_utils/primitives.h>
+
+#include "primitives_impl.h"
+
+#ifdef PRIMITIVES_HAVE_X86
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define SSE2_TARGET __attribute__((target("sse2")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+// SSE2
+
+static SSE2_TARGET void dither_and_clamp_sse2(int32_t *out, const int32_t *sums, size_t c)
+{
+    // four pairs at a time: packs saturates exactly as clamp16() does, and
+    // leaves each left sample below its right one as out wants them
+    for (; c >= 4; c -= 4, sums += 8, out += 4) {
+        __m128i a = _mm_srai_epi32(_mm_loadu_si128((const __m128i *) sums), 12);
+        __m128i b = _mm_srai_epi32(_mm_loadu_si128((const __m128i *) (sums + 4)), 12);
+        _mm_storeu_si128((__m128i *) out, _mm_packs_epi32(a, b));
+    }
+    for (; c > 0; c--, sums += 2) {
+        int32_t l = clamp16(sums[0] >> 12);
+        int32_t r = clamp16(sums[1] >> 12);
+        *out++ = (r << 16) | (l & 0xFFFF);
+    }
+}
+
+static SSE2_TARGET void memcpy_to_i16_from_u8_sse2(int16_t *dst, const uint8_t *src,
+        size_t count)
+{
+    // from the end, as the portable code, so that dst may be src
+    const __m128i bias = _mm_set1_epi8((char) 0x80);
+    const __m128i zero = _mm_setzero_si128();
+    size_t n = count & ~(size_t) 15;
+    while (count > n) {
+        count--;
+        dst[count] = (int16_t)(src[count] - 0x80) << 8;
+    }
+    while (n > 0) {
+        n -= 16;
+        __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (src + n)), bias);
+        _mm_storeu_si128((__m128i *) (dst + n), _mm_unpacklo_epi8(zero, x));
+        _mm_storeu_si128((__m128i *) (dst + n + 8), _mm_unpackhi_epi8(zero, x));
+    }
+}
+
+static SSE2_TARGET void downmix_to_mono_i16_from_stereo_i16_sse2(int16_t *dst,
+        const int16_t *src, size_t count)
+{
+    const __m128i one = _mm_set1_epi16(1);
+    for (; count >= 8; count -= 8, src += 16, dst += 8) {
+        __m128i a = _mm_madd_epi16(_mm_loadu_si128((const __m128i *) src), one);
+        __m128i b = _mm_madd_epi16(_mm_loadu_si128((const __m128i *) (src + 8)), one);
+        a = _mm_srai_epi32(a, 1);
+        b = _mm_srai_epi32(b, 1);
+        _mm_storeu_si128((__m128i *) dst, _mm_packs_epi32(a, b));
+    }
+    for (; count > 0; count--, src += 2) {
+        *dst++ = (int16_t)(((int32_t)src[0] + (int32_t)src[1]) >> 1);
+    }
+}
+
+static SSE2_TARGET void upmix_to_stereo_i16_from_mono_i16_sse2(int16_t *dst,
+        const int16_t *src, size_t count)
+{
+    for (; count >= 8; count -= 8, src += 8, dst += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *) src);
+        _mm_storeu_si128((__m128i *) dst, _mm_unpacklo_epi16(x, x));
+        _mm_storeu_si128((__m128i *) (dst + 8), _mm_unpackhi_epi16(x, x));
+    }
+    for (; count > 0; count--, dst += 2) {
+        dst[0] = dst[1] = *src++;
+    }
+}
+
+// Sums of the pairs of 32-bit lanes of a and b: a0+a1, a2+a3, b0+b1, b2+b3.
+static SSE2_TARGET inline __m128i sse2_hadd_epi32(__m128i a, __m128i b)
+{
+    __m128 fa = _mm_castsi128_ps(a);
+    __m128 fb = _mm_castsi128_ps(b);
+    return _mm_add_epi32(
+            _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0))),
+            _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+// Four frames of four channels, summed.
+static SSE2_TARGET inline __m128i sse2_sum4(const int16_t *src)
+{
+    const __m128i one = _mm_set1_epi16(1);
+    return sse2_hadd_epi32(
+            _mm_madd_epi16(_mm_loadu_si128((const __m128i *) src), one),
+            _mm_madd_epi16(_mm_loadu_si128((const __m128i *) (src + 8)), one));
+}
+
+// Four frames of eight channels, summed.
+static SSE2_TARGET inline __m128i sse2_sum8(const int16_t *src)
+{
+    const __m128i one = _mm_set1_epi16(1);
+    __m128i f0 = _mm_madd_epi16(_mm_loadu_si128((const __m128i *) src), one);
+    __m128i f1 = _mm_madd_epi16(_mm_loadu_si128((const __m128i *) (src + 8)), one);
+    __m128i f2 = _mm_madd_epi16(_mm_loadu_si128((const __m128i *) (src + 16)), one);
+    __m128i f3 = _mm_madd_epi16(_mm_loadu_si128((const __m128i *) (src + 24)), one);
+    return sse2_hadd_epi32(sse2_hadd_epi32(f0, f1), sse2_hadd_epi32(f2, f3));
+}
+
+static SSE2_TARGET int downmix_to_mono_i16_from_multi_i16_sse2(int16_t *dst,
+        const int16_t *src, size_t channels, size_t count)
+{
+    // for a power of two channels the portable reciprocal is just a shift
+    int shift;
+    switch (channels) {
+    case 2:
+        downmix_to_mono_i16_from_stereo_i16_sse2(dst, src, count);
+        return 1;
+    case 4:
+        shift = 2;
+        for (; count >= 8; count -= 8, src += 32, dst += 8) {
+            __m128i a = _mm_srai_epi32(sse2_sum4(src), 2);
+            __m128i b = _mm_srai_epi32(sse2_sum4(src + 16), 2);
+            _mm_storeu_si128((__m128i *) dst, _mm_packs_epi32(a, b));
+        }
+        break;
+    case 8:
+        shift = 3;
+        for (; count >= 8; count -= 8, src += 64, dst += 8) {
+            __m128i a = _mm_srai_epi32(sse2_sum8(src), 3);
+            __m128i b = _mm_srai_epi32(sse2_sum8(src + 32), 3);
+            _mm_storeu_si128((__m128i *) dst, _mm_packs_epi32(a, b));
+        }
+        break;
+    default:
+        return 0;
+    }
+    for (; count > 0; count--) {
+        int32_t sum = 0;
+        size_t i;
+        for (i = 0; i < channels; i++) {
+            sum += *src++;
+        }
+        *dst++ = (int16_t)(sum >> shift);
+    }
+    return 1;
+}
+
+static SSE2_TARGET void memcpy_to_float_from_i16_sse2(float *dst, const int16_t *src,
+        size_t count)
+{
+    // from the end, so that dst may be src
+    const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+    size_t n = count & ~(size_t) 7;
+    while (count > n) {
+        count--;
+        dst[count] = src[count] * (1.0f / 32768.0f);
+    }
+    while (n > 0) {
+        n -= 8;
+        __m128i x = _mm_loadu_si128((const __m128i *) (src + n));
+        // sign extend by putting each sample in the top half of a lane
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(dst + n, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(dst + n + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+}
+
+static SSE2_TARGET inline __m128i sse2_clamp16_from_float(__m128 f)
+{
+    f = _mm_mul_ps(f, _mm_set1_ps(32768.0f));
+    f = _mm_max_ps(_mm_min_ps(f, _mm_set1_ps(32767.0f)), _mm_set1_ps(-32768.0f));
+    // rounds to nearest even, in the default rounding mode as lrintf() does
+    return _mm_cvtps_epi32(f);
+}
+
+static SSE2_TARGET void memcpy_to_i16_from_float_sse2(int16_t *dst, const float *src,
+        size_t count)
+{
+    for (; count >= 8; count -= 8, src += 8, dst += 8) {
+        __m128i a = sse2_clamp16_from_float(_mm_loadu_ps(src));
+        __m128i b = sse2_clamp16_from_float(_mm_loadu_ps(src + 4));
+        _mm_storeu_si128((__m128i *) dst, _mm_packs_epi32(a, b));
+    }
+    while (count--) {
+        *dst++ = clamp16_from_float(*src++);
+    }
+}
+
+static SSE2_TARGET void memcpy_to_float_from_i32_sse2(float *dst, const int32_t *src,
+        size_t count)
+{
+    const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+    for (; count >= 4; count -= 4, src += 4, dst += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *) src);
+        _mm_storeu_ps(dst, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+    }
+    while (count--) {
+        *dst++ = *src++ * (1.0f / 2147483648.0f);
+    }
+}
+
+static SSE2_TARGET void memcpy_to_i32_from_float_sse2(int32_t *dst, const float *src,
+        size_t count)
+{
+    const __m128 scale = _mm_set1_ps(2147483648.0f);
+    for (; count >= 4; count -= 4, src += 4, dst += 4) {
+        __m128 f = _mm_mul_ps(_mm_loadu_ps(src), scale);
+        // cvtps gives 0x80000000 for anything out of range, which is right
+        // for large negative samples; flip it for the positive ones
+        __m128i over = _mm_castps_si128(_mm_cmpge_ps(f, scale));
+        _mm_storeu_si128((__m128i *) dst, _mm_xor_si128(_mm_cvtps_epi32(f), over));
+    }
+    while (count--) {
+        *dst++ = clamp32_from_float(*src++);
+    }
+}
+
+static SSE2_TARGET void mix_to_i32_from_i16_sse2(int32_t *dst, const int16_t *src,
+        size_t count, int16_t vl, int16_t vr)
+{
+    const __m128i vol = _mm_set1_epi32(((uint32_t)(uint16_t) vr << 16) | (uint16_t) vl);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i lo = _mm_mullo_epi16(x, vol);
+        __m128i hi = _mm_mulhi_epi16(x, vol);
+        __m128i d0 = _mm_loadu_si128((const __m128i *) (dst + i));
+        __m128i d1 = _mm_loadu_si128((const __m128i *) (dst + i + 4));
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_add_epi32(d0, _mm_unpacklo_epi16(lo, hi)));
+        _mm_storeu_si128((__m128i *) (dst + i + 4),
+                _mm_add_epi32(d1, _mm_unpackhi_epi16(lo, hi)));
+    }
+    for (; i < count; i++) {
+        const int32_t v = (i & 1) ? vr : vl;
+        dst[i] = (int32_t)((uint32_t)dst[i] + (uint32_t)(src[i] * v));
+    }
+}
+
+static SSE2_TARGET void mix_to_float_from_float_sse2(float *dst, const float *src,
+        size_t count, float vol)
+{
+    const __m128 v = _mm_set1_ps(vol);
+    for (; count >= 4; count -= 4, src += 4, dst += 4) {
+        __m128 d = _mm_loadu_ps(dst);
+        _mm_storeu_ps(dst, _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(src), v)));
+    }
+    while (count--) {
+        *dst++ += *src++ * vol;
+    }
+}
+
+// AVX2, for the conversions and the mixes; the rest is as fast with SSE2.
+
+static AVX2_TARGET void memcpy_to_float_from_i16_avx2(float *dst, const int16_t *src,
+        size_t count)
+{
+    const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+    size_t n = count & ~(size_t) 15;
+    while (count > n) {
+        count--;
+        dst[count] = src[count] * (1.0f / 32768.0f);
+    }
+    while (n > 0) {
+        n -= 16;
+        __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (src + n)));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (src + n + 8)));
+        _mm256_storeu_ps(dst + n, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale));
+        _mm256_storeu_ps(dst + n + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale));
+    }
+}
+
+static AVX2_TARGET inline __m256i avx2_clamp16_from_float(__m256 f)
+{
+    f = _mm256_mul_ps(f, _mm256_set1_ps(32768.0f));
+    f = _mm256_max_ps(_mm256_min_ps(f, _mm256_set1_ps(32767.0f)), _mm256_set1_ps(-32768.0f));
+    return _mm256_cvtps_epi32(f);
+}
+
+static AVX2_TARGET void memcpy_to_i16_from_float_avx2(int16_t *dst, const float *src,
+        size_t count)
+{
+    for (; count >= 16; count -= 16, src += 16, dst += 16) {
+        __m256i a = avx2_clamp16_from_float(_mm256_loadu_ps(src));
+        __m256i b = avx2_clamp16_from_float(_mm256_loadu_ps(src + 8));
+        // packs works within each 128-bit half; put the quarters back in order
+        __m256i x = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i *) dst, x);
+    }
+    memcpy_to_i16_from_float_sse2(dst, src, count);
+}
+
+static AVX2_TARGET void memcpy_to_float_from_i32_avx2(float *dst, const int32_t *src,
+        size_t count)
+{
+    const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+    for (; count >= 8; count -= 8, src += 8, dst += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i *) src);
+        _mm256_storeu_ps(dst, _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+    }
+    memcpy_to_float_from_i32_sse2(dst, src, count);
+}
+
+static AVX2_TARGET void memcpy_to_i32_from_float_avx2(int32_t *dst, const float *src,
+        size_t count)
+{
+    const __m256 scale = _mm256_set1_ps(2147483648.0f);
+    for (; count >= 8; count -= 8, src += 8, dst += 8) {
+        __m256 f = _mm256_mul_ps(_mm256_loadu_ps(src), scale);
+        __m256i over = _mm256_castps_si256(_mm256_cmp_ps(f, scale, _CMP_GE_OQ));
+        _mm256_storeu_si256((__m256i *) dst, _mm256_xor_si256(_mm256_cvtps_epi32(f), over));
+    }
+    memcpy_to_i32_from_float_sse2(dst, src, count);
+}
+
+static AVX2_TARGET void mix_to_i32_from_i16_avx2(int32_t *dst, const int16_t *src,
+        size_t count, int16_t vl, int16_t vr)
+{
+    const __m256i vol = _mm256_set1_epi32(((uint32_t)(uint16_t) vr << 16) | (uint16_t) vl);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i x = _mm256_loadu_si256((const __m256i *) (src + i));
+        __m256i lo = _mm256_mullo_epi16(x, vol);
+        __m256i hi = _mm256_mulhi_epi16(x, vol);
+        // unpack works within each 128-bit half: products 0-3 and 8-11, then 4-7 and 12-15
+        __m256i p0 = _mm256_unpacklo_epi16(lo, hi);
+        __m256i p1 = _mm256_unpackhi_epi16(lo, hi);
+        __m256i d0 = _mm256_loadu_si256((const __m256i *) (dst + i));
+        __m256i d1 = _mm256_loadu_si256((const __m256i *) (dst + i + 8));
+        d0 = _mm256_add_epi32(d0, _mm256_permute2x128_si256(p0, p1, 0x20));
+        d1 = _mm256_add_epi32(d1, _mm256_permute2x128_si256(p0, p1, 0x31));
+        _mm256_storeu_si256((__m256i *) (dst + i), d0);
+        _mm256_storeu_si256((__m256i *) (dst + i + 8), d1);
+    }
+    // i is even, so the tail starts on a left sample
+    mix_to_i32_from_i16_sse2(dst + i, src + i, count - i, vl, vr);
+}
+
+static AVX2_TARGET void mix_to_float_from_float_avx2(float *dst, const float *src,
+        size_t count, float vol)
+{
+    const __m256 v = _mm256_set1_ps(vol);
+    for (; count >= 8; count -= 8, src += 8, dst += 8) {
+        __m256 d = _mm256_loadu_ps(dst);
+        // not fused: the product is rounded, as it is everywhere else
+        _mm256_storeu_ps(dst, _mm256_add_ps(d, _mm256_mul_ps(_mm256_loadu_ps(src), v)));
+    }
+    mix_to_float_from_float_sse2(dst, src, count, vol);
+}
+
+static const audio_primitives_impl_t primitives_avx2 = {
+    "avx2",
+    dither_and_clamp_sse2,
+    memcpy_to_i16_from_u8_sse2,
+    downmix_to_mono_i16_from_stereo_i16_sse2,
+    upmix_to_stereo_i16_from_mono_i16_sse2,
+    downmix_to_mono_i16_from_multi_i16_sse2,
+    memcpy_to_float_from_i16_avx2,
+    memcpy_to_i16_from_float_avx2,
+    memcpy_to_float_from_i32_avx2,
+    memcpy_to_i32_from_float_avx2,
+    mix_to_i32_from_i16_avx2,
+    mix_to_float_from_float_avx2,
+};
+
+static const audio_primitives_impl_t primitives_sse2 = {
+    "sse2",
+    dither_and_clamp_sse2,
+    memcpy_to_i16_from_u8_sse2,
+    downmix_to_mono_i16_from_stereo_i16_sse2,
+    upmix_to_stereo_i16_from_mono_i16_sse2,
+    downmix_to_mono_i16_from_multi_i16_sse2,
+    memcpy_to_float_from_i16_sse2,
+    memcpy_to_i16_from_float_sse2,
+    memcpy_to_float_from_i32_sse2,
+    memcpy_to_i32_from_float_sse2,
+    mix_to_i32_from_i16_sse2,
+    mix_to_float_from_float_sse2,
+};
+
+// Whether the OS saves the ymm registers across context switches.
+static int ymm_enabled(void)
+{
+    uint32_t lo, hi;
+    __asm__ (".byte 0x0f, 0x01, 0xd0" : "=a" (lo), "=d" (hi) : "c" (0));  // xgetbv
+    return (lo & 6) == 6;
+}
+
+int audio_primitives_x86_impls(const audio_primitives_impl_t **impls, int max)
+{
+    unsigned int eax, ebx, ecx, edx;
+    unsigned int ebx7 = 0;
+    int n = 0;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    if (__get_cpuid_max(0, NULL) >= 7) {
+        unsigned int a, c, d;
+        __cpuid_count(7, 0, a, ebx7, c, d);
+    }
+
+    if (n < max && (ebx7 & (1 << 5)) && (ecx & bit_OSXSAVE) && ymm_enabled()) {
+        impls[n++] = &primitives_avx2;
+    }
+    if (n < max && (edx & bit_SSE2)) {
+        impls[n++] = &primitives_sse2;
+    }
+    return n;
+}
+
+#endif  // PRIMITIVES_HAVE_X86
@@ -19,41 +19,53 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <cutils/log.h>
 #include <system/audio.h>
 #include <audio_utils/resampler.h>
 #include <speex/speex_resampler.h>
 
+#include "polyphase.h"
+
 
 struct resampler {
     struct resampler_itfe itfe;
     SpeexResamplerState *speex_resampler;       // handle on speex resampler
+    struct polyphase *polyphase;                // or on the built-in one
     struct resampler_buffer_provider *provider; // buffer provider installed by client
     uint32_t in_sample_rate;                    // input sampling rate in Hz
     uint32_t out_sample_rate;                   // output sampling rate in Hz
     uint32_t channel_count;                     // number of channels (interleaved)
-    int16_t *in_buf;                            // input buffer
+    uint32_t flags;                             // RESAMPLER_FLAG_xxx
+    size_t frame_size;                          // frame size in bytes
+    void *in_buf;                               // input buffer
     size_t in_buf_size;                         // input buffer size
     size_t frames_in;                           // number of frames in input buffer
     size_t frames_rq;                           // cached number of output frames
     size_t frames_needed;                       // minimum number of input frames to produce
                                                 // frames_rq output frames
-    int32_t speex_delay_ns;                     // delay introduced by speex resampler in ns
+    int32_t filter_delay_ns;                    // delay introduced by the resampler in ns
 };
 
 
 //------------------------------------------------------------------------------
-// speex based resampler
+// speex or built-in polyphase resampler
 //------------------------------------------------------------------------------
 
 static void resampler_reset(struct resampler_itfe *resampler)
 {
     struct resampler *rsmp = (struct resampler *)resampler;
 
+    if (rsmp == NULL) {
+        return;
+    }
+
     rsmp->frames_in = 0;
     rsmp->frames_rq = 0;
 
-    if (rsmp != NULL && rsmp->speex_resampler != NULL) {
+    if (rsmp->polyphase != NULL) {
+        polyphase_reset(rsmp->polyphase);
+    } else if (rsmp->speex_resampler != NULL) {
         speex_resampler_reset_mem(rsmp->speex_resampler);
     }
 }
@@ -63,27 +75,62 @@ static int32_t resampler_delay_ns(struct resampler_itfe *resampler)
     struct resampler *rsmp = (struct resampler *)resampler;
 
     int32_t delay = (int32_t)((1000000000 * (int64_t)rsmp->frames_in) / rsmp->in_sample_rate);
-    delay += rsmp->speex_delay_ns;
+    delay += rsmp->filter_delay_ns;
 
     return delay;
 }
 
+// resamples at most *inFrameCount frames from in to at most *outFrameCount frames of out,
+// and updates them with the number of frames consumed and produced.
+static void resampler_process(struct resampler *rsmp,
+                              const void *in,
+                              size_t *inFrameCount,
+                              void *out,
+                              size_t *outFrameCount)
+{
+    if (rsmp->polyphase != NULL) {
+        if (rsmp->flags & RESAMPLER_FLAG_FLOAT) {
+            polyphase_process_float(rsmp->polyphase, (const float *)in, inFrameCount,
+                                    (float *)out, outFrameCount);
+        } else {
+            polyphase_process_i16(rsmp->polyphase, (const int16_t *)in, inFrameCount,
+                                  (int16_t *)out, outFrameCount);
+        }
+        return;
+    }
+
+    spx_uint32_t inFrames = *inFrameCount;
+    spx_uint32_t outFrames = *outFrameCount;
+    if (rsmp->channel_count == 1) {
+        speex_resampler_process_int(rsmp->speex_resampler,
+                                    0,
+                                    (const int16_t *)in,
+                                    &inFrames,
+                                    (int16_t *)out,
+                                    &outFrames);
+    } else {
+        speex_resampler_process_interleaved_int(rsmp->speex_resampler,
+                                    (const int16_t *)in,
+                                    &inFrames,
+                                    (int16_t *)out,
+                                    &outFrames);
+    }
+    *inFrameCount = inFrames;
+    *outFrameCount = outFrames;
+}
+
 // outputs a number of frames less or equal to *outFrameCount and updates *outFrameCount
 // with the actual number of frames produced.
-int resampler_resample_from_provider(struct resampler_itfe *resampler,
-                       int16_t *out,
+static int resample_from_provider(struct resampler *rsmp,
+                       void *out,
                        size_t *outFrameCount)
 {
-    struct resampler *rsmp = (struct resampler *)resampler;
-
-    if (rsmp == NULL || out == NULL || outFrameCount == NULL) {
-        return -EINVAL;
-    }
     if (rsmp->provider == NULL) {
         *outFrameCount = 0;
         return -ENOSYS;
     }
 
+    const size_t frameSize = rsmp->frame_size;
     size_t framesRq = *outFrameCount;
     // update and cache the number of frames needed at the input sampling rate to produce
     // the number of frames requested at the output sampling rate
@@ -93,7 +140,31 @@ int resampler_resample_from_provider(struct resampler_itfe *resampler,
     }
 
     size_t framesWr = 0;
-    size_t inFrames = 0;
+    if (rsmp->flags & RESAMPLER_FLAG_IN_PLACE) {
+        // resample straight from the provider's buffers, and give back what wasn't used
+        while (framesWr < framesRq) {
+            struct resampler_buffer buf;
+            buf.frame_count = ((framesRq - framesWr) * rsmp->in_sample_rate) /
+                    rsmp->out_sample_rate + 1;
+            rsmp->provider->get_next_buffer(rsmp->provider, &buf);
+            if (buf.raw == NULL) {
+                break;
+            }
+            size_t inFrames = buf.frame_count;
+            size_t outFrames = framesRq - framesWr;
+            resampler_process(rsmp, buf.raw, &inFrames,
+                              (char *)out + framesWr * frameSize, &outFrames);
+            buf.frame_count = inFrames;
+            rsmp->provider->release_buffer(rsmp->provider, &buf);
+            framesWr += outFrames;
+            if (inFrames == 0 && outFrames == 0) {
+                break;
+            }
+        }
+        *outFrameCount = framesWr;
+        return 0;
+    }
+
     while (framesWr < framesRq) {
         if (rsmp->frames_in < rsmp->frames_needed) {
             // make sure that the number of frames present in rsmp->in_buf (rsmp->frames_in) is at
@@ -101,8 +172,7 @@ int resampler_resample_from_provider(struct resampler_itfe *resampler,
             // the output sampling rate
             if (rsmp->in_buf_size < rsmp->frames_needed) {
                 rsmp->in_buf_size = rsmp->frames_needed;
-                rsmp->in_buf = (int16_t *)realloc(rsmp->in_buf,
-                                        rsmp->in_buf_size * rsmp->channel_count * sizeof(int16_t));
+                rsmp->in_buf = realloc(rsmp->in_buf, rsmp->in_buf_size * frameSize);
             }
             struct resampler_buffer buf;
             buf.frame_count = rsmp->frames_needed - rsmp->frames_in;
@@ -110,94 +180,132 @@ int resampler_resample_from_provider(struct resampler_itfe *resampler,
             if (buf.raw == NULL) {
                 break;
             }
-            memcpy(rsmp->in_buf + rsmp->frames_in * rsmp->channel_count,
+            memcpy((char *)rsmp->in_buf + rsmp->frames_in * frameSize,
                     buf.raw,
-                    buf.frame_count * rsmp->channel_count * sizeof(int16_t));
+                    buf.frame_count * frameSize);
             rsmp->frames_in += buf.frame_count;
             rsmp->provider->release_buffer(rsmp->provider, &buf);
         }
 
         size_t outFrames = framesRq - framesWr;
-        inFrames = rsmp->frames_in;
-        if (rsmp->channel_count == 1) {
-            speex_resampler_process_int(rsmp->speex_resampler,
-                                        0,
-                                        rsmp->in_buf,
-                                        &inFrames,
-                                        out + framesWr,
-                                        &outFrames);
-        } else {
-            speex_resampler_process_interleaved_int(rsmp->speex_resampler,
-                                        rsmp->in_buf,
-                                        &inFrames,
-                                        out + framesWr * rsmp->channel_count,
-                                        &outFrames);
-        }
+        size_t inFrames = rsmp->frames_in;
+        resampler_process(rsmp, rsmp->in_buf, &inFrames,
+                          (char *)out + framesWr * frameSize, &outFrames);
         framesWr += outFrames;
         rsmp->frames_in -= inFrames;
-        ALOGW_IF((framesWr != framesRq) && (rsmp->frames_in != 0),
+        ALOGV_IF((framesWr != framesRq) && (rsmp->frames_in != 0),
                 "ReSampler::resample() remaining %d frames in and %d frames out",
                 rsmp->frames_in, (framesRq - framesWr));
-    }
-    if (rsmp->frames_in) {
-        memmove(rsmp->in_buf,
-                rsmp->in_buf + inFrames * rsmp->channel_count,
-                rsmp->frames_in * rsmp->channel_count * sizeof(int16_t));
+        // the frames left go first the next time round
+        if (rsmp->frames_in) {
+            memmove(rsmp->in_buf,
+                    (char *)rsmp->in_buf + inFrames * frameSize,
+                    rsmp->frames_in * frameSize);
+        }
     }
     *outFrameCount = framesWr;
 
     return 0;
 }
 
-int resampler_resample_from_input(struct resampler_itfe *resampler,
-                                  int16_t *in,
-                                  size_t *inFrameCount,
-                                  int16_t *out,
-                                  size_t *outFrameCount)
+int resampler_resample_from_provider(struct resampler_itfe *resampler,
+                       int16_t *out,
+                       size_t *outFrameCount)
 {
     struct resampler *rsmp = (struct resampler *)resampler;
 
-    if (rsmp == NULL || in == NULL || inFrameCount == NULL ||
-            out == NULL || outFrameCount == NULL) {
+    if (rsmp == NULL || out == NULL || outFrameCount == NULL ||
+            (rsmp->flags & RESAMPLER_FLAG_FLOAT)) {
+        return -EINVAL;
+    }
+    return resample_from_provider(rsmp, out, outFrameCount);
+}
+
+int resampler_resample_from_provider_float(struct resampler_itfe *resampler,
+                       float *out,
+                       size_t *outFrameCount)
+{
+    struct resampler *rsmp = (struct resampler *)resampler;
+
+    if (rsmp == NULL || out == NULL || outFrameCount == NULL ||
+            !(rsmp->flags & RESAMPLER_FLAG_FLOAT)) {
         return -EINVAL;
     }
+    return resample_from_provider(rsmp, out, outFrameCount);
+}
+
+static int resample_from_input(struct resampler *rsmp,
+                               const void *in,
+                               size_t *inFrameCount,
+                               void *out,
+                               size_t *outFrameCount)
+{
     if (rsmp->provider != NULL) {
         *outFrameCount = 0;
         return -ENOSYS;
     }
 
-    if (rsmp->channel_count == 1) {
-        speex_resampler_process_int(rsmp->speex_resampler,
-                                    0,
-                                    in,
-                                    inFrameCount,
-                                    out,
-                                    outFrameCount);
-    } else {
-        speex_resampler_process_interleaved_int(rsmp->speex_resampler,
-                                                in,
-                                                inFrameCount,
-                                                out,
-                                                outFrameCount);
-    }
+    resampler_process(rsmp, in, inFrameCount, out, outFrameCount);
 
     ALOGV("resampler_resample_from_input() DONE in %d out % d", *inFrameCount, *outFrameCount);
 
     return 0;
 }
 
+int resampler_resample_from_input(struct resampler_itfe *resampler,
+                                  int16_t *in,
+                                  size_t *inFrameCount,
+                                  int16_t *out,
+                                  size_t *outFrameCount)
+{
+    struct resampler *rsmp = (struct resampler *)resampler;
+
+    if (rsmp == NULL || in == NULL || inFrameCount == NULL ||
+            out == NULL || outFrameCount == NULL || (rsmp->flags & RESAMPLER_FLAG_FLOAT)) {
+        return -EINVAL;
+    }
+    return resample_from_input(rsmp, in, inFrameCount, out, outFrameCount);
+}
+
+int resampler_resample_from_input_float(struct resampler_itfe *resampler,
+                                        float *in,
+                                        size_t *inFrameCount,
+                                        float *out,
+                                        size_t *outFrameCount)
+{
+    struct resampler *rsmp = (struct resampler *)resampler;
+
+    if (rsmp == NULL || in == NULL || inFrameCount == NULL ||
+            out == NULL || outFrameCount == NULL || !(rsmp->flags & RESAMPLER_FLAG_FLOAT)) {
+        return -EINVAL;
+    }
+    return resample_from_input(rsmp, in, inFrameCount, out, outFrameCount);
+}
+
 int create_resampler(uint32_t inSampleRate,
                     uint32_t outSampleRate,
                     uint32_t channelCount,
                     uint32_t quality,
                     struct resampler_buffer_provider* provider,
                     struct resampler_itfe **resampler)
+{
+    return create_resampler_ex(inSampleRate, outSampleRate, channelCount, quality, 0,
+                               provider, resampler);
+}
+
+int create_resampler_ex(uint32_t inSampleRate,
+                    uint32_t outSampleRate,
+                    uint32_t channelCount,
+                    uint32_t quality,
+                    uint32_t flags,
+                    struct resampler_buffer_provider* provider,
+                    struct resampler_itfe **resampler)
 {
     int error;
     struct resampler *rsmp;
 
-    ALOGV("create_resampler() In SR %d Out SR %d channels %d",
-         inSampleRate, outSampleRate, channelCount);
+    ALOGV("create_resampler() In SR %d Out SR %d channels %d flags %#x",
+         inSampleRate, outSampleRate, channelCount, flags);
 
     if (resampler == NULL) {
         return -EINVAL;
@@ -209,41 +317,66 @@ int create_resampler(uint32_t inSampleRate,
         return -EINVAL;
     }
 
+    // speex unless the caller asks for the built-in resampler
+    int native = (flags & (RESAMPLER_FLAG_POLYPHASE | RESAMPLER_FLAG_FLOAT)) != 0;
+    if (native && !polyphase_supported(inSampleRate, outSampleRate)) {
+        return -EINVAL;
+    }
+
     rsmp = (struct resampler *)calloc(1, sizeof(struct resampler));
+    if (rsmp == NULL) {
+        return -ENOMEM;
+    }
 
-    rsmp->speex_resampler = speex_resampler_init(channelCount,
-                                      inSampleRate,
-                                      outSampleRate,
-                                      quality,
-                                      &error);
-    if (rsmp->speex_resampler == NULL) {
-        ALOGW("ReSampler: Cannot create speex resampler: %s", speex_resampler_strerror(error));
-        free(rsmp);
-        return -ENODEV;
+    if (native) {
+        rsmp->polyphase = polyphase_create(inSampleRate, outSampleRate, channelCount, quality,
+                                           flags & RESAMPLER_FLAG_FLOAT);
+        if (rsmp->polyphase == NULL) {
+            ALOGW("ReSampler: Cannot create polyphase resampler");
+            free(rsmp);
+            return -ENOMEM;
+        }
+        rsmp->filter_delay_ns = polyphase_delay_ns(rsmp->polyphase);
+    } else {
+        rsmp->speex_resampler = speex_resampler_init(channelCount,
+                                          inSampleRate,
+                                          outSampleRate,
+                                          quality,
+                                          &error);
+        if (rsmp->speex_resampler == NULL) {
+            ALOGW("ReSampler: Cannot create speex resampler: %s",
+                  speex_resampler_strerror(error));
+            free(rsmp);
+            return -ENODEV;
+        }
+        int frames = speex_resampler_get_input_latency(rsmp->speex_resampler);
+        rsmp->filter_delay_ns = (int32_t)((1000000000 * (int64_t)frames) / inSampleRate);
+        frames = speex_resampler_get_output_latency(rsmp->speex_resampler);
+        rsmp->filter_delay_ns += (int32_t)((1000000000 * (int64_t)frames) / outSampleRate);
     }
 
     rsmp->itfe.reset = resampler_reset;
     rsmp->itfe.resample_from_provider = resampler_resample_from_provider;
     rsmp->itfe.resample_from_input = resampler_resample_from_input;
     rsmp->itfe.delay_ns = resampler_delay_ns;
+    rsmp->itfe.resample_from_provider_float = resampler_resample_from_provider_float;
+    rsmp->itfe.resample_from_input_float = resampler_resample_from_input_float;
 
     rsmp->provider = provider;
     rsmp->in_sample_rate = inSampleRate;
     rsmp->out_sample_rate = outSampleRate;
     rsmp->channel_count = channelCount;
+    rsmp->flags = flags;
+    rsmp->frame_size = channelCount *
+            ((flags & RESAMPLER_FLAG_FLOAT) ? sizeof(float) : sizeof(int16_t));
     rsmp->in_buf = NULL;
     rsmp->in_buf_size = 0;
 
     resampler_reset(&rsmp->itfe);
 
-    int frames = speex_resampler_get_input_latency(rsmp->speex_resampler);
-    rsmp->speex_delay_ns = (int32_t)((1000000000 * (int64_t)frames) / rsmp->in_sample_rate);
-    frames = speex_resampler_get_output_latency(rsmp->speex_resampler);
-    rsmp->speex_delay_ns += (int32_t)((1000000000 * (int64_t)frames) / rsmp->out_sample_rate);
-
     *resampler = &rsmp->itfe;
-    ALOGV("create_resampler() DONE rsmp %p &rsmp->itfe %p speex %p",
-         rsmp, &rsmp->itfe, rsmp->speex_resampler);
+    ALOGV("create_resampler() DONE rsmp %p &rsmp->itfe %p speex %p polyphase %p",
+         rsmp, &rsmp->itfe, rsmp->speex_resampler, rsmp->polyphase);
     return 0;
 }
 
@@ -257,6 +390,7 @@ void release_resampler(struct resampler_itfe *resampler)
 
     free(rsmp->in_buf);
 
+    polyphase_destroy(rsmp->polyphase);
     if (rsmp->speex_resampler != NULL) {
         speex_resampler_destroy(rsmp->speex_resampler);
     }
@@ -0,0 +1,82 @@
+LOCAL_PATH:= $(call my-dir)
+
+# Checks each implementation of the primitives against the portable one,
+# then times them.
+
+primitives_bench_src_files := \
+	../primitives.c \
+	primitives_bench.c
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := primitives_bench
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := $(primitives_bench_src_files)
+ifeq ($(TARGET_ARCH),x86)
+LOCAL_SRC_FILES += ../primitives_x86.c
+endif
+ifeq ($(TARGET_ARCH),arm)
+LOCAL_SRC_FILES += ../primitives_neon.c
+endif
+LOCAL_CFLAGS := -ffp-contract=off
+LOCAL_C_INCLUDES := $(call include-path-for, audio-utils)
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := primitives_bench
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := $(primitives_bench_src_files)
+ifeq ($(HOST_ARCH),x86)
+LOCAL_SRC_FILES += ../primitives_x86.c
+endif
+# keep the portable float code from using x87 extended precision
+LOCAL_CFLAGS := -ffp-contract=off -msse2 -mfpmath=sse
+LOCAL_C_INCLUDES := $(call include-path-for, audio-utils)
+LOCAL_LDLIBS := -lm
+include $(BUILD_HOST_EXECUTABLE)
+
+# Checks each implementation of the FFT against the radix-2 one, then times
+# them.
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := fixedfft_bench
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := ../fixedfft.cpp.arm fixedfft_bench.c
+LOCAL_C_INCLUDES := $(call include-path-for, audio-utils)
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := fixedfft_bench
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := ../fixedfft.cpp fixedfft_bench.c
+LOCAL_CFLAGS := -msse2
+LOCAL_C_INCLUDES := $(call include-path-for, audio-utils)
+LOCAL_LDLIBS := -lm -lpthread
+include $(BUILD_HOST_EXECUTABLE)
+
+# Compares the built-in resampler with speex, which is only built for the
+# target.
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := resampler_bench
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := resampler_bench.c
+LOCAL_C_INCLUDES := $(call include-path-for, audio-utils)
+LOCAL_SHARED_LIBRARIES := libaudioutils
+include $(BUILD_EXECUTABLE)
+
+# Measures echo_reference write() times with a capture thread reading
+# against it.
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := echo_reference_bench
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := echo_reference_bench.c
+LOCAL_C_INCLUDES := $(call include-path-for, audio-utils)
+LOCAL_SHARED_LIBRARIES := libaudioutils
+include $(BUILD_EXECUTABLE)
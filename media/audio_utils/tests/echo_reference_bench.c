@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Runs a playback thread writing to an echo reference against a capture
+ * thread reading from it, and measures how long write() takes, worst case
+ * included. Each pair of rates runs paced, 10 ms at a time as audio HALs do,
+ * then flat out on both sides to make the most of contention.
+ *
+ * When nothing is converted, the frames written count up, so the reader can
+ * check that every frame it gets is whole and, when paced, follows the one
+ * before.
+ *
+ *   echo_reference_bench [-s seconds per run]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <system/audio.h>
+#include <audio_utils/echo_reference.h>
+
+#define PERIOD_MS       10
+#define PLAYBACK_DELAY_NS   (20 * 1000000)
+#define CAPTURE_DELAY_NS    (10 * 1000000)
+#define MAX_US          10000           // write() times above this all land in the last bucket
+
+struct run {
+    struct echo_reference_itfe *er;
+    uint32_t wr_rate;
+    uint32_t rd_rate;
+    uint32_t rd_channels;
+    int paced;
+    int checked;
+    long long end_ns;
+
+    // writer results
+    unsigned writes;
+    unsigned hist[MAX_US + 1];          // write() times, by microsecond
+    long long total_ns;
+    long long max_ns;
+
+    // reader results
+    unsigned reads;
+    unsigned torn;                      // frames whose channels don't match
+    unsigned jumps;                     // frames that don't follow the one before
+    unsigned silent;                    // frames of silence
+};
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_until(long long ns)
+{
+    struct timespec ts;
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+    }
+}
+
+static void to_timespec(long long ns, struct timespec *ts)
+{
+    ts->tv_sec = ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+}
+
+// Frame k: a left sample that is never 0 and a right one that is its complement.
+static int16_t frame_left(uint32_t k)
+{
+    return (int16_t) (1 + k % 32767);
+}
+
+static void *writer(void *arg)
+{
+    struct run *r = (struct run *) arg;
+    const size_t frames = r->wr_rate * PERIOD_MS / 1000;
+    int16_t *buf = malloc(frames * 2 * sizeof(int16_t));
+    long long next = now_ns();
+    uint32_t k = 0;
+
+    while (now_ns() < r->end_ns) {
+        struct echo_reference_buffer b;
+        long long start, t;
+        size_t i;
+
+        for (i = 0; i < frames; i++, k++) {
+            buf[2 * i] = frame_left(k);
+            buf[2 * i + 1] = ~buf[2 * i];
+        }
+        b.raw = buf;
+        b.frame_count = frames;
+        b.delay_ns = PLAYBACK_DELAY_NS;
+
+        start = now_ns();
+        to_timespec(start, &b.time_stamp);
+        r->er->write(r->er, &b);
+        t = now_ns() - start;
+
+        r->writes++;
+        r->total_ns += t;
+        if (t > r->max_ns) {
+            r->max_ns = t;
+        }
+        r->hist[t / 1000 < MAX_US ? t / 1000 : MAX_US]++;
+
+        if (r->paced) {
+            next += PERIOD_MS * 1000000LL;
+            sleep_until(next);
+        }
+    }
+    r->er->write(r->er, NULL);
+    free(buf);
+    return NULL;
+}
+
+static void *reader(void *arg)
+{
+    struct run *r = (struct run *) arg;
+    const size_t frames = r->rd_rate * PERIOD_MS / 1000;
+    int16_t *buf = malloc(frames * r->rd_channels * sizeof(int16_t));
+    // a third of a period out of step with the writer
+    long long next = now_ns() + PERIOD_MS * 1000000LL / 3;
+    int16_t prev = 0;
+
+    while (now_ns() < r->end_ns) {
+        struct echo_reference_buffer b;
+        size_t i;
+
+        if (r->paced) {
+            sleep_until(next);
+            next += PERIOD_MS * 1000000LL;
+        }
+        b.raw = buf;
+        b.frame_count = frames;
+        b.delay_ns = CAPTURE_DELAY_NS;
+        // the checked runs leave the delay alone, so no frames are dropped or added
+        if (r->checked) {
+            b.time_stamp.tv_sec = 0;
+            b.time_stamp.tv_nsec = 0;
+        } else {
+            to_timespec(now_ns(), &b.time_stamp);
+        }
+        r->er->read(r->er, &b);
+        r->reads++;
+
+        if (!r->checked) {
+            continue;
+        }
+        for (i = 0; i < frames; i++) {
+            int16_t left = buf[2 * i];
+            int16_t right = buf[2 * i + 1];
+            if (left == 0 && right == 0) {
+                r->silent++;
+                continue;
+            }
+            if (right != (int16_t) ~left) {
+                r->torn++;
+            } else if (prev != 0 && left != (prev == 32767 ? 1 : prev + 1)) {
+                r->jumps++;
+            }
+            prev = left;
+        }
+    }
+    r->er->read(r->er, NULL);
+    free(buf);
+    return NULL;
+}
+
+// the write() time under which fraction of them fall, in microseconds
+static unsigned percentile(const struct run *r, double fraction)
+{
+    unsigned long long want = (unsigned long long) (r->writes * fraction);
+    unsigned long long seen = 0;
+    unsigned us;
+    for (us = 0; us < MAX_US; us++) {
+        seen += r->hist[us];
+        if (seen > want) {
+            break;
+        }
+    }
+    return us + 1;
+}
+
+static int run(uint32_t wr_rate, uint32_t rd_rate, uint32_t rd_channels, int paced,
+               int seconds)
+{
+    struct run *r = calloc(1, sizeof(*r));
+    pthread_t wr, rd;
+    int errors = 0;
+
+    if (create_echo_reference(AUDIO_FORMAT_PCM_16_BIT, rd_channels, rd_rate,
+                              AUDIO_FORMAT_PCM_16_BIT, 2, wr_rate, &r->er) != 0) {
+        fprintf(stderr, "cannot create echo reference %u -> %u\n", wr_rate, rd_rate);
+        free(r);
+        return 1;
+    }
+    r->wr_rate = wr_rate;
+    r->rd_rate = rd_rate;
+    r->rd_channels = rd_channels;
+    r->paced = paced;
+    r->checked = wr_rate == rd_rate && rd_channels == 2;
+    r->end_ns = now_ns() + seconds * 1000000000LL;
+
+    pthread_create(&rd, NULL, reader, r);
+    pthread_create(&wr, NULL, writer, r);
+    pthread_join(wr, NULL);
+    pthread_join(rd, NULL);
+    release_echo_reference(r->er);
+
+    printf("%5u -> %5u %-6s %-6s %9u %8.2f %8u %8u %9.1f",
+           wr_rate, rd_rate, rd_channels == 1 ? "mono" : "stereo",
+           paced ? "paced" : "flat", r->writes,
+           r->writes ? r->total_ns / 1000.0 / r->writes : 0.0,
+           percentile(r, 0.99), percentile(r, 0.999), r->max_ns / 1000.0);
+    if (r->checked) {
+        printf("   %u torn, %u jumps, %u silent", r->torn, r->jumps, r->silent);
+        if (r->torn != 0 || (paced && r->jumps != 0)) {
+            errors++;
+        }
+    }
+    printf("\n");
+    free(r);
+    return errors;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-s seconds per run]\n", name);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = 5;
+    int errors = 0;
+    int opt, paced;
+
+    while ((opt = getopt(argc, argv, "s:")) != -1) {
+        switch (opt) {
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (seconds <= 0) {
+        usage(argv[0]);
+    }
+
+    printf("%-27s %9s %8s %8s %8s %9s\n", "write() us", "writes", "mean", "99%", "99.9%", "max");
+    for (paced = 1; paced >= 0; paced--) {
+        errors += run(48000, 48000, 2, paced, seconds);
+        errors += run(48000, 16000, 1, paced, seconds);
+    }
+
+    if (errors) {
+        fprintf(stderr, "%d runs lost or mangled frames\n", errors);
+    }
+    return errors ? 1 : 0;
+}
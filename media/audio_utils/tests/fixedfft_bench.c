@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Checks that every implementation of fixed_fft() and fixed_fft_real() this
+ * cpu can run gives exactly what the radix-2 reference does, for every size,
+ * then how far the reference is from a DFT in double precision, and times
+ * each implementation in microseconds per transform.
+ *
+ *   fixedfft_bench [-t milliseconds per size]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <audio_utils/fixedfft.h>
+
+#include "../fixedfft_impl.h"
+
+#define MAX_SIZE        1024
+#define MAX_REAL_SIZE   512
+#define CHECK_RUNS      20
+#define BATCH           16
+
+static long long now_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static uint32_t g_seed = 1;
+
+static uint32_t rand32(void)
+{
+    g_seed = g_seed * 1103515245 + 12345;
+    return (g_seed >> 16) | ((g_seed * 1103515245 + 12345) & 0xffff0000);
+}
+
+// Run 0 is full scale on both parts, where the butterflies come closest to
+// overflowing, run 1 a full scale tone, the others noise at various levels.
+static void fill(int32_t *v, int n, int run)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        int32_t re, im;
+        if (run == 0) {
+            re = (i & 1) ? 32767 : -32768;
+            im = (i & 2) ? 32767 : -32768;
+        } else if (run == 1) {
+            re = (int32_t) (32767 * cos(2 * M_PI * 3 * i / n));
+            im = (int32_t) (32767 * sin(2 * M_PI * 3 * i / n));
+        } else {
+            int shift = run % 8;
+            re = (int16_t) rand32() >> shift;
+            im = (int16_t) rand32() >> shift;
+        }
+        v[i] = (re << 16) | (im & 0xFFFF);
+    }
+}
+
+static int check(const fixed_fft_impl_t *impl, const fixed_fft_impl_t *ref)
+{
+    int32_t in[MAX_SIZE], want[MAX_SIZE], got[MAX_SIZE];
+    int errors = 0;
+    int n, run, real;
+
+    for (real = 0; real <= 1; real++) {
+        for (n = 2; n <= (real ? MAX_REAL_SIZE : MAX_SIZE); n <<= 1) {
+            for (run = 0; run < CHECK_RUNS; run++) {
+                int i;
+                fill(in, n, run);
+                memcpy(want, in, n * sizeof(int32_t));
+                memcpy(got, in, n * sizeof(int32_t));
+                if (real) {
+                    ref->fft_real(n, want);
+                    impl->fft_real(n, got);
+                } else {
+                    ref->fft(n, want);
+                    impl->fft(n, got);
+                }
+                for (i = 0; i < n && got[i] == want[i]; i++) {
+                }
+                if (i < n) {
+                    printf("%s %s n=%d run %d: point %d is %08x, not %08x\n", impl->name,
+                           real ? "fft_real" : "fft", n, run, i, got[i], want[i]);
+                    errors++;
+                    break;
+                }
+            }
+        }
+    }
+    return errors;
+}
+
+// The signal to error ratio of fixed_fft() on noise, against the DFT scaled
+// down by n as it is.
+static double snr(int n)
+{
+    int32_t v[MAX_SIZE];
+    double signal = 0, noise = 0;
+    int run, j, k;
+
+    for (run = 2; run < 6; run++) {
+        fill(v, n, run);
+        double re[MAX_SIZE], im[MAX_SIZE];
+        for (j = 0; j < n; j++) {
+            re[j] = v[j] >> 16;
+            im[j] = (int16_t) v[j];
+        }
+        fixed_fft(n, v);
+        for (k = 0; k < n; k++) {
+            double sr = 0, si = 0;
+            for (j = 0; j < n; j++) {
+                double a = -2 * M_PI * (double) j * k / n;
+                sr += re[j] * cos(a) - im[j] * sin(a);
+                si += re[j] * sin(a) + im[j] * cos(a);
+            }
+            sr /= n;
+            si /= n;
+            double er = (v[k] >> 16) - sr;
+            double ei = (int16_t) v[k] - si;
+            signal += sr * sr + si * si;
+            noise += er * er + ei * ei;
+        }
+    }
+    return 10 * log10(signal / noise);
+}
+
+// Microseconds per transform of n points, transforming the same frames over
+// and over for about ms milliseconds.
+static double time_fft(void (*fft)(int, int32_t *), int n, int32_t *frames, int ms)
+{
+    long long start = now_us(), end = start + ms * 1000LL, t;
+    long long count = 0;
+    int i;
+
+    do {
+        for (i = 0; i < BATCH; i++) {
+            fft(n, frames + i * n);
+        }
+        count += BATCH;
+    } while ((t = now_us()) < end);
+    return (double) (t - start) / count;
+}
+
+static double time_batch(void (*batch)(int, int32_t *, size_t), int n, int32_t *frames, int ms)
+{
+    long long start = now_us(), end = start + ms * 1000LL, t;
+    long long count = 0;
+
+    do {
+        batch(n, frames, BATCH);
+        count += BATCH;
+    } while ((t = now_us()) < end);
+    return (double) (t - start) / count;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-t milliseconds per size]\n", name);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const fixed_fft_impl_t *impls[FIXED_FFT_MAX_IMPLS];
+    int32_t *frames = malloc(BATCH * MAX_SIZE * sizeof(int32_t));
+    int ms = 200;
+    int errors = 0;
+    int count, opt, i, n, real;
+
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        switch (opt) {
+        case 't':
+            ms = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (ms <= 0) {
+        usage(argv[0]);
+    }
+
+    count = fixed_fft_impls(impls, FIXED_FFT_MAX_IMPLS);
+    for (i = 0; i < count - 1; i++) {
+        errors += check(impls[i], impls[count - 1]);
+    }
+    printf("%d implementations checked against %s: %s\n", count - 1, impls[count - 1]->name,
+           errors ? "MISMATCH" : "bit exact");
+
+    printf("\n%-6s %8s\n", "n", "SNR dB");
+    for (n = 16; n <= MAX_SIZE; n <<= 1) {
+        printf("%-6d %8.1f\n", n, snr(n));
+    }
+
+    for (i = 0; i < BATCH * MAX_SIZE; i++) {
+        frames[i] = rand32();
+    }
+    for (real = 0; real <= 1; real++) {
+        printf("\n%-14s", real ? "fft_real us" : "fft us");
+        for (i = 0; i < count; i++) {
+            printf(" %8s", impls[i]->name);
+        }
+        printf(" %8s\n", "batch");
+        for (n = 64; n <= (real ? MAX_REAL_SIZE : MAX_SIZE); n <<= 1) {
+            printf("%-14d", n);
+            for (i = 0; i < count; i++) {
+                printf(" %8.2f", time_fft(real ? impls[i]->fft_real : impls[i]->fft,
+                                          n, frames, ms));
+            }
+            fixed_fft_use_impl(NULL);
+            printf(" %8.2f\n", time_batch(real ? fixed_fft_real_batch : fixed_fft_batch,
+                                          n, frames, ms));
+        }
+    }
+
+    free(frames);
+    return errors ? 1 : 0;
+}
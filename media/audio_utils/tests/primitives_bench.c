@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Checks that every implementation of the primitives this cpu can run gives
+ * exactly the samples the portable one does, for every length up to a few
+ * vectors, from unaligned buffers and in place where that is allowed. Then
+ * times each primitive with each implementation, in Msamples/s.
+ *
+ *   primitives_bench [-n samples] [-t milliseconds per primitive]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <audio_utils/primitives.h>
+
+#include "../primitives_impl.h"
+
+#define CHECK_LEN   67
+#define MAX_OFFSET  3
+
+static long long now_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+// Inputs, shared by all the primitives. Each takes up to 8 input samples per
+// output sample (a frame of 8 channels), and writes at most 2 (the stereo
+// upmix) of at most 4 bytes.
+static int32_t *in_i32;
+static int16_t *in_i16;
+static uint8_t *in_u8;
+static float *in_float;
+
+static uint32_t g_seed = 1;
+
+static uint32_t rand32(void)
+{
+    g_seed = g_seed * 1103515245 + 12345;
+    return (g_seed >> 16) | ((g_seed * 1103515245 + 12345) & 0xffff0000);
+}
+
+static void fill_inputs(size_t len)
+{
+    size_t i;
+    in_i32 = malloc(len * sizeof(int32_t));
+    in_i16 = malloc(len * sizeof(int16_t));
+    in_u8 = malloc(len);
+    in_float = malloc(len * sizeof(float));
+    for (i = 0; i < len; i++) {
+        uint32_t r = rand32();
+        // ditherAndClamp sums, some of them well outside Q19.12 range
+        in_i32[i] = (i % 5 == 0) ? (int32_t) r : ((int32_t) r >> 3);
+        in_i16[i] = (i % 11 == 0) ? ((r & 1) ? 32767 : -32768) : (int16_t) r;
+        in_u8[i] = (uint8_t) r;
+        switch (i % 6) {
+        case 0:
+            // halfway between two 16-bit samples, to see how ties round
+            in_float[i] = ((int16_t) r + 0.5f) / 32768.0f;
+            break;
+        case 1:
+            // out of range
+            in_float[i] = (r & 1) ? 1.5f : -1.25f;
+            break;
+        case 2:
+            in_float[i] = (r & 1) ? 1.0f : -1.0f;
+            break;
+        default:
+            in_float[i] = ((int32_t) r) / 2147483648.0f * 1.1f;
+            break;
+        }
+    }
+}
+
+// Each primitive is run over count output samples, into out, with its
+// inputs offset by a few samples so the vector code can't count on alignment.
+typedef struct {
+    const char *name;
+    size_t out_size;            // bytes written per output sample
+    void (*run)(void *out, size_t offset, size_t count);
+} primitive_t;
+
+static void run_dither(void *out, size_t o, size_t count)
+{
+    ditherAndClamp((int32_t *) out, in_i32 + o, count);
+}
+
+static void run_u8(void *out, size_t o, size_t count)
+{
+    memcpy_to_i16_from_u8((int16_t *) out, in_u8 + o, count);
+}
+
+static void run_downmix(void *out, size_t o, size_t count)
+{
+    downmix_to_mono_i16_from_stereo_i16((int16_t *) out, in_i16 + o, count);
+}
+
+static void run_upmix(void *out, size_t o, size_t count)
+{
+    upmix_to_stereo_i16_from_mono_i16((int16_t *) out, in_i16 + o, count / 2);
+}
+
+static void run_multi4(void *out, size_t o, size_t count)
+{
+    downmix_to_mono_i16_from_multi_i16((int16_t *) out, in_i16 + o, 4, count);
+}
+
+static void run_multi6(void *out, size_t o, size_t count)
+{
+    downmix_to_mono_i16_from_multi_i16((int16_t *) out, in_i16 + o, 6, count);
+}
+
+static void run_multi8(void *out, size_t o, size_t count)
+{
+    downmix_to_mono_i16_from_multi_i16((int16_t *) out, in_i16 + o, 8, count);
+}
+
+static void run_float_from_i16(void *out, size_t o, size_t count)
+{
+    memcpy_to_float_from_i16((float *) out, in_i16 + o, count);
+}
+
+static void run_i16_from_float(void *out, size_t o, size_t count)
+{
+    memcpy_to_i16_from_float((int16_t *) out, in_float + o, count);
+}
+
+static void run_float_from_i32(void *out, size_t o, size_t count)
+{
+    memcpy_to_float_from_i32((float *) out, in_i32 + o, count);
+}
+
+static void run_i32_from_float(void *out, size_t o, size_t count)
+{
+    memcpy_to_i32_from_float((int32_t *) out, in_float + o, count);
+}
+
+static void run_mix_i16(void *out, size_t o, size_t count)
+{
+    mix_to_i32_from_i16((int32_t *) out, in_i16 + o, count, 0x0c00);
+}
+
+static void run_mix_stereo_i16(void *out, size_t o, size_t count)
+{
+    mix_to_i32_from_stereo_i16((int32_t *) out, in_i16 + o, count / 2, 0x1000, -0x7fff);
+}
+
+static void run_mix_float(void *out, size_t o, size_t count)
+{
+    mix_to_float_from_float((float *) out, in_float + o, count, 0.71f);
+}
+
+static const primitive_t g_primitives[] = {
+    { "ditherAndClamp",     4, run_dither },
+    { "i16_from_u8",        2, run_u8 },
+    { "mono_from_stereo",   2, run_downmix },
+    { "stereo_from_mono",   2, run_upmix },
+    { "mono_from_4ch",      2, run_multi4 },
+    { "mono_from_6ch",      2, run_multi6 },
+    { "mono_from_8ch",      2, run_multi8 },
+    { "float_from_i16",     4, run_float_from_i16 },
+    { "i16_from_float",     2, run_i16_from_float },
+    { "float_from_i32",     4, run_float_from_i32 },
+    { "i32_from_float",     4, run_i32_from_float },
+    { "mix_i32_from_i16",   4, run_mix_i16 },
+    { "mix_i32_stereo",     4, run_mix_stereo_i16 },
+    { "mix_float",          4, run_mix_float },
+};
+
+#define NUM_PRIMITIVES (sizeof(g_primitives) / sizeof(g_primitives[0]))
+
+// What the mixes add to: normal floats, which are as good as any int32_t.
+static void reset_output(void *out, size_t size)
+{
+    float *f = (float *) out;
+    size_t i;
+    for (i = 0; i < size / sizeof(float); i++) {
+        f[i] = (float)(int)(i * 2654435761u % 2001 - 1000) / 1024.0f;
+    }
+}
+
+static int check(const audio_primitives_impl_t *impl, const audio_primitives_impl_t *portable)
+{
+    // room for the three in place conversions too
+    const size_t size = (CHECK_LEN + MAX_OFFSET) * sizeof(float) * 3;
+    char *expected = malloc(size);
+    char *actual = malloc(size);
+    int errors = 0;
+    size_t p, count, o;
+
+    for (p = 0; p < NUM_PRIMITIVES; p++) {
+        const primitive_t *prim = &g_primitives[p];
+        for (count = 0; count <= CHECK_LEN; count++) {
+            for (o = 0; o <= MAX_OFFSET; o++) {
+                // the output is as misaligned as the input
+                const size_t skip = o * prim->out_size;
+                reset_output(expected, size);
+                reset_output(actual, size);
+                audio_primitives_use_impl(portable);
+                prim->run(expected + skip, o, count);
+                audio_primitives_use_impl(impl);
+                prim->run(actual + skip, o, count);
+                if (memcmp(expected, actual, size)) {
+                    size_t i = 0;
+                    while (expected[i] == actual[i]) i++;
+                    fprintf(stderr, "%s: %s of %u samples at offset %u differs at byte %u\n",
+                            impl->name, prim->name, (unsigned) count, (unsigned) o,
+                            (unsigned) (i - skip));
+                    errors++;
+                    break;
+                }
+            }
+            if (o <= MAX_OFFSET) {
+                break;
+            }
+        }
+    }
+
+    // in place, which the widening copies do from the end
+    for (count = 0; count <= CHECK_LEN; count++) {
+        const size_t bytes = count * sizeof(float);
+        audio_primitives_use_impl(portable);
+        memcpy_to_i16_from_u8((int16_t *) expected, in_u8, count);
+        memcpy_to_float_from_i16((float *) (expected + bytes), in_i16, count);
+        memcpy_to_i16_from_float((int16_t *) (expected + 2 * bytes), in_float, count);
+        audio_primitives_use_impl(impl);
+        memcpy(actual, in_u8, count);
+        memcpy_to_i16_from_u8((int16_t *) actual, (uint8_t *) actual, count);
+        memcpy(actual + bytes, in_i16, count * sizeof(int16_t));
+        memcpy_to_float_from_i16((float *) (actual + bytes), (int16_t *) (actual + bytes),
+                count);
+        memcpy(actual + 2 * bytes, in_float, bytes);
+        memcpy_to_i16_from_float((int16_t *) (actual + 2 * bytes), (float *) (actual + 2 * bytes),
+                count);
+        if (memcmp(expected, actual, count * 2) ||
+            memcmp(expected + bytes, actual + bytes, bytes) ||
+            memcmp(expected + 2 * bytes, actual + 2 * bytes, count * 2)) {
+            fprintf(stderr, "%s: in place conversions of %u samples differ\n",
+                    impl->name, (unsigned) count);
+            errors++;
+            break;
+        }
+    }
+
+    free(expected);
+    free(actual);
+    return errors;
+}
+
+static double time_primitive(const primitive_t *prim, void *out, size_t count, long long budget)
+{
+    long long start = now_us();
+    long long t;
+    size_t runs = 0;
+    do {
+        int i;
+        for (i = 0; i < 16; i++) {
+            prim->run(out, 0, count);
+        }
+        runs += 16;
+        t = now_us() - start;
+    } while (t < budget);
+    return (double) count * runs / t;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-n samples] [-t milliseconds per primitive]\n", name);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const audio_primitives_impl_t *impls[PRIMITIVES_MAX_IMPLS];
+    const audio_primitives_impl_t *portable;
+    size_t samples = 4096;
+    long long budget = 200000;
+    int count, i, opt;
+    int errors = 0;
+    size_t p;
+    void *out;
+
+    while ((opt = getopt(argc, argv, "n:t:")) != -1) {
+        switch (opt) {
+        case 'n':
+            samples = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            budget = atoi(optarg) * 1000LL;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (samples < 2 || budget <= 0) {
+        usage(argv[0]);
+    }
+    samples &= ~(size_t) 1;
+
+    fill_inputs(samples * 8 + CHECK_LEN * 8 + MAX_OFFSET + 16);
+    count = audio_primitives_impls(impls, PRIMITIVES_MAX_IMPLS);
+    portable = impls[count - 1];
+
+    for (i = 0; i < count - 1; i++) {
+        errors += check(impls[i], portable);
+    }
+    if (errors) {
+        fprintf(stderr, "%d primitives differ from the portable ones\n", errors);
+    }
+
+    out = malloc(samples * 4);
+    printf("%-18s", "Msamples/s");
+    for (i = 0; i < count; i++) {
+        printf(" %10s", impls[i]->name);
+    }
+    printf("\n");
+    for (p = 0; p < NUM_PRIMITIVES; p++) {
+        printf("%-18s", g_primitives[p].name);
+        for (i = 0; i < count; i++) {
+            audio_primitives_use_impl(impls[i]);
+            // the mixes would run into infinities if they added up forever
+            reset_output(out, samples * 4);
+            printf(" %10.1f", time_primitive(&g_primitives[p], out, samples, budget));
+        }
+        printf("\n");
+    }
+    free(out);
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,405 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Compares speex with the built-in resampler, int16 and float, for the usual
+ * rate pairs: cpu time per second of audio and THD+N of a 1 kHz sine at
+ * -1 dBFS. Checks first that the built-in one gives the same samples however
+ * its input is split, whether it is passed in, copied from a buffer provider
+ * or read in place from it.
+ *
+ *   resampler_bench [-q quality] [-s seconds of audio timed]
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <audio_utils/resampler.h>
+
+#define TONE_HZ     1000.0
+#define TONE_AMP    0.891250938     // -1 dBFS
+
+static const struct {
+    uint32_t in;
+    uint32_t out;
+} g_rates[] = {
+    { 44100, 48000 },
+    { 48000, 44100 },
+    { 8000, 48000 },
+    { 16000, 48000 },
+    { 48000, 16000 },
+    { 48000, 8000 },
+};
+
+#define NUM_RATES (sizeof(g_rates) / sizeof(g_rates[0]))
+
+static const struct {
+    const char *name;
+    uint32_t flags;
+} g_engines[] = {
+    { "speex", 0 },
+    { "native", RESAMPLER_FLAG_POLYPHASE },
+    { "float", RESAMPLER_FLAG_POLYPHASE | RESAMPLER_FLAG_FLOAT },
+};
+
+#define NUM_ENGINES (sizeof(g_engines) / sizeof(g_engines[0]))
+
+static long long cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// frames of the tone, as int16 and float, interleaved
+static void make_tone(uint32_t rate, uint32_t channels, size_t frames,
+                      int16_t *i16, float *f)
+{
+    size_t i;
+    uint32_t c;
+    for (i = 0; i < frames; i++) {
+        double s = TONE_AMP * sin(2 * M_PI * TONE_HZ * i / rate);
+        for (c = 0; c < channels; c++) {
+            // the second channel in antiphase, so it can't pass for a copy of the first
+            double v = (c & 1) ? -s : s;
+            f[i * channels + c] = (float) v;
+            i16[i * channels + c] = (int16_t) lrint(v * 32767);
+        }
+    }
+}
+
+// Resamples in through from_input, in blocks of in_block frames into at most
+// out_block frames at a time, as long as it makes progress. Returns the frames written.
+static size_t run_input(struct resampler_itfe *r, int is_float, uint32_t channels,
+                        const void *in, size_t in_frames, size_t in_block,
+                        void *out, size_t out_frames, size_t out_block)
+{
+    const size_t fs = channels * (is_float ? sizeof(float) : sizeof(int16_t));
+    size_t done_in = 0;
+    size_t done_out = 0;
+
+    while (done_in < in_frames && done_out < out_frames) {
+        size_t n_in = in_frames - done_in;
+        size_t n_out = out_frames - done_out;
+        if (n_in > in_block) n_in = in_block;
+        if (n_out > out_block) n_out = out_block;
+        if (is_float) {
+            r->resample_from_input_float(r, (float *) ((char *) in + done_in * fs), &n_in,
+                                         (float *) ((char *) out + done_out * fs), &n_out);
+        } else {
+            r->resample_from_input(r, (int16_t *) ((char *) in + done_in * fs), &n_in,
+                                   (int16_t *) ((char *) out + done_out * fs), &n_out);
+        }
+        if (n_in == 0 && n_out == 0) {
+            break;
+        }
+        done_in += n_in;
+        done_out += n_out;
+    }
+    return done_out;
+}
+
+// Hands out a buffer in chunks of at most chunk frames, and takes back any
+// number of them.
+struct test_provider {
+    struct resampler_buffer_provider itfe;
+    const char *buf;
+    size_t frame_size;
+    size_t frames;
+    size_t pos;
+    size_t chunk;
+};
+
+static int test_get_next_buffer(struct resampler_buffer_provider *provider,
+                                struct resampler_buffer *buffer)
+{
+    struct test_provider *p = (struct test_provider *) provider;
+    size_t n = p->frames - p->pos;
+    if (n > buffer->frame_count) n = buffer->frame_count;
+    if (n > p->chunk) n = p->chunk;
+    if (n == 0) {
+        buffer->raw = NULL;
+        buffer->frame_count = 0;
+        return -ENODATA;
+    }
+    buffer->raw = (void *) (p->buf + p->pos * p->frame_size);
+    buffer->frame_count = n;
+    return 0;
+}
+
+static void test_release_buffer(struct resampler_buffer_provider *provider,
+                                struct resampler_buffer *buffer)
+{
+    struct test_provider *p = (struct test_provider *) provider;
+    p->pos += buffer->frame_count;
+}
+
+static size_t run_provider(uint32_t in_rate, uint32_t out_rate, uint32_t channels,
+                           uint32_t quality, uint32_t flags, const void *in, size_t in_frames,
+                           size_t chunk, void *out, size_t out_frames, size_t out_block)
+{
+    const int is_float = (flags & RESAMPLER_FLAG_FLOAT) != 0;
+    const size_t fs = channels * (is_float ? sizeof(float) : sizeof(int16_t));
+    struct test_provider p;
+    struct resampler_itfe *r;
+    size_t done = 0;
+
+    p.itfe.get_next_buffer = test_get_next_buffer;
+    p.itfe.release_buffer = test_release_buffer;
+    p.buf = (const char *) in;
+    p.frame_size = fs;
+    p.frames = in_frames;
+    p.pos = 0;
+    p.chunk = chunk;
+    if (create_resampler_ex(in_rate, out_rate, channels, quality, flags, &p.itfe, &r) != 0) {
+        return 0;
+    }
+    while (done < out_frames) {
+        size_t n = out_frames - done;
+        if (n > out_block) n = out_block;
+        if (is_float) {
+            r->resample_from_provider_float(r, (float *) ((char *) out + done * fs), &n);
+        } else {
+            r->resample_from_provider(r, (int16_t *) ((char *) out + done * fs), &n);
+        }
+        if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+    release_resampler(r);
+    return done;
+}
+
+// The same samples from every way of feeding the built-in resampler. The
+// reference is one call to from_input with all of the input.
+static int check(uint32_t in_rate, uint32_t out_rate, uint32_t channels, uint32_t quality,
+                 uint32_t flags, const void *in, size_t in_frames)
+{
+    static const size_t blocks[] = { 1, 7, 160, 441 };
+    const int is_float = (flags & RESAMPLER_FLAG_FLOAT) != 0;
+    const size_t fs = channels * (is_float ? sizeof(float) : sizeof(int16_t));
+    const size_t out_frames = (size_t) ((uint64_t) in_frames * out_rate / in_rate) + 1;
+    void *expected = calloc(out_frames, fs);
+    void *actual = malloc(out_frames * fs);
+    struct resampler_itfe *r;
+    size_t n_expected, n, i;
+    int errors = 0;
+
+    create_resampler_ex(in_rate, out_rate, channels, quality, flags, NULL, &r);
+    n_expected = run_input(r, is_float, channels, in, in_frames, in_frames,
+                           expected, out_frames, out_frames);
+    release_resampler(r);
+
+    for (i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++) {
+        const size_t out_block = blocks[i] + 5;
+        const char *how;
+        memset(actual, 0, out_frames * fs);
+
+        create_resampler_ex(in_rate, out_rate, channels, quality, flags, NULL, &r);
+        n = run_input(r, is_float, channels, in, in_frames, blocks[i],
+                      actual, out_frames, blocks[i] + 3);
+        release_resampler(r);
+        how = "from_input";
+        if (n != n_expected || memcmp(expected, actual, n * fs)) {
+            goto differs;
+        }
+
+        // the provider runs dry with up to a call's worth of frames still to come
+        n = run_provider(in_rate, out_rate, channels, quality, flags, in, in_frames,
+                         blocks[i], actual, n_expected, out_block);
+        how = "from_provider";
+        if (n > n_expected || n + out_block + 1 < n_expected ||
+                memcmp(expected, actual, n * fs)) {
+            goto differs;
+        }
+
+        n = run_provider(in_rate, out_rate, channels, quality, flags | RESAMPLER_FLAG_IN_PLACE,
+                         in, in_frames, blocks[i], actual, n_expected, out_block);
+        how = "in place";
+        if (n > n_expected || n + out_block + 1 < n_expected ||
+                memcmp(expected, actual, n * fs)) {
+            goto differs;
+        }
+        continue;
+differs:
+        fprintf(stderr, "%u -> %u %uch%s: %s in blocks of %u differs\n",
+                in_rate, out_rate, channels, is_float ? " float" : "", how,
+                (unsigned) blocks[i]);
+        errors++;
+    }
+
+    free(expected);
+    free(actual);
+    return errors;
+}
+
+// THD+N in dB of the first channel of out: what is left once the best fitting
+// 1 kHz sine and DC are taken away, against that sine. The frames the filter
+// takes to settle are skipped.
+static double thd_n(const void *out, int is_float, uint32_t channels, uint32_t rate,
+                    size_t skip, size_t frames)
+{
+    const double w = 2 * M_PI * TONE_HZ / rate;
+    double m[3][4];
+    double a, b, c, signal = 0, noise = 0;
+    size_t i;
+    int row, col, k;
+
+    // least squares through the normal equations, for sin, cos and 1
+    memset(m, 0, sizeof(m));
+    for (i = skip; i < frames; i++) {
+        double basis[3] = { sin(w * i), cos(w * i), 1.0 };
+        double y = is_float ? ((const float *) out)[i * channels] :
+                ((const int16_t *) out)[i * channels] / 32767.0;
+        for (row = 0; row < 3; row++) {
+            for (col = 0; col < 3; col++) {
+                m[row][col] += basis[row] * basis[col];
+            }
+            m[row][3] += basis[row] * y;
+        }
+    }
+    for (k = 0; k < 3; k++) {
+        for (row = k + 1; row < 3; row++) {
+            double f = m[row][k] / m[k][k];
+            for (col = k; col < 4; col++) {
+                m[row][col] -= f * m[k][col];
+            }
+        }
+    }
+    c = m[2][3] / m[2][2];
+    b = (m[1][3] - m[1][2] * c) / m[1][1];
+    a = (m[0][3] - m[0][1] * b - m[0][2] * c) / m[0][0];
+
+    for (i = skip; i < frames; i++) {
+        double y = is_float ? ((const float *) out)[i * channels] :
+                ((const int16_t *) out)[i * channels] / 32767.0;
+        double fit = a * sin(w * i) + b * cos(w * i);
+        signal += fit * fit;
+        noise += (y - fit - c) * (y - fit - c);
+    }
+    return 10 * log10(noise / signal);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-q quality] [-s seconds of audio timed]\n", name);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t quality = RESAMPLER_QUALITY_DEFAULT;
+    int seconds = 10;
+    int errors = 0;
+    int opt;
+    size_t p, e;
+    uint32_t channels;
+
+    while ((opt = getopt(argc, argv, "q:s:")) != -1) {
+        switch (opt) {
+        case 'q':
+            quality = atoi(optarg);
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (quality <= RESAMPLER_QUALITY_MIN || quality >= RESAMPLER_QUALITY_MAX || seconds <= 0) {
+        usage(argv[0]);
+    }
+
+    printf("quality %u, cpu ms per second of audio / THD+N dB\n", quality);
+    printf("%-14s", "");
+    for (e = 0; e < NUM_ENGINES; e++) {
+        for (channels = 1; channels <= 2; channels++) {
+            char name[32];
+            snprintf(name, sizeof(name), "%s %s", g_engines[e].name,
+                     channels == 1 ? "mono" : "stereo");
+            printf(" %17s", name);
+        }
+    }
+    printf("\n");
+
+    for (p = 0; p < NUM_RATES; p++) {
+        const uint32_t in_rate = g_rates[p].in;
+        const uint32_t out_rate = g_rates[p].out;
+        // one second of the tone, fed over and over for timing
+        const size_t in_frames = in_rate;
+        const size_t out_frames = (size_t) out_rate + 16;
+        int16_t *in_i16 = malloc(in_frames * 2 * sizeof(int16_t));
+        float *in_f = malloc(in_frames * 2 * sizeof(float));
+        void *out = malloc(out_frames * 2 * sizeof(float));
+
+        printf("%5u -> %5u ", in_rate, out_rate);
+        for (e = 0; e < NUM_ENGINES; e++) {
+            const int is_float = (g_engines[e].flags & RESAMPLER_FLAG_FLOAT) != 0;
+            for (channels = 1; channels <= 2; channels++) {
+                const void *in = is_float ? (const void *) in_f : (const void *) in_i16;
+                struct resampler_itfe *r;
+                long long start;
+                size_t n;
+                double ms, thd;
+                int s;
+
+                make_tone(in_rate, channels, in_frames, in_i16, in_f);
+                if (create_resampler_ex(in_rate, out_rate, channels, quality,
+                                        g_engines[e].flags, NULL, &r) != 0) {
+                    printf(" %17s", "-");
+                    continue;
+                }
+                if (g_engines[e].flags & RESAMPLER_FLAG_POLYPHASE) {
+                    errors += check(in_rate, out_rate, channels, quality, g_engines[e].flags,
+                                    in, in_frames / 4);
+                }
+
+                // 10 ms blocks, as the audio HALs give them
+                n = run_input(r, is_float, channels, in, in_frames, in_rate / 100,
+                              out, out_frames, out_frames);
+                thd = thd_n(out, is_float, channels, out_rate,
+                            (size_t) (r->delay_ns(r) * (double) out_rate / 1e9) +
+                                    out_rate / 100, n);
+
+                start = cpu_ns();
+                for (s = 0; s < seconds; s++) {
+                    run_input(r, is_float, channels, in, in_frames, in_rate / 100,
+                              out, out_frames, out_frames);
+                }
+                ms = (cpu_ns() - start) / 1e6 / seconds;
+                release_resampler(r);
+
+                printf(" %7.3f / %7.1f", ms, thd);
+            }
+        }
+        printf("\n");
+
+        free(in_i16);
+        free(in_f);
+        free(out);
+    }
+
+    if (errors) {
+        fprintf(stderr, "%d checks failed\n", errors);
+    }
+    return errors ? 1 : 0;
+}
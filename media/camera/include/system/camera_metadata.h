@@ -256,7 +256,8 @@ camera_metadata_t *copy_camera_metadata(void *dst, size_t dst_size,
  * Append camera metadata in src to an existing metadata structure in dst.  This
  * does not resize the destination structure, so if it is too small, a non-zero
  * value is returned. On success, 0 is returned. Appending onto a sorted
- * structure results in a non-sorted combined structure.
+ * structure results in a non-sorted combined structure, unless src is sorted
+ * too and its first tag is no lower than the last tag in dst.
  */
 ANDROID_API
 int append_camera_metadata(camera_metadata_t *dst, const camera_metadata_t *src);
@@ -287,8 +288,10 @@ size_t calculate_camera_metadata_entry_data_size(uint8_t type,
  * entries in the data array of the tag's type, not a count of
  * bytes. Vendor-defined tags can not be added using this method, unless
  * set_vendor_tag_query_ops() has been called first. Entries are always added to
- * the end of the structure (highest index), so after addition, a
- * previously-sorted array will be marked as unsorted.
+ * the end of the structure (highest index). A sorted array stays sorted if the
+ * new tag is no lower than the last one, so adding entries in tag order keeps
+ * searches fast without sorting again; otherwise the array will be marked as
+ * unsorted. A newly allocated or placed array is sorted.
  */
 ANDROID_API
 int add_camera_metadata_entry(camera_metadata_t *dst,
@@ -298,8 +301,10 @@ int add_camera_metadata_entry(camera_metadata_t *dst,
 
 /**
  * Sort the metadata buffer for fast searching. If already marked as sorted,
- * does nothing. Adding or appending entries to the buffer will place the buffer
- * back into an unsorted state.
+ * does nothing. Adding or appending entries out of tag order will place the
+ * buffer back into an unsorted state. If only a few entries at the end are out
+ * of order, they are moved into place without sorting the rest; entries with
+ * the same tag then keep the order they were added in.
  */
 ANDROID_API
 int sort_camera_metadata(camera_metadata_t *dst);
@@ -350,10 +355,13 @@ int delete_camera_metadata_entry(camera_metadata_t *dst,
 /**
  * Updates a metadata entry with new data. If the data size is changing, may
  * need to adjust the data array, making this an O(N) operation. If the data
- * size is the same or still fits in the entry space, this is O(1). Maintains
- * sorting, but invalidates camera_metadata_entry instances that point to the
- * updated entry. If a non-NULL value is passed in to entry, the entry structure
- * is updated to match the new buffer state.  Returns a non-zero value if there
+ * size is the same or still fits in the entry space, this is O(1). It is O(1)
+ * too when the entry's data is the last in the buffer, which it is after any
+ * change in size, so an entry whose size changes often is cheap to update
+ * after the first time. Maintains sorting, but invalidates
+ * camera_metadata_entry instances that point to the updated entry. If a
+ * non-NULL value is passed in to entry, the entry structure is updated to match
+ * the new buffer state.  Returns a non-zero value if there
  * is no room for the new data in the buffer.
  */
 ANDROID_API
@@ -378,6 +386,107 @@ int set_camera_metadata_user_pointer(camera_metadata_t *dst, void* user);
 ANDROID_API
 int get_camera_metadata_user_pointer(camera_metadata_t *dst, void** user);
 
+/**
+ * Buffer pools and deltas for per-frame metadata
+ * =============================================================================
+ */
+
+/**
+ * A pool of metadata buffers of the same capacities, for metadata such as
+ * capture results that is built and thrown away once per frame. The buffers
+ * are allocated once, together; acquiring one places an empty structure in
+ * it, and releasing it makes it available again. The pool can be used from
+ * several threads at once.
+ */
+struct camera_metadata_pool;
+typedef struct camera_metadata_pool camera_metadata_pool_t;
+
+/**
+ * Allocate a pool of buffer_count metadata buffers, each with room for
+ * entry_capacity entries and data_capacity bytes of data. Returns NULL if
+ * buffer_count or entry_capacity is 0, or if out of memory.
+ */
+ANDROID_API
+camera_metadata_pool_t *allocate_camera_metadata_pool(size_t buffer_count,
+        size_t entry_capacity,
+        size_t data_capacity);
+
+/**
+ * Free a pool. Every buffer acquired from it should have been released first.
+ * Using or releasing a pool buffer that is still acquired when the pool is
+ * freed is undefined; such buffers are logged as an error. Structures that
+ * were allocated because the pool was empty stay valid and can be freed with
+ * free_camera_metadata().
+ */
+ANDROID_API
+void free_camera_metadata_pool(camera_metadata_pool_t *pool);
+
+/**
+ * Get an empty metadata structure with the capacities of the pool. If all the
+ * pool's buffers are in use, allocates a new one with
+ * allocate_camera_metadata(). Returns NULL if that fails. Give the structure
+ * back with release_camera_metadata(); do not call free_camera_metadata() on
+ * it.
+ */
+ANDROID_API
+camera_metadata_t *acquire_camera_metadata(camera_metadata_pool_t *pool);
+
+/**
+ * Give back a structure from acquire_camera_metadata(), making its buffer
+ * available to acquire again, or freeing it if the pool was empty when it was
+ * acquired. Does nothing if metadata is NULL. Releasing a buffer that is
+ * already free, or a pointer into the pool that is not the start of one of
+ * its buffers, logs an error and does nothing.
+ */
+ANDROID_API
+void release_camera_metadata(camera_metadata_pool_t *pool,
+        camera_metadata_t *metadata);
+
+/**
+ * A delta is a metadata structure holding what changed from a base structure
+ * to a later one: the entries whose type, count, or values changed or that are
+ * new, plus an entry with a count of 0 for each tag that went away. When most
+ * tags keep their values from frame to frame, it is much smaller than the
+ * structure itself, and can be copied and sent the same ways.
+ *
+ * The base and later structures must be sorted, and each tag can appear at most
+ * once in them. Since a count of 0 marks a removed tag, entries with no values
+ * do not make it through a delta.
+ */
+
+/**
+ * Calculate the entry_count and data_count a delta between base and src needs,
+ * for allocating or checking the structure to hold it. Returns 0 on success, or
+ * a non-zero value if base or src is not sorted or has a tag more than once.
+ */
+ANDROID_API
+int calculate_camera_metadata_delta_size(const camera_metadata_t *base,
+        const camera_metadata_t *src,
+        size_t *entry_count,
+        size_t *data_count);
+
+/**
+ * Fill delta with the changes from base to src, replacing any entries it held.
+ * The delta is sorted. Returns 0 on success, or a non-zero value if base or src
+ * is not sorted or has a tag more than once, or if there is not enough room in
+ * delta.
+ */
+ANDROID_API
+int compute_camera_metadata_delta(camera_metadata_t *delta,
+        const camera_metadata_t *base,
+        const camera_metadata_t *src);
+
+/**
+ * Apply delta to dst, which holds the base it was computed from, turning dst
+ * into the structure the delta was computed for. Entries whose size does not
+ * change are updated in place. dst is sorted afterwards. Returns 0 on success,
+ * or a non-zero value if dst or delta is not sorted, a tag changes type, or
+ * dst runs out of room; dst may then be partly updated.
+ */
+ANDROID_API
+int apply_camera_metadata_delta(camera_metadata_t *dst,
+        const camera_metadata_t *delta);
+
 /**
  * Retrieve human-readable name of section the tag is in. Returns NULL if
  * no such tag is defined. Returns NULL for tags in the vendor section, unless
@@ -16,6 +16,7 @@
 #define _GNU_SOURCE // for fdprintf
 #include <system/camera_metadata.h>
 #include <cutils/log.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -94,6 +95,12 @@ struct camera_metadata {
 /** Flag definitions */
 #define FLAG_SORTED 0x00000001
 
+/**
+ * With up to this many entries out of order at the end, sort_camera_metadata()
+ * inserts them one by one into place instead of sorting everything again.
+ */
+#define SORT_INSERT_MAX 16
+
 /** Tag information */
 
 typedef struct tag_info {
@@ -146,7 +153,8 @@ camera_metadata_t *place_camera_metadata(void *dst,
 
     camera_metadata_t *metadata = (camera_metadata_t*)dst;
     metadata->version = CURRENT_METADATA_VERSION;
-    metadata->flags = 0;
+    // An empty buffer is in order
+    metadata->flags = FLAG_SORTED;
     metadata->entry_count = 0;
     metadata->entry_capacity = entry_capacity;
     metadata->entries = (camera_metadata_buffer_entry_t*)(metadata + 1);
@@ -268,11 +276,15 @@ int append_camera_metadata(camera_metadata_t *dst,
         }
     }
     if (dst->entry_count == 0) {
-        // Appending onto empty buffer, keep sorted state
-        dst->flags |= src->flags & FLAG_SORTED;
+        // Appending onto empty buffer, take on src sorted state
+        dst->flags = (dst->flags & ~FLAG_SORTED) | (src->flags & FLAG_SORTED);
     } else if (src->entry_count != 0) {
-        // Both src, dst are nonempty, cannot assume sort remains
-        dst->flags &= ~FLAG_SORTED;
+        // Both src, dst are nonempty, sorted only if src follows on from dst
+        if (!(src->flags & FLAG_SORTED) ||
+                src->entries[0].tag <
+                dst->entries[dst->entry_count - 1].tag) {
+            dst->flags &= ~FLAG_SORTED;
+        }
     } else {
         // Src is empty, keep dst sorted state
     }
@@ -318,6 +330,7 @@ static int add_camera_metadata_entry_raw(camera_metadata_t *dst,
 
     size_t data_bytes =
             calculate_camera_metadata_entry_data_size(type, data_count);
+    if (dst->data_count + data_bytes > dst->data_capacity) return ERROR;
 
     camera_metadata_buffer_entry_t *entry = dst->entries + dst->entry_count;
     entry->tag = tag;
@@ -332,8 +345,11 @@ static int add_camera_metadata_entry_raw(camera_metadata_t *dst,
         memcpy(dst->data + entry->data.offset, data, data_bytes);
         dst->data_count += data_bytes;
     }
+    // Adding in tag order, as most callers do, keeps the buffer sorted
+    if (dst->entry_count > 0 && tag < entry[-1].tag) {
+        dst->flags &= ~FLAG_SORTED;
+    }
     dst->entry_count++;
-    dst->flags &= ~FLAG_SORTED;
     return OK;
 }
 
@@ -367,9 +383,37 @@ int sort_camera_metadata(camera_metadata_t *dst) {
     if (dst == NULL) return ERROR;
     if (dst->flags & FLAG_SORTED) return OK;
 
-    qsort(dst->entries, dst->entry_count,
-            sizeof(camera_metadata_buffer_entry_t),
-            compare_entry_tags);
+    camera_metadata_buffer_entry_t *entries = dst->entries;
+    size_t sorted = 1;
+    while (sorted < dst->entry_count &&
+            entries[sorted - 1].tag <= entries[sorted].tag) {
+        sorted++;
+    }
+
+    if (sorted < dst->entry_count &&
+            dst->entry_count - sorted > SORT_INSERT_MAX) {
+        qsort(entries, dst->entry_count,
+                sizeof(camera_metadata_buffer_entry_t),
+                compare_entry_tags);
+    } else {
+        // Only a few entries out of order at the end, typically just added;
+        // insert each after the last entry with the same or a lower tag
+        for (; sorted < dst->entry_count; sorted++) {
+            camera_metadata_buffer_entry_t moving = entries[sorted];
+            size_t low = 0, high = sorted;
+            while (low < high) {
+                size_t mid = low + (high - low) / 2;
+                if (entries[mid].tag <= moving.tag) {
+                    low = mid + 1;
+                } else {
+                    high = mid;
+                }
+            }
+            memmove(entries + low + 1, entries + low,
+                    sizeof(camera_metadata_buffer_entry_t[sorted - low]));
+            entries[low] = moving;
+        }
+    }
     dst->flags |= FLAG_SORTED;
 
     return OK;
@@ -445,7 +489,11 @@ int delete_camera_metadata_entry(camera_metadata_t *dst,
     size_t data_bytes = calculate_camera_metadata_entry_data_size(entry->type,
             entry->count);
 
-    if (data_bytes > 0) {
+    if (data_bytes > 0 &&
+            entry->data.offset + data_bytes == dst->data_count) {
+        // Data is last in the data array, nothing to shift
+        dst->data_count -= data_bytes;
+    } else if (data_bytes > 0) {
         // Shift data buffer to overwrite deleted data
         uint8_t *start = dst->data + entry->data.offset;
         uint8_t *end = start + data_bytes;
@@ -496,7 +544,13 @@ int update_camera_metadata_entry(camera_metadata_t *dst,
             // No room
             return ERROR;
         }
-        if (entry_bytes != 0) {
+        if (entry_bytes != 0 &&
+                entry->data.offset + entry_bytes == dst->data_count) {
+            // Old data is last in the data array, drop it without shifting.
+            // Since changed data goes to the end, an entry whose size keeps
+            // changing only pays for a shift the first time.
+            dst->data_count -= entry_bytes;
+        } else if (entry_bytes != 0) {
             // Remove old data
             uint8_t *start = dst->data + entry->data.offset;
             uint8_t *end = start + entry_bytes;
@@ -558,6 +612,277 @@ int get_camera_metadata_user_pointer(camera_metadata_t *dst, void** user) {
     return OK;
 }
 
+/**
+ * A pool of metadata buffers. The free list and the buffers follow the header
+ * in the same allocation.
+ */
+struct camera_metadata_pool {
+    pthread_mutex_t lock;
+    size_t          entry_capacity;
+    size_t          data_capacity;
+    size_t          buffer_size;
+    size_t          buffer_count;
+    size_t          free_count;
+    uint8_t       **free_buffers;
+    uint8_t        *buffers;
+};
+
+// Buffers in a pool start at multiples of this, for the size_t fields
+#define POOL_BUFFER_ALIGNMENT 8
+
+camera_metadata_pool_t *allocate_camera_metadata_pool(size_t buffer_count,
+        size_t entry_capacity,
+        size_t data_capacity) {
+    if (buffer_count == 0 || entry_capacity == 0) return NULL;
+
+    size_t buffer_size = calculate_camera_metadata_size(entry_capacity,
+            data_capacity);
+    buffer_size = (buffer_size + POOL_BUFFER_ALIGNMENT - 1) &
+            ~(size_t)(POOL_BUFFER_ALIGNMENT - 1);
+    size_t header_size = sizeof(camera_metadata_pool_t) +
+            sizeof(uint8_t*[buffer_count]);
+    header_size = (header_size + POOL_BUFFER_ALIGNMENT - 1) &
+            ~(size_t)(POOL_BUFFER_ALIGNMENT - 1);
+
+    camera_metadata_pool_t *pool =
+            malloc(header_size + buffer_size * buffer_count);
+    if (pool == NULL) return NULL;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->entry_capacity = entry_capacity;
+    pool->data_capacity = data_capacity;
+    pool->buffer_size = buffer_size;
+    pool->buffer_count = buffer_count;
+    pool->free_count = buffer_count;
+    pool->free_buffers = (uint8_t**)(pool + 1);
+    pool->buffers = (uint8_t*)pool + header_size;
+    size_t i;
+    for (i = 0; i < buffer_count; i++) {
+        // Hand out the first buffer first
+        pool->free_buffers[i] =
+                pool->buffers + buffer_size * (buffer_count - 1 - i);
+    }
+    return pool;
+}
+
+void free_camera_metadata_pool(camera_metadata_pool_t *pool) {
+    if (pool == NULL) return;
+    pthread_mutex_lock(&pool->lock);
+    size_t outstanding = pool->buffer_count - pool->free_count;
+    pthread_mutex_unlock(&pool->lock);
+    if (outstanding > 0) {
+        ALOGE("%s: Freeing a pool with %d buffers still acquired",
+                __FUNCTION__, outstanding);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+camera_metadata_t *acquire_camera_metadata(camera_metadata_pool_t *pool) {
+    if (pool == NULL) return NULL;
+
+    uint8_t *buffer = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->free_count > 0) {
+        buffer = pool->free_buffers[--pool->free_count];
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (buffer == NULL) {
+        ALOGV("%s: All %d buffers in use, allocating", __FUNCTION__,
+                pool->buffer_count);
+        return allocate_camera_metadata(pool->entry_capacity,
+                pool->data_capacity);
+    }
+    return place_camera_metadata(buffer, pool->buffer_size,
+            pool->entry_capacity, pool->data_capacity);
+}
+
+void release_camera_metadata(camera_metadata_pool_t *pool,
+        camera_metadata_t *metadata) {
+    if (pool == NULL || metadata == NULL) return;
+
+    uint8_t *buffer = (uint8_t*)metadata;
+    if (buffer < pool->buffers ||
+            buffer >= pool->buffers + pool->buffer_size * pool->buffer_count) {
+        free_camera_metadata(metadata);
+        return;
+    }
+    if ((size_t)(buffer - pool->buffers) % pool->buffer_size != 0) {
+        ALOGE("%s: %p is inside the pool but not one of its buffers",
+                __FUNCTION__, metadata);
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->free_count == pool->buffer_count) {
+        // Released twice; pushing it again would overrun the free list
+        pthread_mutex_unlock(&pool->lock);
+        ALOGE("%s: %p released with no buffers acquired", __FUNCTION__,
+                metadata);
+        return;
+    }
+    pool->free_buffers[pool->free_count++] = buffer;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Returns whether the entries of src are sorted with no tag twice.
+ */
+static int is_sorted_unique(const camera_metadata_t *src) {
+    if (!(src->flags & FLAG_SORTED)) return 0;
+    size_t i;
+    for (i = 1; i < src->entry_count; i++) {
+        if (src->entries[i - 1].tag == src->entries[i].tag) return 0;
+    }
+    return 1;
+}
+
+static const uint8_t *entry_data(const camera_metadata_t *src,
+        const camera_metadata_buffer_entry_t *entry) {
+    if (calculate_camera_metadata_entry_data_size(entry->type,
+            entry->count) > 0) {
+        return src->data + entry->data.offset;
+    }
+    return entry->data.value;
+}
+
+static int same_entry_values(const camera_metadata_t *a,
+        const camera_metadata_buffer_entry_t *entry_a,
+        const camera_metadata_t *b,
+        const camera_metadata_buffer_entry_t *entry_b) {
+    if (entry_a->type != entry_b->type) return 0;
+    if (entry_a->count != entry_b->count) return 0;
+    return memcmp(entry_data(a, entry_a), entry_data(b, entry_b),
+            entry_a->count * camera_metadata_type_size[entry_a->type]) == 0;
+}
+
+typedef struct delta_size {
+    size_t entry_count;
+    size_t data_count;
+} delta_size_t;
+
+/**
+ * Counts an entry of the delta in size, and adds it to delta unless that is
+ * NULL. owner is the structure the entry is in; count is 0 for a deleted tag.
+ */
+static int visit_delta_entry(camera_metadata_t *delta,
+        delta_size_t *size,
+        const camera_metadata_t *owner,
+        const camera_metadata_buffer_entry_t *entry,
+        size_t count) {
+    size->entry_count++;
+    size->data_count +=
+            calculate_camera_metadata_entry_data_size(entry->type, count);
+    if (delta == NULL) return OK;
+    return add_camera_metadata_entry_raw(delta,
+            entry->tag,
+            entry->type,
+            entry_data(owner, entry),
+            count);
+}
+
+/**
+ * Walks base and src in tag order, visiting each entry of src that is new or
+ * changed, and each entry of base whose tag is gone with a count of 0. Stops
+ * at the first error.
+ */
+static int walk_camera_metadata_delta(const camera_metadata_t *base,
+        const camera_metadata_t *src,
+        camera_metadata_t *delta,
+        delta_size_t *size) {
+    if (base == NULL || src == NULL) return ERROR;
+    if (!is_sorted_unique(base) || !is_sorted_unique(src)) return ERROR;
+
+    size_t i = 0, j = 0;
+    int res = OK;
+    while (res == OK && (i < base->entry_count || j < src->entry_count)) {
+        const camera_metadata_buffer_entry_t *b =
+                i < base->entry_count ? base->entries + i : NULL;
+        const camera_metadata_buffer_entry_t *s =
+                j < src->entry_count ? src->entries + j : NULL;
+        if (s == NULL || (b != NULL && b->tag < s->tag)) {
+            res = visit_delta_entry(delta, size, base, b, 0);
+            i++;
+        } else if (b == NULL || s->tag < b->tag) {
+            res = visit_delta_entry(delta, size, src, s, s->count);
+            j++;
+        } else {
+            if (!same_entry_values(base, b, src, s)) {
+                res = visit_delta_entry(delta, size, src, s, s->count);
+            }
+            i++;
+            j++;
+        }
+    }
+    return res;
+}
+
+int calculate_camera_metadata_delta_size(const camera_metadata_t *base,
+        const camera_metadata_t *src,
+        size_t *entry_count,
+        size_t *data_count) {
+    if (entry_count == NULL || data_count == NULL) return ERROR;
+
+    delta_size_t size = { 0, 0 };
+    int res = walk_camera_metadata_delta(base, src, NULL, &size);
+    if (res != OK) return res;
+    *entry_count = size.entry_count;
+    *data_count = size.data_count;
+    return OK;
+}
+
+int compute_camera_metadata_delta(camera_metadata_t *delta,
+        const camera_metadata_t *base,
+        const camera_metadata_t *src) {
+    if (delta == NULL) return ERROR;
+
+    delta->entry_count = 0;
+    delta->data_count = 0;
+    delta->flags |= FLAG_SORTED;
+    delta_size_t size = { 0, 0 };
+    return walk_camera_metadata_delta(base, src, delta, &size);
+}
+
+int apply_camera_metadata_delta(camera_metadata_t *dst,
+        const camera_metadata_t *delta) {
+    if (dst == NULL || delta == NULL) return ERROR;
+    if (!(dst->flags & FLAG_SORTED) || !is_sorted_unique(delta)) return ERROR;
+
+    // Update and delete the entries dst has, which keeps it sorted
+    size_t i = 0, k;
+    for (k = 0; k < delta->entry_count; k++) {
+        const camera_metadata_buffer_entry_t *d = delta->entries + k;
+        while (i < dst->entry_count && dst->entries[i].tag < d->tag) i++;
+        if (i == dst->entry_count || dst->entries[i].tag != d->tag) continue;
+
+        int res;
+        if (dst->entries[i].type != d->type) return ERROR;
+        if (d->count == 0) {
+            res = delete_camera_metadata_entry(dst, i);
+        } else {
+            res = update_camera_metadata_entry(dst, i, entry_data(delta, d),
+                    d->count, NULL);
+            i++;
+        }
+        if (res != OK) return res;
+    }
+
+    // Then add the new ones at the end, and sort them into place
+    size_t old_count = dst->entry_count;
+    i = 0;
+    for (k = 0; k < delta->entry_count; k++) {
+        const camera_metadata_buffer_entry_t *d = delta->entries + k;
+        if (d->count == 0) continue;
+        while (i < old_count && dst->entries[i].tag < d->tag) i++;
+        if (i < old_count && dst->entries[i].tag == d->tag) continue;
+
+        int res = add_camera_metadata_entry_raw(dst, d->tag, d->type,
+                entry_data(delta, d), d->count);
+        if (res != OK) return res;
+    }
+    return sort_camera_metadata(dst);
+}
+
 static const vendor_tag_query_ops_t *vendor_tag_ops = NULL;
 
 const char *get_camera_metadata_section_name(uint32_t tag) {
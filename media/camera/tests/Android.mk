@@ -25,3 +25,21 @@ LOCAL_MODULE := camera_metadata_tests
 LOCAL_MODULE_TAGS := tests
 
 include $(BUILD_EXECUTABLE)
+
+# Times building, updating and searching per-frame metadata.
+
+include $(CLEAR_VARS)
+
+LOCAL_SHARED_LIBRARIES := \
+	libcamera_metadata
+
+LOCAL_C_INCLUDES := \
+	system/media/camera/include
+
+LOCAL_SRC_FILES := \
+	camera_metadata_bench.cpp
+
+LOCAL_MODULE := camera_metadata_bench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Times what a camera HAL does with the metadata of each frame: build it,
+ * update it, and look tags up in it, with 200 tags per frame. Past the
+ * tags the framework defines, the frame takes vendor tags of every type.
+ *
+ * Then times handing results over, a tenth of the tags changing value from
+ * one frame to the next, and counts the bytes copied: as a fresh clone, into
+ * a buffer from a pool, and as a delta against the frame before.
+ *
+ *   camera_metadata_bench [-n frames] [-t tags per frame]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "system/camera_metadata.h"
+
+#define MAX_COUNT 6
+
+static int g_tags = 200;
+static uint32_t *g_tag;         // the tags of a frame, in tag order
+static size_t *g_count;         // the count of each
+static int *g_shuffled;         // indices into g_tag, out of order
+
+static long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static const char *get_bench_section_name(const vendor_tag_query_ops_t *,
+        uint32_t) {
+    return "com.example.bench";
+}
+
+static const char *get_bench_tag_name(const vendor_tag_query_ops_t *,
+        uint32_t) {
+    return "tag";
+}
+
+static int get_bench_tag_type(const vendor_tag_query_ops_t *, uint32_t tag) {
+    return (tag & 0xFFFF) % NUM_TYPES;
+}
+
+static const vendor_tag_query_ops_t bench_query_ops = {
+    get_bench_section_name,
+    get_bench_tag_name,
+    get_bench_tag_type
+};
+
+// Picks the first g_tags tags, a quarter of them with values too large to fit
+// in the entry
+static void setup_tags() {
+    g_tag = new uint32_t[g_tags];
+    g_count = new size_t[g_tags];
+    g_shuffled = new int[g_tags];
+
+    int n = 0;
+    for (int i = 0; i < ANDROID_SECTION_COUNT && n < g_tags; i++) {
+        for (uint32_t tag = camera_metadata_section_bounds[i][0];
+                tag < camera_metadata_section_bounds[i][1] && n < g_tags;
+                tag++, n++) {
+            g_tag[n] = tag;
+            g_count[n] = n % 4 == 0 ? 4 : 1;
+        }
+    }
+    set_camera_metadata_vendor_tag_ops(&bench_query_ops);
+    for (uint32_t tag = VENDOR_SECTION << 16; n < g_tags; tag++, n++) {
+        g_tag[n] = tag;
+        g_count[n] = n % 4 == 0 ? 4 : 1;
+    }
+
+    for (int i = 0; i < g_tags; i++) {
+        g_shuffled[i] = i;
+    }
+    srand(1);
+    for (int i = g_tags - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int t = g_shuffled[i];
+        g_shuffled[i] = g_shuffled[j];
+        g_shuffled[j] = t;
+    }
+}
+
+static size_t frame_data_size() {
+    size_t size = 0;
+    for (int i = 0; i < g_tags; i++) {
+        size += calculate_camera_metadata_entry_data_size(
+                get_camera_metadata_tag_type(g_tag[i]), MAX_COUNT);
+    }
+    return size;
+}
+
+static int find_all(camera_metadata_t *m) {
+    camera_metadata_entry_t e;
+    int missing = 0;
+    for (int i = 0; i < g_tags; i++) {
+        if (find_camera_metadata_entry(m, g_tag[i], &e) != 0) missing++;
+    }
+    return missing;
+}
+
+// Each test runs once per frame on m, which holds one frame in tag order
+// on entry and on return.
+struct test {
+    const char *name;
+    int (*run)(camera_metadata_t *m, void *buf, size_t size, int frame);
+};
+
+static int64_t g_values[MAX_COUNT];
+
+static int build_in_order(camera_metadata_t *, void *buf, size_t size, int) {
+    camera_metadata_t *m = place_camera_metadata(buf, size, g_tags,
+            size - calculate_camera_metadata_size(g_tags, 0));
+    for (int i = 0; i < g_tags; i++) {
+        add_camera_metadata_entry(m, g_tag[i], g_values, g_count[i]);
+    }
+    return find_all(m);
+}
+
+static int build_shuffled(camera_metadata_t *, void *buf, size_t size, int) {
+    camera_metadata_t *m = place_camera_metadata(buf, size, g_tags,
+            size - calculate_camera_metadata_size(g_tags, 0));
+    for (int i = 0; i < g_tags; i++) {
+        int j = g_shuffled[i];
+        add_camera_metadata_entry(m, g_tag[j], g_values, g_count[j]);
+    }
+    sort_camera_metadata(m);
+    return find_all(m);
+}
+
+static int build_append_few(camera_metadata_t *, void *buf, size_t size,
+        int) {
+    // In order, but for a few tags added last
+    camera_metadata_t *m = place_camera_metadata(buf, size, g_tags,
+            size - calculate_camera_metadata_size(g_tags, 0));
+    for (int i = 0; i < g_tags; i++) {
+        if (i % 50 == 7) continue;
+        add_camera_metadata_entry(m, g_tag[i], g_values, g_count[i]);
+    }
+    for (int i = 7; i < g_tags; i += 50) {
+        add_camera_metadata_entry(m, g_tag[i], g_values, g_count[i]);
+    }
+    sort_camera_metadata(m);
+    return find_all(m);
+}
+
+static int find_only(camera_metadata_t *m, void *, size_t, int) {
+    return find_all(m);
+}
+
+static int update_same_size(camera_metadata_t *m, void *, size_t, int frame) {
+    g_values[0] = frame;
+    for (int i = 0; i < g_tags; i++) {
+        camera_metadata_entry_t e;
+        find_camera_metadata_entry(m, g_tag[i], &e);
+        update_camera_metadata_entry(m, e.index, g_values, e.count, NULL);
+    }
+    return 0;
+}
+
+static int update_resize(camera_metadata_t *m, void *, size_t, int frame) {
+    // A tenth of the tags change size, the same ones every frame
+    for (int i = 0; i < g_tags; i += 10) {
+        camera_metadata_entry_t e;
+        find_camera_metadata_entry(m, g_tag[i], &e);
+        size_t count = (frame & 1) ? MAX_COUNT : g_count[i];
+        update_camera_metadata_entry(m, e.index, g_values, count, NULL);
+    }
+    return 0;
+}
+
+static const test tests[] = {
+    { "build in order + find", build_in_order },
+    { "build few last + sort + find", build_append_few },
+    { "build shuffled + sort + find", build_shuffled },
+    { "find", find_only },
+    { "find + update same size", update_same_size },
+    { "find + update 1/10 resized", update_resize },
+};
+
+// State kept from one result to the next
+struct results {
+    camera_metadata_pool_t *pool;
+    camera_metadata_t *prev;        // the last result handed over
+    camera_metadata_t *received;    // what the other side has, from deltas
+    size_t bytes;                   // copied so far
+};
+
+struct result_test {
+    const char *name;
+    void (*run)(results *r, int frame);
+};
+
+static void build_result(camera_metadata_t *m, int frame) {
+    for (int i = 0; i < g_tags; i++) {
+        g_values[0] = (frame + i) / 10;
+        add_camera_metadata_entry(m, g_tag[i], g_values, g_count[i]);
+    }
+}
+
+static void result_clone(results *r, int frame) {
+    camera_metadata_t *m = allocate_camera_metadata(g_tags,
+            frame_data_size());
+    build_result(m, frame);
+    camera_metadata_t *copy = clone_camera_metadata(m);
+    r->bytes += get_camera_metadata_compact_size(copy);
+    free_camera_metadata(copy);
+    free_camera_metadata(m);
+}
+
+static void result_pool(results *r, int frame) {
+    camera_metadata_t *m = acquire_camera_metadata(r->pool);
+    build_result(m, frame);
+    camera_metadata_t *copy = acquire_camera_metadata(r->pool);
+    append_camera_metadata(copy, m);
+    r->bytes += get_camera_metadata_compact_size(m);
+    release_camera_metadata(r->pool, copy);
+    release_camera_metadata(r->pool, m);
+}
+
+static void result_delta(results *r, int frame) {
+    camera_metadata_t *m = acquire_camera_metadata(r->pool);
+    build_result(m, frame);
+    camera_metadata_t *delta = acquire_camera_metadata(r->pool);
+    compute_camera_metadata_delta(delta, r->prev, m);
+    r->bytes += get_camera_metadata_compact_size(delta);
+    apply_camera_metadata_delta(r->received, delta);
+    release_camera_metadata(r->pool, delta);
+    release_camera_metadata(r->pool, r->prev);
+    r->prev = m;
+}
+
+static const result_test result_tests[] = {
+    { "allocate + clone", result_clone },
+    { "pool + copy", result_pool },
+    { "pool + delta + apply", result_delta },
+};
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-n frames] [-t tags per frame]\n", name);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    int frames = 10000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:t:")) != -1) {
+        switch (opt) {
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        case 't':
+            g_tags = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (frames <= 0 || g_tags <= 0) usage(argv[0]);
+    setup_tags();
+
+    size_t size = calculate_camera_metadata_size(g_tags, frame_data_size());
+    void *buf = malloc(size);
+    void *scratch = malloc(size);
+    camera_metadata_t *m = place_camera_metadata(buf, size, g_tags,
+            frame_data_size());
+    build_in_order(m, buf, size, 0);
+
+    int errors = 0;
+    printf("%d tags, %zu bytes per frame\n", g_tags, size);
+    printf("%-32s %10s\n", "per frame", "us");
+    for (size_t t = 0; t < sizeof(tests) / sizeof(tests[0]); t++) {
+        int missing = 0;
+        long long start = now_ns();
+        for (int frame = 0; frame < frames; frame++) {
+            missing += tests[t].run(m, scratch, size, frame);
+        }
+        long long elapsed = now_ns() - start;
+        printf("%-32s %10.2f\n", tests[t].name, elapsed / 1000.0 / frames);
+        if (missing != 0) {
+            fprintf(stderr, "%s: %d tags not found\n", tests[t].name, missing);
+            errors++;
+        }
+    }
+
+    printf("\n%-32s %10s %10s\n", "per result", "us", "bytes");
+    for (size_t t = 0; t < sizeof(result_tests) / sizeof(result_tests[0]);
+            t++) {
+        results r;
+        r.pool = allocate_camera_metadata_pool(4, g_tags, frame_data_size());
+        r.prev = acquire_camera_metadata(r.pool);
+        r.received = allocate_camera_metadata(g_tags, frame_data_size());
+        r.bytes = 0;
+
+        long long start = now_ns();
+        for (int frame = 0; frame < frames; frame++) {
+            result_tests[t].run(&r, frame);
+        }
+        long long elapsed = now_ns() - start;
+        printf("%-32s %10.2f %10zu\n", result_tests[t].name,
+                elapsed / 1000.0 / frames, r.bytes / frames);
+
+        if (result_tests[t].run == result_delta) {
+            size_t entry_count, data_count;
+            if (calculate_camera_metadata_delta_size(r.received, r.prev,
+                    &entry_count, &data_count) != 0 || entry_count != 0) {
+                fprintf(stderr, "%s: received result differs\n",
+                        result_tests[t].name);
+                errors++;
+            }
+        }
+        free_camera_metadata(r.received);
+        release_camera_metadata(r.pool, r.prev);
+        free_camera_metadata_pool(r.pool);
+    }
+
+    free(scratch);
+    free(buf);
+    delete[] g_tag;
+    delete[] g_count;
+    delete[] g_shuffled;
+    return errors ? 1 : 0;
+}
@@ -1596,3 +1596,627 @@ TEST(camera_metadata, user_pointer) {
     free(buf);
     free_camera_metadata(m);
 }
+
+TEST(camera_metadata, add_in_order) {
+    camera_metadata_t *m = NULL;
+    const size_t entry_capacity = 10;
+    const size_t data_capacity = 100;
+
+    int result;
+
+    m = allocate_camera_metadata(entry_capacity, data_capacity);
+
+    // Add entries in tag order, with a repeated tag
+
+    int32_t frameCount = 5;
+    result = add_camera_metadata_entry(m,
+            ANDROID_REQUEST_FRAME_COUNT,
+            &frameCount, 1);
+    EXPECT_EQ(OK, result);
+
+    float focus_distance = 0.5f;
+    result = add_camera_metadata_entry(m,
+            ANDROID_LENS_FOCUS_DISTANCE,
+            &focus_distance, 1);
+    EXPECT_EQ(OK, result);
+
+    int64_t exposure_time = 1000000000;
+    result = add_camera_metadata_entry(m,
+            ANDROID_SENSOR_EXPOSURE_TIME,
+            &exposure_time, 1);
+    EXPECT_EQ(OK, result);
+    result = add_camera_metadata_entry(m,
+            ANDROID_SENSOR_EXPOSURE_TIME,
+            &exposure_time, 1);
+    EXPECT_EQ(OK, result);
+
+    int32_t sensitivity = 800;
+    result = add_camera_metadata_entry(m,
+            ANDROID_SENSOR_SENSITIVITY,
+            &sensitivity, 1);
+    EXPECT_EQ(OK, result);
+
+    float colorTransform[9] = {
+        0.9f, 0.0f, 0.0f,
+        0.2f, 0.5f, 0.0f,
+        0.0f, 0.1f, 0.7f
+    };
+    result = add_camera_metadata_entry(m,
+            ANDROID_COLOR_TRANSFORM,
+            colorTransform, 9);
+    EXPECT_EQ(OK, result);
+
+    camera_metadata_entry_t entry;
+    result = find_camera_metadata_entry(m,
+            ANDROID_SENSOR_SENSITIVITY,
+            &entry);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)4, entry.index);
+    EXPECT_EQ(sensitivity, *entry.data.i32);
+
+    result = find_camera_metadata_entry(m,
+            ANDROID_COLOR_TRANSFORM,
+            &entry);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)5, entry.index);
+    EXPECT_EQ(colorTransform[4], entry.data.f[4]);
+
+    // Add one out of order; it still goes at the end, and all entries can
+    // still be found
+
+    uint8_t noiseStrength = 3;
+    result = add_camera_metadata_entry(m,
+            ANDROID_NOISE_STRENGTH,
+            &noiseStrength, 1);
+    EXPECT_EQ(OK, result);
+
+    result = find_camera_metadata_entry(m,
+            ANDROID_NOISE_STRENGTH,
+            &entry);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)6, entry.index);
+    EXPECT_EQ(noiseStrength, *entry.data.u8);
+
+    result = find_camera_metadata_entry(m,
+            ANDROID_REQUEST_FRAME_COUNT,
+            &entry);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)0, entry.index);
+
+    result = sort_camera_metadata(m);
+    EXPECT_EQ(OK, result);
+
+    result = find_camera_metadata_entry(m,
+            ANDROID_NOISE_STRENGTH,
+            &entry);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)5, entry.index);
+    EXPECT_EQ(noiseStrength, *entry.data.u8);
+
+    result = find_camera_metadata_entry(m,
+            ANDROID_COLOR_TRANSFORM,
+            &entry);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)6, entry.index);
+    EXPECT_EQ(colorTransform[8], entry.data.f[8]);
+
+    free_camera_metadata(m);
+}
+
+// The n-th tag defined, in tag order
+static uint32_t nth_tag(int n) {
+    for (int i = 0; i < ANDROID_SECTION_COUNT; i++) {
+        int count = camera_metadata_section_bounds[i][1] -
+                camera_metadata_section_bounds[i][0];
+        if (n < count) return camera_metadata_section_bounds[i][0] + n;
+        n -= count;
+    }
+    return 0;
+}
+
+// Adds tags 0 to in_order - 1 in order, then out_of_order more, each below
+// the one before. The first data byte of each entry counts up from 0.
+static void add_sort_test_metadata(camera_metadata_t *m, int in_order,
+        int out_of_order) {
+    uint8_t data[8] = { 0 };
+    int result;
+
+    for (int i = 0; i < in_order + out_of_order; i++) {
+        uint32_t tag = i < in_order ? nth_tag(i) :
+                nth_tag((in_order - 1) - 3 * (i - in_order) % in_order);
+        data[0] = i;
+        result = add_camera_metadata_entry(m, tag, data, 1);
+        ASSERT_EQ(OK, result);
+    }
+}
+
+// Checks that entries are in tag order, with those of the same tag in the
+// order they were added
+static void check_sorted_metadata(camera_metadata_t *m, bool stable) {
+    camera_metadata_entry_t prev, e;
+    int result;
+
+    for (size_t i = 0; i < get_camera_metadata_entry_count(m); i++) {
+        result = get_camera_metadata_entry(m, i, &e);
+        ASSERT_EQ(OK, result);
+        if (i > 0) {
+            EXPECT_LE(prev.tag, e.tag);
+            if (stable && prev.tag == e.tag) {
+                EXPECT_LT(prev.data.u8[0], e.data.u8[0]);
+            }
+        }
+        camera_metadata_entry_t found;
+        result = find_camera_metadata_entry(m, e.tag, &found);
+        EXPECT_EQ(OK, result);
+        EXPECT_EQ(e.tag, found.tag);
+        prev = e;
+    }
+}
+
+TEST(camera_metadata, sort_metadata_few_out_of_order) {
+    const size_t entry_capacity = 50;
+    const size_t data_capacity = 400;
+
+    camera_metadata_t *m = allocate_camera_metadata(entry_capacity,
+            data_capacity);
+
+    add_sort_test_metadata(m, 40, 3);
+    EXPECT_EQ((size_t)43, get_camera_metadata_entry_count(m));
+    size_t data_count = get_camera_metadata_data_count(m);
+
+    int result = sort_camera_metadata(m);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)43, get_camera_metadata_entry_count(m));
+    EXPECT_EQ(data_count, get_camera_metadata_data_count(m));
+    check_sorted_metadata(m, true);
+
+    free_camera_metadata(m);
+}
+
+TEST(camera_metadata, sort_metadata_many_out_of_order) {
+    const size_t entry_capacity = 100;
+    const size_t data_capacity = 800;
+
+    camera_metadata_t *m = allocate_camera_metadata(entry_capacity,
+            data_capacity);
+
+    add_sort_test_metadata(m, 40, 40);
+    EXPECT_EQ((size_t)80, get_camera_metadata_entry_count(m));
+
+    int result = sort_camera_metadata(m);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)80, get_camera_metadata_entry_count(m));
+    check_sorted_metadata(m, false);
+
+    free_camera_metadata(m);
+}
+
+TEST(camera_metadata, append_metadata_sorted) {
+    camera_metadata_t *src, *dst;
+    camera_metadata_entry_t e;
+    int result;
+
+    // Unsorted onto empty stays unsorted
+
+    src = allocate_camera_metadata(5, 100);
+    uint8_t noiseStrength = 3;
+    result = add_camera_metadata_entry(src,
+            ANDROID_NOISE_STRENGTH,
+            &noiseStrength, 1);
+    EXPECT_EQ(OK, result);
+    float focus_distance = 0.5f;
+    result = add_camera_metadata_entry(src,
+            ANDROID_LENS_FOCUS_DISTANCE,
+            &focus_distance, 1);
+    EXPECT_EQ(OK, result);
+
+    dst = allocate_camera_metadata(10, 100);
+    result = append_camera_metadata(dst, src);
+    EXPECT_EQ(OK, result);
+
+    result = find_camera_metadata_entry(dst,
+            ANDROID_LENS_FOCUS_DISTANCE, &e);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)1, e.index);
+    result = find_camera_metadata_entry(dst,
+            ANDROID_NOISE_STRENGTH, &e);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)0, e.index);
+
+    // Sorted onto sorted, following on
+
+    result = sort_camera_metadata(dst);
+    EXPECT_EQ(OK, result);
+    free_camera_metadata(src);
+    src = allocate_camera_metadata(5, 100);
+    float colorTransform[9] = { 0 };
+    result = add_camera_metadata_entry(src,
+            ANDROID_COLOR_TRANSFORM,
+            colorTransform, 9);
+    EXPECT_EQ(OK, result);
+
+    result = append_camera_metadata(dst, src);
+    EXPECT_EQ(OK, result);
+    result = find_camera_metadata_entry(dst,
+            ANDROID_LENS_FOCUS_DISTANCE, &e);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)0, e.index);
+    result = find_camera_metadata_entry(dst,
+            ANDROID_COLOR_TRANSFORM, &e);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)2, e.index);
+
+    // Sorted onto sorted, starting lower
+
+    int32_t frameCount = 7;
+    result = update_camera_metadata_entry(src, 0, &frameCount, 0, NULL);
+    EXPECT_EQ(OK, result);
+    result = delete_camera_metadata_entry(src, 0);
+    EXPECT_EQ(OK, result);
+    result = add_camera_metadata_entry(src,
+            ANDROID_REQUEST_FRAME_COUNT,
+            &frameCount, 1);
+    EXPECT_EQ(OK, result);
+
+    result = append_camera_metadata(dst, src);
+    EXPECT_EQ(OK, result);
+    result = find_camera_metadata_entry(dst,
+            ANDROID_REQUEST_FRAME_COUNT, &e);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)3, e.index);
+    EXPECT_EQ(frameCount, *e.data.i32);
+    result = find_camera_metadata_entry(dst,
+            ANDROID_COLOR_TRANSFORM, &e);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)2, e.index);
+
+    free_camera_metadata(src);
+    free_camera_metadata(dst);
+}
+
+TEST(camera_metadata, update_metadata_last) {
+    camera_metadata_t *m = NULL;
+    const size_t entry_capacity = 50;
+    const size_t data_capacity = 450;
+
+    int result;
+
+    m = allocate_camera_metadata(entry_capacity, data_capacity);
+
+    size_t num_entries = 5;
+    size_t data_per_entry =
+            calculate_camera_metadata_entry_data_size(TYPE_INT64, 1);
+    size_t num_data = num_entries * data_per_entry;
+
+    add_test_metadata(m, num_entries);
+
+    // Grow and shrink the entry whose data is last
+
+    int64_t newExposures[3] = { 5000, 6000, 7000 };
+    camera_metadata_entry_t e;
+    for (size_t count = 1; count <= 3; count++) {
+        result = update_camera_metadata_entry(m,
+                num_entries - 1, newExposures, count, &e);
+        EXPECT_EQ(OK, result);
+        EXPECT_EQ(num_data + (count - 1) * data_per_entry,
+                get_camera_metadata_data_count(m));
+        EXPECT_EQ(count, e.count);
+        EXPECT_EQ(newExposures[count - 1], e.data.i64[count - 1]);
+    }
+    result = update_camera_metadata_entry(m,
+            num_entries - 1, newExposures, 1, &e);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ(num_data, get_camera_metadata_data_count(m));
+
+    // Grow the first entry, which moves its data to the end, then again
+
+    for (size_t count = 2; count <= 3; count++) {
+        result = update_camera_metadata_entry(m,
+                0, newExposures, count, &e);
+        EXPECT_EQ(OK, result);
+        EXPECT_EQ(num_data + (count - 1) * data_per_entry,
+                get_camera_metadata_data_count(m));
+        EXPECT_EQ((size_t)0, e.index);
+        EXPECT_EQ(count, e.count);
+        EXPECT_EQ(newExposures[count - 1], e.data.i64[count - 1]);
+    }
+
+    for (size_t i = 1; i < num_entries; i++) {
+        camera_metadata_entry e2;
+        result = get_camera_metadata_entry(m, i, &e2);
+        EXPECT_EQ(OK, result);
+        EXPECT_EQ(ANDROID_SENSOR_EXPOSURE_TIME, e2.tag);
+        EXPECT_EQ((size_t)1, e2.count);
+        int64_t exposureTime = i == num_entries - 1 ?
+                newExposures[0] : 100 + 100 * i;
+        EXPECT_EQ(exposureTime, *e2.data.i64);
+    }
+
+    free_camera_metadata(m);
+}
+
+TEST(camera_metadata, pool) {
+    const size_t buffer_count = 3;
+    const size_t entry_capacity = 5;
+    const size_t data_capacity = 64;
+
+    EXPECT_NULL(allocate_camera_metadata_pool(0, entry_capacity,
+            data_capacity));
+    EXPECT_NULL(allocate_camera_metadata_pool(buffer_count, 0,
+            data_capacity));
+
+    camera_metadata_pool_t *pool = allocate_camera_metadata_pool(buffer_count,
+            entry_capacity, data_capacity);
+    ASSERT_NE((void*)NULL, (void*)pool);
+
+    // Take every pooled buffer and one more
+
+    camera_metadata_t *m[buffer_count + 1];
+    for (size_t i = 0; i < buffer_count + 1; i++) {
+        m[i] = acquire_camera_metadata(pool);
+        ASSERT_NE((void*)NULL, (void*)m[i]);
+        EXPECT_EQ((size_t)0, get_camera_metadata_entry_count(m[i]));
+        EXPECT_EQ(entry_capacity, get_camera_metadata_entry_capacity(m[i]));
+        EXPECT_EQ((size_t)0, get_camera_metadata_data_count(m[i]));
+        EXPECT_EQ(data_capacity, get_camera_metadata_data_capacity(m[i]));
+        for (size_t j = 0; j < i; j++) {
+            EXPECT_NE(m[j], m[i]);
+        }
+
+        int64_t exposure_time = 100 * i;
+        int result = add_camera_metadata_entry(m[i],
+                ANDROID_SENSOR_EXPOSURE_TIME,
+                &exposure_time, 1);
+        EXPECT_EQ(OK, result);
+    }
+    for (size_t i = 0; i < buffer_count + 1; i++) {
+        camera_metadata_entry_t e;
+        int result = get_camera_metadata_entry(m[i], 0, &e);
+        EXPECT_EQ(OK, result);
+        EXPECT_EQ((int64_t)(100 * i), *e.data.i64);
+    }
+
+    // A released buffer comes back empty
+
+    release_camera_metadata(pool, m[1]);
+    camera_metadata_t *again = acquire_camera_metadata(pool);
+    EXPECT_EQ(m[1], again);
+    EXPECT_EQ((size_t)0, get_camera_metadata_entry_count(again));
+    EXPECT_EQ((size_t)0, get_camera_metadata_data_count(again));
+
+    release_camera_metadata(pool, NULL);
+    for (size_t i = 0; i < buffer_count + 1; i++) {
+        release_camera_metadata(pool, m[i]);
+    }
+
+    // Releasing a buffer twice, or a pointer between buffers, is rejected
+    // rather than putting the same buffer on the free list twice
+
+    release_camera_metadata(pool, m[0]);
+    m[0] = acquire_camera_metadata(pool);
+    release_camera_metadata(pool, (camera_metadata_t*)((uint8_t*)m[0] + 8));
+    release_camera_metadata(pool, m[0]);
+    for (size_t i = 0; i < buffer_count + 1; i++) {
+        m[i] = acquire_camera_metadata(pool);
+        ASSERT_NE((void*)NULL, (void*)m[i]);
+        for (size_t j = 0; j < i; j++) {
+            EXPECT_NE(m[j], m[i]);
+        }
+    }
+    for (size_t i = 0; i < buffer_count + 1; i++) {
+        release_camera_metadata(pool, m[i]);
+    }
+    free_camera_metadata_pool(pool);
+}
+
+// Adds tags 0 to count - 1 of the test tags, each of type INT64 with two
+// values, the first being value + the tag's number
+static void add_delta_test_metadata(camera_metadata_t *m, size_t count,
+        int64_t value) {
+    static const uint32_t tags[] = {
+        ANDROID_REQUEST_FRAME_COUNT,
+        ANDROID_LENS_FOCUS_DISTANCE,
+        ANDROID_SENSOR_EXPOSURE_TIME,
+        ANDROID_SENSOR_FRAME_DURATION,
+        ANDROID_SENSOR_SENSITIVITY,
+        ANDROID_SENSOR_TIMESTAMP,
+        ANDROID_NOISE_STRENGTH,
+        ANDROID_COLOR_TRANSFORM,
+    };
+    uint8_t data[64] = { 0 };
+
+    for (size_t i = 0; i < count && i < sizeof(tags) / sizeof(tags[0]); i++) {
+        int type = get_camera_metadata_tag_type(tags[i]);
+        size_t values = type == TYPE_BYTE ? 1 : 2;
+        int64_t v = value + i;
+        memcpy(data, &v, camera_metadata_type_size[type]);
+        int result = add_camera_metadata_entry(m, tags[i], data, values);
+        ASSERT_EQ(OK, result);
+    }
+}
+
+// Checks that a and b hold the same entries, in the same order
+static void expect_same_metadata(camera_metadata_t *a, camera_metadata_t *b) {
+    ASSERT_EQ(get_camera_metadata_entry_count(a),
+            get_camera_metadata_entry_count(b));
+    EXPECT_EQ(get_camera_metadata_data_count(a),
+            get_camera_metadata_data_count(b));
+    for (size_t i = 0; i < get_camera_metadata_entry_count(a); i++) {
+        camera_metadata_entry_t ea, eb;
+        EXPECT_EQ(OK, get_camera_metadata_entry(a, i, &ea));
+        EXPECT_EQ(OK, get_camera_metadata_entry(b, i, &eb));
+        EXPECT_EQ(ea.tag, eb.tag);
+        EXPECT_EQ(ea.type, eb.type);
+        ASSERT_EQ(ea.count, eb.count);
+        EXPECT_EQ(0, memcmp(ea.data.u8, eb.data.u8,
+                ea.count * camera_metadata_type_size[ea.type]));
+    }
+}
+
+TEST(camera_metadata, delta_metadata) {
+    const size_t entry_capacity = 10;
+    const size_t data_capacity = 200;
+
+    camera_metadata_t *base = allocate_camera_metadata(entry_capacity,
+            data_capacity);
+    camera_metadata_t *src = allocate_camera_metadata(entry_capacity,
+            data_capacity);
+    camera_metadata_t *delta = allocate_camera_metadata(entry_capacity,
+            data_capacity);
+    int result;
+
+    add_delta_test_metadata(base, 6, 100);
+
+    // No change, empty delta
+
+    add_delta_test_metadata(src, 6, 100);
+    size_t entry_count = 99, data_count = 99;
+    result = calculate_camera_metadata_delta_size(base, src,
+            &entry_count, &data_count);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)0, entry_count);
+    EXPECT_EQ((size_t)0, data_count);
+    result = compute_camera_metadata_delta(delta, base, src);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)0, get_camera_metadata_entry_count(delta));
+
+    // Two values changed, the last tag gone, two tags added, one at the end
+
+    free_camera_metadata(src);
+    src = allocate_camera_metadata(entry_capacity, data_capacity);
+    add_delta_test_metadata(src, 8, 100);
+    int64_t newExposures[2] = { 5000, 6000 };
+    camera_metadata_entry_t e;
+    result = find_camera_metadata_entry(src,
+            ANDROID_SENSOR_EXPOSURE_TIME, &e);
+    EXPECT_EQ(OK, result);
+    result = update_camera_metadata_entry(src, e.index, newExposures, 2,
+            NULL);
+    EXPECT_EQ(OK, result);
+    int32_t newSensitivity = 400;
+    result = find_camera_metadata_entry(src,
+            ANDROID_SENSOR_SENSITIVITY, &e);
+    EXPECT_EQ(OK, result);
+    result = update_camera_metadata_entry(src, e.index, &newSensitivity, 1,
+            NULL);
+    EXPECT_EQ(OK, result);
+    result = find_camera_metadata_entry(src,
+            ANDROID_SENSOR_TIMESTAMP, &e);
+    EXPECT_EQ(OK, result);
+    result = delete_camera_metadata_entry(src, e.index);
+    EXPECT_EQ(OK, result);
+
+    result = calculate_camera_metadata_delta_size(base, src,
+            &entry_count, &data_count);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)5, entry_count);
+    result = compute_camera_metadata_delta(delta, base, src);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ(entry_count, get_camera_metadata_entry_count(delta));
+    EXPECT_EQ(data_count, get_camera_metadata_data_count(delta));
+
+    result = find_camera_metadata_entry(delta,
+            ANDROID_SENSOR_TIMESTAMP, &e);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)0, e.count);
+    result = find_camera_metadata_entry(delta,
+            ANDROID_SENSOR_EXPOSURE_TIME, &e);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)2, e.count);
+    EXPECT_EQ(newExposures[1], e.data.i64[1]);
+    result = find_camera_metadata_entry(delta,
+            ANDROID_REQUEST_FRAME_COUNT, &e);
+    EXPECT_EQ(NOT_FOUND, result);
+
+    // Applying it to a copy of base gives src
+
+    camera_metadata_t *dst = allocate_camera_metadata(entry_capacity,
+            data_capacity);
+    result = append_camera_metadata(dst, base);
+    EXPECT_EQ(OK, result);
+    result = apply_camera_metadata_delta(dst, delta);
+    EXPECT_EQ(OK, result);
+    expect_same_metadata(src, dst);
+
+    // And the delta back the other way turns it into base again
+
+    result = compute_camera_metadata_delta(delta, src, base);
+    EXPECT_EQ(OK, result);
+    result = apply_camera_metadata_delta(dst, delta);
+    EXPECT_EQ(OK, result);
+    expect_same_metadata(base, dst);
+
+    free_camera_metadata(dst);
+    free_camera_metadata(delta);
+    free_camera_metadata(src);
+    free_camera_metadata(base);
+}
+
+TEST(camera_metadata, delta_metadata_errors) {
+    camera_metadata_t *base = allocate_camera_metadata(10, 200);
+    camera_metadata_t *src = allocate_camera_metadata(10, 200);
+    camera_metadata_t *delta = allocate_camera_metadata(10, 200);
+    size_t entry_count, data_count;
+    int result;
+
+    add_delta_test_metadata(base, 4, 100);
+
+    // Unsorted src
+
+    float colorTransform[9] = { 0 };
+    result = add_camera_metadata_entry(src,
+            ANDROID_COLOR_TRANSFORM, colorTransform, 9);
+    EXPECT_EQ(OK, result);
+    float focus_distance = 0.5f;
+    result = add_camera_metadata_entry(src,
+            ANDROID_LENS_FOCUS_DISTANCE, &focus_distance, 1);
+    EXPECT_EQ(OK, result);
+
+    result = calculate_camera_metadata_delta_size(base, src,
+            &entry_count, &data_count);
+    EXPECT_EQ(ERROR, result);
+    result = compute_camera_metadata_delta(delta, base, src);
+    EXPECT_EQ(ERROR, result);
+
+    // Sorted, but with a tag twice
+
+    result = sort_camera_metadata(src);
+    EXPECT_EQ(OK, result);
+    result = add_camera_metadata_entry(src,
+            ANDROID_COLOR_TRANSFORM, colorTransform, 9);
+    EXPECT_EQ(OK, result);
+    result = compute_camera_metadata_delta(delta, base, src);
+    EXPECT_EQ(ERROR, result);
+
+    // No room in delta
+
+    result = delete_camera_metadata_entry(src, 2);
+    EXPECT_EQ(OK, result);
+    camera_metadata_t *small = allocate_camera_metadata(1, 200);
+    result = compute_camera_metadata_delta(small, base, src);
+    EXPECT_EQ(ERROR, result);
+    free_camera_metadata(small);
+
+    result = compute_camera_metadata_delta(delta, base, src);
+    EXPECT_EQ(OK, result);
+
+    // No room in dst
+
+    free_camera_metadata(src);
+    src = allocate_camera_metadata(10, 200);
+    add_delta_test_metadata(src, 8, 100);
+    result = compute_camera_metadata_delta(delta, base, src);
+    EXPECT_EQ(OK, result);
+    EXPECT_EQ((size_t)4, get_camera_metadata_entry_count(delta));
+
+    camera_metadata_t *dst = allocate_camera_metadata(4, 200);
+    result = append_camera_metadata(dst, base);
+    EXPECT_EQ(OK, result);
+    result = apply_camera_metadata_delta(dst, delta);
+    EXPECT_EQ(ERROR, result);
+
+    free_camera_metadata(dst);
+    free_camera_metadata(delta);
+    free_camera_metadata(src);
+    free_camera_metadata(base);
+}
@@ -1,5 +1,8 @@
 LOCAL_PATH := $(call my-dir)
 
+# This tree ships netd and ndc as prebuilts for each board; the sources here
+# are kept alongside but are not compiled by this makefile.
+
 include $(CLEAR_VARS) 
 
 LOCAL_SRC_FILES += netd_mt7601:system/bin/netd_mt7601
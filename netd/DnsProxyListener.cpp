@@ -33,12 +33,24 @@
 #include <sysutils/SocketClient.h>
 
 #include "DnsProxyListener.h"
+#include "DnsWorkerPool.h"
 #include "ResponseCode.h"
 
+DnsWorkerPool *DnsProxyListener::sPool = NULL;
+
 DnsProxyListener::DnsProxyListener() :
                  FrameworkListener("dnsproxyd") {
     registerCmd(new GetAddrInfoCmd());
     registerCmd(new GetHostByAddrCmd());
+
+    if (!sPool) {
+        sPool = new DnsWorkerPool(NUM_WORKERS, MAX_QUEUED);
+        if (sPool->start()) {
+            // Whatever workers did start still serve; with none, each
+            // request gets a thread of its own as before.
+            ALOGE("Unable to start DNS worker pool (%s)", strerror(errno));
+        }
+    }
 }
 
 DnsProxyListener::GetAddrInfoHandler::~GetAddrInfoHandler() {
@@ -47,26 +59,33 @@ DnsProxyListener::GetAddrInfoHandler::~GetAddrInfoHandler() {
     free(mHints);
 }
 
-void DnsProxyListener::GetAddrInfoHandler::start() {
-    pthread_t thread;
-    pthread_create(&thread, NULL,
-                   DnsProxyListener::GetAddrInfoHandler::threadStart, this);
+bool DnsProxyListener::GetAddrInfoHandler::start() {
+    return sPool->enqueue(DnsProxyListener::GetAddrInfoHandler::threadStart, this);
 }
 
-void* DnsProxyListener::GetAddrInfoHandler::threadStart(void* obj) {
+void DnsProxyListener::GetAddrInfoHandler::threadStart(void* obj) {
     GetAddrInfoHandler* handler = reinterpret_cast<GetAddrInfoHandler*>(obj);
     handler->run();
     delete handler;
-    pthread_exit(NULL);
-    return NULL;
 }
 
-// Sends 4 bytes of big-endian length, followed by the data.
-// Returns true on success.
-static bool sendLenAndData(SocketClient *c, const int len, const void* data) {
+// Appends 4 bytes of big-endian length, followed by the data.
+static void appendLenAndData(std::string* out, const int len, const void* data) {
     uint32_t len_be = htonl(len);
-    return c->sendData(&len_be, 4) == 0 &&
-        (len == 0 || c->sendData(data, len) == 0);
+    out->append(reinterpret_cast<const char*>(&len_be), 4);
+    if (len) {
+        out->append(reinterpret_cast<const char*>(data), len);
+    }
+}
+
+// Sends a getaddrinfo reply, either freshly resolved or from the cache.
+// Returns true on success.
+static bool sendAddrInfoResult(SocketClient *c, const DnsResultCache::Result& r) {
+    if (r.code != ResponseCode::DnsProxyQueryResult) {
+        return !c->sendBinaryMsg(r.code, &r.error, sizeof(r.error));
+    }
+    return !c->sendCode(r.code) &&
+        !c->sendData(r.payload.data(), r.payload.size());
 }
 
 void DnsProxyListener::GetAddrInfoHandler::run() {
@@ -74,31 +93,47 @@ void DnsProxyListener::GetAddrInfoHandler::run() {
         ALOGD("GetAddrInfoHandler, now for %s / %s", mHost, mService);
     }
 
+    DnsResultCache::Result r;
     struct addrinfo* result = NULL;
-    uint32_t rv = getaddrinfo(mHost, mService, mHints, &result);
-    if (rv) {
+    r.error = getaddrinfo(mHost, mService, mHints, &result);
+    if (r.error) {
         // getaddrinfo failed
-        mClient->sendBinaryMsg(ResponseCode::DnsProxyOperationFailed, &rv, sizeof(rv));
+        r.code = ResponseCode::DnsProxyOperationFailed;
     } else {
-        bool success = !mClient->sendCode(ResponseCode::DnsProxyQueryResult);
-        struct addrinfo* ai = result;
-        while (ai && success) {
-            success = sendLenAndData(mClient, sizeof(struct addrinfo), ai)
-                && sendLenAndData(mClient, ai->ai_addrlen, ai->ai_addr)
-                && sendLenAndData(mClient,
-                                  ai->ai_canonname ? strlen(ai->ai_canonname) + 1 : 0,
-                                  ai->ai_canonname);
-            ai = ai->ai_next;
-        }
-        success = success && sendLenAndData(mClient, 0, "");
-        if (!success) {
-            ALOGW("Error writing DNS result to client");
+        r.code = ResponseCode::DnsProxyQueryResult;
+        for (struct addrinfo* ai = result; ai; ai = ai->ai_next) {
+            appendLenAndData(&r.payload, sizeof(struct addrinfo), ai);
+            appendLenAndData(&r.payload, ai->ai_addrlen, ai->ai_addr);
+            appendLenAndData(&r.payload,
+                             ai->ai_canonname ? strlen(ai->ai_canonname) + 1 : 0,
+                             ai->ai_canonname);
         }
+        appendLenAndData(&r.payload, 0, "");
     }
     if (result) {
         freeaddrinfo(result);
     }
-    mClient->decRef();
+    finish(r);
+}
+
+void DnsProxyListener::GetAddrInfoHandler::fail(uint32_t error) {
+    DnsResultCache::Result r;
+    r.code = ResponseCode::DnsProxyOperationFailed;
+    r.error = error;
+    finish(r);
+}
+
+void DnsProxyListener::GetAddrInfoHandler::finish(const DnsResultCache::Result& r) {
+    std::list<SocketClient*> waiters;
+    DnsResultCache::Instance()->complete(mKey, r, &waiters);
+
+    waiters.push_front(mClient);
+    for (std::list<SocketClient*>::iterator it = waiters.begin(); it != waiters.end(); ++it) {
+        if (!sendAddrInfoResult(*it, r)) {
+            ALOGW("Error writing DNS result to client");
+        }
+        (*it)->decRef();
+    }
 }
 
 DnsProxyListener::GetAddrInfoCmd::GetAddrInfoCmd() :
@@ -124,17 +159,14 @@ int DnsProxyListener::GetAddrInfoCmd::runCommand(SocketClient *cli,
     char* name = argv[1];
     if (strcmp("^", name) == 0) {
         name = NULL;
-    } else {
-        name = strdup(name);
     }
 
     char* service = argv[2];
     if (strcmp("^", service) == 0) {
         service = NULL;
-    } else {
-        service = strdup(service);
     }
 
+    struct addrinfo hintsBuf;
     struct addrinfo* hints = NULL;
     int ai_flags = atoi(argv[3]);
     int ai_family = atoi(argv[4]);
@@ -142,11 +174,12 @@ int DnsProxyListener::GetAddrInfoCmd::runCommand(SocketClient *cli,
     int ai_protocol = atoi(argv[6]);
     if (ai_flags != -1 || ai_family != -1 ||
         ai_socktype != -1 || ai_protocol != -1) {
-        hints = (struct addrinfo*) calloc(1, sizeof(struct addrinfo));
-        hints->ai_flags = ai_flags;
-        hints->ai_family = ai_family;
-        hints->ai_socktype = ai_socktype;
-        hints->ai_protocol = ai_protocol;
+        memset(&hintsBuf, 0, sizeof(hintsBuf));
+        hintsBuf.ai_flags = ai_flags;
+        hintsBuf.ai_family = ai_family;
+        hintsBuf.ai_socktype = ai_socktype;
+        hintsBuf.ai_protocol = ai_protocol;
+        hints = &hintsBuf;
     }
 
     if (DBG) {
@@ -155,10 +188,38 @@ int DnsProxyListener::GetAddrInfoCmd::runCommand(SocketClient *cli,
              service ? service : "[nullservice]");
     }
 
+    // Answer from the cache, or piggyback on an identical lookup in flight,
+    // without touching the worker pool at all.
+    std::string key = DnsResultCache::makeKey(name, service, hints);
+    DnsResultCache::Result cached;
+    switch (DnsResultCache::Instance()->lookup(key, cli, &cached)) {
+    case DnsResultCache::LOOKUP_HIT:
+        if (!sendAddrInfoResult(cli, cached)) {
+            ALOGW("Error writing cached DNS result to client");
+        }
+        return 0;
+    case DnsResultCache::LOOKUP_PENDING:
+        return 0;
+    case DnsResultCache::LOOKUP_MISS:
+        break;
+    }
+
+    if (hints) {
+        hints = (struct addrinfo*) malloc(sizeof(struct addrinfo));
+        memcpy(hints, &hintsBuf, sizeof(struct addrinfo));
+    }
+
     cli->incRef();
     DnsProxyListener::GetAddrInfoHandler* handler =
-        new DnsProxyListener::GetAddrInfoHandler(cli, name, service, hints);
-    handler->start();
+        new DnsProxyListener::GetAddrInfoHandler(cli,
+                                                 name ? strdup(name) : NULL,
+                                                 service ? strdup(service) : NULL,
+                                                 hints, key);
+    if (!handler->start()) {
+        ALOGW("No DNS worker available, rejecting getaddrinfo");
+        handler->fail(EAI_AGAIN);
+        delete handler;
+    }
 
     return 0;
 }
@@ -207,7 +268,13 @@ int DnsProxyListener::GetHostByAddrCmd::runCommand(SocketClient *cli,
     cli->incRef();
     DnsProxyListener::GetHostByAddrHandler* handler =
             new DnsProxyListener::GetHostByAddrHandler(cli, addr, addrLen, addrFamily);
-    handler->start();
+    if (!handler->start()) {
+        ALOGW("No DNS worker available, rejecting gethostbyaddr");
+        uint32_t error = TRY_AGAIN;
+        cli->sendBinaryMsg(ResponseCode::DnsProxyOperationFailed, &error, sizeof(error));
+        cli->decRef();
+        delete handler;
+    }
 
     return 0;
 }
@@ -216,18 +283,14 @@ DnsProxyListener::GetHostByAddrHandler::~GetHostByAddrHandler() {
     free(mAddress);
 }
 
-void DnsProxyListener::GetHostByAddrHandler::start() {
-    pthread_t thread;
-    pthread_create(&thread, NULL,
-                   DnsProxyListener::GetHostByAddrHandler::threadStart, this);
+bool DnsProxyListener::GetHostByAddrHandler::start() {
+    return sPool->enqueue(DnsProxyListener::GetHostByAddrHandler::threadStart, this);
 }
 
-void* DnsProxyListener::GetHostByAddrHandler::threadStart(void* obj) {
+void DnsProxyListener::GetHostByAddrHandler::threadStart(void* obj) {
     GetHostByAddrHandler* handler = reinterpret_cast<GetHostByAddrHandler*>(obj);
     handler->run();
     delete handler;
-    pthread_exit(NULL);
-    return NULL;
 }
 
 void DnsProxyListener::GetHostByAddrHandler::run() {
@@ -17,16 +17,27 @@
 #ifndef _DNSPROXYLISTENER_H__
 #define _DNSPROXYLISTENER_H__
 
+#include <string>
+
 #include <sysutils/FrameworkListener.h>
 
+#include "DnsResultCache.h"
 #include "NetdCommand.h"
 
+class DnsWorkerPool;
+
 class DnsProxyListener : public FrameworkListener {
 public:
     DnsProxyListener();
     virtual ~DnsProxyListener() {}
 
+    /* Lookups are handed to a fixed pool instead of a thread per request. */
+    static const int NUM_WORKERS = 8;
+    static const int MAX_QUEUED  = 128;
+
 private:
+    static DnsWorkerPool *sPool;
+
     class GetAddrInfoCmd : public NetdCommand {
     public:
         GetAddrInfoCmd();
@@ -40,22 +51,29 @@ private:
         GetAddrInfoHandler(SocketClient *c,
                            char* host,
                            char* service,
-                           struct addrinfo* hints)
+                           struct addrinfo* hints,
+                           const std::string& key)
             : mClient(c),
               mHost(host),
               mService(service),
-              mHints(hints) {}
+              mHints(hints),
+              mKey(key) {}
         ~GetAddrInfoHandler();
 
-        static void* threadStart(void* handler);
-        void start();
+        static void threadStart(void* handler);
+        // Returns false if the worker queue is full; the caller still owns us.
+        bool start();
+        // Answers the client and any coalesced waiters with a failure.
+        void fail(uint32_t error);
 
     private:
         void run();
+        void finish(const DnsResultCache::Result& result);
         SocketClient* mClient;  // ref counted
         char* mHost;    // owned
         char* mService; // owned
         struct addrinfo* mHints;  // owned
+        std::string mKey;  // DnsResultCache key
     };
 
     /* ------ gethostbyaddr ------*/
@@ -78,8 +96,8 @@ private:
               mAddressFamily(addressFamily) {}
         ~GetHostByAddrHandler();
 
-        static void* threadStart(void* handler);
-        void start();
+        static void threadStart(void* handler);
+        bool start();
 
     private:
         void run();
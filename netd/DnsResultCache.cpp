@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_TAG "DnsResultCache"
+#define DBG 0
+
+#include <cutils/log.h>
+#include <sysutils/SocketClient.h>
+
+#include "DnsResultCache.h"
+#include "ResponseCode.h"
+
+DnsResultCache *DnsResultCache::sInstance = NULL;
+static pthread_once_t sInstanceOnce = PTHREAD_ONCE_INIT;
+
+void DnsResultCache::createInstance() {
+    sInstance = new DnsResultCache();
+}
+
+// The listener, the workers and the command thread all get here first on
+// their own, so the instance has to be created exactly once.
+DnsResultCache *DnsResultCache::Instance() {
+    pthread_once(&sInstanceOnce, createInstance);
+    return sInstance;
+}
+
+DnsResultCache::DnsResultCache() :
+        mGeneration(0),
+        mHits(0),
+        mMisses(0),
+        mCoalesced(0) {
+    pthread_mutex_init(&mLock, NULL);
+}
+
+time_t DnsResultCache::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+std::string DnsResultCache::makeKey(const char* host, const char* service,
+                                    const struct addrinfo* hints) {
+    char buf[64];
+    std::string key;
+
+    // "^" is never a valid host or service; use it for NULL like the wire protocol.
+    key += host ? host : "^";
+    key += '\0';
+    key += service ? service : "^";
+    key += '\0';
+    if (hints) {
+        snprintf(buf, sizeof(buf), "%d/%d/%d/%d", hints->ai_flags, hints->ai_family,
+                 hints->ai_socktype, hints->ai_protocol);
+        key += buf;
+    }
+    return key;
+}
+
+DnsResultCache::LookupStatus DnsResultCache::lookup(const std::string& key,
+                                                    SocketClient* c, Result* result) {
+    pthread_mutex_lock(&mLock);
+
+    std::map<std::string, Entry>::iterator it = mEntries.find(key);
+    if (it != mEntries.end()) {
+        if (it->second.expires > now()) {
+            *result = it->second.result;
+            mLru.splice(mLru.begin(), mLru, it->second.lruPos);
+            mHits++;
+            pthread_mutex_unlock(&mLock);
+            return LOOKUP_HIT;
+        }
+        evictLocked(it);
+    }
+
+    std::map<std::string, Pending>::iterator p = mPending.find(key);
+    if (p != mPending.end()) {
+        c->incRef();
+        p->second.waiters.push_back(c);
+        mCoalesced++;
+        pthread_mutex_unlock(&mLock);
+        return LOOKUP_PENDING;
+    }
+
+    mPending[key].generation = mGeneration;
+    mMisses++;
+    pthread_mutex_unlock(&mLock);
+    return LOOKUP_MISS;
+}
+
+void DnsResultCache::complete(const std::string& key, const Result& result,
+                              std::list<SocketClient*>* waiters) {
+    pthread_mutex_lock(&mLock);
+
+    std::map<std::string, Pending>::iterator p = mPending.find(key);
+    if (p == mPending.end()) {
+        pthread_mutex_unlock(&mLock);
+        return;
+    }
+    waiters->swap(p->second.waiters);
+    bool stale = p->second.generation != mGeneration;
+    mPending.erase(p);
+
+    int ttl = 0;
+    if (result.code == ResponseCode::DnsProxyQueryResult) {
+        ttl = POSITIVE_TTL_SECONDS;
+    } else if ((int) result.error == EAI_NONAME
+#ifdef EAI_NODATA
+               || (int) result.error == EAI_NODATA
+#endif
+               ) {
+        ttl = NEGATIVE_TTL_SECONDS;
+    }
+
+    // Results that raced with a flush were resolved against the old config.
+    if (ttl && !stale) {
+        std::map<std::string, Entry>::iterator it = mEntries.find(key);
+        if (it != mEntries.end()) {
+            evictLocked(it);
+        }
+        if ((int) mEntries.size() >= MAX_ENTRIES) {
+            evictLocked(mEntries.find(mLru.back()));
+        }
+        mLru.push_front(key);
+        Entry& e = mEntries[key];
+        e.result = result;
+        e.expires = now() + ttl;
+        e.lruPos = mLru.begin();
+    }
+
+    pthread_mutex_unlock(&mLock);
+}
+
+void DnsResultCache::evictLocked(std::map<std::string, Entry>::iterator it) {
+    mLru.erase(it->second.lruPos);
+    mEntries.erase(it);
+}
+
+void DnsResultCache::flush() {
+    pthread_mutex_lock(&mLock);
+    if (DBG) {
+        ALOGD("flush: dropping %d entries (hits %d misses %d coalesced %d)",
+              (int) mEntries.size(), mHits, mMisses, mCoalesced);
+    }
+    mEntries.clear();
+    mLru.clear();
+    mGeneration++;
+    pthread_mutex_unlock(&mLock);
+}
+
+void DnsResultCache::getStats(int* hits, int* misses, int* coalesced) {
+    pthread_mutex_lock(&mLock);
+    *hits = mHits;
+    *misses = mMisses;
+    *coalesced = mCoalesced;
+    pthread_mutex_unlock(&mLock);
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _DNS_RESULT_CACHE_H
+#define _DNS_RESULT_CACHE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <list>
+#include <map>
+#include <string>
+
+struct addrinfo;
+class SocketClient;
+
+/*
+ * Cache of serialized getaddrinfo() replies, keyed by (host, service, hints).
+ *
+ * Sits in front of bionic's resolver cache: it saves the round trip through
+ * getaddrinfo() for apps that ask for the same name at the same time, and
+ * it parks identical lookups that arrive while one is already in flight so
+ * only one of them goes to the resolver.
+ *
+ * getaddrinfo() does not report record TTLs, so entries are only kept for a
+ * short period (well under any sane DNS TTL) and the whole cache is dropped
+ * whenever the resolver configuration changes.  Only definite negative
+ * answers (EAI_NONAME/EAI_NODATA) are cached; transient failures never are.
+ */
+class DnsResultCache {
+private:
+    static DnsResultCache *sInstance;
+    static void createInstance();
+
+public:
+    struct Result {
+        int         code;       // ResponseCode::DnsProxyQueryResult or DnsProxyOperationFailed
+        uint32_t    error;      // getaddrinfo() error, when code is DnsProxyOperationFailed
+        std::string payload;    // length-prefixed addrinfo records, when successful
+    };
+
+    enum LookupStatus {
+        LOOKUP_HIT,        // *result has been filled in
+        LOOKUP_MISS,       // caller must resolve and then call complete()
+        LOOKUP_PENDING,    // identical lookup in flight; the client was parked on it
+    };
+
+    static const int MAX_ENTRIES          = 256;
+    static const int POSITIVE_TTL_SECONDS = 10;
+    static const int NEGATIVE_TTL_SECONDS = 5;
+
+    static DnsResultCache *Instance();
+
+    static std::string makeKey(const char* host, const char* service,
+                               const struct addrinfo* hints);
+
+    // On LOOKUP_PENDING the cache takes a reference on the client.
+    LookupStatus lookup(const std::string& key, SocketClient* c, Result* result);
+
+    // Stores the result (if cacheable) and hands back the parked clients.
+    // The caller must send the result to each of them and decRef() it.
+    void complete(const std::string& key, const Result& result,
+                  std::list<SocketClient*>* waiters);
+
+    void flush();
+
+    void getStats(int* hits, int* misses, int* coalesced);
+
+private:
+    struct Entry {
+        Result result;
+        time_t expires;
+        std::list<std::string>::iterator lruPos;
+    };
+
+    struct Pending {
+        unsigned int generation;
+        std::list<SocketClient*> waiters;
+    };
+
+    DnsResultCache();
+
+    static time_t now();
+    void evictLocked(std::map<std::string, Entry>::iterator it);
+
+    pthread_mutex_t                  mLock;
+    std::map<std::string, Entry>     mEntries;
+    std::map<std::string, Pending>   mPending;
+    std::list<std::string>           mLru;     // most recently used at the front
+    unsigned int                     mGeneration;
+    int                              mHits;
+    int                              mMisses;
+    int                              mCoalesced;
+};
+
+#endif
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_TAG "DnsWorkerPool"
+
+#include <cutils/log.h>
+
+#include "DnsWorkerPool.h"
+
+DnsWorkerPool::DnsWorkerPool(int numThreads, int maxQueued) :
+        mNumThreads(numThreads),
+        mMaxQueued(maxQueued),
+        mHead(0),
+        mCount(0),
+        mRunning(0),
+        mStarted(false) {
+    mThreads = new pthread_t[numThreads];
+    mQueue = new Task[maxQueued];
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mCond, NULL);
+}
+
+DnsWorkerPool::~DnsWorkerPool() {
+    // The workers never exit; the pool lives as long as netd.
+    delete[] mThreads;
+    delete[] mQueue;
+    pthread_cond_destroy(&mCond);
+    pthread_mutex_destroy(&mLock);
+}
+
+int DnsWorkerPool::start() {
+    pthread_mutex_lock(&mLock);
+    if (mStarted) {
+        pthread_mutex_unlock(&mLock);
+        return 0;
+    }
+    mStarted = true;
+    pthread_mutex_unlock(&mLock);
+
+    for (int i = 0; i < mNumThreads; i++) {
+        int rc = pthread_create(&mThreads[i], NULL, DnsWorkerPool::threadStart, this);
+        if (rc) {
+            ALOGE("pthread_create failed for worker %d (%s)", i, strerror(rc));
+            errno = rc;
+            break;
+        }
+        pthread_mutex_lock(&mLock);
+        mRunning++;
+        pthread_mutex_unlock(&mLock);
+    }
+    // Short of workers the pool still serves, and with none at all enqueue()
+    // falls back to a thread per job.
+    pthread_mutex_lock(&mLock);
+    bool allRunning = mRunning == mNumThreads;
+    pthread_mutex_unlock(&mLock);
+    return allRunning ? 0 : -1;
+}
+
+bool DnsWorkerPool::enqueue(Job job, void* arg) {
+    pthread_mutex_lock(&mLock);
+    if (mRunning == 0) {
+        pthread_mutex_unlock(&mLock);
+        return spawn(job, arg);
+    }
+    if (mCount == mMaxQueued) {
+        pthread_mutex_unlock(&mLock);
+        return false;
+    }
+    Task* t = &mQueue[(mHead + mCount) % mMaxQueued];
+    t->job = job;
+    t->arg = arg;
+    mCount++;
+    pthread_cond_signal(&mCond);
+    pthread_mutex_unlock(&mLock);
+    return true;
+}
+
+bool DnsWorkerPool::spawn(Job job, void* arg) {
+    Task* t = new Task;
+    t->job = job;
+    t->arg = arg;
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int rc = pthread_create(&thread, &attr, DnsWorkerPool::taskStart, t);
+    pthread_attr_destroy(&attr);
+    if (rc) {
+        ALOGE("pthread_create failed for DNS request (%s)", strerror(rc));
+        delete t;
+        return false;
+    }
+    return true;
+}
+
+void* DnsWorkerPool::taskStart(void* obj) {
+    Task* t = reinterpret_cast<Task*>(obj);
+    t->job(t->arg);
+    delete t;
+    return NULL;
+}
+
+void* DnsWorkerPool::threadStart(void* obj) {
+    DnsWorkerPool* me = reinterpret_cast<DnsWorkerPool*>(obj);
+    me->run();
+    pthread_exit(NULL);
+    return NULL;
+}
+
+void DnsWorkerPool::run() {
+    while (1) {
+        pthread_mutex_lock(&mLock);
+        while (mCount == 0) {
+            pthread_cond_wait(&mCond, &mLock);
+        }
+        Task t = mQueue[mHead];
+        mHead = (mHead + 1) % mMaxQueued;
+        mCount--;
+        pthread_mutex_unlock(&mLock);
+
+        t.job(t.arg);
+    }
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _DNS_WORKER_POOL_H
+#define _DNS_WORKER_POOL_H
+
+#include <pthread.h>
+
+/*
+ * Fixed-size pool of worker threads fed from a bounded FIFO.
+ *
+ * Used by DnsProxyListener so that a burst of lookups from many apps
+ * does not turn into a burst of pthread_create() calls; when the queue
+ * is full the request is refused rather than queued without bound.
+ */
+class DnsWorkerPool {
+public:
+    typedef void (*Job)(void* arg);
+
+    DnsWorkerPool(int numThreads, int maxQueued);
+    virtual ~DnsWorkerPool();
+
+    // Returns -1 with errno set if not every worker could be started.
+    int start();
+
+    // Returns false (and does not take ownership of arg) if the queue is full.
+    // If no worker is running, runs job on a thread of its own instead.
+    bool enqueue(Job job, void* arg);
+
+    int getNumThreads() const { return mNumThreads; }
+
+private:
+    struct Task {
+        Job job;
+        void* arg;
+    };
+
+    static void* threadStart(void* obj);
+    static void* taskStart(void* obj);
+    bool spawn(Job job, void* arg);
+    void run();
+
+    int             mNumThreads;
+    int             mMaxQueued;
+    pthread_t*      mThreads;
+    Task*           mQueue;     // ring of mMaxQueued entries
+    int             mHead;
+    int             mCount;
+    int             mRunning;   // workers started
+    bool            mStarted;
+    pthread_mutex_t mLock;
+    pthread_cond_t  mCond;
+};
+
+#endif
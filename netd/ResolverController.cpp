@@ -25,6 +25,7 @@
 //       declarations for _resolv_set_default_iface() and others.
 #include <resolv_iface.h>
 
+#include "DnsResultCache.h"
 #include "ResolverController.h"
 
 int ResolverController::setDefaultInterface(const char* iface) {
@@ -33,6 +34,7 @@ int ResolverController::setDefaultInterface(const char* iface) {
     }
 
     _resolv_set_default_iface(iface);
+    DnsResultCache::Instance()->flush();
 
     return 0;
 }
@@ -43,6 +45,7 @@ int ResolverController::setInterfaceDnsServers(const char* iface, char** servers
     }
 
     _resolv_set_nameservers_for_iface(iface, servers, numservers);
+    DnsResultCache::Instance()->flush();
 
     return 0;
 }
@@ -53,6 +56,7 @@ int ResolverController::setInterfaceAddress(const char* iface, struct in_addr* a
     }
 
     _resolv_set_addr_of_iface(iface, addr);
+    DnsResultCache::Instance()->flush();
 
     return 0;
 }
@@ -63,6 +67,7 @@ int ResolverController::flushDefaultDnsCache() {
     }
 
     _resolv_flush_cache_for_default_iface();
+    DnsResultCache::Instance()->flush();
 
     return 0;
 }
@@ -73,6 +78,7 @@ int ResolverController::flushInterfaceDnsCache(const char* iface) {
     }
 
     _resolv_flush_cache_for_iface(iface);
+    DnsResultCache::Instance()->flush();
 
     return 0;
 }
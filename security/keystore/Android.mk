@@ -42,3 +42,19 @@ LOCAL_SHARED_LIBRARIES := libcutils
 LOCAL_MODULE := libkeystore_client
 LOCAL_MODULE_TAGS := optional
 include $(BUILD_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+LOCAL_SRC_FILES := keystore_bench.cpp
+LOCAL_SHARED_LIBRARIES := libcutils libkeystore_client
+LOCAL_MODULE := keystore_bench
+LOCAL_MODULE_TAGS := debug
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+LOCAL_SRC_FILES := keystore_conn_test.cpp
+LOCAL_SHARED_LIBRARIES := libcutils libkeystore_client
+LOCAL_MODULE := keystore_conn_test
+LOCAL_MODULE_TAGS := debug
+include $(BUILD_EXECUTABLE)
@@ -24,8 +24,11 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <assert.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <arpa/inet.h>
@@ -437,6 +440,482 @@ private:
     struct blob mBlob;
 };
 
+/* Decrypted blobs of recently used keys, so that repeated get, sign and
+ * verify requests skip reading the file and running decryptBlob() again.
+ * All entries live in one mlock()ed mapping so plaintext never reaches swap,
+ * and are wiped whenever the keystore is locked or reset or its password
+ * changes. Blobs too large for a slot are not cached. If the mapping cannot
+ * be locked the cache stays disabled. */
+class BlobCache {
+public:
+    BlobCache() : mSlots(NULL), mClock(0) {}
+
+    ~BlobCache() {
+        if (mSlots != NULL) {
+            clear();
+            munmap(mSlots, sizeof(Slot) * NUM_SLOTS);
+        }
+    }
+
+    bool init() {
+        void* p = mmap(NULL, sizeof(Slot) * NUM_SLOTS, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            ALOGW("blob cache disabled: mmap: %s", strerror(errno));
+            return false;
+        }
+        if (mlock(p, sizeof(Slot) * NUM_SLOTS) != 0) {
+            ALOGW("blob cache disabled: mlock: %s", strerror(errno));
+            munmap(p, sizeof(Slot) * NUM_SLOTS);
+            return false;
+        }
+#ifdef MADV_DONTDUMP
+        madvise(p, sizeof(Slot) * NUM_SLOTS, MADV_DONTDUMP);
+#endif
+        mSlots = (Slot*) p;
+        clear();
+        return true;
+    }
+
+    bool get(const char* filename, Blob* blob) {
+        Slot* slot = find(filename);
+        if (slot == NULL) {
+            return false;
+        }
+        slot->lastUsed = ++mClock;
+        *blob = Blob(slot->data, slot->length, slot->data + slot->length, slot->infoLength,
+                     BlobType(slot->type));
+        blob->setVersion(slot->version);
+        return true;
+    }
+
+    void put(const char* filename, const Blob& blob) {
+        size_t size = blob.getLength() + blob.getInfoLength();
+        if (mSlots == NULL || size > sizeof(mSlots->data)
+                || strlen(filename) >= sizeof(mSlots->filename)) {
+            invalidate(filename);
+            return;
+        }
+        Slot* slot = find(filename);
+        if (slot == NULL) {
+            slot = &mSlots[0];
+            for (int i = 1; i < NUM_SLOTS; ++i) {
+                if (mSlots[i].lastUsed < slot->lastUsed) {
+                    slot = &mSlots[i];
+                }
+            }
+        }
+        wipe(slot);
+        strcpy(slot->filename, filename);
+        slot->type = blob.getType();
+        slot->version = blob.getVersion();
+        slot->infoLength = blob.getInfoLength();
+        slot->length = blob.getLength();
+        memcpy(slot->data, blob.getValue(), blob.getLength());
+        memcpy(slot->data + blob.getLength(), blob.getInfo(), blob.getInfoLength());
+        slot->lastUsed = ++mClock;
+    }
+
+    void invalidate(const char* filename) {
+        Slot* slot = find(filename);
+        if (slot != NULL) {
+            wipe(slot);
+        }
+    }
+
+    void clear() {
+        if (mSlots != NULL) {
+            for (int i = 0; i < NUM_SLOTS; ++i) {
+                wipe(&mSlots[i]);
+            }
+        }
+    }
+
+private:
+    static const int NUM_SLOTS = 16;
+    static const size_t SLOT_SIZE = 4096;
+
+    struct Slot {
+        char filename[NAME_MAX + 1];
+        uint64_t lastUsed; // 0 when empty
+        uint8_t type;
+        uint8_t version;
+        uint8_t infoLength;
+        int32_t length;
+        uint8_t data[SLOT_SIZE - (NAME_MAX + 1) - 2 * sizeof(uint64_t)];
+    };
+
+    Slot* mSlots;
+    uint64_t mClock;
+
+    Slot* find(const char* filename) {
+        if (mSlots == NULL) {
+            return NULL;
+        }
+        for (int i = 0; i < NUM_SLOTS; ++i) {
+            if (mSlots[i].lastUsed != 0 && !strcmp(mSlots[i].filename, filename)) {
+                return &mSlots[i];
+            }
+        }
+        return NULL;
+    }
+
+    static void wipe(Slot* slot) {
+        // volatile so the final wipe of freed secrets isn't optimized away
+        volatile uint8_t* p = (volatile uint8_t*) slot;
+        for (size_t i = 0; i < sizeof(*slot); ++i) {
+            p[i] = 0;
+        }
+    }
+};
+
+/* Sorted index of key names per uid, so that saw and exist don't have to
+ * read and decode every file in the directory. Each uid's index is kept on
+ * disk as a sorted snapshot (.index_<uid>) plus a journal of additions and
+ * removals (.index_<uid>.log) that is folded back into the snapshot once it
+ * grows. An index is loaded the first time its uid is used and checked
+ * against a single scan of the directory, since a key written just before a
+ * crash, or put in place by anything but keystore, is on disk but not in the
+ * journal; if there is no snapshot or it doesn't match, the index is rebuilt
+ * from that scan. */
+class KeyIndex {
+public:
+    KeyIndex() {
+        list_init(&mUids);
+    }
+
+    ~KeyIndex() {
+        clear();
+    }
+
+    /* Returns the position of the first name >= prefix, and sets *end to
+     * one past the last name starting with prefix. */
+    size_t findPrefix(uid_t uid, const uint8_t* prefix, size_t length, size_t* end) {
+        UidIndex* index = getIndex(uid);
+        size_t begin = lowerBound(index, prefix, length);
+        size_t i = begin;
+        while (i < index->count && index->names[i].length >= length
+                && !memcmp(index->names[i].data, prefix, length)) {
+            ++i;
+        }
+        *end = i;
+        return begin;
+    }
+
+    const uint8_t* getName(uid_t uid, size_t i, size_t* length) {
+        UidIndex* index = getIndex(uid);
+        *length = index->names[i].length;
+        return index->names[i].data;
+    }
+
+    bool contains(uid_t uid, const uint8_t* name, size_t length) {
+        UidIndex* index = getIndex(uid);
+        size_t i = lowerBound(index, name, length);
+        return i < index->count && compare(&index->names[i], name, length) == 0;
+    }
+
+    void add(const char* filename) {
+        uid_t uid;
+        Value name;
+        if (!parseFilename(filename, &uid, &name)) {
+            return;
+        }
+        UidIndex* index = getIndex(uid);
+        if (insert(index, name.value, name.length)) {
+            journal(index, '+', name.value, name.length);
+        }
+    }
+
+    void remove(const char* filename) {
+        uid_t uid;
+        Value name;
+        if (!parseFilename(filename, &uid, &name)) {
+            return;
+        }
+        UidIndex* index = getIndex(uid);
+        size_t i = lowerBound(index, name.value, name.length);
+        if (i < index->count && compare(&index->names[i], name.value, name.length) == 0) {
+            delete[] index->names[i].data;
+            memmove(&index->names[i], &index->names[i + 1],
+                    (index->count - i - 1) * sizeof(Name));
+            --index->count;
+            journal(index, '-', name.value, name.length);
+        }
+    }
+
+    /* Forgets the in-memory indexes; the files themselves are removed
+     * along with everything else by KeyStore::reset(). */
+    void clear() {
+        while (!list_empty(&mUids)) {
+            UidIndex* index = node_to_item(list_head(&mUids), UidIndex, plist);
+            list_remove(&index->plist);
+            for (size_t i = 0; i < index->count; ++i) {
+                delete[] index->names[i].data;
+            }
+            free(index->names);
+            delete index;
+        }
+    }
+
+    static bool isIndexFile(const char* filename) {
+        return !strncmp(filename, INDEX_PREFIX, strlen(INDEX_PREFIX));
+    }
+
+private:
+    static const char INDEX_PREFIX[];
+    static const uint32_t INDEX_MAGIC = 0x4b534958; // "KSIX"
+    static const size_t MIN_COMPACT_RECORDS = 64;
+
+    struct Name {
+        uint8_t* data;
+        size_t length;
+    };
+
+    typedef struct {
+        uid_t uid;
+        Name* names;
+        size_t count;
+        size_t capacity;
+        size_t journalRecords;
+        struct listnode plist;
+    } UidIndex;
+
+    struct listnode mUids;
+
+    static int compare(const Name* a, const uint8_t* b, size_t length) {
+        size_t n = (a->length < length) ? a->length : length;
+        int rc = memcmp(a->data, b, n);
+        if (rc != 0) {
+            return rc;
+        }
+        return (a->length < length) ? -1 : (a->length > length);
+    }
+
+    static size_t lowerBound(const UidIndex* index, const uint8_t* name, size_t length) {
+        size_t lo = 0;
+        size_t hi = index->count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (compare(&index->names[mid], name, length) < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    static bool insert(UidIndex* index, const uint8_t* name, size_t length) {
+        size_t i = lowerBound(index, name, length);
+        if (i < index->count && compare(&index->names[i], name, length) == 0) {
+            return false;
+        }
+        if (index->count == index->capacity) {
+            size_t capacity = index->capacity ? index->capacity * 2 : 16;
+            Name* names = (Name*) realloc(index->names, capacity * sizeof(Name));
+            if (names == NULL) {
+                return false;
+            }
+            index->names = names;
+            index->capacity = capacity;
+        }
+        memmove(&index->names[i + 1], &index->names[i], (index->count - i) * sizeof(Name));
+        index->names[i].data = new uint8_t[length];
+        index->names[i].length = length;
+        memcpy(index->names[i].data, name, length);
+        ++index->count;
+        return true;
+    }
+
+    static bool parseFilename(const char* filename, uid_t* uid, Value* name) {
+        char* end;
+        errno = 0;
+        unsigned long value = strtoul(filename, &end, 10);
+        if (end == filename || *end != '_' || errno != 0) {
+            return false;
+        }
+        *uid = value;
+        ++end;
+        name->length = decode_key(name->value, end, strlen(end));
+        return true;
+    }
+
+    static void indexFilename(char* out, uid_t uid, bool log) {
+        snprintf(out, NAME_MAX, "%s%u%s", INDEX_PREFIX, uid, log ? ".log" : "");
+    }
+
+    UidIndex* getIndex(uid_t uid) {
+        struct listnode* node;
+        list_for_each(node, &mUids) {
+            UidIndex* index = node_to_item(node, UidIndex, plist);
+            if (index->uid == uid) {
+                return index;
+            }
+        }
+
+        UidIndex* index = new UidIndex;
+        memset(index, 0, sizeof(*index));
+        index->uid = uid;
+        list_add_tail(&mUids, &index->plist);
+        if (!load(index)) {
+            rebuild(index);
+        } else if (!matchesDirectory(index)) {
+            ALOGW("index for uid %u doesn't match the directory; rebuilding", index->uid);
+            rebuild(index);
+        }
+        return index;
+    }
+
+    /* Whether the index names exactly the keys of its uid in the directory. */
+    bool matchesDirectory(UidIndex* index) {
+        DIR* dir = opendir(".");
+        if (dir == NULL) {
+            return true;
+        }
+        struct dirent* file;
+        uid_t uid;
+        Value name;
+        size_t count = 0;
+        bool ok = true;
+        while (ok && (file = readdir(dir)) != NULL) {
+            if (parseFilename(file->d_name, &uid, &name) && uid == index->uid) {
+                size_t i = lowerBound(index, name.value, name.length);
+                ok = i < index->count && compare(&index->names[i], name.value, name.length) == 0;
+                ++count;
+            }
+        }
+        closedir(dir);
+        return ok && count == index->count;
+    }
+
+    /* Reads the snapshot and replays the journal on top of it. */
+    bool load(UidIndex* index) {
+        char filename[NAME_MAX];
+        indexFilename(filename, index->uid, false);
+        FILE* in = fopen(filename, "r");
+        if (in == NULL) {
+            return false;
+        }
+        uint32_t header[2];
+        bool ok = fread(header, sizeof(header), 1, in) == 1 && ntohl(header[0]) == INDEX_MAGIC;
+        Value name;
+        for (uint32_t i = 0; ok && i < ntohl(header[1]); ++i) {
+            ok = readName(in, &name) && insert(index, name.value, name.length);
+        }
+        fclose(in);
+        if (!ok) {
+            ALOGW("index for uid %u is corrupt; rebuilding", index->uid);
+            return false;
+        }
+
+        indexFilename(filename, index->uid, true);
+        in = fopen(filename, "r");
+        if (in != NULL) {
+            int op;
+            while ((op = fgetc(in)) != EOF && readName(in, &name)) {
+                if (op == '+') {
+                    insert(index, name.value, name.length);
+                } else {
+                    size_t i = lowerBound(index, name.value, name.length);
+                    if (i < index->count
+                            && compare(&index->names[i], name.value, name.length) == 0) {
+                        delete[] index->names[i].data;
+                        memmove(&index->names[i], &index->names[i + 1],
+                                (index->count - i - 1) * sizeof(Name));
+                        --index->count;
+                    }
+                }
+                ++index->journalRecords;
+            }
+            fclose(in);
+        }
+        return true;
+    }
+
+    static bool readName(FILE* in, Value* name) {
+        uint8_t bytes[2];
+        if (fread(bytes, 2, 1, in) != 1) {
+            return false;
+        }
+        name->length = bytes[0] << 8 | bytes[1];
+        return name->length <= KEY_SIZE
+                && fread(name->value, 1, name->length, in) == (size_t) name->length;
+    }
+
+    /* One scan of the directory, used when a uid has no index yet. */
+    void rebuild(UidIndex* index) {
+        for (size_t i = 0; i < index->count; ++i) {
+            delete[] index->names[i].data;
+        }
+        index->count = 0;
+
+        DIR* dir = opendir(".");
+        if (dir == NULL) {
+            return;
+        }
+        struct dirent* file;
+        uid_t uid;
+        Value name;
+        while ((file = readdir(dir)) != NULL) {
+            if (parseFilename(file->d_name, &uid, &name) && uid == index->uid) {
+                insert(index, name.value, name.length);
+            }
+        }
+        closedir(dir);
+        writeSnapshot(index);
+    }
+
+    void writeSnapshot(UidIndex* index) {
+        char filename[NAME_MAX];
+        const char* tmpFileName = ".tmp";
+        FILE* out = fopen(tmpFileName, "w");
+        if (out == NULL) {
+            return;
+        }
+        uint32_t header[2] = { htonl(INDEX_MAGIC), htonl(index->count) };
+        bool ok = fwrite(header, sizeof(header), 1, out) == 1;
+        for (size_t i = 0; ok && i < index->count; ++i) {
+            ok = writeName(out, index->names[i].data, index->names[i].length);
+        }
+        if (fclose(out) != 0 || !ok) {
+            unlink(tmpFileName);
+            return;
+        }
+        indexFilename(filename, index->uid, false);
+        if (rename(tmpFileName, filename) == 0) {
+            indexFilename(filename, index->uid, true);
+            unlink(filename);
+            index->journalRecords = 0;
+        }
+    }
+
+    static bool writeName(FILE* out, const uint8_t* name, size_t length) {
+        uint8_t bytes[2] = { uint8_t(length >> 8), uint8_t(length) };
+        return fwrite(bytes, 2, 1, out) == 1 && fwrite(name, 1, length, out) == length;
+    }
+
+    void journal(UidIndex* index, int op, const uint8_t* name, size_t length) {
+        if (++index->journalRecords > MIN_COMPACT_RECORDS
+                && index->journalRecords > index->count / 4) {
+            writeSnapshot(index);
+            return;
+        }
+        char filename[NAME_MAX];
+        indexFilename(filename, index->uid, true);
+        FILE* out = fopen(filename, "a");
+        if (out == NULL) {
+            return;
+        }
+        bool ok = fputc(op, out) != EOF && writeName(out, name, length);
+        if (fclose(out) != 0 || !ok) {
+            // Don't leave a torn journal behind; fall back to a snapshot.
+            writeSnapshot(index);
+        }
+    }
+};
+
+const char KeyIndex::INDEX_PREFIX[] = ".index_";
+
 typedef struct {
     uint32_t uid;
     const uint8_t* filename;
@@ -458,6 +937,7 @@ public:
         }
 
         list_init(&mGrants);
+        mCache.init();
     }
 
     State getState() const {
@@ -485,6 +965,7 @@ public:
     }
 
     ResponseCode writeMasterKey(Value* pw) {
+        mCache.clear();
         uint8_t passwordKey[MASTER_KEY_SIZE_BYTES];
         generateKeyFromPassword(passwordKey, MASTER_KEY_SIZE_BYTES, pw, mSalt);
         AES_KEY passwordAesKey;
@@ -494,6 +975,7 @@ public:
     }
 
     ResponseCode readMasterKey(Value* pw) {
+        mCache.clear();
         int in = open(MASTER_KEY_FILE, O_RDONLY);
         if (in == -1) {
             return SYSTEM_ERROR;
@@ -551,6 +1033,8 @@ public:
     }
 
     bool reset() {
+        mCache.clear();
+        mIndex.clear();
         clearMasterKeys();
         setState(STATE_UNINITIALIZED);
 
@@ -585,19 +1069,24 @@ public:
     }
 
     void lock() {
+        mCache.clear();
         clearMasterKeys();
         setState(STATE_LOCKED);
     }
 
     ResponseCode get(const char* filename, Blob* keyBlob, const BlobType type) {
-        ResponseCode rc = keyBlob->decryptBlob(filename, &mMasterKeyDecryption);
-        if (rc != NO_ERROR) {
-            return rc;
-        }
+        ResponseCode rc = NO_ERROR;
+        if (!mCache.get(filename, keyBlob)) {
+            rc = keyBlob->decryptBlob(filename, &mMasterKeyDecryption);
+            if (rc != NO_ERROR) {
+                return rc;
+            }
 
-        const uint8_t version = keyBlob->getVersion();
-        if (version < CurrentBlobVersion) {
-            upgrade(filename, keyBlob, version, type);
+            const uint8_t version = keyBlob->getVersion();
+            if (version < CurrentBlobVersion) {
+                upgrade(filename, keyBlob, version, type);
+            }
+            mCache.put(filename, *keyBlob);
         }
 
         if (keyBlob->getType() != type) {
@@ -609,7 +1098,25 @@ public:
     }
 
     ResponseCode put(const char* filename, Blob* keyBlob) {
-        return keyBlob->encryptBlob(filename, &mMasterKeyEncryption, mEntropy);
+        mCache.invalidate(filename);
+        ResponseCode rc = keyBlob->encryptBlob(filename, &mMasterKeyEncryption, mEntropy);
+        if (rc == NO_ERROR) {
+            mIndex.add(filename);
+        }
+        return rc;
+    }
+
+    ResponseCode del(const char* filename) {
+        mCache.invalidate(filename);
+        if (unlink(filename) && errno != ENOENT) {
+            return SYSTEM_ERROR;
+        }
+        mIndex.remove(filename);
+        return NO_ERROR;
+    }
+
+    KeyIndex* getIndex() {
+        return &mIndex;
     }
 
     void addGrant(const char* filename, const Value* uidValue) {
@@ -692,6 +1199,9 @@ private:
 
     struct listnode mGrants;
 
+    BlobCache mCache;
+    KeyIndex mIndex;
+
     void setState(State state) {
         mState = state;
         if (mState == STATE_NO_ERROR || mState == STATE_UNINITIALIZED) {
@@ -741,6 +1251,7 @@ private:
 
     static bool isKeyFile(const char* filename) {
         return ((strcmp(filename, MASTER_KEY_FILE) != 0)
+                && !KeyIndex::isIndexFile(filename)
                 && (strcmp(filename, ".") != 0)
                 && (strcmp(filename, "..") != 0));
     }
@@ -848,48 +1359,105 @@ const char* KeyStore::MASTER_KEY_FILE = ".masterkey";
 /* Here is the protocol used in both requests and responses:
  *     code [length_1 message_1 ... length_n message_n] end-of-file
  * where code is one byte long and lengths are unsigned 16-bit integers in
- * network order. Thus the maximum length of a message is 65535 bytes. */
+ * network order. Thus the maximum length of a message is 65535 bytes.
+ *
+ * A client that wants to issue more than one request on a connection sends
+ * the SESSION code as the very first byte. From then on requests are not
+ * terminated by end-of-file (the number of messages is fixed per action, so
+ * they delimit themselves) and may be pipelined; each is answered in order by
+ *     code count [length_1 message_1 ... length_count message_count]
+ * where count is an unsigned 32-bit integer in network order. */
+
+struct Connection {
+    int sock;
+    uid_t uid;
+    bool started;   // first byte seen; session is decided by it
+    bool session;
+    bool eof;       // client shut down its side
+    bool closing;   // close once the output is drained
+    time_t lastActive;  // last request run or reply bytes taken, not bytes read
+    unsigned long activity; // orders connections by lastActive, ties included
+
+    uint8_t* in;
+    size_t inLength;
+    size_t inCapacity;
+
+    uint8_t* out;
+    size_t outOffset;
+    size_t outLength;
+    size_t outCapacity;
+
+    size_t replyStart;      // offset of the current reply's count, in session mode
+    uint32_t replyMessages;
+};
+
+static unsigned long activityCount;
 
-static int recv_code(int sock, int8_t* code) {
-    return recv(sock, code, 1, 0) == 1;
+static void touch(Connection* conn, time_t now) {
+    conn->lastActive = now;
+    conn->activity = ++activityCount;
 }
 
-static int recv_message(int sock, uint8_t* message, int length) {
-    uint8_t bytes[2];
-    if (recv(sock, &bytes[0], 1, 0) != 1 ||
-        recv(sock, &bytes[1], 1, 0) != 1) {
-        return -1;
-    } else {
-        int offset = bytes[0] << 8 | bytes[1];
-        if (length < offset) {
-            return -1;
-        }
-        length = offset;
-        offset = 0;
-        while (offset < length) {
-            int n = recv(sock, &message[offset], length - offset, 0);
-            if (n <= 0) {
-                return -1;
-            }
-            offset += n;
+static bool append_bytes(uint8_t** buf, size_t* length, size_t* capacity,
+        const void* data, size_t size) {
+    if (*length + size > *capacity) {
+        size_t newCapacity = *capacity ? *capacity : 4096;
+        while (newCapacity < *length + size) {
+            newCapacity *= 2;
         }
+        uint8_t* newBuf = (uint8_t*) realloc(*buf, newCapacity);
+        if (newBuf == NULL) {
+            return false;
+        }
+        *buf = newBuf;
+        *capacity = newCapacity;
     }
-    return length;
+    memcpy(*buf + *length, data, size);
+    *length += size;
+    return true;
 }
 
-static int recv_end_of_file(int sock) {
-    uint8_t byte;
-    return recv(sock, &byte, 1, 0) == 0;
+static void send_code(Connection* conn, int8_t code) {
+    if (!append_bytes(&conn->out, &conn->outLength, &conn->outCapacity, &code, 1)) {
+        conn->closing = true;
+        return;
+    }
+    if (conn->session) {
+        uint32_t count = 0;
+        conn->replyStart = conn->outLength;
+        conn->replyMessages = 0;
+        append_bytes(&conn->out, &conn->outLength, &conn->outCapacity, &count, sizeof(count));
+    }
 }
 
-static void send_code(int sock, int8_t code) {
-    send(sock, &code, 1, 0);
+static void send_message(Connection* conn, const uint8_t* message, int length) {
+    uint16_t bytes = htons(length);
+    if (!append_bytes(&conn->out, &conn->outLength, &conn->outCapacity, &bytes, 2)
+            || !append_bytes(&conn->out, &conn->outLength, &conn->outCapacity, message, length)) {
+        conn->closing = true;
+        return;
+    }
+    if (conn->session) {
+        uint32_t count = htonl(++conn->replyMessages);
+        memcpy(conn->out + conn->replyStart, &count, sizeof(count));
+    }
 }
 
-static void send_message(int sock, const uint8_t* message, int length) {
-    uint16_t bytes = htons(length);
-    send(sock, &bytes, 2, 0);
-    send(sock, message, length, 0);
+/* Takes the next message of at most maxLength bytes off the front of a
+ * request. Returns its length, or -1 if it is truncated or too long. */
+static int take_message(const uint8_t** request, size_t* remaining, uint8_t* message,
+        int maxLength) {
+    if (*remaining < 2) {
+        return -1;
+    }
+    int length = (*request)[0] << 8 | (*request)[1];
+    if (length > maxLength || *remaining < 2 + (size_t) length) {
+        return -1;
+    }
+    memcpy(message, *request + 2, length);
+    *request += 2 + length;
+    *remaining -= 2 + length;
+    return length;
 }
 
 static ResponseCode get_key_for_name(KeyStore* keyStore, Blob* keyBlob, const Value* keyName,
@@ -932,11 +1500,11 @@ static ResponseCode get_key_for_name(KeyStore* keyStore, Blob* keyBlob, const Va
 
 static const ResponseCode NO_ERROR_RESPONSE_CODE_SENT = (ResponseCode) 0;
 
-static ResponseCode test(KeyStore* keyStore, int, uid_t, Value*, Value*, Value*) {
+static ResponseCode test(KeyStore* keyStore, Connection*, uid_t, Value*, Value*, Value*) {
     return (ResponseCode) keyStore->getState();
 }
 
-static ResponseCode get(KeyStore* keyStore, int sock, uid_t uid, Value* keyName, Value*, Value*) {
+static ResponseCode get(KeyStore* keyStore, Connection* conn, uid_t uid, Value* keyName, Value*, Value*) {
     char filename[NAME_MAX];
     encode_key_for_uid(filename, uid, keyName);
     Blob keyBlob;
@@ -944,12 +1512,12 @@ static ResponseCode get(KeyStore* keyStore, int sock, uid_t uid, Value* keyName,
     if (responseCode != NO_ERROR) {
         return responseCode;
     }
-    send_code(sock, NO_ERROR);
-    send_message(sock, keyBlob.getValue(), keyBlob.getLength());
+    send_code(conn, NO_ERROR);
+    send_message(conn, keyBlob.getValue(), keyBlob.getLength());
     return NO_ERROR_RESPONSE_CODE_SENT;
 }
 
-static ResponseCode insert(KeyStore* keyStore, int, uid_t uid, Value* keyName, Value* val,
+static ResponseCode insert(KeyStore* keyStore, Connection*, uid_t uid, Value* keyName, Value* val,
         Value*) {
     char filename[NAME_MAX];
     encode_key_for_uid(filename, uid, keyName);
@@ -957,7 +1525,7 @@ static ResponseCode insert(KeyStore* keyStore, int, uid_t uid, Value* keyName, V
     return keyStore->put(filename, &keyBlob);
 }
 
-static ResponseCode del(KeyStore* keyStore, int, uid_t uid, Value* keyName, Value*, Value*) {
+static ResponseCode del(KeyStore* keyStore, Connection*, uid_t uid, Value* keyName, Value*, Value*) {
     char filename[NAME_MAX];
     encode_key_for_uid(filename, uid, keyName);
     Blob keyBlob;
@@ -965,40 +1533,40 @@ static ResponseCode del(KeyStore* keyStore, int, uid_t uid, Value* keyName, Valu
     if (responseCode != NO_ERROR) {
         return responseCode;
     }
-    return (unlink(filename) && errno != ENOENT) ? SYSTEM_ERROR : NO_ERROR;
+    return keyStore->del(filename);
 }
 
-static ResponseCode exist(KeyStore*, int, uid_t uid, Value* keyName, Value*, Value*) {
+static ResponseCode exist(KeyStore* keyStore, Connection*, uid_t uid, Value* keyName, Value*,
+        Value*) {
+    if (keyStore->getIndex()->contains(uid, keyName->value, keyName->length)) {
+        return NO_ERROR;
+    }
+    // A key put in place since the index was checked; add it so saw sees it too.
     char filename[NAME_MAX];
     encode_key_for_uid(filename, uid, keyName);
     if (access(filename, R_OK) == -1) {
         return (errno != ENOENT) ? SYSTEM_ERROR : KEY_NOT_FOUND;
     }
+    keyStore->getIndex()->add(filename);
     return NO_ERROR;
 }
 
-static ResponseCode saw(KeyStore*, int sock, uid_t uid, Value* keyPrefix, Value*, Value*) {
-    DIR* dir = opendir(".");
-    if (!dir) {
-        return SYSTEM_ERROR;
-    }
-    char filename[NAME_MAX];
-    int n = encode_key_for_uid(filename, uid, keyPrefix);
-    send_code(sock, NO_ERROR);
+static ResponseCode saw(KeyStore* keyStore, Connection* conn, uid_t uid, Value* keyPrefix, Value*,
+        Value*) {
+    KeyIndex* index = keyStore->getIndex();
+    size_t end;
+    size_t i = index->findPrefix(uid, keyPrefix->value, keyPrefix->length, &end);
+    send_code(conn, NO_ERROR);
 
-    struct dirent* file;
-    while ((file = readdir(dir)) != NULL) {
-        if (!strncmp(filename, file->d_name, n)) {
-            const char* p = &file->d_name[n];
-            keyPrefix->length = decode_key(keyPrefix->value, p, strlen(p));
-            send_message(sock, keyPrefix->value, keyPrefix->length);
-        }
+    for (; i < end; ++i) {
+        size_t length;
+        const uint8_t* name = index->getName(uid, i, &length);
+        send_message(conn, name + keyPrefix->length, length - keyPrefix->length);
     }
-    closedir(dir);
     return NO_ERROR_RESPONSE_CODE_SENT;
 }
 
-static ResponseCode reset(KeyStore* keyStore, int, uid_t, Value*, Value*, Value*) {
+static ResponseCode reset(KeyStore* keyStore, Connection*, uid_t, Value*, Value*, Value*) {
     ResponseCode rc = keyStore->reset() ? NO_ERROR : SYSTEM_ERROR;
 
     const keymaster_device_t* device = keyStore->getDevice();
@@ -1026,7 +1594,7 @@ static ResponseCode reset(KeyStore* keyStore, int, uid_t, Value*, Value*, Value*
  * any thing goes wrong during the transition, the new file will not overwrite
  * the old one. This avoids permanent damages of the existing data. */
 
-static ResponseCode password(KeyStore* keyStore, int, uid_t, Value* pw, Value*, Value*) {
+static ResponseCode password(KeyStore* keyStore, Connection*, uid_t, Value* pw, Value*, Value*) {
     switch (keyStore->getState()) {
         case STATE_UNINITIALIZED: {
             // generate master key, encrypt with password, write to file, initialize mMasterKey*.
@@ -1044,21 +1612,21 @@ static ResponseCode password(KeyStore* keyStore, int, uid_t, Value* pw, Value*,
     return SYSTEM_ERROR;
 }
 
-static ResponseCode lock(KeyStore* keyStore, int, uid_t, Value*, Value*, Value*) {
+static ResponseCode lock(KeyStore* keyStore, Connection*, uid_t, Value*, Value*, Value*) {
     keyStore->lock();
     return NO_ERROR;
 }
 
-static ResponseCode unlock(KeyStore* keyStore, int sock, uid_t uid, Value* pw, Value* unused,
+static ResponseCode unlock(KeyStore* keyStore, Connection* conn, uid_t uid, Value* pw, Value* unused,
         Value* unused2) {
-    return password(keyStore, sock, uid, pw, unused, unused2);
+    return password(keyStore, conn, uid, pw, unused, unused2);
 }
 
-static ResponseCode zero(KeyStore* keyStore, int, uid_t, Value*, Value*, Value*) {
+static ResponseCode zero(KeyStore* keyStore, Connection*, uid_t, Value*, Value*, Value*) {
     return keyStore->isEmpty() ? KEY_NOT_FOUND : NO_ERROR;
 }
 
-static ResponseCode generate(KeyStore* keyStore, int, uid_t uid, Value* keyName, Value*,
+static ResponseCode generate(KeyStore* keyStore, Connection*, uid_t uid, Value* keyName, Value*,
         Value*) {
     char filename[NAME_MAX];
     uint8_t* data;
@@ -1091,7 +1659,7 @@ static ResponseCode generate(KeyStore* keyStore, int, uid_t uid, Value* keyName,
     return keyStore->put(filename, &keyBlob);
 }
 
-static ResponseCode import(KeyStore* keyStore, int, uid_t uid, Value* keyName, Value* key,
+static ResponseCode import(KeyStore* keyStore, Connection*, uid_t uid, Value* keyName, Value* key,
         Value*) {
     char filename[NAME_MAX];
 
@@ -1111,7 +1679,7 @@ static ResponseCode import(KeyStore* keyStore, int, uid_t uid, Value* keyName, V
  * "del_key" since the Java code doesn't really communicate what it's
  * intentions are.
  */
-static ResponseCode get_pubkey(KeyStore* keyStore, int sock, uid_t uid, Value* keyName, Value*, Value*) {
+static ResponseCode get_pubkey(KeyStore* keyStore, Connection* conn, uid_t uid, Value* keyName, Value*, Value*) {
     Blob keyBlob;
     ALOGV("get_pubkey '%s' from uid %d", ValueString(keyName).c_str(), uid);
 
@@ -1139,14 +1707,14 @@ static ResponseCode get_pubkey(KeyStore* keyStore, int sock, uid_t uid, Value* k
         return SYSTEM_ERROR;
     }
 
-    send_code(sock, NO_ERROR);
-    send_message(sock, data, dataLength);
+    send_code(conn, NO_ERROR);
+    send_message(conn, data, dataLength);
     free(data);
 
     return NO_ERROR_RESPONSE_CODE_SENT;
 }
 
-static ResponseCode del_key(KeyStore* keyStore, int, uid_t uid, Value* keyName, Value*,
+static ResponseCode del_key(KeyStore* keyStore, Connection*, uid_t uid, Value* keyName, Value*,
         Value*) {
     char filename[NAME_MAX];
     encode_key_for_uid(filename, uid, keyName);
@@ -1174,10 +1742,10 @@ static ResponseCode del_key(KeyStore* keyStore, int, uid_t uid, Value* keyName,
         return rc;
     }
 
-    return (unlink(filename) && errno != ENOENT) ? SYSTEM_ERROR : NO_ERROR;
+    return keyStore->del(filename);
 }
 
-static ResponseCode sign(KeyStore* keyStore, int sock, uid_t uid, Value* keyName, Value* data,
+static ResponseCode sign(KeyStore* keyStore, Connection* conn, uid_t uid, Value* keyName, Value* data,
         Value*) {
     ALOGV("sign %s from uid %d", ValueString(keyName).c_str(), uid);
     Blob keyBlob;
@@ -1213,12 +1781,12 @@ static ResponseCode sign(KeyStore* keyStore, int sock, uid_t uid, Value* keyName
         return SYSTEM_ERROR;
     }
 
-    send_code(sock, NO_ERROR);
-    send_message(sock, signedData, signedDataLength);
+    send_code(conn, NO_ERROR);
+    send_message(conn, signedData, signedDataLength);
     return NO_ERROR_RESPONSE_CODE_SENT;
 }
 
-static ResponseCode verify(KeyStore* keyStore, int, uid_t uid, Value* keyName, Value* data,
+static ResponseCode verify(KeyStore* keyStore, Connection*, uid_t uid, Value* keyName, Value* data,
         Value* signature) {
     Blob keyBlob;
     int rc;
@@ -1250,7 +1818,7 @@ static ResponseCode verify(KeyStore* keyStore, int, uid_t uid, Value* keyName, V
     }
 }
 
-static ResponseCode grant(KeyStore* keyStore, int, uid_t uid, Value* keyName,
+static ResponseCode grant(KeyStore* keyStore, Connection*, uid_t uid, Value* keyName,
         Value* granteeData, Value*) {
     char filename[NAME_MAX];
     encode_key_for_uid(filename, uid, keyName);
@@ -1262,7 +1830,7 @@ static ResponseCode grant(KeyStore* keyStore, int, uid_t uid, Value* keyName,
     return NO_ERROR;
 }
 
-static ResponseCode ungrant(KeyStore* keyStore, int, uid_t uid, Value* keyName,
+static ResponseCode ungrant(KeyStore* keyStore, Connection*, uid_t uid, Value* keyName,
         Value* granteeData, Value*) {
     char filename[NAME_MAX];
     encode_key_for_uid(filename, uid, keyName);
@@ -1273,7 +1841,7 @@ static ResponseCode ungrant(KeyStore* keyStore, int, uid_t uid, Value* keyName,
     return keyStore->removeGrant(filename, granteeData) ? NO_ERROR : KEY_NOT_FOUND;
 }
 
-static ResponseCode getmtime(KeyStore*, int sock, uid_t uid, Value* keyName,
+static ResponseCode getmtime(KeyStore*, Connection* conn, uid_t uid, Value* keyName,
         Value*, Value*) {
     char filename[NAME_MAX];
     encode_key_for_uid(filename, uid, keyName);
@@ -1299,8 +1867,8 @@ static ResponseCode getmtime(KeyStore*, int sock, uid_t uid, Value* keyName,
         return SYSTEM_ERROR;
     }
 
-    send_code(sock, NO_ERROR);
-    send_message(sock, data, dataLength);
+    send_code(conn, NO_ERROR);
+    send_message(conn, data, dataLength);
     free(data);
 
     return NO_ERROR_RESPONSE_CODE_SENT;
@@ -1325,11 +1893,19 @@ enum perm {
 };
 
 static const int MAX_PARAM = 3;
+static const size_t MAX_REQUEST_SIZE = 1 + MAX_PARAM * (2 + 65535);
+
+static const int MAX_CONNECTIONS = 16;
+static const int MAX_CONNECTIONS_PER_UID = 4;
+static const int ONE_SHOT_TIMEOUT = 3;        // seconds; matches the old socket timeouts
+static const int SESSION_IDLE_TIMEOUT = 10;   // seconds
+static const int MAX_REQUESTS_PER_WAKEUP = 16;
+static const size_t MAX_PENDING_OUTPUT = 256 * 1024;
 
 static const State STATE_ANY = (State) 0;
 
 static struct action {
-    ResponseCode (*run)(KeyStore* keyStore, int sock, uid_t uid, Value* param1, Value* param2,
+    ResponseCode (*run)(KeyStore* keyStore, Connection* conn, uid_t uid, Value* param1, Value* param2,
             Value* param3);
     int8_t code;
     State state;
@@ -1372,18 +1948,46 @@ static struct user {
                                P_SIGN | P_VERIFY},
 };
 
-static ResponseCode process(KeyStore* keyStore, int sock, uid_t uid, int8_t code) {
+static const struct action* find_action(int8_t code) {
+    const struct action* action = actions;
+    while (action->code && action->code != code) {
+        ++action;
+    }
+    return action->code ? action : NULL;
+}
+
+/* Returns the length of the complete request at the start of a session's
+ * input, 0 if more input is needed, or -1 if the request cannot be framed. */
+static ssize_t session_request_length(const uint8_t* buf, size_t length) {
+    if (length < 1) {
+        return 0;
+    }
+    const struct action* action = find_action(buf[0]);
+    if (action == NULL) {
+        return -1;
+    }
+    size_t offset = 1;
+    for (int i = 0; i < MAX_PARAM && action->lengths[i] != 0; ++i) {
+        if (length < offset + 2) {
+            return 0;
+        }
+        offset += 2 + (buf[offset] << 8 | buf[offset + 1]);
+    }
+    return (length < offset) ? 0 : offset;
+}
+
+static ResponseCode process(KeyStore* keyStore, Connection* conn, const uint8_t* request,
+        size_t length) {
     struct user* user = users;
-    struct action* action = actions;
+    uid_t uid = conn->uid;
+    int8_t code = request[0];
     int i;
 
     while (~user->uid && user->uid != (uid % AID_USER)) {
         ++user;
     }
-    while (action->code && action->code != code) {
-        ++action;
-    }
-    if (!action->code) {
+    const struct action* action = find_action(code);
+    if (action == NULL) {
         return UNDEFINED_ACTION;
     }
     if (!(action->perm & user->perms)) {
@@ -1396,16 +2000,208 @@ static ResponseCode process(KeyStore* keyStore, int sock, uid_t uid, int8_t code
         uid = user->euid;
     }
     Value params[MAX_PARAM];
+    ++request;
+    --length;
     for (i = 0; i < MAX_PARAM && action->lengths[i] != 0; ++i) {
-        params[i].length = recv_message(sock, params[i].value, action->lengths[i]);
+        params[i].length = take_message(&request, &length, params[i].value, action->lengths[i]);
         if (params[i].length < 0) {
             return PROTOCOL_ERROR;
         }
     }
-    if (!recv_end_of_file(sock)) {
+    if (length != 0) {
         return PROTOCOL_ERROR;
     }
-    return action->run(keyStore, sock, uid, &params[0], &params[1], &params[2]);
+    return action->run(keyStore, conn, uid, &params[0], &params[1], &params[2]);
+}
+
+static void run_request(KeyStore* keyStore, Connection* conn, const uint8_t* request,
+        size_t length) {
+    touch(conn, time(NULL));
+    State old_state = keyStore->getState();
+    ResponseCode response = process(keyStore, conn, request, length);
+    if (response == NO_ERROR_RESPONSE_CODE_SENT) {
+        response = NO_ERROR;
+    } else {
+        send_code(conn, response);
+    }
+    ALOGI("uid: %d action: %c -> %d state: %d -> %d retry: %d",
+         conn->uid,
+         request[0], response,
+         old_state, keyStore->getState(),
+         keyStore->getRetry());
+}
+
+/* Runs whatever complete requests a connection has buffered. One-shot
+ * connections run a single request once the client has shut down its side;
+ * sessions run requests as soon as they are complete. Returns true if a
+ * session still has complete requests waiting. */
+static bool handle_input(KeyStore* keyStore, Connection* conn) {
+    if (!conn->started && conn->inLength > 0) {
+        conn->started = true;
+        if (conn->in[0] == CommandCodes[SESSION]) {
+            conn->session = true;
+            memmove(conn->in, conn->in + 1, --conn->inLength);
+        }
+    }
+
+    if (!conn->session) {
+        if (conn->inLength > MAX_REQUEST_SIZE) {
+            send_code(conn, PROTOCOL_ERROR);
+            conn->closing = true;
+        } else if (conn->eof && !conn->closing) {
+            if (conn->inLength > 0) {
+                run_request(keyStore, conn, conn->in, conn->inLength);
+            }
+            conn->closing = true;
+        }
+        return false;
+    }
+
+    // Don't let one client's pipeline starve the others, or queue up
+    // replies without bound for a client that isn't reading them.
+    size_t consumed = 0;
+    ssize_t length = 0;
+    for (int n = 0; !conn->closing; ++n) {
+        length = session_request_length(conn->in + consumed, conn->inLength - consumed);
+        if (length < 0 || (length == 0 && conn->inLength - consumed > MAX_REQUEST_SIZE)) {
+            send_code(conn, (length < 0) ? UNDEFINED_ACTION : PROTOCOL_ERROR);
+            conn->closing = true;
+            break;
+        }
+        if (length == 0 || n == MAX_REQUESTS_PER_WAKEUP
+                || conn->outLength - conn->outOffset > MAX_PENDING_OUTPUT) {
+            break;
+        }
+        run_request(keyStore, conn, conn->in + consumed, length);
+        consumed += length;
+    }
+    conn->inLength -= consumed;
+    memmove(conn->in, conn->in + consumed, conn->inLength);
+    if (conn->eof && conn->inLength == 0) {
+        conn->closing = true;
+    }
+    return !conn->closing && length > 0
+            && conn->outLength - conn->outOffset <= MAX_PENDING_OUTPUT;
+}
+
+static bool read_input(Connection* conn) {
+    uint8_t buf[4096];
+    for (;;) {
+        ssize_t n = recv(conn->sock, buf, sizeof(buf), 0);
+        if (n > 0) {
+            if (!append_bytes(&conn->in, &conn->inLength, &conn->inCapacity, buf, n)) {
+                return false;
+            }
+            continue;
+        }
+        if (n == 0) {
+            conn->eof = true;
+            return true;
+        }
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+static bool write_output(Connection* conn) {
+    while (conn->outOffset < conn->outLength) {
+        ssize_t n = send(conn->sock, conn->out + conn->outOffset,
+                conn->outLength - conn->outOffset, MSG_NOSIGNAL);
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        conn->outOffset += n;
+    }
+    conn->outOffset = conn->outLength = 0;
+    return true;
+}
+
+static Connection* accept_connection(int controlSocket) {
+    int sock = accept(controlSocket, NULL, 0);
+    if (sock == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            ALOGE("accept: %s", strerror(errno));
+        }
+        return NULL;
+    }
+
+    struct ucred cred;
+    socklen_t size = sizeof(cred);
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &size) != 0) {
+        ALOGW("getsockopt: %s", strerror(errno));
+        close(sock);
+        return NULL;
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+
+    Connection* conn = new Connection;
+    memset(conn, 0, sizeof(*conn));
+    conn->sock = sock;
+    conn->uid = cred.uid;
+    touch(conn, time(NULL));
+    return conn;
+}
+
+static void close_connection(Connection* conn) {
+    close(conn->sock);
+    free(conn->in);
+    free(conn->out);
+    delete conn;
+}
+
+/* Whether a connection can be closed without losing a request: a session
+ * whose requests have all been answered and sent. A connection still being
+ * read, or one that hasn't said yet whether it is a session, never is. */
+static bool is_idle_session(const Connection* conn) {
+    return conn->session && !conn->closing && conn->inLength == 0
+            && conn->outLength == conn->outOffset;
+}
+
+/* Makes room for a new connection from uid, if need be by closing an idle
+ * session: the least recently active one of that uid when it is at its limit,
+ * or of anyone when the table is full. Returns false if there is no room and
+ * nothing can be closed, in which case the connection has to wait. */
+static bool make_room(Connection** conns, int* numConns, uid_t uid) {
+    int oldestIdle = -1;
+    int oldestIdleOfUid = -1;
+    int ofUid = 0;
+    for (int i = 0; i < *numConns; ++i) {
+        bool idle = is_idle_session(conns[i]);
+        if (idle && (oldestIdle == -1 || conns[i]->activity < conns[oldestIdle]->activity)) {
+            oldestIdle = i;
+        }
+        if (conns[i]->uid == uid) {
+            ++ofUid;
+            if (idle && (oldestIdleOfUid == -1
+                    || conns[i]->activity < conns[oldestIdleOfUid]->activity)) {
+                oldestIdleOfUid = i;
+            }
+        }
+    }
+
+    int victim = -1;
+    if (ofUid >= MAX_CONNECTIONS_PER_UID) {
+        victim = oldestIdleOfUid;
+    } else if (*numConns == MAX_CONNECTIONS) {
+        victim = oldestIdle;
+    } else {
+        return true;
+    }
+    if (victim == -1) {
+        return false;
+    }
+    ALOGW("closing idle session of uid %d for a connection from uid %d", conns[victim]->uid, uid);
+    close_connection(conns[victim]);
+    conns[victim] = conns[--*numConns];
+    return true;
+}
+
+static bool has_idle_session(Connection* const* conns, int numConns) {
+    for (int i = 0; i < numConns; ++i) {
+        if (is_idle_session(conns[i])) {
+            return true;
+        }
+    }
+    return false;
 }
 
 int main(int argc, char* argv[]) {
@@ -1430,46 +2226,101 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    if (listen(controlSocket, 3) == -1) {
+    if (listen(controlSocket, MAX_CONNECTIONS) == -1) {
         ALOGE("listen: %s", strerror(errno));
         return 1;
     }
+    fcntl(controlSocket, F_SETFL, fcntl(controlSocket, F_GETFL) | O_NONBLOCK);
 
     signal(SIGPIPE, SIG_IGN);
 
+    /* Requests are still run one at a time on this thread, but clients are
+     * multiplexed with poll() so a slow or idle client cannot hold up the
+     * others while it sends its request or reads its reply. */
     KeyStore keyStore(&entropy, dev);
-    int sock;
-    while ((sock = accept(controlSocket, NULL, 0)) != -1) {
-        struct timeval tv;
-        tv.tv_sec = 3;
-        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
-
-        struct ucred cred;
-        socklen_t size = sizeof(cred);
-        int credResult = getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &size);
-        if (credResult != 0) {
-            ALOGW("getsockopt: %s", strerror(errno));
-        } else {
-            int8_t request;
-            if (recv_code(sock, &request)) {
-                State old_state = keyStore.getState();
-                ResponseCode response = process(&keyStore, sock, cred.uid, request);
-                if (response == NO_ERROR_RESPONSE_CODE_SENT) {
-                    response = NO_ERROR;
-                } else {
-                    send_code(sock, response);
+    Connection* conns[MAX_CONNECTIONS];
+    struct pollfd fds[MAX_CONNECTIONS + 1];
+    int numConns = 0;
+    bool busy = false;
+    // Accepted, but there was no room for it. Nothing more is accepted until
+    // it gets in, so later clients wait in the listen backlog.
+    Connection* waiting = NULL;
+
+    for (;;) {
+        fds[0].fd = controlSocket;
+        fds[0].events = 0;
+        if (waiting == NULL
+                && (numConns < MAX_CONNECTIONS || has_idle_session(conns, numConns))) {
+            fds[0].events = POLLIN;
+        }
+        fds[0].revents = 0;
+        for (int i = 0; i < numConns; ++i) {
+            fds[i + 1].fd = conns[i]->sock;
+            fds[i + 1].events = 0;
+            fds[i + 1].revents = 0;
+            if (!conns[i]->eof && !conns[i]->closing) {
+                fds[i + 1].events |= POLLIN;
+            }
+            if (conns[i]->outLength > conns[i]->outOffset) {
+                fds[i + 1].events |= POLLOUT;
+            }
+        }
+        if (poll(fds, numConns + 1, busy ? 0 : 1000) == -1 && errno != EINTR) {
+            ALOGE("poll: %s", strerror(errno));
+            break;
+        }
+
+        time_t now = time(NULL);
+        busy = false;
+        for (int i = 0; i < numConns; ++i) {
+            Connection* conn = conns[i];
+            bool ok = true;
+            // Bytes trickling in don't count as activity, or a client could
+            // hold a connection forever without ever completing a request.
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                ok = read_input(conn);
+            }
+            if (ok && handle_input(&keyStore, conn)) {
+                busy = true;
+            }
+            size_t pending = conn->outLength - conn->outOffset;
+            if (ok && pending > 0) {
+                ok = write_output(conn);
+                if (conn->outLength - conn->outOffset < pending) {
+                    touch(conn, now);
                 }
-                ALOGI("uid: %d action: %c -> %d state: %d -> %d retry: %d",
-                     cred.uid,
-                     request, response,
-                     old_state, keyStore.getState(),
-                     keyStore.getRetry());
+            }
+            int timeout = conn->session ? SESSION_IDLE_TIMEOUT : ONE_SHOT_TIMEOUT;
+            bool drained = conn->outLength == conn->outOffset;
+            if (!ok || (conn->closing && drained) || now - conn->lastActive > timeout) {
+                close_connection(conn);
+                fds[i + 1] = fds[numConns];
+                conns[i] = conns[numConns - 1];
+                --numConns;
+                --i;
+            }
+        }
+
+        if (waiting != NULL && make_room(conns, &numConns, waiting->uid)) {
+            // its time to send a request starts now
+            touch(waiting, now);
+            conns[numConns++] = waiting;
+            waiting = NULL;
+        }
+        if (waiting == NULL && (fds[0].revents & POLLIN)) {
+            for (int n = 0; n < MAX_CONNECTIONS; ++n) {
+                Connection* conn = accept_connection(controlSocket);
+                if (conn == NULL) {
+                    break;
+                }
+                if (!make_room(conns, &numConns, conn->uid)) {
+                    waiting = conn;
+                    break;
+                }
+                conns[numConns++] = conn;
             }
         }
-        close(sock);
     }
-    ALOGE("accept: %s", strerror(errno));
 
     keymaster_device_release(dev);
 
@@ -64,12 +64,13 @@ enum CommandNames {
     GRANT = 17,
     UNGRANT = 18,
     GETMTIME = 19,
+    SESSION = 20,
 };
 
 typedef uint8_t command_code_t;
 
 // Taken: a b c d e f g h i j k l m n o p q r s t u v w x y z
-//        * * * * *   *   *   * * * *   *   * * * * *   *   *
+//        * * * * *   *   *   * * * * * *   * * * * *   *   *
 command_code_t CommandCodes[] = {
     't', // TEST
     'g', // GET
@@ -91,6 +92,7 @@ command_code_t CommandCodes[] = {
     'x', // GRANT
     'y', // UNGRANT
     'c', // GETMTIME
+    'o', // SESSION
 };
 
 /**
@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures keystore throughput for repeated GET and SIGN requests, using a
+ * new connection per request (keystore_cmd), one request at a time on a
+ * session, and pipelined requests on a session, plus the latency of
+ * individual requests on a session. With -k, also times SAW and EXIST
+ * against that many keys. The keystore must be unlocked; the benchmark
+ * creates and deletes its own keys.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <keystore.h>
+#include <keystore_client.h>
+
+static const char KEY_NAME[] = "keystore_bench_value";
+static const char PAIR_NAME[] = "keystore_bench_pair";
+
+static int iterations = 1000;
+static int depth = 16;
+static int numKeys = 0;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define ARG(s) (size_t) (sizeof(s) - 1), (const uint8_t*) (s)
+
+struct Op {
+    const char* name;
+    command_code_t code;
+    int numArgs;
+};
+
+// Both ops send the key name; SIGN also sends a 256-byte block to sign.
+static uint8_t signData[256];
+
+static ResponseCode oneShot(const Op& op, Keystore_Reply* reply) {
+    if (op.numArgs == 1) {
+        return keystore_cmd(op.code, reply, 1, ARG(KEY_NAME));
+    }
+    return keystore_cmd(op.code, reply, 2, ARG(PAIR_NAME), sizeof(signData), signData);
+}
+
+static bool sessionSend(Keystore_Session* s, const Op& op) {
+    if (op.numArgs == 1) {
+        return s->send(op.code, 1, ARG(KEY_NAME));
+    }
+    return s->send(op.code, 2, ARG(PAIR_NAME), sizeof(signData), signData);
+}
+
+static int compareDouble(const void* a, const void* b) {
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x < y) ? -1 : (x > y);
+}
+
+static void report(const char* op, const char* mode, int n, double elapsed, int failures) {
+    printf("%-5s %-22s %8.0f ops/s  (%d ops, %d failures)\n", op, mode, n / elapsed, n,
+           failures);
+}
+
+static void bench(const Op& op) {
+    Keystore_Reply reply;
+    int failures = 0;
+
+    double t0 = now();
+    for (int i = 0; i < iterations; i++) {
+        if (oneShot(op, &reply) != NO_ERROR) {
+            failures++;
+        }
+    }
+    report(op.name, "connection per request", iterations, now() - t0, failures);
+
+    Keystore_Session session;
+    if (!session.connect()) {
+        fprintf(stderr, "could not open keystore session\n");
+        return;
+    }
+
+    failures = 0;
+    double* latency = new double[iterations];
+    t0 = now();
+    for (int i = 0; i < iterations; i++) {
+        double start = now();
+        if (!sessionSend(&session, op) || session.receive(&reply) != NO_ERROR) {
+            failures++;
+        }
+        latency[i] = now() - start;
+    }
+    report(op.name, "session", iterations, now() - t0, failures);
+
+    // Repeated requests for the same key; with the blob cache these should
+    // not touch the filesystem or decrypt after the first one.
+    qsort(latency, iterations, sizeof(double), compareDouble);
+    printf("%-5s %-22s %8.1f us p50  %8.1f us p99  %8.1f us max\n", op.name, "session latency",
+           latency[iterations / 2] * 1e6, latency[iterations * 99 / 100] * 1e6,
+           latency[iterations - 1] * 1e6);
+    delete[] latency;
+
+    char mode[32];
+    snprintf(mode, sizeof(mode), "session, depth %d", depth);
+    failures = 0;
+    int sent = 0, received = 0;
+    t0 = now();
+    while (received < iterations) {
+        while (sent < iterations && sent - received < depth) {
+            if (!sessionSend(&session, op)) {
+                fprintf(stderr, "send failed\n");
+                return;
+            }
+            sent++;
+        }
+        if (session.receive(&reply) != NO_ERROR) {
+            failures++;
+        }
+        received++;
+    }
+    report(op.name, mode, iterations, now() - t0, failures);
+}
+
+/* Populates the store with numKeys keys, then times prefix listing (SAW)
+ * and EXIST against it. */
+static void benchIndex() {
+    Keystore_Session session;
+    Keystore_Reply reply;
+    char name[32];
+    uint8_t value[16];
+    memset(value, 'v', sizeof(value));
+
+    double t0 = now();
+    int sent = 0, received = 0, failures = 0;
+    while (received < numKeys) {
+        while (sent < numKeys && sent - received < depth) {
+            int n = snprintf(name, sizeof(name), "bench_idx_%06d", sent);
+            if (!session.send(CommandCodes[INSERT], 2, (size_t) n, name, sizeof(value), value)) {
+                fprintf(stderr, "send failed\n");
+                return;
+            }
+            sent++;
+        }
+        if (session.receive(NULL) != NO_ERROR) {
+            failures++;
+        }
+        received++;
+    }
+    report("insert", "indexed keys", numKeys, now() - t0, failures);
+
+    // Each prefix matches ten keys.
+    failures = 0;
+    t0 = now();
+    for (int i = 0; i < iterations; i++) {
+        int n = snprintf(name, sizeof(name), "bench_idx_%05d", i % (numKeys / 10 + 1));
+        if (session.cmd(CommandCodes[SAW], &reply, 1, (size_t) n, name) != NO_ERROR) {
+            failures++;
+        }
+    }
+    report("saw", "10 of N keys", iterations, now() - t0, failures);
+
+    failures = 0;
+    t0 = now();
+    for (int i = 0; i < iterations; i++) {
+        int n = snprintf(name, sizeof(name), "bench_idx_%06d", i % numKeys);
+        if (session.cmd(CommandCodes[EXIST], NULL, 1, (size_t) n, name) != NO_ERROR) {
+            failures++;
+        }
+    }
+    report("exist", "indexed keys", iterations, now() - t0, failures);
+
+    sent = received = 0;
+    while (received < numKeys) {
+        while (sent < numKeys && sent - received < depth) {
+            int n = snprintf(name, sizeof(name), "bench_idx_%06d", sent);
+            if (!session.send(CommandCodes[DELETE], 1, (size_t) n, name)) {
+                return;
+            }
+            sent++;
+        }
+        session.receive(NULL);
+        received++;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int c;
+    while ((c = getopt(argc, argv, "n:d:k:")) != -1) {
+        switch (c) {
+        case 'n': iterations = atoi(optarg); break;
+        case 'd': depth = atoi(optarg); break;
+        case 'k': numKeys = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-d pipeline depth] [-k keys to index]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    if (keystore_cmd(CommandCodes[TEST], NULL, 0) != NO_ERROR) {
+        fprintf(stderr, "keystore is not unlocked\n");
+        return 1;
+    }
+    memset(signData, 0x5a, sizeof(signData));
+    signData[0] = 0;    // keep the raw RSA input below the modulus
+
+    uint8_t value[128];
+    memset(value, 'v', sizeof(value));
+    if (keystore_cmd(CommandCodes[INSERT], NULL, 2, ARG(KEY_NAME), sizeof(value), value)
+            != NO_ERROR) {
+        fprintf(stderr, "could not insert %s\n", KEY_NAME);
+        return 1;
+    }
+    bool havePair = keystore_cmd(CommandCodes[GENERATE], NULL, 1, ARG(PAIR_NAME)) == NO_ERROR;
+
+    const Op get = { "get", CommandCodes[GET], 1 };
+    const Op sign = { "sign", CommandCodes[SIGN], 2 };
+    bench(get);
+    if (havePair) {
+        bench(sign);
+    } else {
+        fprintf(stderr, "could not generate %s; skipping sign\n", PAIR_NAME);
+    }
+
+    keystore_cmd(CommandCodes[DELETE], NULL, 1, ARG(KEY_NAME));
+    if (havePair) {
+        keystore_cmd(CommandCodes[DEL_KEY], NULL, 1, ARG(PAIR_NAME));
+    }
+
+    if (numKeys > 0) {
+        benchIndex();
+    }
+    return 0;
+}
@@ -17,8 +17,12 @@
 #include <keystore.h>
 #include <keystore_client.h>
 
+#include <string.h>
+
 #include <cutils/sockets.h>
 
+#include <utils/UniquePtr.h>
+
 #define LOG_TAG "keystore_client"
 #include <cutils/log.h>
 
@@ -96,6 +100,161 @@ ResponseCode keystore_cmd(command_code_t cmd, Keystore_Reply* reply, int numArgs
     return static_cast<ResponseCode>(code);
 }
 
+Keystore_Session::Keystore_Session()
+        : mSock(-1) {
+}
+
+Keystore_Session::~Keystore_Session() {
+    disconnect();
+}
+
+bool Keystore_Session::connect() {
+    if (mSock != -1) {
+        return true;
+    }
+    mSock = socket_local_client("keystore", ANDROID_SOCKET_NAMESPACE_RESERVED, SOCK_STREAM);
+    if (mSock == -1) {
+        return false;
+    }
+    uint8_t code = CommandCodes[SESSION];
+    if (TEMP_FAILURE_RETRY(::send(mSock, &code, 1, MSG_NOSIGNAL)) != 1) {
+        disconnect();
+        return false;
+    }
+    return true;
+}
+
+void Keystore_Session::disconnect() {
+    if (mSock != -1) {
+        close(mSock);
+        mSock = -1;
+    }
+}
+
+bool Keystore_Session::sendArgs(command_code_t cmd, int numArgs, va_list vl) {
+    // Build the whole request first so it goes out in one write.
+    size_t length = 1;
+    va_list sizes;
+    va_copy(sizes, vl);
+    for (int i = 0; i < numArgs; i++) {
+        size_t argLen = va_arg(sizes, size_t);
+        va_arg(sizes, uint8_t*);
+        if (argLen > KEYSTORE_MESSAGE_SIZE) {
+            ALOGE("code called us with an argLen out of bounds: %llu", (unsigned long long) argLen);
+            va_end(sizes);
+            return false;
+        }
+        length += 2 + argLen;
+    }
+    va_end(sizes);
+
+    UniquePtr<uint8_t[]> request(new uint8_t[length]);
+    uint8_t* p = request.get();
+    *p++ = cmd;
+    for (int i = 0; i < numArgs; i++) {
+        size_t argLen = va_arg(vl, size_t);
+        uint8_t* arg = va_arg(vl, uint8_t*);
+        *p++ = argLen >> 8;
+        *p++ = argLen;
+        memcpy(p, arg, argLen);
+        p += argLen;
+    }
+
+    for (size_t offset = 0; offset < length; ) {
+        ssize_t n = TEMP_FAILURE_RETRY(::send(mSock, request.get() + offset, length - offset,
+                MSG_NOSIGNAL));
+        if (n <= 0) {
+            ALOGW("truncated write to keystore");
+            return false;
+        }
+        offset += n;
+    }
+    return true;
+}
+
+bool Keystore_Session::send(command_code_t cmd, int numArgs, ...) {
+    if (!connect()) {
+        return false;
+    }
+    va_list vl;
+    va_start(vl, numArgs);
+    bool ok = sendArgs(cmd, numArgs, vl);
+    va_end(vl);
+    if (!ok) {
+        disconnect();
+    }
+    return ok;
+}
+
+bool Keystore_Session::recvFully(uint8_t* data, size_t length) {
+    for (size_t offset = 0; offset < length; ) {
+        ssize_t n = TEMP_FAILURE_RETRY(recv(mSock, data + offset, length - offset, 0));
+        if (n <= 0) {
+            return false;
+        }
+        offset += n;
+    }
+    return true;
+}
+
+ResponseCode Keystore_Session::receive(Keystore_Reply* reply) {
+    uint8_t code;
+    uint8_t count[4];
+    if (mSock == -1 || !recvFully(&code, 1) || !recvFully(count, 4)) {
+        ALOGW("truncated read from keystore for code");
+        disconnect();
+        return SYSTEM_ERROR;
+    }
+
+    uint32_t messages = count[0] << 24 | count[1] << 16 | count[2] << 8 | count[3];
+    for (uint32_t i = 0; i < messages; i++) {
+        uint8_t bytes[2];
+        if (!recvFully(bytes, 2)) {
+            ALOGW("truncated read from keystore for length");
+            disconnect();
+            return SYSTEM_ERROR;
+        }
+        size_t length = bytes[0] << 8 | bytes[1];
+        uint8_t discard[256];
+        bool keep = (i == 0 && reply != NULL);
+        while (!keep && length > 0) {
+            size_t chunk = length < sizeof(discard) ? length : sizeof(discard);
+            if (!recvFully(discard, chunk)) {
+                break;
+            }
+            length -= chunk;
+        }
+        if ((keep && !recvFully(reply->get(), length)) || (!keep && length > 0)) {
+            ALOGW("truncated read from keystore for data");
+            disconnect();
+            return SYSTEM_ERROR;
+        }
+        if (keep) {
+            reply->setLength(length);
+        }
+    }
+
+    if (reply != NULL) {
+        reply->setCode(static_cast<ResponseCode>(code));
+    }
+    return static_cast<ResponseCode>(code);
+}
+
+ResponseCode Keystore_Session::cmd(command_code_t cmd, Keystore_Reply* reply, int numArgs, ...) {
+    if (!connect()) {
+        return SYSTEM_ERROR;
+    }
+    va_list vl;
+    va_start(vl, numArgs);
+    bool ok = sendArgs(cmd, numArgs, vl);
+    va_end(vl);
+    if (!ok) {
+        disconnect();
+        return SYSTEM_ERROR;
+    }
+    return receive(reply);
+}
+
 Keystore_Reply::Keystore_Reply()
         : mCode(SYSTEM_ERROR)
         , mLength(-1) {
@@ -17,6 +17,8 @@
 #ifndef __KEYSTORE_CLIENT_H__
 #define __KEYSTORE_CLIENT_H__
 
+#include <stdarg.h>
+
 #include <keystore.h>
 
 #define KEYSTORE_MESSAGE_SIZE 65535
@@ -48,4 +50,32 @@ private:
  */
 ResponseCode keystore_cmd(command_code_t cmd, Keystore_Reply* reply, int numArgs, ...);
 
+
+/**
+ * A persistent connection to the keystore. Requests sent with send() are
+ * pipelined; their replies must be collected with receive() in the same
+ * order. Unlike keystore_cmd(), receive() returns the keystore's own
+ * response code. Only the first message of a reply is kept in the
+ * Keystore_Reply; any others (e.g. from SAW) are discarded.
+ */
+class Keystore_Session {
+public:
+    Keystore_Session();
+    ~Keystore_Session();
+
+    bool connect();
+    void disconnect();
+
+    bool send(command_code_t cmd, int numArgs, ...);
+    ResponseCode receive(Keystore_Reply* reply);
+
+    ResponseCode cmd(command_code_t cmd, Keystore_Reply* reply, int numArgs, ...);
+
+private:
+    bool sendArgs(command_code_t cmd, int numArgs, va_list vl);
+    bool recvFully(uint8_t* data, size_t length);
+
+    int mSock;
+};
+
 #endif /* __KEYSTORE_CLIENT_H__ */
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks that one client cannot keep others away from the keystore. A child
+ * running as app_0 opens more idle sessions than the keystore serves at once;
+ * then a client running as app_1 must still get an answer. Last, app_1 makes
+ * more one-shot requests at once than one uid may have connections, and every
+ * one of them must be answered: the extra ones wait, nothing is dropped.
+ * Run as root, from test-keystore.
+ */
+
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cutils/sockets.h>
+
+#include <keystore.h>
+#include <keystore_client.h>
+
+static const uid_t HOLDER_UID = 10000;     // app_0
+static const uid_t CLIENT_UID = 10001;     // app_1
+static const int NUM_HELD = 17;
+static const int NUM_CONCURRENT = 8;
+
+static void timedOut(int) {
+    static const char msg[] = "second uid not served\n";
+    _exit(write(STDOUT_FILENO, msg, sizeof(msg) - 1) == -1 ? 2 : 1);
+}
+
+/* Opens NUM_HELD sessions that send nothing after the session byte, tells
+ * the parent, waits for it to be done, then exits with how many of them the
+ * keystore has kept open. */
+static int hold(int ready, int done) {
+    if (setuid(HOLDER_UID) != 0) {
+        perror("setuid");
+        return 0;
+    }
+    int socks[NUM_HELD];
+    for (int i = 0; i < NUM_HELD; i++) {
+        socks[i] = socket_local_client("keystore", ANDROID_SOCKET_NAMESPACE_RESERVED,
+                SOCK_STREAM);
+        if (socks[i] != -1) {
+            uint8_t session = CommandCodes[SESSION];
+            send(socks[i], &session, sizeof(session), MSG_NOSIGNAL);
+        }
+        // Let the keystore take each one before the next.
+        usleep(10000);
+    }
+    char c = 0;
+    if (write(ready, &c, 1) != 1 || read(done, &c, 1) != 1) {
+        return 0;
+    }
+
+    int open = 0;
+    for (int i = 0; i < NUM_HELD; i++) {
+        struct pollfd p = { socks[i], POLLIN, 0 };
+        if (socks[i] != -1 && poll(&p, 1, 0) == 0) {
+            open++;
+        }
+    }
+    return open;
+}
+
+/* Sends a one-shot TEST request and returns whether any answer came back;
+ * keystore_cmd() can't tell an answer other than NO_ERROR from none. */
+static bool one_shot() {
+    int sock = socket_local_client("keystore", ANDROID_SOCKET_NAMESPACE_RESERVED, SOCK_STREAM);
+    if (sock == -1) {
+        return false;
+    }
+    uint8_t code = CommandCodes[TEST];
+    bool answered = send(sock, &code, 1, MSG_NOSIGNAL) == 1 && shutdown(sock, SHUT_WR) == 0
+            && recv(sock, &code, 1, 0) == 1;
+    close(sock);
+    return answered;
+}
+
+int main() {
+    if (getuid() != 0) {
+        fprintf(stderr, "must run as root\n");
+        return 1;
+    }
+
+    int ready[2], done[2];
+    if (pipe(ready) != 0 || pipe(done) != 0) {
+        perror("pipe");
+        return 1;
+    }
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        _exit(hold(ready[1], done[0]));
+    }
+
+    char c;
+    if (read(ready[0], &c, 1) != 1) {
+        fprintf(stderr, "holder failed\n");
+        return 1;
+    }
+    if (setuid(CLIENT_UID) != 0) {
+        perror("setuid");
+        return 1;
+    }
+    signal(SIGALRM, timedOut);
+    alarm(5);
+    Keystore_Session session;
+    ResponseCode code = session.cmd(CommandCodes[TEST], NULL, 0);
+    alarm(0);
+    printf("second uid %s\n", code != SYSTEM_ERROR ? "served" : "not served");
+
+    if (write(done[1], &c, 1) != 1) {
+        perror("write");
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    printf("%d of %d sessions from one uid kept open\n",
+            WIFEXITED(status) ? WEXITSTATUS(status) : -1, NUM_HELD);
+
+    // Each child exits with 0 if its request was answered.
+    pid_t pids[NUM_CONCURRENT];
+    for (int i = 0; i < NUM_CONCURRENT; i++) {
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            alarm(5);
+            _exit(one_shot() ? 0 : 1);
+        }
+    }
+    int answered = 0;
+    for (int i = 0; i < NUM_CONCURRENT; i++) {
+        if (pids[i] != -1 && waitpid(pids[i], &status, 0) == pids[i]
+                && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            answered++;
+        }
+    }
+    printf("%d of %d concurrent requests from one uid answered\n", answered, NUM_CONCURRENT);
+
+    return code != SYSTEM_ERROR && answered == NUM_CONCURRENT ? 0 : 1;
+}
@@ -16,7 +16,8 @@ common_src_files := \
 	Devmapper.cpp \
 	ResponseCode.cpp \
 	Xwarp.cpp \
-	cryptfs.c
+	cryptfs.c \
+	cryptfs_inplace.c
 
 common_c_includes := \
 	$(KERNEL_HEADERS) \
@@ -58,7 +59,7 @@ LOCAL_C_INCLUDES := $(common_c_includes)
 
 LOCAL_CFLAGS := -Werror=format
 
-LOCAL_SHARED_LIBRARIES := $(common_shared_libraries)
+LOCAL_SHARED_LIBRARIES := $(common_shared_libraries) libcorkscrew
 
 LOCAL_STATIC_LIBRARIES := libfs_mgr
 
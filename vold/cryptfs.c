@@ -40,6 +40,7 @@
 #include <linux/kdev_t.h>
 #include <fs_mgr.h>
 #include "cryptfs.h"
+#include "cryptfs_inplace.h"
 #define LOG_TAG "Cryptfs"
 #include "cutils/android_reboot.h"
 #include "cutils/log.h"
@@ -1027,31 +1028,33 @@ static int cryptfs_enable_wipe(char *crypto_blkdev, off64_t size, int type)
     return rc;
 }
 
-static inline int unix_read(int  fd, void*  buff, int  len)
-{
-    int  ret;
-    do { ret = read(fd, buff, len); } while (ret < 0 && errno == EINTR);
-    return ret;
-}
+struct inplace_progress {
+    off64_t already_done;
+    off64_t one_pct;
+    off64_t cur_pct;
+};
 
-static inline int unix_write(int  fd, const void*  buff, int  len)
+static void inplace_progress(void *cookie, off64_t sectors_done)
 {
-    int  ret;
-    do { ret = write(fd, buff, len); } while (ret < 0 && errno == EINTR);
-    return ret;
+    struct inplace_progress *p = cookie;
+    off64_t new_pct = (p->already_done + sectors_done) / p->one_pct;
+
+    if (new_pct > p->cur_pct) {
+        char buf[8];
+
+        p->cur_pct = new_pct;
+        snprintf(buf, sizeof(buf), "%lld", p->cur_pct);
+        property_set("vold.encrypt_progress", buf);
+    }
 }
 
-#define CRYPT_INPLACE_BUFSIZE 4096
-#define CRYPT_SECTORS_PER_BUFSIZE (CRYPT_INPLACE_BUFSIZE / 512)
 static int cryptfs_enable_inplace(char *crypto_blkdev, char *real_blkdev, off64_t size,
                                   off64_t *size_already_done, off64_t tot_size)
 {
     int realfd, cryptofd;
-    char *buf[CRYPT_INPLACE_BUFSIZE];
-    int rc = -1;
-    off64_t numblocks, i, remainder;
-    off64_t one_pct, cur_pct, new_pct;
-    off64_t blocks_already_done, tot_numblocks;
+    int rc;
+    struct inplace_progress progress;
+    off64_t copied = 0;
 
     if ( (realfd = open(real_blkdev, O_RDONLY)) < 0) { 
         SLOGE("Error opening real_blkdev %s for inplace encrypt\n", real_blkdev);
@@ -1064,56 +1067,27 @@ static int cryptfs_enable_inplace(char *crypto_blkdev, char *real_blkdev, off64_
         return -1;
     }
 
-    /* This is pretty much a simple loop of reading 4K, and writing 4K.
-     * The size passed in is the number of 512 byte sectors in the filesystem.
-     * So compute the number of whole 4K blocks we should read/write,
-     * and the remainder.
+    /* The size passed in is the number of 512 byte sectors in the filesystem.
+     * Only the blocks an ext4 filesystem has in use need to go through
+     * dm-crypt; see cryptfs_inplace.c.
      */
-    numblocks = size / CRYPT_SECTORS_PER_BUFSIZE;
-    remainder = size % CRYPT_SECTORS_PER_BUFSIZE;
-    tot_numblocks = tot_size / CRYPT_SECTORS_PER_BUFSIZE;
-    blocks_already_done = *size_already_done / CRYPT_SECTORS_PER_BUFSIZE;
+    progress.already_done = *size_already_done;
+    progress.one_pct = tot_size / 100;
+    if (progress.one_pct == 0) {
+        progress.one_pct = 1;
+    }
+    progress.cur_pct = 0;
 
     SLOGE("Encrypting filesystem in place...");
 
-    one_pct = tot_numblocks / 100;
-    cur_pct = 0;
-    /* process the majority of the filesystem in blocks */
-    for (i=0; i<numblocks; i++) {
-        new_pct = (i + blocks_already_done) / one_pct;
-        if (new_pct > cur_pct) {
-            char buf[8];
-
-            cur_pct = new_pct;
-            snprintf(buf, sizeof(buf), "%lld", cur_pct);
-            property_set("vold.encrypt_progress", buf);
-        }
-        if (unix_read(realfd, buf, CRYPT_INPLACE_BUFSIZE) <= 0) {
-            SLOGE("Error reading real_blkdev %s for inplace encrypt\n", crypto_blkdev);
-            goto errout;
-        }
-        if (unix_write(cryptofd, buf, CRYPT_INPLACE_BUFSIZE) <= 0) {
-            SLOGE("Error writing crypto_blkdev %s for inplace encrypt\n", crypto_blkdev);
-            goto errout;
-        }
-    }
-
-    /* Do any remaining sectors */
-    for (i=0; i<remainder; i++) {
-        if (unix_read(realfd, buf, 512) <= 0) {
-            SLOGE("Error reading rival sectors from real_blkdev %s for inplace encrypt\n", crypto_blkdev);
-            goto errout;
-        }
-        if (unix_write(cryptofd, buf, 512) <= 0) {
-            SLOGE("Error writing final sectors to crypto_blkdev %s for inplace encrypt\n", crypto_blkdev);
-            goto errout;
-        }
+    rc = cryptfs_inplace_copy(realfd, cryptofd, size, inplace_progress, &progress, &copied);
+    if (rc) {
+        SLOGE("Error encrypting %s in place through %s\n", real_blkdev, crypto_blkdev);
+    } else {
+        SLOGI("Encrypted %lld of %lld bytes of %s\n", copied, size * 512, real_blkdev);
+        *size_already_done += size;
     }
 
-    *size_already_done += size;
-    rc = 0;
-
-errout:
     close(realfd);
     close(cryptofd);
 
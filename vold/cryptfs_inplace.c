@@ -0,0 +1,391 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* In place encryption copies the plaintext partition through its dm-crypt
+ * mapping. Two things make that slow: copying blocks the filesystem does
+ * not use, and doing it 4K at a time with the read and the write in
+ * lockstep. Here the caller's thread reads runs of allocated blocks into a
+ * small ring of large buffers while a second thread writes them out.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ext4.h>
+#define LOG_TAG "Cryptfs"
+#include "cutils/log.h"
+#include "cryptfs_inplace.h"
+
+#ifndef EXT4_SUPER_MAGIC
+#define EXT4_SUPER_MAGIC 0xEF53
+#endif
+
+#define INPLACE_BUF_SIZE (1024 * 1024)
+#define INPLACE_NUM_BUFS 4
+/* Free space shorter than this between two allocated runs is copied anyway,
+ * so that fragmented areas still turn into large I/Os. */
+#define INPLACE_MAX_GAP (64 * 1024)
+
+struct inplace_buf {
+    char *data;
+    off64_t offset;
+    size_t len;
+};
+
+struct inplace_ctx {
+    int realfd;
+    int cryptofd;
+
+    /* Filled buffers are bufs[head] .. bufs[head + count - 1] (mod
+     * INPLACE_NUM_BUFS); the reader fills the one after them. */
+    struct inplace_buf bufs[INPLACE_NUM_BUFS];
+    int head;
+    int count;
+    int done;
+    int error;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    /* The run of blocks the reader is collecting for its next buffer. */
+    off64_t run_start;
+    off64_t run_len;
+
+    off64_t bytes_copied;
+    inplace_progress_func progress;
+    void *cookie;
+};
+
+static int pread_full(int fd, void *buf, size_t len, off64_t off)
+{
+    char *p = buf;
+
+    while (len) {
+        ssize_t ret = pread64(fd, p, len, off);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return -1;
+        }
+        p += ret;
+        off += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+static int pwrite_full(int fd, const void *buf, size_t len, off64_t off)
+{
+    const char *p = buf;
+
+    while (len) {
+        ssize_t ret = pwrite64(fd, p, len, off);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return -1;
+        }
+        p += ret;
+        off += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+static void *writer_thread(void *arg)
+{
+    struct inplace_ctx *ctx = arg;
+
+    pthread_mutex_lock(&ctx->lock);
+    for (;;) {
+        struct inplace_buf *b;
+        int failed;
+
+        while (!ctx->count && !ctx->done && !ctx->error) {
+            pthread_cond_wait(&ctx->cond, &ctx->lock);
+        }
+        if (!ctx->count || ctx->error) {
+            break;
+        }
+        b = &ctx->bufs[ctx->head];
+        pthread_mutex_unlock(&ctx->lock);
+
+        failed = pwrite_full(ctx->cryptofd, b->data, b->len, b->offset);
+        if (failed) {
+            SLOGE("Error writing %zu bytes at %lld for inplace encrypt (%s)\n",
+                  b->len, b->offset, strerror(errno));
+        } else if (ctx->progress) {
+            ctx->progress(ctx->cookie, (b->offset + b->len) / 512);
+        }
+
+        pthread_mutex_lock(&ctx->lock);
+        if (failed) {
+            ctx->error = 1;
+        } else {
+            ctx->bytes_copied += b->len;
+        }
+        ctx->head = (ctx->head + 1) % INPLACE_NUM_BUFS;
+        ctx->count--;
+        pthread_cond_broadcast(&ctx->cond);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+/* Reads the current run into the next free buffer and hands it to the
+ * writer. */
+static int flush_run(struct inplace_ctx *ctx)
+{
+    struct inplace_buf *b;
+
+    if (!ctx->run_len) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    while (ctx->count == INPLACE_NUM_BUFS && !ctx->error) {
+        pthread_cond_wait(&ctx->cond, &ctx->lock);
+    }
+    if (ctx->error) {
+        pthread_mutex_unlock(&ctx->lock);
+        return -1;
+    }
+    b = &ctx->bufs[(ctx->head + ctx->count) % INPLACE_NUM_BUFS];
+    pthread_mutex_unlock(&ctx->lock);
+
+    b->offset = ctx->run_start;
+    b->len = ctx->run_len;
+    ctx->run_len = 0;
+    if (pread_full(ctx->realfd, b->data, b->len, b->offset)) {
+        SLOGE("Error reading %zu bytes at %lld for inplace encrypt (%s)\n",
+              b->len, b->offset, strerror(errno));
+        pthread_mutex_lock(&ctx->lock);
+        ctx->error = 1;
+        pthread_cond_broadcast(&ctx->cond);
+        pthread_mutex_unlock(&ctx->lock);
+        return -1;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->count++;
+    pthread_cond_broadcast(&ctx->cond);
+    pthread_mutex_unlock(&ctx->lock);
+    return 0;
+}
+
+/* Adds len bytes at off to the data to be copied. Ranges must be added in
+ * increasing order. */
+static int add_range(struct inplace_ctx *ctx, off64_t off, off64_t len)
+{
+    while (len > 0) {
+        off64_t end = ctx->run_start + ctx->run_len;
+        off64_t room;
+
+        if (!ctx->run_len || off < end || off - end > INPLACE_MAX_GAP ||
+                off - ctx->run_start >= INPLACE_BUF_SIZE) {
+            if (flush_run(ctx)) {
+                return -1;
+            }
+            ctx->run_start = off;
+        }
+        room = ctx->run_start + INPLACE_BUF_SIZE - off;
+        if (room > len) {
+            room = len;
+        }
+        ctx->run_len = off + room - ctx->run_start;
+        off += room;
+        len -= room;
+    }
+    return 0;
+}
+
+/* Adds the allocated blocks of an ext4 filesystem on realfd.
+ * Returns 1 if there is no filesystem we understand, in which case nothing
+ * has been added, 0 on success and -1 on error.
+ */
+static int add_ext4_ranges(struct inplace_ctx *ctx, off64_t part_bytes)
+{
+    struct ext4_super_block sb;
+    struct ext4_group_desc *gd;
+    unsigned char *bitmap = NULL, *gdt = NULL;
+    off64_t blocks_count, block_size;
+    unsigned int first_block, bpg, desc_size, groups, g;
+    int uninit_valid, rc = -1;
+
+    if (pread_full(ctx->realfd, &sb, sizeof(sb), 1024)) {
+        return 1;
+    }
+    if (sb.s_magic != EXT4_SUPER_MAGIC || sb.s_log_block_size > 6 ||
+            (sb.s_feature_incompat & EXT4_FEATURE_INCOMPAT_META_BG)) {
+        return 1;
+    }
+    block_size = 1024 << sb.s_log_block_size;
+    blocks_count = sb.s_blocks_count_lo;
+    desc_size = EXT4_MIN_DESC_SIZE;
+    if (sb.s_feature_incompat & EXT4_FEATURE_INCOMPAT_64BIT) {
+        blocks_count |= (off64_t) sb.s_blocks_count_hi << 32;
+        desc_size = sb.s_desc_size;
+    }
+    first_block = sb.s_first_data_block;
+    bpg = sb.s_blocks_per_group;
+    if (!bpg || bpg > block_size * 8 || desc_size < EXT4_MIN_DESC_SIZE ||
+            blocks_count <= first_block || blocks_count * block_size > part_bytes) {
+        SLOGW("Unexpected ext4 geometry, encrypting the whole partition\n");
+        return 1;
+    }
+    groups = (blocks_count - first_block + bpg - 1) / bpg;
+    /* The kernel only trusts BLOCK_UNINIT when group checksums are on */
+    uninit_valid = sb.s_feature_ro_compat & EXT4_FEATURE_RO_COMPAT_GDT_CSUM;
+
+    gdt = malloc((size_t) groups * desc_size);
+    bitmap = malloc(block_size);
+    if (!gdt || !bitmap) {
+        SLOGE("Cannot allocate ext4 bitmaps for inplace encrypt\n");
+        goto out;
+    }
+    if (pread_full(ctx->realfd, gdt, (size_t) groups * desc_size,
+                   (first_block + 1) * block_size)) {
+        SLOGE("Cannot read ext4 group descriptors (%s)\n", strerror(errno));
+        goto out;
+    }
+
+    SLOGI("Encrypting %u ext4 block groups of %u %lld byte blocks\n",
+          groups, bpg, block_size);
+
+    /* With 1K blocks, block 0 holds the boot sector and is in no group */
+    if (first_block && add_range(ctx, 0, first_block * block_size)) {
+        goto out;
+    }
+
+    for (g = 0; g < groups; g++) {
+        off64_t start = first_block + (off64_t) g * bpg;
+        off64_t bitmap_block;
+        unsigned int nblocks = bpg, i;
+
+        if (start + nblocks > blocks_count) {
+            nblocks = blocks_count - start;
+        }
+        gd = (struct ext4_group_desc *) (gdt + (size_t) g * desc_size);
+
+        /* The bitmap of an uninitialized group is not on disk. The group
+         * can still hold metadata, so copy it whole. */
+        if (uninit_valid && (gd->bg_flags & EXT4_BG_BLOCK_UNINIT)) {
+            if (add_range(ctx, start * block_size, nblocks * block_size)) {
+                goto out;
+            }
+            continue;
+        }
+
+        bitmap_block = gd->bg_block_bitmap_lo;
+        if (desc_size >= EXT4_MIN_DESC_SIZE_64BIT) {
+            bitmap_block |= (off64_t) gd->bg_block_bitmap_hi << 32;
+        }
+        if (bitmap_block >= blocks_count ||
+                pread_full(ctx->realfd, bitmap, block_size, bitmap_block * block_size)) {
+            SLOGE("Cannot read block bitmap of group %u\n", g);
+            goto out;
+        }
+
+        for (i = 0; i < nblocks; ) {
+            unsigned char bits = bitmap[i / 8];
+
+            if (!(i % 8) && i + 8 <= nblocks && (bits == 0 || bits == 0xff)) {
+                if (bits && add_range(ctx, (start + i) * block_size, 8 * block_size)) {
+                    goto out;
+                }
+                i += 8;
+                continue;
+            }
+            if ((bits & (1 << (i % 8))) &&
+                    add_range(ctx, (start + i) * block_size, block_size)) {
+                goto out;
+            }
+            i++;
+        }
+    }
+    rc = 0;
+
+out:
+    free(bitmap);
+    free(gdt);
+    return rc;
+}
+
+int cryptfs_inplace_copy(int realfd, int cryptofd, off64_t size,
+                         inplace_progress_func progress, void *cookie,
+                         off64_t *bytes_copied)
+{
+    struct inplace_ctx ctx;
+    pthread_t writer;
+    char *mem;
+    int i, rc;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.realfd = realfd;
+    ctx.cryptofd = cryptofd;
+    ctx.progress = progress;
+    ctx.cookie = cookie;
+    pthread_mutex_init(&ctx.lock, NULL);
+    pthread_cond_init(&ctx.cond, NULL);
+
+    /* Page aligned, so the block layer can use the buffers directly */
+    mem = mmap(NULL, INPLACE_BUF_SIZE * INPLACE_NUM_BUFS, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        SLOGE("Cannot allocate inplace encryption buffers (%s)\n", strerror(errno));
+        return -1;
+    }
+    for (i = 0; i < INPLACE_NUM_BUFS; i++) {
+        ctx.bufs[i].data = mem + i * INPLACE_BUF_SIZE;
+    }
+
+    if ((rc = pthread_create(&writer, NULL, writer_thread, &ctx))) {
+        SLOGE("Cannot start inplace encryption writer (%s)\n", strerror(rc));
+        munmap(mem, INPLACE_BUF_SIZE * INPLACE_NUM_BUFS);
+        return -1;
+    }
+
+    rc = add_ext4_ranges(&ctx, size * 512);
+    if (rc > 0) {
+        rc = add_range(&ctx, 0, size * 512);
+    }
+    if (!rc) {
+        rc = flush_run(&ctx);
+    }
+
+    pthread_mutex_lock(&ctx.lock);
+    ctx.done = 1;
+    pthread_cond_broadcast(&ctx.cond);
+    pthread_mutex_unlock(&ctx.lock);
+    pthread_join(writer, NULL);
+
+    if (ctx.error) {
+        rc = -1;
+    }
+    if (!rc && bytes_copied) {
+        *bytes_copied = ctx.bytes_copied;
+    }
+
+    munmap(mem, INPLACE_BUF_SIZE * INPLACE_NUM_BUFS);
+    pthread_cond_destroy(&ctx.cond);
+    pthread_mutex_destroy(&ctx.lock);
+    return rc;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CRYPTFS_INPLACE_H
+#define _CRYPTFS_INPLACE_H
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Called from the writer thread as the copy moves through the partition.
+ * sectors_done is the position reached, in 512 byte sectors, including
+ * any unused space that was skipped on the way.
+ */
+typedef void (*inplace_progress_func)(void *cookie, off64_t sectors_done);
+
+/* Copies the first size sectors of realfd to the same offsets in cryptofd.
+ * If realfd holds an ext4 filesystem, only the blocks that the filesystem
+ * has allocated (according to its block bitmaps) are copied; anything else
+ * is copied in full. Reads and writes are overlapped using large buffers.
+ * On success returns 0 and, if bytes_copied is not NULL, stores the number
+ * of bytes that were actually copied. Returns -1 on error.
+ */
+int cryptfs_inplace_copy(int realfd, int cryptofd, off64_t size,
+                         inplace_progress_func progress, void *cookie,
+                         off64_t *bytes_copied);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -27,6 +27,7 @@
 #define LOG_TAG "Vold"
 
 #include "cutils/log.h"
+#include "corkscrew/profiler.h"
 
 #include "VolumeManager.h"
 #include "CommandListener.h"
@@ -47,6 +48,8 @@ int main() {
 
     SLOGI("Vold 2.1 (the revenge) firing up");
 
+    profiler_install();
+
     mkdir("/dev/block/vold", 0755);
 	udisk_sem=sem_open("vold_sem",1);
     /* Create our singleton managers */
@@ -3,12 +3,14 @@ LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 
 test_src_files := \
-	VolumeManager_test.cpp
+	VolumeManager_test.cpp \
+	CryptfsInplace_test.cpp
 
 shared_libraries := \
 	liblog \
 	libstlport \
-	libcrypto
+	libcrypto \
+	libext4_utils
 
 static_libraries := \
 	libvold \
@@ -17,6 +19,7 @@ static_libraries := \
 
 c_includes := \
 	external/openssl/include \
+	system/extras/ext4_utils \
 	bionic \
 	bionic/libstdc++/include \
 	external/gtest/include \
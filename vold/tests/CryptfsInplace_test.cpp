@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs the in place encryption copy against file backed images. The "crypto
+ * device" is a second file standing in for the dm-crypt target: it starts
+ * out filled with a marker byte, so afterwards it shows exactly which parts
+ * of the image were copied. Throughput is printed in MB/s.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_TAG "CryptfsInplace_test"
+#include <utils/Log.h>
+#include <make_ext4fs.h>
+#include "../cryptfs_inplace.h"
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+static const char* TEST_DIR = "/data/local/tmp/cryptfs_inplace_test";
+static const off64_t IMAGE_SIZE = 64 * 1024 * 1024;
+static const int BLOCK_SIZE = 4096;
+static const unsigned char MARKER = 0xa5;
+static const char BLOCK_TAG[] = "cryptfs_inplace_test block";
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool fillFile(const char* path, off64_t size, unsigned char byte) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    char buf[BLOCK_SIZE];
+    memset(buf, byte, sizeof(buf));
+    bool ok = true;
+    for (off64_t off = 0; ok && off < size; off += sizeof(buf)) {
+        ok = write(fd, buf, sizeof(buf)) == (ssize_t) sizeof(buf);
+    }
+    close(fd);
+    return ok;
+}
+
+class CryptfsInplaceTest : public testing::Test {
+protected:
+    char mImage[PATH_MAX];
+    char mCrypto[PATH_MAX];
+    char mSource[PATH_MAX];
+
+    virtual void SetUp() {
+        mkdir(TEST_DIR, 0700);
+        snprintf(mImage, sizeof(mImage), "%s/image", TEST_DIR);
+        snprintf(mCrypto, sizeof(mCrypto), "%s/crypto", TEST_DIR);
+        snprintf(mSource, sizeof(mSource), "%s/source", TEST_DIR);
+        ASSERT_TRUE(fillFile(mCrypto, IMAGE_SIZE, MARKER));
+    }
+
+    virtual void TearDown() {
+        char path[PATH_MAX];
+        for (int i = 0; i < 4; i++) {
+            snprintf(path, sizeof(path), "%s/file%d", mSource, i);
+            unlink(path);
+        }
+        rmdir(mSource);
+        unlink(mImage);
+        unlink(mCrypto);
+        rmdir(TEST_DIR);
+    }
+
+    // Builds an ext4 image holding a few files whose blocks all start with
+    // BLOCK_TAG, so their data can be found in the image afterwards.
+    bool makeExt4Image() {
+        char path[PATH_MAX];
+        char block[BLOCK_SIZE];
+
+        if (mkdir(mSource, 0700) && errno != EEXIST) {
+            return false;
+        }
+        for (int i = 0; i < 4; i++) {
+            snprintf(path, sizeof(path), "%s/file%d", mSource, i);
+            int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+            if (fd < 0) {
+                return false;
+            }
+            for (int b = 0; b < (i + 1) * 256; b++) {
+                memset(block, i + b, sizeof(block));
+                memcpy(block, BLOCK_TAG, sizeof(BLOCK_TAG));
+                if (write(fd, block, sizeof(block)) != (ssize_t) sizeof(block)) {
+                    close(fd);
+                    return false;
+                }
+            }
+            close(fd);
+        }
+
+        int fd = open(mImage, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0) {
+            return false;
+        }
+        reset_ext4fs_info();
+        info.len = IMAGE_SIZE;
+        info.block_size = BLOCK_SIZE;
+        char mountpoint[] = "data";
+        int rc = make_ext4fs_internal(fd, mSource, mountpoint, NULL, 0, 0, 0, 0, 1, NULL);
+        close(fd);
+        return rc == 0 && truncate(mImage, IMAGE_SIZE) == 0;
+    }
+
+    int encrypt(off64_t* copied) {
+        int realfd = open(mImage, O_RDONLY);
+        int cryptofd = open(mCrypto, O_WRONLY);
+        int rc = -1;
+
+        if (realfd >= 0 && cryptofd >= 0) {
+            double t0 = now();
+            rc = cryptfs_inplace_copy(realfd, cryptofd, IMAGE_SIZE / 512, NULL, NULL, copied);
+            fsync(cryptofd);
+            double elapsed = now() - t0;
+            printf("copied %lld of %lld bytes in %.3f s: %.1f MB/s effective, %.1f MB/s copied\n",
+                   *copied, IMAGE_SIZE, elapsed, IMAGE_SIZE / elapsed / (1024 * 1024),
+                   *copied / elapsed / (1024 * 1024));
+        }
+        if (realfd >= 0) {
+            close(realfd);
+        }
+        if (cryptofd >= 0) {
+            close(cryptofd);
+        }
+        return rc;
+    }
+};
+
+TEST_F(CryptfsInplaceTest, CopiesWholeImageWithoutFilesystem) {
+    ASSERT_TRUE(fillFile(mImage, IMAGE_SIZE, 0x3c));
+
+    off64_t copied = 0;
+    ASSERT_EQ(0, encrypt(&copied));
+    EXPECT_EQ(IMAGE_SIZE, copied)
+            << "Without a filesystem every block should be copied";
+
+    char a[BLOCK_SIZE], b[BLOCK_SIZE];
+    int fd1 = open(mImage, O_RDONLY);
+    int fd2 = open(mCrypto, O_RDONLY);
+    for (off64_t off = 0; off < IMAGE_SIZE; off += BLOCK_SIZE) {
+        ASSERT_EQ((ssize_t) BLOCK_SIZE, pread64(fd1, a, BLOCK_SIZE, off));
+        ASSERT_EQ((ssize_t) BLOCK_SIZE, pread64(fd2, b, BLOCK_SIZE, off));
+        ASSERT_EQ(0, memcmp(a, b, BLOCK_SIZE)) << "Block at " << off << " differs";
+    }
+    close(fd1);
+    close(fd2);
+}
+
+TEST_F(CryptfsInplaceTest, CopiesOnlyAllocatedExt4Blocks) {
+    ASSERT_TRUE(makeExt4Image());
+
+    off64_t copied = 0;
+    ASSERT_EQ(0, encrypt(&copied));
+    EXPECT_LT(copied, IMAGE_SIZE)
+            << "Unused blocks of the filesystem should have been skipped";
+
+    char a[BLOCK_SIZE], b[BLOCK_SIZE], marker[BLOCK_SIZE];
+    memset(marker, MARKER, sizeof(marker));
+    int fd1 = open(mImage, O_RDONLY);
+    int fd2 = open(mCrypto, O_RDONLY);
+    int dataBlocks = 0;
+    off64_t same = 0;
+    for (off64_t off = 0; off < IMAGE_SIZE; off += BLOCK_SIZE) {
+        ASSERT_EQ((ssize_t) BLOCK_SIZE, pread64(fd1, a, BLOCK_SIZE, off));
+        ASSERT_EQ((ssize_t) BLOCK_SIZE, pread64(fd2, b, BLOCK_SIZE, off));
+        if (!memcmp(a, BLOCK_TAG, sizeof(BLOCK_TAG))) {
+            dataBlocks++;
+            ASSERT_EQ(0, memcmp(a, b, BLOCK_SIZE)) << "File data at " << off << " was not copied";
+        }
+        if (!memcmp(a, b, BLOCK_SIZE)) {
+            same += BLOCK_SIZE;
+        } else {
+            ASSERT_EQ(0, memcmp(b, marker, BLOCK_SIZE)) << "Block at " << off << " is corrupt";
+        }
+    }
+    close(fd1);
+    close(fd2);
+
+    EXPECT_EQ((1 + 2 + 3 + 4) * 256, dataBlocks);
+    EXPECT_LE(copied, same);
+
+    // The superblock must have been copied for the result to mount.
+    fd1 = open(mImage, O_RDONLY);
+    fd2 = open(mCrypto, O_RDONLY);
+    ASSERT_EQ((ssize_t) 1024, pread64(fd1, a, 1024, 1024));
+    ASSERT_EQ((ssize_t) 1024, pread64(fd2, b, 1024, 1024));
+    EXPECT_EQ(0, memcmp(a, b, 1024));
+    close(fd1);
+    close(fd2);
+}
+
+}